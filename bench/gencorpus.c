@@ -0,0 +1,150 @@
+/*
+ * gencorpus.c -- generates a synthetic crawl for the benchmarks
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: writes <pages> pages, ids 1 to <pages>, to a page
+ * directory as the crawler would, one file per page or packed segments
+ * with -p. Their words are drawn from a vocabulary of -v words (50000)
+ * with Zipf exponent -z (1.0), -w words (300) and -l links (10) per
+ * page. With -q <file> <queries> a workload of queries in the style of
+ * querier/good-queries.txt is written too: one to four words, drawn
+ * from the same vocabulary, some joined by "or" or "and". The same -s
+ * seed gives the same corpus and queries.
+ *
+ * usage: gencorpus <pageDirectory> <pages> [-p] [-w <words>] [-l <links>]
+ *                  [-v <vocabulary>] [-z <exponent>] [-s <seed>]
+ *                  [-q <queryFile> <queries>]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <webpage.h>
+#include <pageio.h>
+#include "synth.h"
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: gencorpus <pageDirectory> <pages> [-p] [-w <words>] [-l <links>] "
+                    "[-v <vocabulary>] [-z <exponent>] [-s <seed>] [-q <queryFile> <queries>]\n");
+    exit(EXIT_FAILURE);
+}
+
+/* writes nqueries queries of words drawn from the vocabulary to file */
+static int32_t write_queries(const vocab_t *vp, rng_t *rp, char *name, int nqueries)
+{
+    FILE *file = fopen(name, "w");
+    char word[WORD_MAX];
+
+    if (!file)
+    {
+        fprintf(stderr, "Failed to create %s\n", name);
+        return 1;
+    }
+    for (int q = 0; q < nqueries; q++)
+    {
+        int nwords = 1 + (int)rng_below(rp, 4);
+        for (int i = 0; i < nwords; i++)
+        {
+            uint64_t op = rng_below(rp, 10);
+            if (i > 0)
+                fputs(op < 2 ? " or " : (op < 3 ? " and " : " "), file);
+            vocab_word(vocab_draw(vp, rp), word);
+            fputs(word, file);
+        }
+        fputc('\n', file);
+    }
+    return fclose(file) != 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int npages, nwords = 300, nlinks = 10, vocab_size = 50000, nqueries = 0;
+    double exponent = 1.0;
+    unsigned long long seed = 1;
+    char *dirname, *queryfile = NULL;
+    bool packed = false;
+
+    if (argc < 3 || (npages = atoi(argv[2])) < 1)
+        usage();
+    dirname = argv[1];
+    for (int i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-p") == 0)
+            packed = true;
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+            nwords = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+            nlinks = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc)
+            vocab_size = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-z") == 0 && i + 1 < argc)
+            exponent = atof(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-q") == 0 && i + 2 < argc)
+        {
+            queryfile = argv[++i];
+            nqueries = atoi(argv[++i]);
+        }
+        else
+            usage();
+    }
+    if (nwords < 1 || nlinks < 0 || nlinks > nwords || nqueries < 0)
+        usage();
+
+    vocab_t vocab;
+    rng_t rng;
+    struct stat st;
+    if (vocab_open(&vocab, vocab_size, exponent) != 0)
+        usage();
+    rng_seed(&rng, seed);
+    if ((stat(dirname, &st) != 0 || !S_ISDIR(st.st_mode)) && mkdir(dirname, 0755) != 0)
+    {
+        fprintf(stderr, "Failed to create directory %s\n", dirname);
+        exit(EXIT_FAILURE);
+    }
+    segwriter_t *sw = packed ? segwriter_open(dirname, 0) : NULL;
+    if (packed && !sw)
+    {
+        fprintf(stderr, "Failed to open segments in %s\n", dirname);
+        exit(EXIT_FAILURE);
+    }
+
+    double start = seconds();
+    long bytes = 0;
+    for (int id = 1; id <= npages; id++)
+    {
+        char url[sizeof(INTERNAL_URL_PREFIX) + 32], *html;
+        webpage_t *page;
+
+        snprintf(url, sizeof(url), "%s/bench/p%d.html", INTERNAL_URL_PREFIX, id);
+        if (!(html = synth_page(&vocab, &rng, id, npages, nwords, nlinks)) ||
+            !(page = webpage_new(url, id == 1 ? 0 : 1, html)) ||
+            (sw ? segwriter_add(sw, page, id) : pagesave(page, id, dirname)) != 0)
+        {
+            fprintf(stderr, "Failed to write page %d\n", id);
+            exit(EXIT_FAILURE);
+        }
+        bytes += webpage_getHTMLlen(page);
+        webpage_delete(page);
+    }
+    if ((sw && segwriter_close(sw) != 0) || pageio_flush() != 0)
+    {
+        fprintf(stderr, "Failed to write the pages\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("%d pages, %.1f MB of html in %.2f s\n", npages, bytes / 1e6, seconds() - start);
+
+    if (queryfile)
+    {
+        if (write_queries(&vocab, &rng, queryfile, nqueries) != 0)
+            exit(EXIT_FAILURE);
+        printf("%d queries in %s\n", nqueries, queryfile);
+    }
+    vocab_close(&vocab);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,377 @@
+/*
+ * microbench.c -- microbenchmarks of the crawl, index and query hot paths
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: times the hash table (hput, hsearch), the queue (qput,
+ * qsearch), the scans of a page (webpage_getNextWord, webpage_extract),
+ * indexload of a text and a binary index, and the intersection and
+ * union of posting lists, on synthetic data drawn as by gencorpus.
+ * Each benchmark prints its operations and the time per operation.
+ *
+ * With -n <scale> the sizes are multiplied by scale, and with -b
+ * <name> only the benchmarks whose names start with name are run.
+ *
+ * usage: microbench [-n <scale>] [-b <name>]
+ */
+#define _POSIX_C_SOURCE 200809L // getpid
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <hash.h>
+#include <queue.h>
+#include <webpage.h>
+#include <indexio.h>
+#include <postings.h>
+#include "synth.h"
+
+#define VOCAB 50000    /* words of the synthetic vocabulary */
+#define ZIPF 1.0       /* and its exponent */
+
+static int scale = 1;
+static const char *only = NULL;
+static volatile long sink; /* keeps results from being optimized away */
+
+/* a word and its number of occurrences */
+typedef struct counted
+{
+    char word[WORD_MAX];
+    int count;
+} counted_t;
+
+static void fail(const char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+/* true if the benchmark name was asked for */
+static bool wanted(const char *name)
+{
+    return !only || strncmp(name, only, strlen(only)) == 0;
+}
+
+static void report(const char *name, long ops, double elapsed, const char *extra)
+{
+    printf("%-26s %10ld ops %12.1f ns/op %s\n", name, ops, elapsed * 1e9 / (ops ? ops : 1), extra ? extra : "");
+}
+
+static bool counted_searchfn(void *elementp, const void *searchkeyp)
+{
+    return strcmp(((counted_t *)elementp)->word, (const char *)searchkeyp) == 0;
+}
+
+static bool entry_searchfn(void *elementp, const void *searchkeyp)
+{
+    return strcmp(((entry_t *)elementp)->word, (const char *)searchkeyp) == 0;
+}
+
+static bool int_searchfn(void *elementp, const void *searchkeyp)
+{
+    return *(int *)elementp == *(const int *)searchkeyp;
+}
+
+static void bench_hash(void)
+{
+    int n = 200000 * scale;
+    counted_t *words = malloc(n * sizeof(counted_t));
+    hashtable_t *ht = hopen(1000);
+    double start;
+    long found = 0;
+    char missing[WORD_MAX + 1];
+
+    if (!words || !ht)
+        fail("Out of memory");
+    for (int i = 0; i < n; i++)
+    {
+        vocab_word(i, words[i].word);
+        words[i].count = i;
+    }
+    if (wanted("hput"))
+    {
+        start = seconds();
+        for (int i = 0; i < n; i++)
+        {
+            if (hput(ht, &words[i], words[i].word, strlen(words[i].word)) != 0)
+                fail("hput failed");
+        }
+        report("hput", n, seconds() - start, "(growing from 1000)");
+    }
+    else
+    {
+        for (int i = 0; i < n; i++)
+            hput(ht, &words[i], words[i].word, strlen(words[i].word));
+    }
+    if (wanted("hsearch"))
+    {
+        rng_t rng;
+        rng_seed(&rng, 7);
+        start = seconds();
+        for (int i = 0; i < n; i++)
+        {
+            const char *w = words[rng_below(&rng, n)].word;
+            found += hsearch(ht, counted_searchfn, w, strlen(w)) != NULL;
+        }
+        report("hsearch hit", n, seconds() - start, NULL);
+        start = seconds();
+        for (int i = 0; i < n; i++)
+        {
+            /* a word of the same shape that was never put */
+            snprintf(missing, sizeof(missing), "%sz", words[i].word);
+            found += hsearch(ht, counted_searchfn, missing, strlen(missing)) != NULL;
+        }
+        report("hsearch miss", n, seconds() - start, NULL);
+    }
+    sink = found;
+    /* the entries are not the table's to free */
+    for (int i = 0; i < n; i++)
+        hremove(ht, counted_searchfn, words[i].word, strlen(words[i].word));
+    hclose(ht);
+    free(words);
+}
+
+static void bench_queue(void)
+{
+    int n = 1000000 * scale, len = 1000, searches = 20000 * scale;
+    int *values = malloc(n * sizeof(int));
+    queue_t *qp = qopen();
+    double start;
+    long found = 0;
+
+    if (!values || !qp)
+        fail("Out of memory");
+    for (int i = 0; i < n; i++)
+        values[i] = i;
+    if (wanted("qput"))
+    {
+        start = seconds();
+        for (int i = 0; i < n; i++)
+            qput(qp, &values[i]);
+        report("qput", n, seconds() - start, NULL);
+        start = seconds();
+        while (qget(qp))
+            found++;
+        report("qget", n, seconds() - start, NULL);
+    }
+    if (wanted("qsearch"))
+    {
+        rng_t rng;
+        char extra[64];
+        rng_seed(&rng, 11);
+        for (int i = 0; i < len; i++)
+            qput(qp, &values[i]);
+        start = seconds();
+        for (int i = 0; i < searches; i++)
+        {
+            int key = (int)rng_below(&rng, len);
+            found += qsearch(qp, int_searchfn, &key) != NULL;
+        }
+        snprintf(extra, sizeof(extra), "(queue of %d)", len);
+        report("qsearch", searches, seconds() - start, extra);
+    }
+    sink = found;
+    /* nor are the queue's */
+    while (qget(qp))
+        ;
+    qclose(qp);
+    free(values);
+}
+
+static int count_word(void *arg, const char *word, int len)
+{
+    (*(long *)arg) += len;
+    return 0;
+}
+
+static void bench_scan(const vocab_t *vp)
+{
+    rng_t rng;
+    char url[] = "https://thayer.github.io/engs50/bench/p1.html", extra[64];
+    int rounds = 20 * scale, pos;
+    long words = 0, letters = 0;
+    double start;
+
+    rng_seed(&rng, 3);
+    char *html = synth_page(vp, &rng, 1, 1000, 20000, 200);
+    webpage_t *page = html ? webpage_new(url, 0, html) : NULL;
+    if (!page)
+        fail("Out of memory");
+    double mb = webpage_getHTMLlen(page) / 1e6;
+
+    if (wanted("webpage_getNextWord"))
+    {
+        char *word;
+        start = seconds();
+        for (int r = 0; r < rounds; r++)
+        {
+            for (pos = 0; (pos = webpage_getNextWord(page, pos, &word)) > 0; words++)
+                free(word);
+        }
+        double elapsed = seconds() - start;
+        snprintf(extra, sizeof(extra), "(%.0f MB/s)", mb * rounds / elapsed);
+        report("webpage_getNextWord", words, elapsed, extra);
+    }
+    if (wanted("webpage_extract"))
+    {
+        webpage_parts_t parts = {.word = count_word, .arg = &letters};
+        start = seconds();
+        for (int r = 0; r < rounds; r++)
+        {
+            if (webpage_extract(page, &parts) != 0)
+                fail("webpage_extract failed");
+        }
+        double elapsed = seconds() - start;
+        snprintf(extra, sizeof(extra), "(%.0f MB/s, per page)", mb * rounds / elapsed);
+        report("webpage_extract", rounds, elapsed, extra);
+    }
+    sink = letters;
+    webpage_delete(page);
+}
+
+static void bench_indexload(const vocab_t *vp)
+{
+    int npages = 2000 * scale, nwords = 300, rounds = 3;
+    char textnm[64], binnm[64], extra[64];
+    rng_t rng;
+    hashtable_t *index = hopen(1000);
+    double start;
+
+    if (!wanted("indexload"))
+        return;
+    /* an index of npages pages of words drawn from the vocabulary */
+    rng_seed(&rng, 5);
+    for (int id = 1; index && id <= npages; id++)
+    {
+        for (int i = 0; i < nwords; i++)
+        {
+            char word[WORD_MAX];
+            vocab_word(vocab_draw(vp, &rng), word);
+            entry_t *ep = hsearch(index, entry_searchfn, word, strlen(word));
+            if (!ep)
+            {
+                if (!(ep = new_entry(word)) || hput(index, ep, ep->word, strlen(ep->word)) != 0)
+                    fail("Failed to build an index");
+            }
+            document_t *dp = ep->documents.ndocs ? &ep->documents.docs[ep->documents.ndocs - 1] : NULL;
+            if (dp && dp->id == id)
+                dp->word_count++;
+            else if (postings_add(&ep->documents, id, 1) != 0)
+                fail("Failed to build an index");
+        }
+    }
+    if (!index)
+        fail("Out of memory");
+    snprintf(textnm, sizeof(textnm), "/tmp/microbench.%d.txt", (int)getpid());
+    snprintf(binnm, sizeof(binnm), "/tmp/microbench.%d.bin", (int)getpid());
+    if (indexsave(index, textnm) != 0 || indexsave_binary(index, binnm) != 0)
+        fail("Failed to save an index");
+    free_entries(index);
+    hclose(index);
+
+    const char *names[] = {"indexload text", "indexload binary"};
+    char *files[] = {textnm, binnm};
+    for (int f = 0; f < 2; f++)
+    {
+        start = seconds();
+        for (int r = 0; r < rounds; r++)
+        {
+            if (!(index = indexload(files[f])))
+                fail("indexload failed");
+            free_entries(index);
+            hclose(index);
+        }
+        snprintf(extra, sizeof(extra), "(index of %d pages)", npages);
+        report(names[f], rounds, seconds() - start, extra);
+    }
+    remove(textnm);
+    remove(binnm);
+}
+
+/* a posting list of about n of the ids below range */
+static postings_t *random_list(rng_t *rp, int n, int range)
+{
+    postings_t *pp = postings_new();
+    for (int id = 0; pp && id < range; id++)
+    {
+        if (rng_below(rp, range) < (uint64_t)n && postings_add(pp, id, 1 + (int)rng_below(rp, 5)) != 0)
+            fail("Out of memory");
+    }
+    return pp;
+}
+
+static void bench_postings(void)
+{
+    int range = 1000000 * scale, rounds = 20;
+    int sizes[][2] = {{100000, 100000}, {100000, 1000}, {10000, 10}};
+    rng_t rng;
+    char name[64];
+    long found = 0;
+
+    rng_seed(&rng, 13);
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+    {
+        postings_t *a = random_list(&rng, sizes[s][0] * scale, range);
+        postings_t *b = random_list(&rng, sizes[s][1] * scale, range);
+        double start;
+        if (!a || !b)
+            fail("Out of memory");
+        if (wanted("intersect"))
+        {
+            start = seconds();
+            for (int r = 0; r < rounds; r++)
+            {
+                postings_t *c = postings_intersect(a, b);
+                found += c ? c->ndocs : 0;
+                postings_free(c);
+            }
+            snprintf(name, sizeof(name), "intersect %dx%d", a->ndocs, b->ndocs);
+            report(name, rounds, seconds() - start, NULL);
+        }
+        if (wanted("union"))
+        {
+            start = seconds();
+            for (int r = 0; r < rounds; r++)
+            {
+                postings_t *c = postings_union(a, b);
+                found += c ? c->ndocs : 0;
+                postings_free(c);
+            }
+            snprintf(name, sizeof(name), "union %dx%d", a->ndocs, b->ndocs);
+            report(name, rounds, seconds() - start, NULL);
+        }
+        postings_free(a);
+        postings_free(b);
+    }
+    sink = found;
+}
+
+int main(int argc, char *argv[])
+{
+    vocab_t vocab;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            scale = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            only = argv[++i];
+        else
+        {
+            fprintf(stderr, "usage: microbench [-n <scale>] [-b <name>]\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (vocab_open(&vocab, VOCAB, ZIPF) != 0)
+        fail("Out of memory");
+    bench_hash();
+    bench_queue();
+    bench_scan(&vocab);
+    bench_indexload(&vocab);
+    bench_postings();
+    vocab_close(&vocab);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,292 @@
+/*
+ * querybench.c -- replays a query workload against the querier
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: starts the querier in server mode on a unix socket,
+ * with one thread for each of -c clients (1), and has the clients send
+ * the queries of <queryFile>, each -n times (5) in all, one at a time
+ * and waiting for the "." that ends each answer. Reports the queries
+ * per second and the percentiles of their latencies, then stops the
+ * server. Options after -- are passed to the querier, as "-r bm25".
+ *
+ * usage: querybench [-x <querier>] [-c <clients>] [-n <rounds>]
+ *                   <pageDirectory> <indexFile> <queryFile> [-- <options>]
+ */
+#define _POSIX_C_SOURCE 200809L // getline, kill
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "synth.h"
+
+#define MAX_QUERIER_ARGS 32
+#define CONNECT_TRIES 200 /* of 50 ms, while the querier loads its index */
+
+/* the queries and what the clients measured of them */
+typedef struct workload
+{
+    char **queries;
+    int nqueries;
+    int rounds;
+    int nclients;
+    const char *socket;
+    double *latencies; /* of each query sent, in seconds */
+} workload_t;
+
+/* a client and the share of the workload it sends */
+typedef struct client
+{
+    workload_t *wp;
+    int index;
+    int failed;
+} client_t;
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: querybench [-x <querier>] [-c <clients>] [-n <rounds>] "
+                    "<pageDirectory> <indexFile> <queryFile> [-- <options>]\n");
+    exit(EXIT_FAILURE);
+}
+
+/* reads the nonblank lines of a file */
+static int32_t read_queries(const char *name, workload_t *wp)
+{
+    FILE *file = fopen(name, "r");
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    int cap = 0;
+
+    if (!file)
+    {
+        fprintf(stderr, "Failed to open %s\n", name);
+        return 1;
+    }
+    while ((len = getline(&line, &size, file)) >= 0)
+    {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if (len == 0)
+            continue;
+        if (wp->nqueries == cap)
+        {
+            cap = cap ? cap * 2 : 64;
+            char **grown = realloc(wp->queries, cap * sizeof(char *));
+            if (!grown)
+                break;
+            wp->queries = grown;
+        }
+        if (!(wp->queries[wp->nqueries] = strdup(line)))
+            break;
+        wp->nqueries++;
+    }
+    free(line);
+    fclose(file);
+    if (len >= 0 || wp->nqueries == 0)
+    {
+        fprintf(stderr, "Failed to read queries from %s\n", name);
+        return 1;
+    }
+    return 0;
+}
+
+/* connects to the server, waiting for it to listen */
+static int connect_server(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    for (int tries = 0; tries < CONNECT_TRIES; tries++)
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+            return fd;
+        close(fd);
+        nanosleep(&(struct timespec){0, 50000000}, NULL);
+    }
+    return -1;
+}
+
+/* sends every nclients'th query, reading each answer to its end */
+static void *run_client(void *arg)
+{
+    client_t *cp = (client_t *)arg;
+    workload_t *wp = cp->wp;
+    int fd = connect_server(wp->socket), out_fd = fd < 0 ? -1 : dup(fd);
+    FILE *in = fd < 0 ? NULL : fdopen(fd, "r"), *out = out_fd < 0 ? NULL : fdopen(out_fd, "w");
+    char *line = NULL;
+    size_t size = 0;
+    long total = (long)wp->nqueries * wp->rounds;
+
+    if (!in || !out)
+    {
+        cp->failed = 1;
+        if (in)
+            fclose(in);
+        else if (fd >= 0)
+            close(fd);
+        if (out)
+            fclose(out);
+        else if (out_fd >= 0)
+            close(out_fd);
+        return NULL;
+    }
+    for (long q = cp->index; q < total && !cp->failed; q += wp->nclients)
+    {
+        double start = seconds();
+        ssize_t len;
+        if (fprintf(out, "%s\n", wp->queries[q % wp->nqueries]) < 0 || fflush(out) != 0)
+        {
+            cp->failed = 1;
+            break;
+        }
+        while ((len = getline(&line, &size, in)) > 0 && strcmp(line, ".\n") != 0)
+            ;
+        if (len <= 0)
+            cp->failed = 1;
+        wp->latencies[q] = seconds() - start;
+    }
+    free(line);
+    fclose(out);
+    fclose(in);
+    return NULL;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[])
+{
+    char *querier = "../querier/query", socket_path[64], threads[16];
+    char *qargv[MAX_QUERIER_ARGS];
+    int qargc = 0, i;
+    workload_t work = {.rounds = 5, .nclients = 1};
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "-x") == 0 && i + 1 < argc)
+            querier = argv[++i];
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            work.nclients = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            work.rounds = atoi(argv[++i]);
+        else
+            usage();
+    }
+    if (argc - i < 3 || (argc - i > 3 && strcmp(argv[i + 3], "--") != 0))
+        usage();
+    if (read_queries(argv[i + 2], &work) != 0)
+        exit(EXIT_FAILURE);
+
+    /* query <pageDirectory> <indexFile> -s <socket> -t <clients> [options] */
+    snprintf(socket_path, sizeof(socket_path), "/tmp/querybench.%d.sock", (int)getpid());
+    snprintf(threads, sizeof(threads), "%d", work.nclients);
+    work.socket = socket_path;
+    qargv[qargc++] = querier;
+    qargv[qargc++] = argv[i];
+    qargv[qargc++] = argv[i + 1];
+    qargv[qargc++] = "-s";
+    qargv[qargc++] = socket_path;
+    qargv[qargc++] = "-t";
+    qargv[qargc++] = threads;
+    for (int j = i + 4; j < argc; j++)
+    {
+        if (qargc == MAX_QUERIER_ARGS - 1)
+            usage();
+        qargv[qargc++] = argv[j];
+    }
+    qargv[qargc] = NULL;
+
+    long total = (long)work.nqueries * work.rounds;
+    client_t *clients = calloc(work.nclients, sizeof(client_t));
+    pthread_t *tids = calloc(work.nclients, sizeof(pthread_t));
+    if (!(work.latencies = calloc(total, sizeof(double))) || !clients || !tids)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    unlink(socket_path);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0)
+    {
+        /* the querier's answers go to the socket; its prompts are not wanted */
+        if (!freopen("/dev/null", "w", stdout))
+            _exit(EXIT_FAILURE);
+        execv(querier, qargv);
+        perror(querier);
+        _exit(EXIT_FAILURE);
+    }
+
+    /* the connection of the first client waits for the index to load */
+    int fd = connect_server(socket_path);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Failed to connect to %s\n", querier);
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+
+    double start = seconds();
+    for (int c = 0; c < work.nclients; c++)
+    {
+        clients[c] = (client_t){.wp = &work, .index = c};
+        if (pthread_create(&tids[c], NULL, run_client, &clients[c]) != 0)
+        {
+            fprintf(stderr, "Failed to start client %d\n", c);
+            exit(EXIT_FAILURE);
+        }
+    }
+    int failed = 0;
+    for (int c = 0; c < work.nclients; c++)
+    {
+        pthread_join(tids[c], NULL);
+        failed |= clients[c].failed;
+    }
+    double elapsed = seconds() - start;
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    unlink(socket_path);
+    if (failed)
+    {
+        fprintf(stderr, "A client lost its connection to the querier\n");
+        exit(EXIT_FAILURE);
+    }
+
+    qsort(work.latencies, total, sizeof(double), compare_doubles);
+    printf("%ld queries from %d clients in %.2f s: %.0f queries/s\n",
+           total, work.nclients, elapsed, total / elapsed);
+    printf("latency ms: p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+           work.latencies[total / 2] * 1e3, work.latencies[total * 9 / 10] * 1e3,
+           work.latencies[total * 99 / 100] * 1e3, work.latencies[total - 1] * 1e3);
+
+    for (int q = 0; q < work.nqueries; q++)
+        free(work.queries[q]);
+    free(work.queries);
+    free(work.latencies);
+    free(clients);
+    free(tids);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,168 @@
+/*
+ * synth.c -- synthetic words and pages for the benchmarks
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: the generator is xorshift64*, and words are drawn by
+ * binary search of the cumulative frequencies of the vocabulary.
+ */
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "synth.h"
+
+void rng_seed(rng_t *rp, uint64_t seed)
+{
+    rp->s = seed ? seed : 0x9e3779b97f4a7c15ULL;
+}
+
+uint64_t rng_next(rng_t *rp)
+{
+    rp->s ^= rp->s >> 12;
+    rp->s ^= rp->s << 25;
+    rp->s ^= rp->s >> 27;
+    return rp->s * 0x2545f4914f6cdd1dULL;
+}
+
+uint64_t rng_below(rng_t *rp, uint64_t n)
+{
+    return n ? rng_next(rp) % n : 0;
+}
+
+int32_t vocab_open(vocab_t *vp, int nwords, double s)
+{
+    double total = 0;
+
+    if (!vp || nwords < 1 || s < 0 || !(vp->cdf = malloc(nwords * sizeof(double))))
+        return 1;
+    for (int r = 0; r < nwords; r++)
+    {
+        total += 1.0 / pow(r + 1, s);
+        vp->cdf[r] = total;
+    }
+    for (int r = 0; r < nwords; r++)
+        vp->cdf[r] /= total;
+    vp->nwords = nwords;
+    return 0;
+}
+
+void vocab_close(vocab_t *vp)
+{
+    if (!vp)
+        return;
+    free(vp->cdf);
+    vp->cdf = NULL;
+    vp->nwords = 0;
+}
+
+int vocab_draw(const vocab_t *vp, rng_t *rp)
+{
+    double u = (rng_next(rp) >> 11) * (1.0 / 9007199254740992.0);
+    int lo = 0, hi = vp->nwords - 1;
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (vp->cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+void vocab_word(int r, char *buf)
+{
+    char digits[WORD_MAX];
+    int n = 0;
+
+    /* rank r in base 26, offset so that every word has three letters */
+    for (unsigned v = (unsigned)r + 26 * 26; v > 0 && n < WORD_MAX - 1; v /= 26)
+        digits[n++] = 'a' + v % 26;
+    for (int i = 0; i < n; i++)
+        buf[i] = digits[n - 1 - i];
+    buf[n] = '\0';
+}
+
+/* appends the NUL-terminated s to the html, growing it as needed */
+static int append(char **html, size_t *len, size_t *size, const char *s)
+{
+    size_t n = strlen(s);
+
+    if (*len + n + 1 > *size)
+    {
+        size_t want = *size ? *size : 4096;
+        while (want < *len + n + 1)
+            want *= 2;
+        char *grown = realloc(*html, want);
+        if (!grown)
+            return 1;
+        *html = grown;
+        *size = want;
+    }
+    memcpy(*html + *len, s, n + 1);
+    *len += n;
+    return 0;
+}
+
+/* appends n words drawn from the vocabulary, separated by spaces */
+static int append_words(char **html, size_t *len, size_t *size, const vocab_t *vp, rng_t *rp, int n)
+{
+    char word[WORD_MAX + 1];
+
+    for (int i = 0; i < n; i++)
+    {
+        vocab_word(vocab_draw(vp, rp), word);
+        strcat(word, i + 1 < n ? " " : "");
+        if (append(html, len, size, word) != 0)
+            return 1;
+    }
+    return 0;
+}
+
+char *synth_page(const vocab_t *vp, rng_t *rp, int id, int npages, int nwords, int nlinks)
+{
+    char *html = NULL, buf[128];
+    size_t len = 0, size = 0;
+    int status = 0;
+
+    status |= append(&html, &len, &size, "<!DOCTYPE html>\n<html>\n<head>\n<title>");
+    status |= append_words(&html, &len, &size, vp, rp, 3);
+    status |= append(&html, &len, &size, "</title>\n<meta name=\"description\" content=\"");
+    status |= append_words(&html, &len, &size, vp, rp, 12);
+    snprintf(buf, sizeof(buf), "\">\n</head>\n<body>\n<h1>Page %d</h1>\n<p>\n", id);
+    status |= append(&html, &len, &size, buf);
+    for (int i = 0; i < nwords && status == 0; i++)
+    {
+        /* links are spread among the words, a paragraph every 50 words */
+        if (nlinks > 0 && rng_below(rp, nwords) < (uint64_t)nlinks)
+        {
+            snprintf(buf, sizeof(buf), "<a href=\"p%d.html\">", 1 + (int)rng_below(rp, npages));
+            status |= append(&html, &len, &size, buf);
+            status |= append_words(&html, &len, &size, vp, rp, 1);
+            status |= append(&html, &len, &size, "</a>\n");
+            continue;
+        }
+        status |= append_words(&html, &len, &size, vp, rp, 1);
+        status |= append(&html, &len, &size, i % 50 == 49 ? "\n</p>\n<p>\n" : (i % 12 == 11 ? "\n" : " "));
+    }
+    status |= append(&html, &len, &size, "\n</p>\n</body>\n</html>\n");
+    if (status != 0)
+    {
+        free(html);
+        return NULL;
+    }
+    return html;
+}
+
+double seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
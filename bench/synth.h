@@ -0,0 +1,71 @@
+#pragma once
+/*
+ * synth.h -- synthetic words and pages for the benchmarks
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: a seeded random generator, so that a run can be
+ * repeated, and a vocabulary whose words are drawn with Zipfian
+ * frequencies, the rank r word about 1 / r^s as often as the first, as
+ * in natural text. Pages are built from such words, with a title, a
+ * description and links to other pages.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#define WORD_MAX 16 /* longest word of a vocabulary, with its NUL */
+
+/* random generator state; any nonzero seed */
+typedef struct rng
+{
+    uint64_t s;
+} rng_t;
+
+/* vocabulary of ranked words and their cumulative frequencies */
+typedef struct vocab
+{
+    int nwords;
+    double *cdf;
+} vocab_t;
+
+/* rng_seed -- starts a generator from seed */
+void rng_seed(rng_t *rp, uint64_t seed);
+
+/* rng_next -- the next 64 random bits */
+uint64_t rng_next(rng_t *rp);
+
+/* rng_below -- a random number from 0 to n - 1 */
+uint64_t rng_below(rng_t *rp, uint64_t n);
+
+/*
+ * vocab_open -- makes a vocabulary of nwords words with Zipf exponent s
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t vocab_open(vocab_t *vp, int nwords, double s);
+
+/* vocab_close -- frees the frequencies of a vocabulary */
+void vocab_close(vocab_t *vp);
+
+/* vocab_draw -- the rank, from 0, of a word drawn at random */
+int vocab_draw(const vocab_t *vp, rng_t *rp);
+
+/*
+ * vocab_word -- writes the word of rank r to buf, of WORD_MAX bytes;
+ * every rank has its own word of lowercase letters, at least three
+ */
+void vocab_word(int r, char *buf);
+
+/*
+ * synth_page -- builds the html of page id of a site of npages pages:
+ * a title, a description and nwords words, nlinks of them links to
+ * random pages of the site
+ *
+ * returns: the malloc'd, NUL-terminated html; NULL if out of memory
+ */
+char *synth_page(const vocab_t *vp, rng_t *rp, int id, int npages, int nwords, int nlinks);
+
+/* seconds -- the time on the monotonic clock, in seconds */
+double seconds(void);
@@ -7,33 +7,128 @@
  * 
  * Description: crawls a website extracting embedded urls
  * 
+ * With -s <pages> the saved pages are synced to disk in batches of that
+ * many pages, so a crash loses at most one batch. With -p they are
+ * appended to packed segment files instead of one file per page.
+ *
+ * Every -c <pages> saved pages (1000 by default, 0 for never) the state
+ * of the crawl is checkpointed to <pagedir>/.checkpoint: the next page
+ * id, the pages claimed but not yet saved, and the seen set of url
+ * fingerprints. A checkpoint waits for the pages being saved and parsed
+ * to finish, so every page is either saved or in the checkpoint. With
+ * --resume a crawl that was killed goes on from its last checkpoint,
+ * refetching the pages that were claimed; pages saved after it are
+ * saved again. The checkpoint is removed once the crawl completes.
+ *
+ * Fetches from one host are -d <ms> apart (one second by default), and
+ * with -r a host's robots.txt may ask for longer; the pages of other
+ * hosts are fetched in the meantime.
+ *
+ * With -v every url found is printed. With -M <file> the counters and
+ * latencies of metrics.h are dumped to the file as JSON when the crawl
+ * ends, and whenever the crawler gets SIGUSR1: the fetches, the pages
+ * saved and the urls found and claimed, and the time taken to save and
+ * to parse each page.
+ * 
  */
+#define _POSIX_C_SOURCE 200809L // rwlocks, fsync, getline, SIGUSR1
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <stdatomic.h>
 #include <sys/stat.h>
 #include <webpage.h>
-#include <lqueue.h>
-#include <lhash.h>
+#include <urlset.h>
 #include <pageio.h>
+#include <fetch.h>
+#include <queue.h>
+#include <cqueue.h>
+#include <hash.h>
+#include <metrics.h>
+#include <signal.h>
 #include <pthread.h>
 
 #define hsize 1000    // hashtable size
+#define max_transfers 64    // fetches in flight at once, across every host
+#define ready_size 1024    // fetched pages waiting to be parsed
+#define checkpoint_pages 1000    // pages saved between checkpoints by default
+#define checkpoint_name ".checkpoint"    // hidden, so it is not taken for a page
 
 static void crawl(int thread_id);
-static bool searchfn(void* elementp, const void* searchkeyp);
 static void* thread_start(void *arg);
+static void* fetch_start(void *arg);
+static void fetched(webpage_t *page, bool ok, void *arg);
+static void page_added(webpage_t *page);
+static void page_done(webpage_t *page);
+static int32_t checkpoint(void);
+static int resume(queue_t *restored);
 
-lqueue_t *qp;
-lhash_t *hp;
+urlset_t *seen;	// urls claimed so far
+fetcher_t *fp;
 char *seed_url, *dirname;
-int max_depth, pages_added=1, pages_retrieved=0, id=1;
-pthread_mutex_t crawl_mutex = PTHREAD_MUTEX_INITIALIZER;
+int max_depth;
+atomic_int id = 1;	// id of the next page saved
+segwriter_t *segments;	// where pages are saved with -p, or NULL
+
+/* the frontier. Pages are parsed one depth at a time, so every url is
+ * first found at its shortest depth even though fetches finish in any
+ * order. Idle workers sleep in cqget on the ready queue, which is shut
+ * once no page is left anywhere in the crawl. The rest is guarded by
+ * frontier_mutex; nothing blocks while holding it.
+ */
+cqueue_t *ready;		// fetched pages to parse now
+queue_t *deferred;		// fetched pages of the next depth
+int level=0, *level_left;	// depth being parsed; pages left at each depth
+int pending=0;			// pages claimed and not yet done
+hashtable_t *claimed;		// those pages, by url
+pthread_mutex_t frontier_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* held shared while a page is saved and its urls claimed, and alone by
+ * a checkpoint
+ */
+pthread_rwlock_t crawl_lock = PTHREAD_RWLOCK_INITIALIZER;
+int checkpoint_every = checkpoint_pages;	// saved pages between checkpoints, or 0
+
+metric_t *pages_saved, *urls_found, *urls_claimed;	// counters
+metric_t *save_time, *parse_time;	// per page
 
 int main(int argc, char *argv[]){
-    if (argc != 4) {
-        printf("Usage: crawler <seedurl> <pagedir> <maxdepth>\n");
+    bool packed = false, resuming = false, robots = false;
+    long delay = -1;
+    char *metrics_file = NULL;
+    for(int i = 4; i < argc; i++) {
+        if(strcmp(argv[i], "-s") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            pageio_sync(atoi(argv[++i]));
+        }
+        else if(strcmp(argv[i], "-p") == 0) {
+            packed = true;
+        }
+        else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 0) {
+            checkpoint_every = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--resume") == 0) {
+            resuming = true;
+        }
+        else if(strcmp(argv[i], "-d") == 0 && i + 1 < argc && atol(argv[i + 1]) >= 0) {
+            delay = atol(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-r") == 0) {
+            robots = true;
+        }
+        else if(strcmp(argv[i], "-v") == 0) {
+            log_level = LOG_DEBUG;
+        }
+        else if(strcmp(argv[i], "-M") == 0 && i + 1 < argc) {
+            metrics_file = argv[++i];
+        }
+        else {
+            argc = 0;
+        }
+    }
+    if (argc < 4) {
+        printf("Usage: crawler <seedurl> <pagedir> <maxdepth> [-s <pages>] [-p] [-c <pages>] [--resume] [-d <ms>] [-r] [-v] [-M <file>]\n");
         exit(EXIT_FAILURE);
     }
 
@@ -51,6 +146,18 @@ int main(int argc, char *argv[]){
     }
     int num_threads= 3;
 
+    /* before any thread starts, so that they leave SIGUSR1 to the dump */
+    if(metrics_file && metrics_export(metrics_file, SIGUSR1) != 0) {
+        printf("Error! Failed to export metrics to %s.\n", metrics_file);
+        exit(EXIT_FAILURE);
+    }
+    metrics_thread("main");
+    pages_saved = metrics_counter("crawl.pages");
+    urls_found = metrics_counter("crawl.urls");
+    urls_claimed = metrics_counter("crawl.claimed");
+    save_time = metrics_histogram("crawl.save");
+    parse_time = metrics_histogram("crawl.parse");
+
     /*************************** SAVE SEED PAGE ***************************/
     /* check save directory */
     struct stat st;
@@ -60,29 +167,63 @@ int main(int argc, char *argv[]){
             exit(EXIT_FAILURE);
         }
     }
-
-    /* initialize seed_page */
-    webpage_t *seed_page;
-    if(!(seed_page=webpage_new(seed_url,0,NULL))){
-        printf("Error! Failed to initialize webpage.");
+    if(packed && !(segments = segwriter_open(dirname, 0))){
+        printf("Failed to open segments in: %s\n", dirname);
         exit(EXIT_FAILURE);
     }
 
-    /* fetch html */
-    if(!webpage_fetch(seed_page)) {
-        printf("Error! Failed to fetch html.");
+    ready = cqopen(ready_size);
+    deferred = qopen();
+    claimed = hopen(hsize);
+    level_left = calloc(max_depth + 2, sizeof(int));
+    if(!(fp = fetch_open(max_transfers, fetched, NULL))) {
+        printf("Error! Failed to initialize fetcher.");
         exit(EXIT_FAILURE);
     }
-    
-    qp = lqopen();
-    hp = lhopen(hsize);
-    lqput(qp,seed_page);
-    lhput(hp,seed_url,seed_url,strlen(seed_url));
-    pagesave(seed_page,id++,dirname);
+    fetch_polite(fp, delay, robots);
+
+    if(resuming) {
+        /* the claimed pages are fetched again, from the lowest depth on */
+        queue_t *restored = qopen();
+        webpage_t *page;
+        int left = resume(restored);
+        if(left < 0) {
+            printf("Error! No checkpoint to resume in %s.\n", dirname);
+            exit(EXIT_FAILURE);
+        }
+        if(left == 0) {
+            printf("Crawl of %s is already complete.\n", dirname);
+            exit(EXIT_SUCCESS);
+        }
+        while((page = qget(restored))) {
+            page_added(page);
+            fetch_add(fp, page);
+        }
+        qclose(restored);
+    }
+    else {
+        /* initialize seed_page */
+        webpage_t *seed_page;
+        if(!(seed_page=webpage_new(seed_url,0,NULL))){
+            printf("Error! Failed to initialize webpage.");
+            exit(EXIT_FAILURE);
+        }
+
+        /* fetch html; the page is saved once it has been retrieved */
+        seen = urlset_open(hsize);
+        urlset_insert(seen, seed_url);
+        page_added(seed_page);
+        fetch_add(fp, seed_page);
+    }
     /**********************************************************************/
 
     /******************************** THREADS *****************************/
-    pthread_t threads[num_threads];
+    /* one thread drives every fetch; the others parse and save pages */
+    pthread_t fetch_thread, threads[num_threads];
+    if(pthread_create(&fetch_thread, NULL, fetch_start, NULL)) {
+        printf("Error creating fetch thread\n");
+        exit(EXIT_FAILURE);
+    }
     for(int i = 0; i < num_threads; i++) {
         if(pthread_create(&threads[i], NULL, thread_start, (void*)(intptr_t)i)) {
             printf("Error creating thread %d\n", i);
@@ -96,82 +237,295 @@ int main(int argc, char *argv[]){
             exit(EXIT_FAILURE);
         }
     }
+
+    fetch_stop(fp);
+    if(pthread_join(fetch_thread, NULL)) {
+        printf("Error joining fetch thread\n");
+        exit(EXIT_FAILURE);
+    }
     /**********************************************************************/
 
-    lhclose(hp);
-    lqclose(qp);
-    pthread_mutex_destroy(&crawl_mutex);
+    if ((segments && segwriter_close(segments) != 0) || pageio_flush() != 0) {
+        printf("Failed to sync saved pages\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* nothing is left to resume */
+    char path[strlen(dirname) + strlen(checkpoint_name) + 2];
+    sprintf(path, "%s/%s", dirname, checkpoint_name);
+    remove(path);
+
+    fetch_close(fp);
+    urlset_close(seen);
+    hclose(claimed);
+    free(seed_url);
+    cqclose(ready);
+    qclose(deferred);
+    free(level_left);
+    pthread_mutex_destroy(&frontier_mutex);
+    pthread_rwlock_destroy(&crawl_lock);
     exit(EXIT_SUCCESS);
 }
 
+/* the page whose urls found_url claims */
+typedef struct found {
+    int thread_id;
+    int depth;
+} found_t;
+
+/* claims a url found on a page, and queues it for fetching if it is
+ * internal and new; called by webpage_extract, which hands it the url
+ */
+static int found_url(void *arg, char *url){
+    found_t *from = (found_t *)arg;
+    webpage_t *page;
+
+    metrics_add(urls_found, 1);
+    if(IsInternalURL(url)) {
+        if (urlset_insert(seen, url)){
+            log_print(LOG_DEBUG, "Thread %d Found url: %s [internal]\n", from->thread_id, url);
+            if(!(page=webpage_new(url,from->depth+1,NULL))) {
+                printf("Error! Failed to initialize internal webpage.\n");
+                exit(EXIT_FAILURE);
+            }
+            metrics_add(urls_claimed, 1);
+            page_added(page);
+            fetch_add(fp, page);
+        }
+        else{
+            log_print(LOG_DEBUG, "Thread %d Found url: %s [internal]\n[url: %s already in queue]\n",
+                      from->thread_id, url, url);
+        }
+    }
+    else{
+        log_print(LOG_DEBUG, "Thread %d Found url: %s [external]\n", from->thread_id, url);
+    }
+    free(url);
+    return 0;
+}
+
 static void crawl(int thread_id){
-    int pos = 0, depth = 0;
-    webpage_t *page, *curr;
-    char *url;
-    int status;
+    int depth = 0;
+    webpage_t *curr;
+    found_t from = { thread_id, 0 };
+    webpage_parts_t parts = { .link = found_url, .arg = &from };
+    char name[16];
+    double start;
     //printf("id: %d entry\n", thread_id);
 
+    snprintf(name, sizeof(name), "crawl %d", thread_id);
+    metrics_thread(name);
+
     /* BFS */
-    while((curr=(webpage_t*)lqget(qp)) || (pages_retrieved<pages_added)){
-        if(!curr) {
-            continue;
-        }
-        pos = 0, depth = 0;
+    while((curr=cqget(ready))){
         depth = webpage_getDepth(curr);
 
-        /* crawl page and retrieve all urls */
-        while (depth<max_depth && (pos = webpage_getNextURL(curr, pos, &url)) > 0) {
-            printf("Thread %d Found url: %s ", thread_id, url);
-            
-            if(IsInternalURL(url)) {
-                printf("[internal]\n");
-                pthread_mutex_lock(&crawl_mutex); /*!******!*/
-                if (lhsearch(hp, searchfn, url, strlen(url)) == NULL){
-                    if(!(page=webpage_new(url,depth+1,NULL))) {
-                        printf("Error! Failed to initialize internal webpage.\n");
-                        exit(EXIT_FAILURE);
-                    }
-
-                    if(!webpage_fetch(page)) {
-                        printf("Error! Failed to fetch html from internal page.\n");
-                        pthread_mutex_unlock(&crawl_mutex);
-                        free(url);
-                        webpage_delete(page);
-                        continue;
-                    }
-                    
-                    lqput(qp, page);
-                    pages_added++;
-                    lhput(hp,url,url,strlen(url));
-                    status = pagesave(page, id++, dirname);
-                    pthread_mutex_unlock(&crawl_mutex); /*!******!*/
-                    if (status!=0){
-                        exit(EXIT_FAILURE);
-                    }
-                }
-                else{
-                    pthread_mutex_unlock(&crawl_mutex);
-                    printf("[url: %s already in queue]\n",url);
-                    free(url);
-                }
-            }
-            else{
-                printf("[external]\n");
-                free(url);
+        pthread_rwlock_rdlock(&crawl_lock);
+        int page_id = atomic_fetch_add(&id, 1);
+        start = metrics_now();
+        if ((segments ? segwriter_add(segments, curr, page_id) : pagesave(curr, page_id, dirname))!=0){
+            exit(EXIT_FAILURE);
+        }
+        metrics_record(save_time, metrics_now() - start);
+        metrics_add(pages_saved, 1);
+
+        /* crawl page and retrieve all urls, in one scan that leaves
+         * the html as it is
+         */
+        from.depth = depth;
+        if (depth<max_depth) {
+            start = metrics_now();
+            if (webpage_extract(curr, &parts) != 0) {
+                printf("Error! Out of memory.\n");
+                exit(EXIT_FAILURE);
             }
+            metrics_record(parse_time, metrics_now() - start);
         }
-        pthread_mutex_lock(&crawl_mutex);
-        pages_retrieved++;
-        pthread_mutex_unlock(&crawl_mutex);
+        page_done(curr);
+        pthread_rwlock_unlock(&crawl_lock);
         webpage_delete(curr);
+
+        if(checkpoint_every > 0 && page_id % checkpoint_every == 0 && checkpoint() != 0) {
+            printf("Error! Failed to write checkpoint.\n");
+            exit(EXIT_FAILURE);
+        }
     }
     //printf("id: %d exit\n", thread_id);
-    //printf("added: %d, retrieved: %d\n",pages_added, pages_retrieved);
 }
 
-static bool searchfn(void* elementp, const void* searchkeyp){
-    char *p = (char*)elementp;
-    return strcmp(p,(char*)searchkeyp) == 0;
+static bool url_searchfn(void *elementp, const void *searchkeyp){
+    return strcmp(webpage_getURL((webpage_t *)elementp), (const char *)searchkeyp) == 0;
+}
+
+/* counts a claimed page; called before it is fetched */
+static void page_added(webpage_t *page){
+    char *url = webpage_getURL(page);
+
+    pthread_mutex_lock(&frontier_mutex);
+    pending++;
+    level_left[webpage_getDepth(page)]++;
+    if(hput(claimed, page, url, strlen(url)) != 0) {
+        printf("Error! Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_unlock(&frontier_mutex);
+}
+
+/* counts a page as finished; once its depth is done, the fetched pages
+ * of the next depth are released for parsing
+ */
+static void page_done(webpage_t *done){
+    webpage_t *page;
+    queue_t *released = NULL;
+    char *url = webpage_getURL(done);
+    int depth = webpage_getDepth(done);
+
+    pthread_mutex_lock(&frontier_mutex);
+    pending--;
+    level_left[depth]--;
+    hremove(claimed, url_searchfn, url, strlen(url));
+    while(level < max_depth && level_left[level] == 0) {
+        level++;
+        if(!released) {
+            released = deferred;
+            deferred = qopen();
+        }
+    }
+    if(pending == 0)
+        cqshut(ready);
+    pthread_mutex_unlock(&frontier_mutex);
+
+    /* released pages are still pending, so the queue cannot be shut */
+    if(released) {
+        while((page = qget(released)))
+            cqput(ready, page);
+        qclose(released);
+    }
+}
+
+/* called by the fetch thread as each page finishes */
+static void fetched(webpage_t *page, bool ok, void *arg){
+    if(ok) {
+        bool now;
+
+        pthread_mutex_lock(&frontier_mutex);
+        if(!(now = webpage_getDepth(page) == level))
+            qput(deferred, page);
+        pthread_mutex_unlock(&frontier_mutex);
+        if(now)
+            cqput(ready, page);
+        return;
+    }
+    if(webpage_getDepth(page) == 0) {
+        printf("Error! Failed to fetch html.");
+        exit(EXIT_FAILURE);
+    }
+    printf("Error! Failed to fetch html from internal page %s.\n", webpage_getURL(page));
+    page_done(page);
+    webpage_delete(page);
+}
+
+static FILE *checkpoint_file;	// where write_claim writes
+
+static void write_claim(void *ep){
+    webpage_t *page = (webpage_t *)ep;
+    fprintf(checkpoint_file, "%d %s\n", webpage_getDepth(page), webpage_getURL(page));
+}
+
+/* writes the checkpoint once no page is being saved or parsed:
+ *   <next id> <maxdepth> <claimed pages>
+ *   <depth> <url>        one line per claimed page
+ *   <seen set>           as written by urlset_write
+ * The saved pages are synced first, and the checkpoint replaces the
+ * last one in a single rename.
+ * returns 0 for success; nonzero otherwise
+ */
+static int32_t checkpoint(void){
+    char path[strlen(dirname) + strlen(checkpoint_name) + 2], tmp[sizeof(path) + 4];
+    int32_t status;
+
+    sprintf(path, "%s/%s", dirname, checkpoint_name);
+    sprintf(tmp, "%s.tmp", path);
+    pthread_rwlock_wrlock(&crawl_lock);
+    status = (segments && segwriter_flush(segments) != 0) || pageio_flush() != 0 ||
+        !(checkpoint_file = fopen(tmp, "w"));
+    if(!status) {
+        pthread_mutex_lock(&frontier_mutex);
+        fprintf(checkpoint_file, "%d %d %d\n", atomic_load(&id), max_depth, pending);
+        happly(claimed, write_claim);
+        pthread_mutex_unlock(&frontier_mutex);
+
+        status = urlset_write(seen, checkpoint_file) != 0 || fflush(checkpoint_file) != 0 ||
+            fsync(fileno(checkpoint_file)) != 0;
+        status = fclose(checkpoint_file) != 0 || status || rename(tmp, path) != 0;
+    }
+    pthread_rwlock_unlock(&crawl_lock);
+    if(status)
+        remove(tmp);
+    return status;
+}
+
+/* reads the checkpoint, setting seen, id and the depth to parse, and
+ * queues the claimed pages in restored; pages saved after the
+ * checkpoint that will not be saved again are removed
+ * returns the number of claimed pages, or -1 if there is no checkpoint
+ * for this crawl
+ */
+static int resume(queue_t *restored){
+    char path[strlen(dirname) + strlen(checkpoint_name) + 2], *line = NULL;
+    size_t size = 0;
+    int next, depth, count, n, url_at;
+    webpage_t *page;
+    FILE *file;
+
+    sprintf(path, "%s/%s", dirname, checkpoint_name);
+    if(!(file = fopen(path, "r")) || fscanf(file, "%d %d %d\n", &next, &depth, &count) != 3 ||
+       depth != max_depth || next < 1 || count < 0) {
+        if(file)
+            fclose(file);
+        return -1;
+    }
+    level = max_depth;
+    for(n = 0; n < count && getline(&line, &size, file) > 0; n++) {
+        line[strcspn(line, "\n")] = '\0';
+        if(sscanf(line, "%d %n", &depth, &url_at) != 1 || depth < 0 || depth > max_depth ||
+           !(page = webpage_new(line + url_at, depth, NULL))) {
+            break;
+        }
+        qput(restored, page);
+        if(depth < level)
+            level = depth;
+    }
+    free(line);
+    if(n < count || !(seen = urlset_read(file))) {
+        fclose(file);
+        while((page = qget(restored)))
+            webpage_delete(page);
+        return -1;
+    }
+    fclose(file);
+    atomic_store(&id, next);
+
+    /* one file per page: the pages from next on are saved again */
+    pagestore_t *ps = !segments ? pagestore_open(dirname) : NULL;
+    const int *ids = ps ? pagestore_ids(ps, &n) : NULL;
+    for(int i = 0; ids && i < n; i++) {
+        if(ids[i] >= next) {
+            snprintf(path, sizeof(path), "%s/%d", dirname, ids[i]);
+            remove(path);
+        }
+    }
+    pagestore_close(ps);
+    return count;
+}
+
+static void *fetch_start(void *arg) {
+    metrics_thread("fetch");
+    if(fetch_run(fp) != 0) {
+        printf("Error! Fetching failed.\n");
+        exit(EXIT_FAILURE);
+    }
+    return NULL;
 }
 
 static void *thread_start(void *arg) {
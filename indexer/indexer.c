@@ -8,23 +8,163 @@
  * every webpage fetched by the crawler; it constructs in memory an index
  * data structure that can be used to look up a word and find out 1) which documents (in the crawler
  * directory) contain the word, and 2) how many times the word occurs in that document.
+ * The index is saved in the binary format by default, or as text with -t.
+ * The url, title and description snippet of every page are saved to a
+ * doc store, <indexnm>.docs, for the querier to show with its results.
+ * They are found in the same scan of the html as the words.
+ * Pages are read through a page store, so <pagedir> may hold one file
+ * per page or the packed segments of crawler -p.
+ *
+ * With -j N the sorted page ids are split into N contiguous ranges of
+ * small chunks, one range per thread. Each thread indexes its chunks
+ * into a private index and, when it runs out, steals chunks from the
+ * end of another thread's range, so uneven pages do not leave threads
+ * idle. Posting lists stay sorted as they are merged, so the saved
+ * index is identical to a serial run.
+ *
+ * Entries and their words are bump allocated from one arena per
+ * thread, which lives until the index is saved.
+ *
+ * With -p N indexing is a pipeline of stages joined by bounded queues
+ * instead: a load thread reads the pages in id order, advising the
+ * kernel to read ahead of it, and hands them round robin to N tokenize
+ * threads. Each turns a page into a batch of its distinct words and
+ * their counts, and the main thread inserts the batches into the index,
+ * taking them round robin too, so they arrive in id order. The time
+ * each stage spends working rather than waiting is reported, which
+ * shows whether a run is bound by the disk or by the CPU.
+ *
+ * With -u only the pages beyond the largest id already in <indexnm>
+ * and its deltas are indexed, into the next delta segment of
+ * indexset.h, which the querier reads along with the base. Once
+ * MAX_DELTAS deltas have piled up they are merged into the base; -m
+ * merges them on its own, and may run in the background while queries
+ * are served from the old segments.
+ *
+ * With -P the positions of the words are indexed too, into
+ * <indexnm>.pos beside each segment, for the phrase and proximity
+ * queries of the querier. A position counts the indexed words before
+ * it, so words too short to index take no position. An update of a
+ * positional index is positional as well.
+ *
+ * With -v every page is reported as it is loaded. With -M <file> the
+ * counters and latencies of metrics.h are dumped to the file as JSON
+ * on exit, and whenever the indexer gets SIGUSR1: the pages, bytes and
+ * words indexed by each thread, with their rates, and the time taken
+ * to load, tokenize and insert each page.
  *
  */
+#define _POSIX_C_SOURCE 200809L // getopt, SIGUSR1
 
 #include <stdio.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
 #include <sys/stat.h>
-#include <dirent.h>
+#include <pthread.h>
 #include <pageio.h>
 #include <indexio.h>
 #include <hash.h>
-#include <queue.h>
+#include <cqueue.h>
+#include <arena.h>
+#include <docstore.h>
+#include <indexset.h>
+#include <metrics.h>
 
 #define hsize 1000 // hashtable size
+#define MIN_WORD_LEN 3 // shorter words are not indexed
+#define CHUNK_PAGES 16 // pages handed out at a time
+#define MAX_DELTAS 8 // deltas of an index before they are merged
+#define PIPE_DEPTH 16 // pages or batches queued between pipeline stages
+#define READAHEAD 64 // pages prefetched ahead of the load stage
 
 static int total_count = 0;
+static hashtable_t *merge_index; /* destination of merge_fn */
+static docstore_t *docs;	 /* metadata of the indexed pages */
+static bool positional;		 /* whether word positions are indexed */
+static metric_t *pages_indexed, *bytes_indexed, *words_indexed;	  /* counters */
+static metric_t *load_time, *tokenize_time, *insert_time; /* per page */
+
+/* a run of consecutive page ids */
+typedef struct chunk
+{
+	const int *ids;
+	int count;
+} chunk_t;
+
+/* an indexing thread and its private index */
+typedef struct worker
+{
+	pthread_t thread;
+	int num;
+	wsqueue_t *chunks;
+	pagestore_t *pages;
+	arena_t *arena; /* holds the entries of index */
+	hashtable_t *index;
+} worker_t;
+
+/* what index_word needs to add the words of a page to an index */
+typedef struct page_words
+{
+	hashtable_t *index;
+	arena_t *arena;
+	int id;
+	uint32_t n;	 /* words added so far */
+	char *word;	 /* the word lowercased, in a reused buffer */
+	size_t wordsize;
+} page_words_t;
+
+/* a distinct word of a page and its number of occurrences */
+typedef struct term
+{
+	const char *word;
+	size_t off; /* of word in the text of its batch */
+	int len;
+	int count;
+	int pos; /* of word in the page; once counted, of its first position in the batch */
+} term_t;
+
+/* the words of one page, handed from a tokenize stage to the insert stage */
+typedef struct batch
+{
+	int nterms;
+	term_t *terms;	    /* sorted by word */
+	char *text;	    /* the NUL-terminated words */
+	uint32_t *positions; /* of each word in turn, if positional */
+	size_t used;	    /* while tokenizing: bytes of text in use */
+	size_t size;	    /* and allocated */
+	int cap;	    /* terms allocated */
+} batch_t;
+
+/* the work done by a pipeline stage */
+typedef struct stage
+{
+	long items;
+	long bytes;
+	double busy; /* seconds spent working rather than waiting on a queue */
+} stage_t;
+
+/* the stages of a pipelined run and the queues joining them */
+typedef struct pipeline
+{
+	const int *ids;
+	int count;
+	pagestore_t *pages;
+	int ntokenizers;
+	cqueue_t **loaded;  /* the pages of each tokenizer, in id order */
+	cqueue_t **batches; /* the batches of each tokenizer, in id order */
+	stage_t load;
+} pipeline_t;
+
+/* a tokenize thread of a pipeline */
+typedef struct tokenizer
+{
+	pthread_t thread;
+	int num;
+	pipeline_t *pl;
+	stage_t stats;
+} tokenizer_t;
 
 /* searches for entry in the hash table */
 static bool entry_searchfn(void *elementp, const void *searchkeyp)
@@ -33,78 +173,600 @@ static bool entry_searchfn(void *elementp, const void *searchkeyp)
 	return strcmp(ep->word, (char *)searchkeyp) == 0;
 }
 
-/* searches for document in queue */
-static bool doc_searchfn(void *elementp, const void *id)
+/* total word count */
+static void total_sum_fn(void *ep)
 {
-	document_t *dp = (document_t *)elementp;
-	return dp->id == *(int *)id;
+	entry_t *p = (entry_t *)ep;
+	for (int i = 0; i < p->documents.ndocs; i++)
+		total_count += p->documents.docs[i].word_count;
 }
 
-/* total word count in the queue ie. word count for a specific word */
-static void queue_sum_fn(void *elementp)
+/* copies the len letters of word to out, lowercased, and ends them */
+static void lower_word(char *out, const char *word, int len)
 {
-	document_t *dp = (document_t *)elementp;
-	total_count += dp->word_count;
+	for (int i = 0; i < len; i++)
+		out[i] = word[i] | 0x20;
+	out[len] = '\0';
 }
 
-/* total word count */
-static void total_sum_fn(void *ep)
+/*
+ * adds a word of a page to the index of pw, if it is long enough. Words
+ * are lowercased into a reused buffer, so memory is only allocated when
+ * a new word enters the index.
+ */
+static int index_word(void *arg, const char *word, int len)
 {
-	entry_t *p = (entry_t *)ep;
-	qapply(p->documents, queue_sum_fn);
+	page_words_t *pw = (page_words_t *)arg;
+	entry_t *ep;
+
+	if (len < MIN_WORD_LEN)
+		return 0;
+	if ((size_t)len >= pw->wordsize)
+	{
+		char *buf = realloc(pw->word, (pw->wordsize = 2 * len + 64));
+		if (!buf)
+			return 1;
+		pw->word = buf;
+	}
+	lower_word(pw->word, word, len);
+	if (!(ep = (entry_t *)hsearch(pw->index, entry_searchfn, pw->word, len)))
+	{
+		if (!(ep = new_entry_in(pw->arena, pw->word)) || hput(pw->index, ep, ep->word, len) != 0)
+			return 1;
+	}
+	postings_add(&ep->documents, pw->id, 1);
+	if (positional && positions_append(&ep->positions, &pw->n, 1) != 0)
+		return 1;
+	pw->n++;
+	return 0;
 }
 
-static int compare_func(const void *a, const void *b)
+/*
+ * adds every word of the page to the index under document id, and its
+ * metadata to the doc store, in one scan of its html
+ */
+static void index_page(hashtable_t *index, arena_t *arena, webpage_t *page, int id)
 {
-	const int *val_a = (const int *)a;
-	const int *val_b = (const int *)b;
-	if (*val_a < *val_b)
+	page_words_t pw = {index, arena, id, 0, NULL, 0};
+	webpage_parts_t parts = {.word = index_word, .arg = &pw};
+	docmeta_t meta;
+	double start = metrics_now();
+
+	if (webpage_extract(page, &parts) != 0)
 	{
-		return -1;
+		printf("Error: failed to index page %d\n", id);
+		exit(EXIT_FAILURE);
 	}
-	else if (*val_a > *val_b)
+	metrics_record(tokenize_time, metrics_now() - start);
+	metrics_add(pages_indexed, 1);
+	metrics_add(bytes_indexed, webpage_getHTMLlen(page));
+	metrics_add(words_indexed, pw.n);
+	free(pw.word);
+	docmeta_parts(page, &parts, &meta);
+	if (docstore_put(docs, id, &meta) != 0)
 	{
-		return 1;
+		printf("Error: failed to save metadata of page %d\n", id);
+		exit(EXIT_FAILURE);
 	}
-	else
+}
+
+/* indexes chunks of pages into the worker's own index until none are left */
+static void *index_chunks(void *arg)
+{
+	worker_t *wp = (worker_t *)arg;
+	webpage_t *page;
+	chunk_t *cp;
+	char name[16];
+
+	snprintf(name, sizeof(name), "index %d", wp->num);
+	metrics_thread(name);
+	while ((cp = wsget(wp->chunks, wp->num)))
 	{
-		return 0;
+		for (int i = 0; i < cp->count; i++)
+		{
+			log_print(LOG_DEBUG, "loading page id: %d ...\n", cp->ids[i]);
+			double start = metrics_now();
+			page = pagestore_load(wp->pages, cp->ids[i]);
+
+			if (!page)
+				exit(EXIT_FAILURE);
+			metrics_record(load_time, metrics_now() - start);
+
+			index_page(wp->index, wp->arena, page, cp->ids[i]);
+			log_print(LOG_DEBUG, "page id: %d loaded successfully.\n", cp->ids[i]);
+			webpage_delete(page);
+		}
+		free(cp);
 	}
+	return NULL;
 }
 
-static void NormalizeWord(char *word)
+/* orders terms by word, then by position */
+static int term_cmp(const void *a, const void *b)
 {
-	if (!word)
+	const term_t *ta = (const term_t *)a, *tb = (const term_t *)b;
+	int cmp = strcmp(ta->word, tb->word);
+	return cmp ? cmp : (ta->pos > tb->pos) - (ta->pos < tb->pos);
+}
+
+static void batch_free(batch_t *bp)
+{
+	if (!bp)
 		return;
+	free(bp->terms);
+	free(bp->text);
+	free(bp->positions);
+	free(bp);
+}
+
+/* adds a word of a page to the end of batch arg, if it is long enough */
+static int batch_word(void *arg, const char *word, int len)
+{
+	batch_t *bp = (batch_t *)arg;
+
+	if (len < MIN_WORD_LEN)
+		return 0;
+	if (bp->used + len + 1 > bp->size)
+	{
+		char *text = realloc(bp->text, (bp->size = 2 * (bp->used + len + 1)));
+		if (!text)
+			return 1;
+		bp->text = text;
+	}
+	if (bp->nterms == bp->cap)
+	{
+		term_t *terms = realloc(bp->terms, (bp->cap = bp->cap ? 2 * bp->cap : 256) * sizeof(term_t));
+		if (!terms)
+			return 1;
+		bp->terms = terms;
+	}
+	lower_word(bp->text + bp->used, word, len);
+	bp->terms[bp->nterms] = (term_t){NULL, bp->used, len, 1, bp->nterms};
+	bp->nterms++;
+	bp->used += len + 1;
+	return 0;
+}
+
+/*
+ * the distinct words of page and their counts, or NULL if out of
+ * memory; the title and description are found in the same scan, into
+ * parts
+ */
+static batch_t *tokenize_page(webpage_t *page, webpage_parts_t *parts)
+{
+	batch_t *bp = calloc(1, sizeof(batch_t));
+
+	if (!bp || !(bp->text = malloc((bp->size = webpage_getHTMLlen(page) + 1))))
+	{
+		batch_free(bp);
+		return NULL;
+	}
+	*parts = (webpage_parts_t){.word = batch_word, .arg = bp};
+	if (webpage_extract(page, parts) != 0)
+	{
+		batch_free(bp);
+		return NULL;
+	}
+
+	/* count each word once, now that the text no longer moves; the
+	 * positions of a word follow one another, in order
+	 */
+	metrics_add(words_indexed, bp->nterms);
+	for (int i = 0; i < bp->nterms; i++)
+		bp->terms[i].word = bp->text + bp->terms[i].off;
+	qsort(bp->terms, bp->nterms, sizeof(term_t), term_cmp);
+	if (positional && !(bp->positions = malloc((bp->nterms ? bp->nterms : 1) * sizeof(uint32_t))))
+	{
+		batch_free(bp);
+		return NULL;
+	}
+	int n = 0;
+	for (int i = 0; i < bp->nterms; i++)
+	{
+		if (positional)
+			bp->positions[i] = bp->terms[i].pos;
+		if (n > 0 && strcmp(bp->terms[n - 1].word, bp->terms[i].word) == 0)
+		{
+			bp->terms[n - 1].count++;
+		}
+		else
+		{
+			bp->terms[n] = bp->terms[i];
+			bp->terms[n++].pos = i;
+		}
+	}
+	bp->nterms = n;
+	return bp;
+}
+
+/* load stage: reads the pages in id order, prefetching the ones ahead */
+static void *load_pages(void *arg)
+{
+	pipeline_t *pl = (pipeline_t *)arg;
+	webpage_t *page;
+
+	metrics_thread("load");
+	for (int i = 0; i < pl->count; i++)
+	{
+		double start = metrics_now();
+		if (i == 0)
+		{
+			for (int j = 0; j < READAHEAD && j < pl->count; j++)
+				pagestore_prefetch(pl->pages, pl->ids[j]);
+		}
+		else if (i + READAHEAD - 1 < pl->count)
+		{
+			pagestore_prefetch(pl->pages, pl->ids[i + READAHEAD - 1]);
+		}
+		log_print(LOG_DEBUG, "loading page id: %d ...\n", pl->ids[i]);
+		if (!(page = pagestore_load(pl->pages, pl->ids[i])))
+			exit(EXIT_FAILURE);
+		log_print(LOG_DEBUG, "page id: %d loaded successfully.\n", pl->ids[i]);
+		pl->load.items++;
+		pl->load.bytes += webpage_getHTMLlen(page);
+		pl->load.busy += metrics_now() - start;
+		metrics_record(load_time, metrics_now() - start);
+
+		if (cqput(pl->loaded[i % pl->ntokenizers], page) != 0)
+			exit(EXIT_FAILURE);
+	}
+	for (int t = 0; t < pl->ntokenizers; t++)
+		cqshut(pl->loaded[t]);
+	return NULL;
+}
+
+/* tokenize stage: turns the pages of one tokenizer into batches */
+static void *tokenize_pages(void *arg)
+{
+	tokenizer_t *tp = (tokenizer_t *)arg;
+	pipeline_t *pl = tp->pl;
+	webpage_t *page;
+	webpage_parts_t parts;
+	docmeta_t meta;
+	batch_t *bp;
+	char name[16];
+
+	snprintf(name, sizeof(name), "tokenize %d", tp->num);
+	metrics_thread(name);
+	for (int i = tp->num; (page = cqget(pl->loaded[tp->num])); i += pl->ntokenizers)
+	{
+		double start = metrics_now();
+		if (!(bp = tokenize_page(page, &parts)) ||
+		    (docmeta_parts(page, &parts, &meta), docstore_put(docs, pl->ids[i], &meta)) != 0)
+		{
+			printf("Error: failed to index page %d\n", pl->ids[i]);
+			exit(EXIT_FAILURE);
+		}
+		tp->stats.items++;
+		tp->stats.bytes += webpage_getHTMLlen(page);
+		metrics_add(pages_indexed, 1);
+		metrics_add(bytes_indexed, webpage_getHTMLlen(page));
+		webpage_delete(page);
+		tp->stats.busy += metrics_now() - start;
+		metrics_record(tokenize_time, metrics_now() - start);
+
+		if (cqput(pl->batches[tp->num], bp) != 0)
+			exit(EXIT_FAILURE);
+	}
+	cqshut(pl->batches[tp->num]);
+	return NULL;
+}
+
+/* insert stage: adds the batches to the index in id order */
+static void insert_batches(pipeline_t *pl, hashtable_t *index, arena_t *arena, stage_t *stats)
+{
+	batch_t *bp;
+	entry_t *ep;
+
+	metrics_thread("insert");
+	for (int i = 0; (bp = cqget(pl->batches[i % pl->ntokenizers])); i++)
+	{
+		double start = metrics_now();
+		for (int j = 0; j < bp->nterms; j++)
+		{
+			term_t *tp = &bp->terms[j];
+			if (!(ep = (entry_t *)hsearch(index, entry_searchfn, tp->word, tp->len)))
+			{
+				if (!(ep = new_entry_in(arena, (char *)tp->word)) || hput(index, ep, ep->word, tp->len) != 0)
+				{
+					printf("Error: failed to add %s to the index\n", tp->word);
+					exit(EXIT_FAILURE);
+				}
+			}
+			if (postings_add(&ep->documents, pl->ids[i], tp->count) != 0 ||
+			    (positional && positions_append(&ep->positions, bp->positions + tp->pos, tp->count) != 0))
+			{
+				printf("Error: failed to add %s to the index\n", tp->word);
+				exit(EXIT_FAILURE);
+			}
+			stats->bytes += tp->len;
+		}
+		stats->items++;
+		batch_free(bp);
+		stats->busy += metrics_now() - start;
+		metrics_record(insert_time, metrics_now() - start);
+	}
+}
+
+/* prints the work of a stage of nthreads threads over a run of elapsed seconds */
+static void report_stage(const char *name, const stage_t *sp, int nthreads, double elapsed)
+{
+	printf("%-8s %6ld pages %8.1f MB %7.2f s busy %5.0f%% %9.0f pages/s\n", name, sp->items,
+	       sp->bytes / 1e6, sp->busy, elapsed > 0 ? 100 * sp->busy / (elapsed * nthreads) : 0,
+	       sp->busy > 0 ? sp->items * nthreads / sp->busy : 0);
+}
 
-	int len = strlen(word);
+/* indexes the pages with a pipeline of ntokenizers tokenize threads */
+static void index_pipelined(pipeline_t *pl, hashtable_t *index, arena_t *arena)
+{
+	int n = pl->ntokenizers;
+	tokenizer_t tokenizers[n];
+	pthread_t loader;
+	stage_t insert = {0, 0, 0};
+	double start = metrics_now();
 
-	if (len < 3)
+	pl->loaded = calloc(n, sizeof(cqueue_t *));
+	pl->batches = calloc(n, sizeof(cqueue_t *));
+	for (int t = 0; pl->loaded && pl->batches && t < n; t++)
+	{
+		if (!(pl->loaded[t] = cqopen(PIPE_DEPTH)) || !(pl->batches[t] = cqopen(PIPE_DEPTH)))
+			break;
+		tokenizers[t] = (tokenizer_t){0, t, pl, {0, 0, 0}};
+	}
+	if (!pl->loaded || !pl->batches || !pl->batches[n - 1])
 	{
-		word[0] = '\0';
+		printf("Error: out of memory\n");
+		exit(EXIT_FAILURE);
 	}
 
-	int i;
-	for (i = 0; i < len; i++)
+	if (pthread_create(&loader, NULL, load_pages, pl))
+	{
+		printf("Error creating load thread\n");
+		exit(EXIT_FAILURE);
+	}
+	for (int t = 0; t < n; t++)
+	{
+		if (pthread_create(&tokenizers[t].thread, NULL, tokenize_pages, &tokenizers[t]))
+		{
+			printf("Error creating thread %d\n", t);
+			exit(EXIT_FAILURE);
+		}
+	}
+	insert_batches(pl, index, arena, &insert);
+	if (pthread_join(loader, NULL))
+	{
+		printf("Error joining load thread\n");
+		exit(EXIT_FAILURE);
+	}
+	stage_t tokenize = {0, 0, 0};
+	for (int t = 0; t < n; t++)
 	{
-		if (!isalpha(word[i]))
+		if (pthread_join(tokenizers[t].thread, NULL))
 		{
-			word[0] = '\0';
-			return;
+			printf("Error joining thread %d\n", t);
+			exit(EXIT_FAILURE);
 		}
-		word[i] = tolower(word[i]);
+		tokenize.items += tokenizers[t].stats.items;
+		tokenize.bytes += tokenizers[t].stats.bytes;
+		tokenize.busy += tokenizers[t].stats.busy;
+		cqclose(pl->loaded[t]);
+		cqclose(pl->batches[t]);
 	}
+	free(pl->loaded);
+	free(pl->batches);
+
+	/* the stage busiest for its threads bounds the run */
+	double elapsed = metrics_now() - start, load = pl->load.busy, tok = tokenize.busy / n, ins = insert.busy;
+	printf("Pipeline with %d tokenize threads: %d pages in %.2f s\n", n, pl->count, elapsed);
+	report_stage("load", &pl->load, 1, elapsed);
+	report_stage("tokenize", &tokenize, n, elapsed);
+	report_stage("insert", &insert, 1, elapsed);
+	printf("The run was %s\n", load >= tok && load >= ins ? "disk-bound, by the load stage"
+				    : tok >= ins		 ? "CPU-bound, by the tokenize stage"
+							 : "CPU-bound, by the insert stage");
+}
+
+/*
+ * moves an entry of a partial index into merge_index. The partial
+ * indexes hold disjoint pages; docs that all come after the merged
+ * ones are appended, otherwise the two lists are merged. A new word
+ * moves its entry over as is, since every arena outlives merge_index.
+ */
+static void merge_fn(void *elementp)
+{
+	entry_t *src = (entry_t *)elementp;
+	entry_t *dst = hsearch(merge_index, entry_searchfn, src->word, strlen(src->word));
+	postings_t *merged;
+
+	if (dst)
+	{
+		postings_t *dp = &dst->documents;
+		if (dp->ndocs == 0 || src->documents.docs[0].id > dp->docs[dp->ndocs - 1].id)
+		{
+			if (postings_append(dp, &src->documents) != 0)
+			{
+				printf("Error: failed to merge postings for %s\n", src->word);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else
+		{
+			if (!(merged = postings_union(dp, &src->documents)))
+			{
+				printf("Error: failed to merge postings for %s\n", src->word);
+				exit(EXIT_FAILURE);
+			}
+			postings_clear(dp);
+			*dp = *merged;
+			free(merged);
+		}
+		postings_clear(&src->documents);
+	}
+	else if (hput(merge_index, src, src->word, strlen(src->word)) != 0)
+	{
+		printf("Error: failed to merge postings for %s\n", src->word);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/* saves the doc store of the index saved as indexnm */
+static int32_t save_docs(char *indexnm)
+{
+	char docsnm[strlen(indexnm) + strlen(DOCSTORE_SUFFIX) + 1];
+	sprintf(docsnm, "%s%s", indexnm, DOCSTORE_SUFFIX);
+	return docstore_save(docs, docsnm);
+}
+
+/* saves the positions of the index saved as indexnm, or removes any
+ * left from an earlier positional index
+ */
+static int32_t save_positions(hashtable_t *index, char *indexnm)
+{
+	char posnm[strlen(indexnm) + strlen(POSITIONS_SUFFIX) + 1];
+	sprintf(posnm, "%s%s", indexnm, POSITIONS_SUFFIX);
+	if (!positional)
+		return remove(posnm) != 0 && access(posnm, F_OK) == 0;
+	return indexsave_positions(index, posnm);
+}
+
+/* saves a full index and its doc store, replacing any deltas */
+static int32_t save_index(hashtable_t *index, char *indexnm, bool text)
+{
+	if ((text ? indexsave(index, indexnm) : indexsave_binary(index, indexnm)) != 0 || save_docs(indexnm) != 0 ||
+	    save_positions(index, indexnm) != 0)
+		return 1;
+
+	indexset_t *set = indexset_open(indexnm);
+	int next = indexset_next(set);
+	char name[strlen(indexnm) + strlen(DOCSTORE_SUFFIX) + strlen(POSITIONS_SUFFIX) + 16];
+	indexset_close(set);
+	for (int i = 1; i < next; i++)
+	{
+		indexset_segname(indexnm, i, name, sizeof(name));
+		remove(name);
+		strcat(name, DOCSTORE_SUFFIX);
+		remove(name);
+		indexset_segname(indexnm, i, name, sizeof(name));
+		strcat(name, POSITIONS_SUFFIX);
+		remove(name);
+	}
+	return 0;
+}
+
+/* saves the next delta of set, index indexnm, merging the deltas once
+ * there are too many
+ */
+static int32_t save_delta(hashtable_t *index, indexset_t *set, char *indexnm)
+{
+	int next = indexset_next(set);
+	indexset_close(set);
+	if (next >= INDEXSET_MAX)
+	{
+		printf("Error: too many deltas of %s\n", indexnm);
+		return 1;
+	}
+
+	/* the delta only appears once it is complete */
+	char name[strlen(indexnm) + 16], tmpnm[strlen(indexnm) + 24];
+	indexset_segname(indexnm, next, name, sizeof(name));
+	sprintf(tmpnm, "%s.tmp", name);
+	if (save_docs(name) != 0 || save_positions(index, name) != 0 || indexsave_binary(index, tmpnm) != 0 ||
+	    rename(tmpnm, name) != 0)
+	{
+		remove(tmpnm);
+		return 1;
+	}
+	printf("Saved delta %s\n", name);
+	if (next >= MAX_DELTAS && indexset_merge(indexnm) != 0)
+	{
+		printf("Error: failed to merge %s\n", indexnm);
+		return 1;
+	}
+	return 0;
+}
+
+static void usage(void)
+{
+	printf("usage: indexer [-t | -u] [-P] [-j <threads> | -p <tokenizers>] [-v] [-M <file>] <pagedir> <indexnm>\n"
+	       "       indexer -m <indexnm>\n");
+	exit(EXIT_FAILURE);
 }
 
 int main(int argc, char *argv[])
 {
-	if (argc != 3)
+	bool text = false, update = false, merge = false;
+	int num_threads = 1, tokenizers = 0;
+	char *metrics_file = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "tumPj:p:vM:")) != -1)
+	{
+		switch (opt)
+		{
+		case 't':
+			text = true;
+			break;
+		case 'u':
+			update = true;
+			break;
+		case 'm':
+			merge = true;
+			break;
+		case 'P':
+			positional = true;
+			break;
+		case 'j':
+			num_threads = atoi(optarg);
+			if (num_threads < 1)
+				usage();
+			break;
+		case 'p':
+			tokenizers = atoi(optarg);
+			if (tokenizers < 1)
+				usage();
+			break;
+		case 'v':
+			log_level = LOG_DEBUG;
+			break;
+		case 'M':
+			metrics_file = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (merge)
 	{
-		printf("usage: indexer <pagedir> <indexnm>\n");
+		if (text || update || positional || argc - optind != 1)
+			usage();
+		if (indexset_merge(argv[optind]) != 0)
+		{
+			printf("Error: failed to merge %s\n", argv[optind]);
+			exit(EXIT_FAILURE);
+		}
+		exit(EXIT_SUCCESS);
+	}
+	/* the partial indexes of threads are merged without their positions */
+	if (argc - optind != 2 || (text && update) || (tokenizers > 0 && num_threads > 1) ||
+	    (positional && (text || num_threads > 1)))
+	{
+		usage();
+	}
+
+	/* before any thread starts, so that they leave SIGUSR1 to the dump */
+	if (metrics_file && metrics_export(metrics_file, SIGUSR1) != 0)
+	{
+		printf("Error: failed to export metrics to %s\n", metrics_file);
 		exit(EXIT_FAILURE);
 	}
+	pages_indexed = metrics_counter("index.pages");
+	bytes_indexed = metrics_counter("index.bytes");
+	words_indexed = metrics_counter("index.words");
+	load_time = metrics_histogram("index.load");
+	tokenize_time = metrics_histogram("index.tokenize");
+	insert_time = metrics_histogram("index.insert");
 
-	char *dirname = argv[1];
+	char *dirname = argv[optind];
+	char *indexnm = argv[optind + 1];
 	struct stat st_dir;
 
 	/* check if <pagedir> exists */
@@ -114,94 +776,141 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
-	hashtable_t *index = hopen(hsize);
-	webpage_t *page;
-	DIR *dir;
-	struct dirent *dir_entry;
-	int count = 0;
-	int *files = NULL;
-
-	/* open directory */
-	dir = opendir(dirname);
-	if (dir == NULL)
+	/* the page ids, from one file per page or the footers of segments */
+	pagestore_t *pages = pagestore_open(dirname);
+	if (pages == NULL)
 	{
 		printf("Failed to open %s\n", dirname);
 		exit(EXIT_FAILURE);
 	}
+	int count;
+	const int *files = pagestore_ids(pages, &count);
 
-	/* add file ids to array */
-	while ((dir_entry = readdir(dir)) != NULL)
+	/* an update indexes the pages beyond the index into its next delta */
+	indexset_t *set = NULL;
+	if (update)
 	{
-		if (dir_entry->d_name[0] != '.')
+		if (!(set = indexset_open(indexnm)))
+		{
+			printf("Error: %s is not a binary index\n", indexnm);
+			exit(EXIT_FAILURE);
+		}
+		if (positional && !indexset_positional(set))
+		{
+			printf("Error: %s has no positions; rebuild it with -P\n", indexnm);
+			exit(EXIT_FAILURE);
+		}
+		positional = indexset_positional(set);
+		int indexed = indexset_nids(set);
+		while (count > 0 && files[0] < indexed)
+		{
+			files++;
+			count--;
+		}
+		if (count == 0)
 		{
-			int id = atoi(dir_entry->d_name);
-			count++;
-			files = realloc(files, count * sizeof(int));
-			files[count - 1] = id;
+			printf("Index %s is up to date\n", indexnm);
+			indexset_close(set);
+			pagestore_close(pages);
+			exit(EXIT_SUCCESS);
 		}
 	}
-	closedir(dir);
 
-	/* sort the files in order using compare_func */
-	qsort(files, count, sizeof(int), compare_func);
-
-	/* loop over files */
-	for (int i = 0; i < count; i++)
+	/* a delta holds the metadata of its own pages only */
+	if (!(docs = docstore_new(count > 0 ? files[0] : 0, count > 0 ? files[count - 1] + 1 : 0)))
 	{
-		printf("loading page id: %d ...\n", files[i]);
-		page = pageload(files[i], dirname);
+		printf("Error: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
 
-		if (!page)
+	/* split the sorted ids into contiguous ranges of chunks, one per thread;
+	 * a pipeline takes them in order instead
+	 */
+	if (num_threads > count)
+		num_threads = count > 0 ? count : 1;
+	wsqueue_t *chunks = wsopen(num_threads);
+	worker_t workers[num_threads];
+	for (int i = 0; i < num_threads; i++)
+	{
+		int first = (long)count * i / num_threads;
+		int last = (long)count * (i + 1) / num_threads;
+		for (int j = first; tokenizers == 0 && j < last; j += CHUNK_PAGES)
+		{
+			chunk_t *cp = malloc(sizeof(chunk_t));
+			if (!cp)
+			{
+				printf("Error: out of memory\n");
+				exit(EXIT_FAILURE);
+			}
+			cp->ids = files + j;
+			cp->count = last - j < CHUNK_PAGES ? last - j : CHUNK_PAGES;
+			wsput(chunks, i, cp);
+		}
+		workers[i].num = i;
+		workers[i].chunks = chunks;
+		workers[i].pages = pages;
+		workers[i].arena = arena_open(0);
+		workers[i].index = hopen_arena(hsize, workers[i].arena);
+		if (!workers[i].index)
+		{
+			printf("Error: out of memory\n");
 			exit(EXIT_FAILURE);
+		}
+	}
 
-		int pos = 0;
-		char *word;
-		entry_t *ep;
-
-		while ((pos = webpage_getNextWord(page, pos, &word)) > 0)
+	if (tokenizers > 0)
+	{
+		pipeline_t pl = {files, count, pages, tokenizers, NULL, NULL, {0, 0, 0}};
+		index_pipelined(&pl, workers[0].index, workers[0].arena);
+	}
+	else if (num_threads == 1)
+	{
+		index_chunks(&workers[0]);
+	}
+	else
+	{
+		for (int i = 0; i < num_threads; i++)
 		{
-			NormalizeWord(word);
-			if (word[0] != '\0')
+			if (pthread_create(&workers[i].thread, NULL, index_chunks, &workers[i]))
 			{
-				if (hsearch(index, entry_searchfn, word, strlen(word)))
-				{
-					ep = (entry_t *)hsearch(index, entry_searchfn, word, strlen(word));
-					document_t *dp;
-					if ((dp = qsearch(ep->documents, doc_searchfn, &files[i])))
-					{
-						dp->word_count = dp->word_count + 1;
-					}
-					else
-					{
-						dp = new_doc(files[i], 1);
-						qput(ep->documents, dp);
-					}
-				}
-				else
-				{
-					ep = new_entry(word);
-					document_t *dp = new_doc(files[i], 1);
-					qput(ep->documents, dp);
-					hput(index, ep, word, strlen(word));
-				}
-				// printf("%s\n",word);
+				printf("Error creating thread %d\n", i);
+				exit(EXIT_FAILURE);
 			}
-			free(word);
 		}
-		printf("page id: %d loaded successfully.\n", files[i]);
-		webpage_delete(page);
+		for (int i = 0; i < num_threads; i++)
+		{
+			if (pthread_join(workers[i].thread, NULL))
+			{
+				printf("Error joining thread %d\n", i);
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+
+	wsclose(chunks);
+
+	/* merge the partial indexes */
+	hashtable_t *index = workers[0].index;
+	merge_index = index;
+	for (int i = 1; i < num_threads; i++)
+	{
+		happly(workers[i].index, merge_fn);
+		hclose(workers[i].index);
 	}
 
 	happly(index, total_sum_fn);
 	printf("Total word count in hashtable: %d\n", total_count);
 
-	free(files);
-	if (indexsave(index, argv[2]) != 0)
+	pagestore_close(pages);
+	if (update ? save_delta(index, set, indexnm) != 0 : save_index(index, indexnm, text) != 0)
 	{
 		exit(EXIT_FAILURE);
 	}
-	free_entries(index);
+	docstore_free(docs);
+	free_postings(index);
 	hclose(index);
+	for (int i = 0; i < num_threads; i++)
+		arena_close(workers[i].arena);
 	exit(EXIT_SUCCESS);
 }
 
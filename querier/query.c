@@ -10,19 +10,186 @@
  * separated by spaces with optiona  boolean operators AND and OR, where AND has precedence over OR.
  * By default, all words typed in a query are implicitly connected by logical-AND.
  *
+ * With -k N only the N best ranked docs are selected, with a bounded
+ * heap, and only their pages are loaded for metadata.
+ *
+ * Docs are ranked by word count by default. With -r bm25 or -r tfidf
+ * each word's posting list is scored instead, and the scores of the
+ * words of a query are added up for both AND and OR. A scored OR of
+ * words with -k on a binary index is evaluated with block-max WAND,
+ * which skips the docs that cannot make the top k.
+ *
+ * The url, title and description of each result come from the doc store
+ * the indexer saved next to the index, <indexFile>.docs, or from the
+ * crawled pages if there is none, in files or packed segments.
+ *
+ * A word ending in "*", such as comput*, is a prefix standing for the OR
+ * of every indexed word starting with it, found as a range of term ids
+ * in the front coded dictionary of a binary index, or by binary search
+ * over the sorted words of a text index.
+ *
+ * A phrase in double quotes, such as "new york", matches the docs where
+ * its words appear one after the other, and w1 NEAR/k w2 the docs where
+ * w2 comes within k words of w1, on either side. Both need the positions
+ * of an index built with indexer -P. The docs having every word are
+ * found first, as for an AND of them, and positions are only decoded
+ * for those. A match ranks as the AND of its words when scored, and by
+ * its number of occurrences otherwise. Words shorter than three letters
+ * are left out of a phrase, as they are of the index and its positions.
+ *
+ * A binary index is read along with the delta segments added to it by
+ * indexer -u, and each delta with its own doc store.
+ *
+ * The ranked docs of a query, their metadata and the queues holding them
+ * are allocated from a scratch arena that is reset after each query.
+ *
+ * With -s <socketPath> or -p <port> the querier loads the index once and
+ * serves queries over a Unix socket, or TCP on the loopback interface,
+ * from a pool of -t threads (4 by default) sharing the read-only index.
+ * Each line a client sends is one query; its results are sent back in
+ * the same format as on stdin followed by a line holding only ".". A
+ * client may send a whole batch of queries at once and read the answers
+ * back in order. SIGINT or SIGTERM stops the server once its clients
+ * have disconnected.
+ *
+ * With -c <kilobytes> the docs selected by each query are cached, up to
+ * that much memory, on the query's tokens after lowercasing and implicit
+ * AND insertion, so "Dog cat" and "dog AND cat" share an entry. Cached
+ * results are dropped whenever the index is loaded again. The cache
+ * counters are printed to stderr on exit.
+ *
+ * The index files are checked for changes at most once a second, and
+ * when the indexer has rewritten the base or added a delta the index and
+ * its doc stores are loaded again, by the query that finds them changed.
+ * Queries already running finish on the old ones, which are freed after
+ * the last of them.
+ *
+ * With -M <file> the counters and latencies of metrics.h are dumped to
+ * the file as JSON on exit, and whenever the querier gets SIGUSR1: the
+ * queries and cache hits, and the time each query spends parsing,
+ * looking up and scoring its words, in the AND and OR of their lists,
+ * selecting and sorting the best docs, pruning with WAND, and fetching
+ * the metadata of its results, as well as in all.
+ *
  */
+#define _POSIX_C_SOURCE 200809L // getline, strtok_r, sockets, SIGUSR1
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
 #include <stdbool.h>
 #include <hash.h>
+#include <queue.h>
 #include <indexio.h>
 #include <pageio.h>
+#include <arena.h>
+#include <docstore.h>
+#include <rank.h>
+#include <cqueue.h>
+#include <rcache.h>
+#include <indexset.h>
+#include <metrics.h>
+
+#define DEFAULT_THREADS 4 /* server threads without -t */
+#define MAX_PENDING 64    /* accepted connections waiting for a thread */
+#define RELOAD_INTERVAL 1 /* seconds between checks of the index files for changes */
+
+/**
+ * @brief the command line options of the querier
+ */
+typedef struct options
+{
+    int k;            /* number of docs to show, or 0 for all */
+    rank_mode_t mode; /* how docs are ranked */
+    char *socket;     /* Unix socket to serve, or NULL */
+    int port;         /* TCP port to serve, or 0 */
+    int threads;      /* number of server threads */
+    long cache_kb;    /* memory cap of the result cache, or 0 for none */
+    char *metrics;    /* file the metrics are exported to, or NULL */
+} options_t;
+
+/**
+ * @brief the metrics of the queries, and of the stages of each query
+ */
+typedef struct query_metrics
+{
+    metric_t *queries;    /* counters */
+    metric_t *cache_hits;
+    metric_t *parse;      /* latencies */
+    metric_t *lookup;
+    metric_t *setops;
+    metric_t *sort;
+    metric_t *wand;
+    metric_t *metadata;
+    metric_t *total;
+} query_metrics_t;
+
+/**
+ * @brief the loaded index and everything derived from it, shared
+ * read-only by all the queries; the options, cache and metrics are
+ * shared by every engine loaded
+ */
+typedef struct engine
+{
+    char *pagedir;
+    char *index_file;
+    options_t opts;
+    uint64_t generation; /* of the index files loaded */
+    int refs;            /* queries using the engine, and the loader */
+    indexset_t *set;    /* the mapped binary index and its deltas, or NULL */
+    hashtable_t *index; /* the loaded text index, used when set is NULL */
+    entry_t **entries;  /* the entries of the text index, sorted by word */
+    int nentries;
+    docmap_t *docs[INDEXSET_MAX]; /* the doc store of each segment, or NULL */
+    int ndocmaps;
+    pagestore_t *pages; /* the crawled pages, when a doc store is missing */
+    doclens_t doclens;
+    ranker_t *ranker; /* NULL when ranking by word count */
+    rcache_t *cache;  /* the result cache, or NULL */
+    query_metrics_t metrics;
+} engine_t;
 
-#define MAX_QUERY_LEN 512
+/**
+ * @brief the latest engine loaded, loaded again when the index changes
+ */
+typedef struct loader
+{
+    pthread_mutex_t lock; /* guards the fields below and the refs of the engines */
+    engine_t *engine;     /* the latest engine */
+    double next_check;    /* when the index files are next checked */
+    bool reloading;       /* a query is checking or loading them */
+} loader_t;
+
+/**
+ * @brief the scratch state of one thread running queries
+ */
+typedef struct session
+{
+    arena_t *scratch;    /* reset after each query */
+    postings_t **stack;  /* evaluation stack */
+    int stack_size;
+} session_t;
+
+/**
+ * @brief a server thread
+ */
+typedef struct worker
+{
+    pthread_t thread;
+    loader_t *loader;
+    cqueue_t *pending; /* accepted connections */
+    session_t session;
+} worker_t;
 
 /**
  * @brief represents a ranked doc with id, ranked word_count and url
@@ -40,19 +207,21 @@ typedef struct doc
 /**
  * Initializes a ranked document
  *
+ * @param scratch the arena of the current query
  * @param id the doc id obtained from the index
  * @param rank the rank of the doc as evaluated from the query
  * @return a pointer to the initialized doc
  */
-static rankedDoc_t *init_doc(int id, int rank);
+static rankedDoc_t *init_doc(arena_t *scratch, int id, int rank);
 
 /**
  * get user input from standard in
  *
- * @param buffer buffer for the input
+ * @param buffer set to a buffer holding the input line, grown as needed
+ * @param size the size of the buffer, updated in place
  * @return -1 if end of file(EOF), 0 if successful
  */
-static int get_input(char *buffer);
+static int get_input(char **buffer, size_t *size);
 
 /**
  * split the query into an array of tokens
@@ -63,14 +232,62 @@ static int get_input(char *buffer);
  */
 static char **tokenize_query(char *query, int *num_tokens);
 
+/**
+ * frees the tokens of a query
+ *
+ * @param tokens the array of tokens
+ * @param count the number of tokens
+ */
+static void free_tokens(char **tokens, int count);
+
 /**
  * Normalizes a word (from the query) by converting to lowercase
  *
  * @param word the query token (string)
- * @return a boolean indicating whether the word is valid (alphabetic)
+ * @return a boolean indicating whether the word is valid (alphabetic,
+ * or a prefix: alphabetic followed by "*")
  */
 static bool NormalizeWord(char *word);
 
+/**
+ * whether a query token is a phrase or a NEAR of two words, the tokens
+ * that need word positions
+ *
+ * @param token the query token
+ * @return true if the token holds several words
+ */
+static bool is_positional(const char *token);
+
+/**
+ * whether a query token is a NEAR/k operator, before tokenize_query joins
+ * it with its words
+ *
+ * @param token the query token
+ * @param k set to the distance allowed, if not NULL
+ * @return true if the token is near/k with k a positive number
+ */
+static bool is_near(const char *token, int *k);
+
+/**
+ * whether a query token is a prefix
+ *
+ * @param token the query token
+ * @return true if the token ends in "*"
+ */
+static bool is_prefix(const char *token);
+
+/**
+ * the words a query token stands for: every indexed word starting with
+ * a prefix, or else the token itself
+ *
+ * @param engine the loaded index
+ * @param scratch the arena of the current query, holding the words
+ * @param token the query token
+ * @param words set to the words, in sorted order
+ * @return the number of words, or -1 on failure
+ */
+static int expand_token(const engine_t *engine, arena_t *scratch, char *token, char ***words);
+
 /**
  * validates query for invalid syntax
  *
@@ -85,9 +302,10 @@ static bool validate_query(char **query, int num_tokens);
  *
  * @param pagedir a pointer to a buffer in which to write crawled pagedir
  * @param indexfile a pointer to a buffer in which to write the index file
+ * @param opts set to the options given
  * @return 0 if successful, -1 if invalid
  */
-static int parse_args(int argc, char *argv[], char **pagedir, char **indexfile);
+static int parse_args(int argc, char *argv[], char **pagedir, char **indexfile, options_t *opts);
 
 /**
  * searches for a query token in the index
@@ -99,102 +317,378 @@ static int parse_args(int argc, char *argv[], char **pagedir, char **indexfile);
 static bool token_searchfn(void *elementp, const void *key);
 
 /**
- * searches for doc in the queue of documents
+ * looks up a query token in the mapped binary index or, for a text
+ * index, in the loaded hashtable
  *
- * @related token_searchfn
+ * @param set the mapped index, or NULL if the index was loaded
+ * @param index the loaded index, used when set is NULL
+ * @param token the token to look up
+ * @return the docs containing the token (decoded from the mapped index,
+ * or a view of the loaded entry); empty if the token is not present
  */
-static bool doc_searchfn(void *elementp, const void *id);
-
-static int comparator(const void *a, const void *b);
+static postings_t *lookup_token(indexset_t *set, hashtable_t *index, const char *token);
 
-static void sort_queue(queue_t **qp);
+/**
+ * replaces the posting list of a query token by its scores
+ *
+ * @param ranker the ranker of the index, or NULL to keep the word counts
+ * @param pp the docs containing the token, freed by the call
+ * @return the scored docs, or NULL on failure
+ */
+static postings_t *score_token(ranker_t *ranker, postings_t *pp);
 
-static void free_doc(rankedDoc_t *dp);
+/**
+ * looks up and scores every word a prefix stands for and unions them,
+ * as an OR of the words would
+ *
+ * @param engine the loaded index
+ * @param scratch the arena of the current query
+ * @param token the prefix
+ * @return the scored docs of the words, or NULL on failure
+ */
+static postings_t *lookup_prefix(const engine_t *engine, arena_t *scratch, char *token);
 
-static void free_queue(queue_t *qp);
+/**
+ * looks up the docs matching a phrase or NEAR token: the docs with all
+ * its words are found first, and only their positions are decoded
+ *
+ * @param engine the loaded index, which must be positional
+ * @param scratch the arena of the current query, holding the positions
+ * @param token the phrase or NEAR token
+ * @return the matching docs, scored as the AND of the words or else
+ * with their number of matches, or NULL on failure
+ */
+static postings_t *lookup_positional(const engine_t *engine, arena_t *scratch, char *token);
 
 /**
- * sets the ranked page url, title and description
+ * sets the ranked page url, title and description, from the doc store
+ * if there is one and otherwise from the crawled page
  *
+ * @param scratch the arena of the current query
  * @param ranked_docs the queue of ranked docs
- * @param pagedir the directory containing crawled pages
+ * @param engine the loaded index, with its doc stores and pages
+ */
+static void get_metadata(arena_t *scratch, queue_t *ranked_docs, const engine_t *engine);
+
+/**
+ * selects the best docs matching a query
+ *
+ * @param scratch the arena of the current query
+ * @param pp the posting list of docs matching the query
+ * @param k the number of docs to keep, or 0 for all of them
+ * @param top set to the selected docs in rank order
+ * @return the number of docs selected, or -1 on failure
+ */
+static int select_top(arena_t *scratch, const postings_t *pp, int k, document_t **top);
+
+/**
+ * whether a query is an OR of words, with no AND
+ *
+ * @param query an array containing the words in the query
+ * @param num_tokens the number of tokens in the query
+ * @return true if every other token is "or"
+ */
+static bool is_disjunction(char **query, int num_tokens);
+
+/**
+ * selects the k best docs of an OR of words straight from the mapped
+ * posting lists, with block-max WAND; a prefix adds all its words
+ *
+ * @param engine the loaded binary index and its ranker
+ * @param scratch the arena of the current query
+ * @param query an array containing the words in the query
+ * @param num_tokens the number of tokens in the query
+ * @param top set to the selected docs in rank order
+ * @return the number of docs selected, or -1 on failure
+ */
+static int select_top_or(const engine_t *engine, arena_t *scratch, char **query, int num_tokens, document_t **top);
+
+/**
+ * the key of a validated query in the result cache: its tokens joined by
+ * single spaces
+ *
+ * @param scratch the arena of the current query
+ * @param query an array containing the words in the query
+ * @param num_tokens the number of tokens in the query
+ * @return the key, or NULL on failure
+ */
+static char *query_key(arena_t *scratch, char **query, int num_tokens);
+
+/**
+ * builds a ranked queue from the selected docs
+ *
+ * @param scratch the arena of the current query
+ * @param top the selected docs in rank order
+ * @param ntop the number of selected docs
+ * @return a pointer to a queue of ranked docs in rank order
+ */
+static queue_t *get_ranked_docs(arena_t *scratch, const document_t *top, int ntop);
+
+/**
+ * pops the top two posting lists off the stack and pushes their
+ * intersection (AND) or union (OR)
+ *
+ * @param stack the evaluation stack
+ * @param top the index of the top of the stack, updated in place
+ * @param intersect true for AND, false for OR
+ * @param scored true if the lists hold scores, which AND adds up
+ * @return 0 if successful, -1 if out of memory, with both lists freed
+ */
+static int reduce_stack(postings_t **stack, int *top, bool intersect, bool scored);
+
+/**
+ * evaluates a query and prints its ranked docs
+ *
+ * @param engine the loaded index
+ * @param sp the scratch state of the calling thread
+ * @param query the raw query, modified by the call
+ * @param out where to print the results
+ * @return 0 if successful, -1 if out of memory
+ */
+static int run_query(const engine_t *engine, session_t *sp, char *query, FILE *out);
+
+/**
+ * loads the index and its doc stores into a new engine holding one
+ * reference, with the options, cache and metrics of shared
+ *
+ * @param shared the engine whose options, cache and metrics are shared
+ * @param generation the generation of the index files, read before they are
+ * @return the engine, or NULL on failure, with an error printed
+ */
+static engine_t *load_engine(const engine_t *shared, uint64_t generation);
+
+/**
+ * frees an engine, or what was loaded of it
+ *
+ * @param engine the engine
+ */
+static void free_engine(engine_t *engine);
+
+/**
+ * takes a reference to the latest engine. At most every RELOAD_INTERVAL
+ * seconds the caller checks the index files first and, if the indexer
+ * has changed them, loads them again; the other queries go on with the
+ * old engine meanwhile, and a failed load is tried again at the next check
+ *
+ * @param loader the loader
+ * @return the engine, to be given back with engine_put
  */
-static void get_metadata(queue_t *ranked_docs, char *pagedir);
+static engine_t *engine_get(loader_t *loader);
 
 /**
- * finds the intersection between two ranked queues
+ * gives back a reference taken by engine_get, freeing an engine that was
+ * replaced once its last query is done
  *
- * @param qp1 the ranked queue
- * @param qp2 the queue of docs containing a token
- * @return a pointer to a queue containing the intersetion
+ * @param loader the loader
+ * @param engine the engine
  */
-static queue_t *get_intersection(queue_t *qp1, queue_t *qp2);
+static void engine_put(loader_t *loader, engine_t *engine);
 
 /**
- * finds the union between two ranked queues in place
- * ie. the result is concatenated into qp1, qp2 is restored to original state
+ * serves queries on the socket given in the options until interrupted
  *
- * @param qp1 the ranked queue
- * @param qp2 the queue of docs containing a token
- * @return a pointer to a queue containing the union
+ * @param loader the loaded index
+ * @param opts the command line options
+ * @return 0 if successful, -1 if the server could not be started
  */
-static queue_t *get_union(queue_t *qp1, queue_t *qp2);
+static int serve(loader_t *loader, const options_t *opts);
+
+/**
+ * creates the listening Unix or TCP socket given in the options
+ *
+ * @param opts the command line options
+ * @return the socket, or -1 on failure
+ */
+static int open_listener(const options_t *opts);
+
+/**
+ * answers the queries of one client, line by line, until it disconnects
+ *
+ * @param loader the loaded index
+ * @param sp the scratch state of the calling thread
+ * @param fd the connected socket, closed by the call
+ */
+static void serve_client(loader_t *loader, session_t *sp, int fd);
+
+/**
+ * server thread: serves the accepted connections until the queue is shut
+ *
+ * @param arg the worker_t of the thread
+ * @return NULL
+ */
+static void *serve_connections(void *arg);
 
 /*************************** MAIN ******************************/
+static volatile sig_atomic_t stopping = 0; /* set by SIGINT and SIGTERM in server mode */
+
 int main(int argc, char *argv[])
 {
     /* use case: query ../pages index < good-queries.txt > output */
-    char *pagedir, *index_file;
-    if (parse_args(argc, argv, &pagedir, &index_file) != 0)
+    char *index_file;
+    engine_t engine;
+    if (parse_args(argc, argv, &engine.pagedir, &index_file, &engine.opts) != 0)
     {
         exit(EXIT_FAILURE);
     }
-    const char *and = "and", * or = "or";
-    hashtable_t *index = indexload(index_file);
-
-    char query[MAX_QUERY_LEN];
-    char **tokenized_query, *token, *curr_operator;
-    int num_tokens, top;
-    entry_t *ep;
-    rankedDoc_t *doc;
-    queue_t *ranked_docs, **stack = NULL, *tmp, *qp1, *qp2;
+    /* before any thread starts, so that they leave SIGUSR1 to the dump */
+    if (engine.opts.metrics && metrics_export(engine.opts.metrics, SIGUSR1) != 0)
+    {
+        fprintf(stderr, "Error: failed to export metrics to '%s'\n", engine.opts.metrics);
+        exit(EXIT_FAILURE);
+    }
+    metrics_thread("main");
+    engine.metrics = (query_metrics_t){
+        metrics_counter("query.queries"), metrics_counter("query.cache_hits"),
+        metrics_histogram("query.parse"), metrics_histogram("query.lookup"),
+        metrics_histogram("query.setops"), metrics_histogram("query.sort"),
+        metrics_histogram("query.wand"), metrics_histogram("query.metadata"),
+        metrics_histogram("query.total")};
+    engine.index_file = index_file;
+    engine.cache = NULL;
+    if (engine.opts.cache_kb > 0 && !(engine.cache = rcache_open((size_t)engine.opts.cache_kb * 1024)))
+    {
+        printf("Error in allocating memory\n");
+        exit(EXIT_FAILURE);
+    }
 
-    while (1)
+    /* the latest engine is swapped in whenever the index files change */
+    uint64_t generation = 0;
+    loader_t loader = {.lock = PTHREAD_MUTEX_INITIALIZER};
+    indexset_generation(index_file, &generation);
+    if (!(loader.engine = load_engine(&engine, generation)))
     {
-        num_tokens = 0;
-        top = -1;
-        curr_operator = "";
+        exit(EXIT_FAILURE);
+    }
+    loader.next_check = metrics_now() + RELOAD_INTERVAL;
 
-        /* get input from stdin */
-        if (get_input(query) != 0)
+    int status = EXIT_SUCCESS;
+    if (engine.opts.socket || engine.opts.port)
+    {
+        if (serve(&loader, &engine.opts) != 0)
         {
-            break;
+            status = EXIT_FAILURE;
         }
-
-        /* no query is entered */
-        if (!query[0])
+    }
+    else
+    {
+        session_t session = {arena_open(0), NULL, 0};
+        char *query = NULL;
+        size_t size = 0;
+        if (!session.scratch)
         {
-            continue;
+            printf("Error in allocating memory\n");
+            exit(EXIT_FAILURE);
         }
 
-        /* get array of tokens from query */
-        tokenized_query = tokenize_query(query, &num_tokens);
-
-        /* validate query */
-        if (!tokenized_query || !validate_query(tokenized_query, num_tokens))
+        /* get input from stdin, one query per line */
+        while (get_input(&query, &size) == 0)
         {
-            for (int i = 0; i < num_tokens; i++)
+            /* no query is entered */
+            if (!query[0])
             {
-                free(tokenized_query[i]);
+                continue;
             }
-            free(tokenized_query);
-            printf("[invalid query]\n");
-            query[0] = '\0';
-            continue;
+            engine_t *ep = engine_get(&loader);
+            int failed = run_query(ep, &session, query, stdout);
+            engine_put(&loader, ep);
+            if (failed != 0)
+            {
+                exit(EXIT_FAILURE);
+            }
+        }
+        free(query);
+        free(session.stack);
+        arena_close(session.scratch);
+    }
+
+    if (engine.cache)
+    {
+        rcache_stats_t stats;
+        rcache_getstats(engine.cache, &stats);
+        fprintf(stderr, "cache: %llu hits, %llu misses, %llu evictions, %llu invalidations\n",
+                (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+                (unsigned long long)stats.evictions, (unsigned long long)stats.invalidations);
+    }
+
+    /* free memory */
+    engine_put(&loader, loader.engine);
+    rcache_close(engine.cache);
+    free(engine.pagedir);
+    free(index_file);
+    exit(status);
+}
+
+/****************************************************************************/
+
+/******************************** FUNCTIONS *********************************/
+static int run_query(const engine_t *engine, session_t *sp, char *query, FILE *out)
+{
+    const char *and = "and", * or = "or";
+    const options_t *opts = &engine->opts;
+    const query_metrics_t *m = &engine->metrics;
+    ranker_t *ranker = engine->ranker;
+    arena_t *scratch = sp->scratch;
+    char **tokenized_query, *token, *curr_operator = "", *key = NULL;
+    int num_tokens = 0, top = -1, ntop = -1, i;
+    document_t *top_docs;
+    rankedDoc_t *doc;
+    queue_t *ranked_docs;
+    postings_t **stack, *tmp;
+    double start = metrics_now(), mark, lookup = 0, setops = 0;
+
+    /* get array of tokens from query */
+    metrics_add(m->queries, 1);
+    tokenized_query = tokenize_query(query, &num_tokens);
+
+    /* validate query */
+    if (!tokenized_query || !validate_query(tokenized_query, num_tokens))
+    {
+        for (i = 0; i < num_tokens; i++)
+        {
+            free(tokenized_query[i]);
         }
+        free(tokenized_query);
+        fprintf(out, "[invalid query]\n");
+        metrics_record(m->total, metrics_now() - start);
+        return 0;
+    }
+    /* phrases and NEAR need the positions of the index */
+    bool positional = false;
+    for (i = 0; i < num_tokens; i++)
+    {
+        positional = positional || is_positional(tokenized_query[i]);
+    }
+    if (positional && !indexset_positional(engine->set))
+    {
+        free_tokens(tokenized_query, num_tokens);
+        fprintf(out, "[phrase and NEAR queries need an index built with indexer -P]\n");
+        metrics_record(m->total, metrics_now() - start);
+        return 0;
+    }
+    metrics_record(m->parse, (mark = metrics_now()) - start);
 
+    /* a repeated query takes its docs from the cache */
+    if (engine->cache && (key = query_key(scratch, tokenized_query, num_tokens)))
+    {
+        ntop = rcache_get(engine->cache, engine->generation, key, scratch, &top_docs);
+    }
+
+    if (ntop >= 0)
+    {
+        key = NULL;
+        metrics_add(m->cache_hits, 1);
+    }
+    else if (engine->set && ranker && opts->k > 0 && is_disjunction(tokenized_query, num_tokens))
+    {
+        /* an OR of words is pruned with block-max WAND */
+        mark = metrics_now();
+        ntop = select_top_or(engine, scratch, tokenized_query, num_tokens, &top_docs);
+        metrics_record(m->wand, metrics_now() - mark);
+    }
+    else
+    {
         /* process tokens in Backus-Naur Form */
-        for (int i = 0; i < num_tokens; i++)
+        for (i = 0; i < num_tokens; i++)
         {
             token = tokenized_query[i];
 
@@ -205,135 +699,606 @@ int main(int argc, char *argv[])
                 continue;
             }
 
-            ep = hsearch(index, token_searchfn, token, strlen(token));
-            tmp = qopen();
-            if (ep)
-            { // if token is present in index push its queue
-                tmp = get_union(tmp, ep->documents);
+            mark = metrics_now();
+            tmp = is_positional(token) ? lookup_positional(engine, scratch, token)
+                  : is_prefix(token)   ? lookup_prefix(engine, scratch, token)
+                                       : score_token(ranker, lookup_token(engine->set, engine->index, token));
+            lookup += metrics_now() - mark;
+            if (!tmp)
+            {
+                break;
+            }
+            if (top + 1 == sp->stack_size)
+            {
+                if (!(stack = realloc(sp->stack, sizeof(postings_t *) * (sp->stack_size + 1))))
+                {
+                    postings_free(tmp);
+                    break;
+                }
+                sp->stack = stack;
+                sp->stack_size++;
+            }
+            sp->stack[++top] = tmp;
+
+            /* if last operator is and, get intersect of prev two lists in stack */
+            mark = metrics_now();
+            if (strcmp(curr_operator, and) == 0 && reduce_stack(sp->stack, &top, true, ranker != NULL) != 0)
+            {
+                break;
+            }
+            setops += metrics_now() - mark;
+        }
+
+        /* union everything left in the stack */
+        mark = metrics_now();
+        while (i == num_tokens && top > 0)
+        {
+            if (reduce_stack(sp->stack, &top, false, ranker != NULL) != 0)
+            {
+                break;
             }
-            stack = (queue_t **)realloc(stack, sizeof(queue_t *) * (top + 2));
-            stack[++top] = tmp;
+        }
+        metrics_record(m->lookup, lookup);
+        metrics_record(m->setops, setops + metrics_now() - mark);
+        if (i == num_tokens && top == 0)
+        {
+            mark = metrics_now();
+            ntop = select_top(scratch, sp->stack[top], opts->k, &top_docs);
+            metrics_record(m->sort, metrics_now() - mark);
+        }
+        while (top >= 0)
+        {
+            postings_free(sp->stack[top--]);
+        }
+    }
+    if (key && ntop >= 0)
+    {
+        rcache_put(engine->cache, engine->generation, key, top_docs, ntop);
+    }
+    for (i = 0; i < num_tokens; i++)
+    {
+        free(tokenized_query[i]);
+    }
+    free(tokenized_query);
+    mark = metrics_now();
+    if (ntop < 0 || !(ranked_docs = get_ranked_docs(scratch, top_docs, ntop)))
+    {
+        fprintf(out, "Error in allocating memory\n");
+        arena_reset(scratch);
+        return -1;
+    }
+
+    /* set metadata -> url, title, content */
+    get_metadata(scratch, ranked_docs, engine);
+    metrics_record(m->metadata, metrics_now() - mark);
+
+    /* print docs' rank & url */
+    while ((doc = qget(ranked_docs)))
+    {
+        if (ranker)
+        {
+            fprintf(out, "title: %s\nrank:%.3f doc:%d : %s\n", doc->title, (double)doc->word_count / RANK_SCALE, doc->id, doc->url);
+        }
+        else
+        {
+            fprintf(out, "title: %s\nrank:%d doc:%d : %s\n", doc->title, doc->word_count, doc->id, doc->url);
+        }
+        fprintf(out, "%s...\n\n", doc->content);
+    }
+    arena_reset(scratch);
+    metrics_record(m->total, metrics_now() - start);
+    return 0;
+}
+
+static engine_t *load_engine(const engine_t *shared, uint64_t generation)
+{
+    engine_t *engine = calloc(1, sizeof(engine_t));
+    if (!engine)
+    {
+        printf("Error in allocating memory\n");
+        return NULL;
+    }
+    engine->pagedir = shared->pagedir;
+    engine->index_file = shared->index_file;
+    engine->opts = shared->opts;
+    engine->cache = shared->cache;
+    engine->metrics = shared->metrics;
+    engine->generation = generation;
+    engine->refs = 1;
+
+    /* map a binary index in place; fall back to loading a text index */
+    engine->set = indexset_open(engine->index_file);
+    engine->index = engine->set ? NULL : indexload(engine->index_file);
+    if (!engine->set && !engine->index)
+    {
+        fprintf(stderr, "Error: failed to load index '%s'\n", engine->index_file);
+        free_engine(engine);
+        return NULL;
+    }
+    if (engine->index && !(engine->entries = index_sorted(engine->index, &engine->nentries)))
+    {
+        printf("Error in allocating memory\n");
+        free_engine(engine);
+        return NULL;
+    }
+
+    /* scoring needs the document lengths: stored in a binary index, summed for a text one */
+    if (engine->opts.mode != RANK_COUNT)
+    {
+        if ((engine->set ? indexset_doclens(engine->set, &engine->doclens) : index_doclens(engine->index, &engine->doclens)) != 0 ||
+            !(engine->ranker = ranker_open(engine->opts.mode, &engine->doclens)))
+        {
+            printf("Error in allocating memory\n");
+            free_engine(engine);
+            return NULL;
+        }
+    }
+
+    /* metadata comes from the doc store the indexer saved with each segment */
+    bool missing = false;
+    engine->ndocmaps = engine->set ? indexset_count(engine->set) : 1;
+    for (int i = 0; i < engine->ndocmaps; i++)
+    {
+        const char *name = engine->set ? indexset_name(engine->set, i) : engine->index_file;
+        char docs_file[strlen(name) + strlen(DOCSTORE_SUFFIX) + 1];
+        sprintf(docs_file, "%s%s", name, DOCSTORE_SUFFIX);
+        missing |= !(engine->docs[i] = docmap_open(docs_file));
+    }
+    engine->pages = missing ? pagestore_open(engine->pagedir) : NULL;
+    if (missing && !engine->pages)
+    {
+        fprintf(stderr, "Error: failed to open pagedir '%s'\n", engine->pagedir);
+        free_engine(engine);
+        return NULL;
+    }
+    return engine;
+}
+
+static void free_engine(engine_t *engine)
+{
+    for (int i = 0; i < engine->ndocmaps; i++)
+    {
+        docmap_close(engine->docs[i]);
+    }
+    pagestore_close(engine->pages);
+    ranker_close(engine->ranker);
+    doclens_clear(&engine->doclens);
+    if (engine->set)
+    {
+        indexset_close(engine->set);
+    }
+    else if (engine->index)
+    {
+        free(engine->entries);
+        free_entries(engine->index);
+        hclose(engine->index);
+    }
+    free(engine);
+}
+
+static engine_t *engine_get(loader_t *loader)
+{
+    double now = metrics_now();
+    engine_t *engine, *loaded = NULL, *replaced = NULL;
+    uint64_t generation;
+
+    pthread_mutex_lock(&loader->lock);
+    bool check = !loader->reloading && now >= loader->next_check;
+    if (check)
+    {
+        loader->reloading = true;
+        loader->next_check = now + RELOAD_INTERVAL;
+    }
+    engine = loader->engine;
+    pthread_mutex_unlock(&loader->lock);
+
+    /* only the checking query replaces the engine, so it stays loaded meanwhile */
+    if (check && indexset_generation(engine->index_file, &generation) == 0 && generation != engine->generation)
+    {
+        loaded = load_engine(engine, generation);
+    }
+
+    pthread_mutex_lock(&loader->lock);
+    if (check)
+    {
+        loader->reloading = false;
+    }
+    if (loaded)
+    {
+        /* the queries still running on the old engine free it when done */
+        replaced = loader->engine;
+        loader->engine = loaded;
+        if (--replaced->refs > 0)
+        {
+            replaced = NULL;
+        }
+    }
+    engine = loader->engine;
+    engine->refs++;
+    pthread_mutex_unlock(&loader->lock);
+    if (replaced)
+    {
+        free_engine(replaced);
+    }
+    return engine;
+}
+
+static void engine_put(loader_t *loader, engine_t *engine)
+{
+    pthread_mutex_lock(&loader->lock);
+    bool last = --engine->refs == 0;
+    pthread_mutex_unlock(&loader->lock);
+    if (last)
+    {
+        free_engine(engine);
+    }
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stopping = 1;
+}
+
+static int serve(loader_t *loader, const options_t *opts)
+{
+    int listener = open_listener(opts), fd, *fdp, started = 0;
+    cqueue_t *pending = cqopen(MAX_PENDING);
+    worker_t *workers = calloc(opts->threads, sizeof(worker_t));
+    if (listener < 0 || !pending || !workers)
+    {
+        if (listener >= 0)
+            close(listener);
+        cqclose(pending);
+        free(workers);
+        return -1;
+    }
+
+    /* a client hanging up must not kill the server; a signal interrupts accept */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, NULL);
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    for (; started < opts->threads; started++)
+    {
+        worker_t *wp = &workers[started];
+        wp->loader = loader;
+        wp->pending = pending;
+        if (!(wp->session.scratch = arena_open(0)) ||
+            pthread_create(&wp->thread, NULL, serve_connections, wp) != 0)
+        {
+            fprintf(stderr, "Error: failed to start server thread\n");
+            arena_close(wp->session.scratch);
+            stopping = 1;
+            break;
+        }
+    }
 
-            /* if last operator is and, get intersect of prev two queues in stack */
-            if (strcmp(curr_operator, and) == 0)
+    while (!stopping)
+    {
+        if ((fd = accept(listener, NULL, NULL)) < 0)
+        {
+            if (errno != EINTR && errno != ECONNABORTED)
             {
-                qp1 = stack[top--];
-                qp2 = stack[top--];
-                stack[++top] = get_intersection(qp1, qp2);
+                perror("accept");
+                break;
             }
+            continue;
+        }
+        if (!(fdp = malloc(sizeof(int))))
+        {
+            close(fd);
+            continue;
+        }
+        *fdp = fd;
+        if (cqput(pending, fdp) != 0)
+        {
+            close(fd);
+            free(fdp);
+        }
+    }
+
+    /* let the threads finish the connections already accepted */
+    cqshut(pending);
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        free(workers[i].session.stack);
+        arena_close(workers[i].session.scratch);
+    }
+    close(listener);
+    if (opts->socket)
+    {
+        unlink(opts->socket);
+    }
+    cqclose(pending);
+    free(workers);
+    return started == opts->threads ? 0 : -1;
+}
+
+static int open_listener(const options_t *opts)
+{
+    int fd;
+    if (opts->socket)
+    {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(opts->socket) >= sizeof(addr.sun_path))
+        {
+            fprintf(stderr, "Error: socket path '%s' is too long\n", opts->socket);
+            return -1;
         }
+        strcpy(addr.sun_path, opts->socket);
+        unlink(opts->socket);
+        if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+            bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0)
+        {
+            perror(opts->socket);
+            if (fd >= 0)
+                close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    struct sockaddr_in addr;
+    int on = 1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(opts->port);
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 ||
+        bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0)
+    {
+        perror("listen");
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void *serve_connections(void *arg)
+{
+    worker_t *wp = (worker_t *)arg;
+    int *fdp;
+    metrics_thread("serve");
+    while ((fdp = cqget(wp->pending)))
+    {
+        serve_client(wp->loader, &wp->session, *fdp);
+        free(fdp);
+    }
+    return NULL;
+}
+
+static void serve_client(loader_t *loader, session_t *sp, int fd)
+{
+    int out_fd = dup(fd);
+    FILE *in = fdopen(fd, "r"), *out = out_fd < 0 ? NULL : fdopen(out_fd, "w");
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    if (!in || !out)
+    {
+        if (in)
+            fclose(in);
+        else
+            close(fd);
+        if (out)
+            fclose(out);
+        else if (out_fd >= 0)
+            close(out_fd);
+        return;
+    }
 
-        /* union everything left in the stack */
-        while (top > 0)
+    while ((len = getline(&line, &size, in)) > 0)
+    {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
         {
-            qp1 = stack[top--];
-            qp2 = stack[top--];
-            stack[++top] = get_union(qp1, qp2);
-            free_queue(qp2);
+            line[--len] = '\0';
         }
-        ranked_docs = stack[top];
-
-        /* set metadata -> url, title, content */
-        get_metadata(ranked_docs, pagedir);
-
-        /* sort ranked docs */
-        sort_queue(ranked_docs);
-
-        /* print docs' rank & url */
-        while ((doc = qget(ranked_docs)))
+        if (line[0])
         {
-            printf("title: %s\nrank:%d doc:%d : %s\n", doc->title, doc->word_count, doc->id, doc->url);
-            printf("%s...\n\n", doc->content);
-            free_doc(doc);
+            engine_t *engine = engine_get(loader);
+            run_query(engine, sp, line, out);
+            engine_put(loader, engine);
         }
-
-        /* free memory */
-        for (int i = 0; i < num_tokens; i++)
+        /* end of the answer */
+        if (fputs(".\n", out) == EOF || fflush(out) != 0)
         {
-            free(tokenized_query[i]);
+            break;
         }
-        free(tokenized_query);
-        free_queue(ranked_docs);
     }
-
-    /* free memory */
-    free(stack);
-    free_entries(index);
-    hclose(index);
-    free(pagedir);
-    free(index_file);
-    exit(EXIT_SUCCESS);
+    free(line);
+    fclose(out);
+    fclose(in);
 }
 
-/****************************************************************************/
-
-/******************************** FUNCTIONS *********************************/
-static int get_input(char *buffer)
+static int get_input(char **buffer, size_t *size)
 {
-    if (!buffer)
+    ssize_t len;
+    if (!buffer || !size)
         return 1;
-    buffer[0] = '\0';
     printf("> ");
-    if (scanf("%[^\n]", buffer) == EOF)
+    if ((len = getline(buffer, size, stdin)) < 0)
     {
         printf("\n");
         return -1;
     }
-    getchar(); // strip newline character
+    if (len > 0 && (*buffer)[len - 1] == '\n')
+    {
+        (*buffer)[len - 1] = '\0'; // strip newline character
+    }
     return 0;
 }
 
-static char **tokenize_query(char *query, int *num_tokens)
+/* whether a token is an operator, which takes no implicit "and" */
+static bool is_operator(const char *token)
+{
+    return strcmp(token, "and") == 0 || strcmp(token, "or") == 0 || is_near(token, NULL);
+}
+
+static void free_tokens(char **tokens, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        free(tokens[i]);
+    }
+    free(tokens);
+}
+
+/* appends a copy of token, after an implicit "and" if it needs one */
+static bool push_token(char ***tokens, int *count, const char *token)
+{
+    bool implicit_and = *count > 0 && !is_operator((*tokens)[*count - 1]) && !is_operator(token);
+    char **grown = realloc(*tokens, (*count + 2) * sizeof(char *));
+    if (!grown)
+        return false;
+    *tokens = grown;
+    if (implicit_and)
+    {
+        if (!(grown[*count] = strdup("and")))
+            return false;
+        (*count)++;
+    }
+    if (!(grown[*count] = strdup(token)))
+        return false;
+    (*count)++;
+    return true;
+}
+
+/* joins each NEAR/k with the words either side of it into one token */
+static bool join_near(char **tokens, int *count)
 {
-    char **tokenized_query = NULL, *prev_token = NULL;
-    char *token = strtok(query, " \t");
-    int count = 0;
-    while (token)
+    int n = 0, i;
+    for (i = 0; i < *count; i++)
     {
-        if (!NormalizeWord(token))
+        if (!is_near(tokens[i], NULL))
         {
-            /* free memory */
-            for (int i = 0; i < count; i++)
-            {
-                free(tokenized_query[i]);
-            }
-            free(tokenized_query);
-            return NULL;
+            tokens[n++] = tokens[i];
+            continue;
+        }
+        char *left = n > 0 ? tokens[n - 1] : NULL, *right = i + 1 < *count ? tokens[i + 1] : NULL;
+        if (!left || !right || is_operator(left) || is_operator(right) || is_positional(left) ||
+            is_positional(right) || is_prefix(left) || is_prefix(right))
+        {
+            break;
+        }
+        char *joined = malloc(strlen(left) + strlen(tokens[i]) + strlen(right) + 3);
+        if (!joined)
+        {
+            break;
+        }
+        sprintf(joined, "%s %s %s", left, tokens[i], right);
+        free(left);
+        free(tokens[i]);
+        free(right);
+        tokens[n - 1] = joined;
+        i++;
+    }
+    if (i < *count)
+    {
+        /* free what was not moved, and leave count at what was */
+        for (int j = i; j < *count; j++)
+        {
+            free(tokens[j]);
         }
+        *count = n;
+        return false;
+    }
+    *count = n;
+    return true;
+}
 
-        if (strlen(token) < 3 && strcmp(token, "or") != 0)
+static char **tokenize_query(char *query, int *num_tokens)
+{
+    char **tokenized_query = NULL, *phrase = NULL, near[32];
+    size_t size = strlen(query) + 3;
+    char *save, *token = strtok_r(query, " \t", &save);
+    int count = 0, nwords = 0, k;
+    bool in_phrase = false, valid = true;
+    for (; valid && token; token = strtok_r(NULL, " \t", &save))
+    {
+        size_t len = strlen(token);
+        bool opens = !in_phrase && token[0] == '"', closes;
+        if (opens)
         {
-            token = strtok(NULL, " \t");
-            continue;
+            token++;
+            len--;
+            in_phrase = true;
+            nwords = 0;
+            if (!phrase && !(phrase = malloc(size)))
+            {
+                valid = false;
+                break;
+            }
+            strcpy(phrase, "\"");
         }
-        if (prev_token && strcmp(prev_token, "and") != 0 && strcmp(prev_token, "or") != 0)
+        if (!in_phrase)
         {
-            // insert an implicit "and" before the current token
-            if (strcmp(token, "and") != 0 && strcmp(token, "or") != 0)
+            if (is_near(token, &k))
+            {
+                snprintf(near, sizeof(near), "near/%d", k);
+                valid = push_token(&tokenized_query, &count, near);
+            }
+            else if (!NormalizeWord(token))
+            {
+                valid = false;
+            }
+            else if (strlen(token) - is_prefix(token) >= 3 || strcmp(token, "or") == 0)
             {
-                tokenized_query = realloc(tokenized_query, (count + 1) * sizeof(char *));
-                tokenized_query[count] = malloc(strlen("and") + 1);
-                strcpy(tokenized_query[count], "and");
-                count++;
+                valid = push_token(&tokenized_query, &count, token);
             }
+            continue;
         }
 
-        tokenized_query = realloc(tokenized_query, (count + 1) * sizeof(char *));
-        tokenized_query[count] = malloc(strlen(token) + 1);
-        strcpy(tokenized_query[count], token);
-        prev_token = token;
-        token = strtok(NULL, " \t");
-        count++;
+        /* a phrase gathers its words, which may not be prefixes */
+        if ((closes = len > 0 && token[len - 1] == '"'))
+        {
+            token[--len] = '\0';
+        }
+        if (len > 0 && (!NormalizeWord(token) || is_prefix(token)))
+        {
+            valid = false;
+        }
+        else if (len >= 3)
+        {
+            if (nwords++ > 0)
+                strcat(phrase, " ");
+            strcat(phrase, token);
+        }
+        if (valid && closes)
+        {
+            /* a phrase of one word is just the word */
+            in_phrase = false;
+            if (nwords > 1)
+                valid = push_token(&tokenized_query, &count, strcat(phrase, "\""));
+            else if (nwords == 1)
+                valid = push_token(&tokenized_query, &count, phrase + 1);
+        }
     }
+    free(phrase);
 
+    /* an unclosed phrase, or a NEAR not between two words, is invalid */
+    if (!valid || in_phrase || !join_near(tokenized_query, &count))
+    {
+        free_tokens(tokenized_query, count);
+        return NULL;
+    }
     *num_tokens = count;
     return tokenized_query;
 }
 
-static rankedDoc_t *init_doc(int id, int rank)
+static rankedDoc_t *init_doc(arena_t *scratch, int id, int rank)
 {
     rankedDoc_t *doc;
-    if (!(doc = (rankedDoc_t *)malloc(sizeof(rankedDoc_t))))
+    if (!(doc = (rankedDoc_t *)arena_alloc(scratch, sizeof(rankedDoc_t))))
     {
         printf("Error in allocating memory\n");
         return NULL;
@@ -354,6 +1319,10 @@ static bool NormalizeWord(char *word)
     int i;
     for (i = 0; i < len; i++)
     {
+        if (word[i] == '*' && i > 0 && i == len - 1)
+        {
+            continue;
+        }
         if (!isalpha(word[i]))
         {
             return false;
@@ -363,6 +1332,65 @@ static bool NormalizeWord(char *word)
     return true;
 }
 
+static bool is_positional(const char *token)
+{
+    return strchr(token, ' ') != NULL;
+}
+
+static bool is_near(const char *token, int *k)
+{
+    char *end;
+    if (strncasecmp(token, "near/", 5) != 0 || !isdigit((unsigned char)token[5]))
+        return false;
+    long distance = strtol(token + 5, &end, 10);
+    if (*end != '\0' || distance < 1 || distance > INT32_MAX)
+        return false;
+    if (k)
+        *k = distance;
+    return true;
+}
+
+static bool is_prefix(const char *token)
+{
+    size_t len = strlen(token);
+    return len > 0 && token[len - 1] == '*';
+}
+
+static int expand_token(const engine_t *engine, arena_t *scratch, char *token, char ***words)
+{
+    if (!is_prefix(token))
+    {
+        if (!(*words = arena_alloc(scratch, sizeof(char *))))
+            return -1;
+        (*words)[0] = token;
+        return 1;
+    }
+    char *prefix = arena_strndup(scratch, token, strlen(token) - 1);
+    if (!prefix)
+        return -1;
+    if (engine->set)
+        return indexset_expand(engine->set, prefix, scratch, words);
+
+    /* the entries from the first word not below the prefix on */
+    size_t len = strlen(prefix);
+    int lo = 0, hi = engine->nentries, n = 0;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (strcmp(engine->entries[mid]->word, prefix) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    while (lo + n < engine->nentries && strncmp(engine->entries[lo + n]->word, prefix, len) == 0)
+        n++;
+    if (!(*words = arena_alloc(scratch, (n ? n : 1) * sizeof(char *))))
+        return -1;
+    for (int i = 0; i < n; i++)
+        (*words)[i] = engine->entries[lo + i]->word;
+    return n;
+}
+
 static bool validate_query(char **query, int num_tokens)
 {
     if (strcmp(query[0], "and") == 0 || strcmp(query[0], "or") == 0 ||
@@ -387,118 +1415,153 @@ static bool validate_query(char **query, int num_tokens)
     return true;
 }
 
-static queue_t *get_intersection(queue_t *qp1, queue_t *qp2)
+static int select_top(arena_t *scratch, const postings_t *pp, int k, document_t **top)
 {
-    queue_t *intersect = qopen();
-    if (!qp1 || !qp2 || !intersect)
-        return NULL;
-    // document_t *doc;
-    rankedDoc_t *dp, *doc;
-    int word_count, rank;
-    while ((doc = qget(qp1)))
+    if (k <= 0 || k > pp->ndocs)
+        k = pp->ndocs;
+    *top = NULL;
+    if (k == 0)
+        return 0;
+    if (!(*top = arena_alloc(scratch, k * sizeof(document_t))))
+        return -1;
+    return postings_topk(pp, k, *top);
+}
+
+static bool is_disjunction(char **query, int num_tokens)
+{
+    for (int i = 1; i < num_tokens; i += 2)
+    {
+        if (strcmp(query[i], "or") != 0)
+            return false;
+    }
+    for (int i = 0; i < num_tokens; i += 2)
     {
-        if ((dp = qsearch(qp2, doc_searchfn, &(doc->id))))
+        if (is_positional(query[i]))
+            return false;
+    }
+    return num_tokens % 2 == 1;
+}
+
+static int select_top_or(const engine_t *engine, arena_t *scratch, char **query, int num_tokens, document_t **top)
+{
+    int ntokens = num_tokens / 2 + 1, nwords = 0, ncursors = 0, k = engine->opts.k;
+    int counts[ntokens];
+    char **words[ntokens];
+    for (int i = 0; i < ntokens; i++)
+    {
+        if ((counts[i] = expand_token(engine, scratch, query[2 * i], &words[i])) < 0)
+            return -1;
+        nwords += counts[i];
+    }
+
+    /* a word has a cursor in each segment holding it, all weighted by its total df */
+    int max = nwords * indexset_count(engine->set);
+    pcursor_t *cursors = arena_alloc(scratch, (max ? max : 1) * sizeof(pcursor_t));
+    int *dfs = arena_alloc(scratch, (max ? max : 1) * sizeof(int));
+    if (!cursors || !dfs || !(*top = arena_alloc(scratch, k * sizeof(document_t))))
+        return -1;
+    for (int i = 0; i < ntokens; i++)
+    {
+        for (int j = 0; j < counts[i]; j++)
         {
-            word_count = dp->word_count;
-            rank = doc->word_count;
-            doc->word_count = word_count < rank ? word_count : rank;
-            qput(intersect, doc);
+            /* words that are not in the index add nothing */
+            int df, n = indexset_cursors(engine->set, words[i][j], &cursors[ncursors], &df);
+            while (n-- > 0)
+                dfs[ncursors++] = df;
         }
-        else
-            free_doc(doc);
     }
-    qclose(qp1);
-    free_queue(qp2);
-    // qclose(qp2);
-    return intersect;
+    return ranker_topk_or(engine->ranker, cursors, dfs, ncursors, k, *top);
 }
 
-static queue_t *get_union(queue_t *qp1, queue_t *qp2)
+static char *query_key(arena_t *scratch, char **query, int num_tokens)
 {
-    queue_t *tmp = qopen();
-    if (!qp1 || !qp2 || !tmp)
+    size_t len = 0;
+    for (int i = 0; i < num_tokens; i++)
+    {
+        len += strlen(query[i]) + 1;
+    }
+    char *key = arena_alloc(scratch, len), *end = key;
+    if (!key)
         return NULL;
-    document_t *dp;
-    rankedDoc_t *doc;
-    int word_count, rank;
-    while ((dp = qget(qp2)))
+    for (int i = 0; i < num_tokens; i++)
     {
-        word_count = dp->word_count;
-        if ((doc = qsearch(qp1, doc_searchfn, &(dp->id))))
-        {
-            rank = doc->word_count;
-            doc->word_count = rank + word_count;
-        }
-        else
-        {
-            doc = init_doc(dp->id, word_count);
-            qput(qp1, doc);
-        }
-        qput(tmp, dp);
+        end = stpcpy(end, query[i]);
+        *end++ = ' ';
     }
+    end[-1] = '\0';
+    return key;
+}
 
-    // restore qp2
-    while ((dp = qget(tmp)))
-        qput(qp2, dp);
-    qclose(tmp);
-    return qp1;
+static queue_t *get_ranked_docs(arena_t *scratch, const document_t *top, int ntop)
+{
+    queue_t *qp = qopen_arena(scratch);
+    rankedDoc_t *dp;
+    if (!qp)
+        return NULL;
+    for (int i = 0; i < ntop; i++)
+    {
+        if (!(dp = init_doc(scratch, top[i].id, top[i].word_count)) || qput(qp, dp) != 0)
+            return NULL;
+    }
+    return qp;
+}
+
+static int reduce_stack(postings_t **stack, int *top, bool intersect, bool scored)
+{
+    postings_t *pp1 = stack[(*top)--];
+    postings_t *pp2 = stack[(*top)--];
+    postings_t *result;
+    if (intersect)
+    {
+        result = scored ? postings_intersect_sum(pp2, pp1) : postings_intersect(pp2, pp1);
+    }
+    else
+    {
+        result = postings_union(pp2, pp1);
+    }
+    postings_free(pp1);
+    postings_free(pp2);
+    if (!result)
+    {
+        return -1;
+    }
+    stack[++(*top)] = result;
+    return 0;
 }
 
-static void get_metadata(queue_t *ranked_docs, char *pagedir)
+static void get_metadata(arena_t *scratch, queue_t *ranked_docs, const engine_t *engine)
 {
     rankedDoc_t *dp;
-    queue_t *tmp = qopen();
-    int id, len;
+    queue_t *tmp = qopen_arena(scratch);
     webpage_t *page;
-    char *url, *html, *start, *end, *content;
+    docmeta_t meta;
+    bool found;
     while ((dp = qget(ranked_docs)))
     {
-        id = dp->id;
-        if ((page = pageload(id, pagedir)))
+        page = NULL;
+        found = false;
+        for (int i = 0; i < engine->ndocmaps && !found; i++)
+        {
+            found = docmap_get(engine->docs[i], dp->id, &meta);
+        }
+        if (!found && engine->pages)
+        {
+            found = (page = pagestore_load(engine->pages, dp->id)) != NULL;
+        }
+        if (found)
         {
-            url = webpage_getURL(page);
-            html = webpage_getHTML(page);
-            if ((dp->url = malloc(strlen(url) + 1)))
+            if (page)
             {
-                strcpy(dp->url, url);
+                docmeta_extract(page, &meta);
             }
-            start = strstr(html, "<title>");
-            if (start != NULL)
+            dp->url = arena_strndup(scratch, meta.url, meta.url_len);
+            if (meta.title)
             {
-                end = strstr(start, "</title>");
-                if (end != NULL)
-                {
-                    len = end - start - strlen("<title>");
-                    if ((dp->title = malloc(len + 1)))
-                    {
-                        strncpy(dp->title, start + strlen("<title>"), len);
-                        dp->title[len] = '\0';
-                    }
-                }
+                dp->title = arena_strndup(scratch, meta.title, meta.title_len);
             }
-            start = NULL, end = NULL;
-            start = strstr(html, "<meta name=\"description\"");
-            if (start != NULL)
+            if (meta.snippet)
             {
-                content = strstr(start, "content=\"");
-                if (content != NULL)
-                {
-                    content += strlen("content=\"");
-                    end = strchr(content, '\"');
-                    if (end != NULL)
-                    {
-                        int len = (int)(end - content);
-                        if (len > 128)
-                        {
-                            len = 128;
-                        }
-                        if ((dp->content = malloc(len + 1)))
-                        {
-                            strncpy(dp->content, content, len);
-                            dp->content[len] = '\0';
-                        }
-                    }
-                }
+                dp->content = arena_strndup(scratch, meta.snippet, meta.snippet_len);
             }
         }
         qput(tmp, dp);
@@ -510,16 +1573,74 @@ static void get_metadata(queue_t *ranked_docs, char *pagedir)
     qclose(tmp);
 }
 
-static int parse_args(int argc, char *argv[], char **pagedir, char **indexfile)
+static int parse_args(int argc, char *argv[], char **pagedir, char **indexfile, options_t *opts)
 {
-    if (argc < 3 || argc > 4)
+    char *end;
+    opts->k = 0;
+    opts->mode = RANK_COUNT;
+    opts->socket = NULL;
+    opts->port = 0;
+    opts->threads = DEFAULT_THREADS;
+    opts->cache_kb = 0;
+    opts->metrics = NULL;
+    if (argc < 3)
     {
-        fprintf(stderr, "usage: query <pageDirectory> <indexFile> [-q]\n");
+        fprintf(stderr, "usage: query <pageDirectory> <indexFile> [-q] [-k <n>] [-r count|tfidf|bm25] [-s <socketPath> | -p <port>] [-t <threads>] [-c <kilobytes>] [-M <file>]\n");
         return -1;
     }
-    if (argc == 4 && strcmp(argv[3], "-q") != 0)
+    for (int i = 3; i < argc; i++)
     {
-        fprintf(stderr, "usage: query <pageDirectory> <indexFile> [-q]\n");
+        if (strcmp(argv[i], "-q") == 0)
+        {
+            continue;
+        }
+        if (strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+        {
+            opts->k = (int)strtol(argv[++i], &end, 10);
+            if (*end == '\0' && opts->k > 0)
+            {
+                continue;
+            }
+        }
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc && rank_parse(argv[++i], &opts->mode) == 0)
+        {
+            continue;
+        }
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc && !opts->port)
+        {
+            opts->socket = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc && !opts->socket)
+        {
+            opts->port = (int)strtol(argv[++i], &end, 10);
+            if (*end == '\0' && opts->port > 0 && opts->port < 65536)
+            {
+                continue;
+            }
+        }
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+        {
+            opts->cache_kb = strtol(argv[++i], &end, 10);
+            if (*end == '\0' && opts->cache_kb > 0)
+            {
+                continue;
+            }
+        }
+        if (strcmp(argv[i], "-M") == 0 && i + 1 < argc)
+        {
+            opts->metrics = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            opts->threads = (int)strtol(argv[++i], &end, 10);
+            if (*end == '\0' && opts->threads > 0)
+            {
+                continue;
+            }
+        }
+        fprintf(stderr, "usage: query <pageDirectory> <indexFile> [-q] [-k <n>] [-r count|tfidf|bm25] [-s <socketPath> | -p <port>] [-t <threads>] [-c <kilobytes>] [-M <file>]\n");
         return -1;
     }
     if (!(*pagedir = malloc(strlen(argv[1]) + 1)))
@@ -572,75 +1693,175 @@ static bool token_searchfn(void *elementp, const void *key)
     return strcmp(ep->word, (char *)key) == 0;
 }
 
-static bool doc_searchfn(void *elementp, const void *id)
+static postings_t *lookup_token(indexset_t *set, hashtable_t *index, const char *token)
 {
-    rankedDoc_t *dp = (rankedDoc_t *)elementp;
-    return dp->id == *((int *)id);
+    if (set)
+    {
+        postings_t *pp = postings_new();
+        if (pp && !indexset_lookup(set, token, pp))
+        {
+            pp->ndocs = 0;
+        }
+        return pp;
+    }
+    entry_t *ep = hsearch(index, token_searchfn, token, strlen(token));
+    return ep ? postings_view(ep->documents.docs, ep->documents.ndocs) : postings_new();
 }
 
-static int comparator(const void *a, const void *b)
+static postings_t *score_token(ranker_t *ranker, postings_t *pp)
 {
-    const rankedDoc_t *doc_a = *(const rankedDoc_t **)a;
-    const rankedDoc_t *doc_b = *(const rankedDoc_t **)b;
-    if (doc_a->word_count < doc_b->word_count)
-    {
-        return 1;
-    }
-    else if (doc_a->word_count > doc_b->word_count)
+    if (!ranker || !pp)
     {
-        return -1;
-    }
-    else
-    {
-        return 0;
+        return pp;
     }
+    postings_t *scored = ranker_score(ranker, pp);
+    postings_free(pp);
+    return scored;
 }
 
-static void sort_queue(queue_t **qp)
+static postings_t *lookup_prefix(const engine_t *engine, arena_t *scratch, char *token)
 {
-    queue_t **tmp = NULL;
-    int count = 0;
-
-    // loop through the queue, adding each document to the array
-    rankedDoc_t *doc;
-    while ((doc = (rankedDoc_t *)qget(qp)) != NULL)
+    char **words;
+    int n = expand_token(engine, scratch, token, &words);
+    postings_t *acc = n >= 0 ? postings_new() : NULL, *pp, *merged;
+    for (int i = 0; acc && i < n; i++)
     {
-        // resize the array to hold another element
-        count++;
-        tmp = realloc(tmp, count * sizeof(rankedDoc_t *));
-
-        // add the document to the end of the array
-        tmp[count - 1] = doc;
+        if (!(pp = score_token(engine->ranker, lookup_token(engine->set, engine->index, words[i]))))
+        {
+            postings_free(acc);
+            return NULL;
+        }
+        merged = postings_union(acc, pp);
+        postings_free(acc);
+        postings_free(pp);
+        acc = merged;
     }
+    return acc;
+}
 
-    // sort the array based on the rank
-    qsort(tmp, count, sizeof(rankedDoc_t *), comparator);
-
-    // add the sorted documents back to the queue
-    for (int i = 0; i < count; i++)
+/* the number of times the words, with their positions in one doc, follow one another */
+static int phrase_matches(uint32_t *const *pos, const int *npos, int n)
+{
+    int at[n], matches = 0;
+    memset(at, 0, sizeof(at));
+    for (int a = 0; a < npos[0]; a++)
     {
-        qput(qp, tmp[i]);
+        bool found = true;
+        for (int i = 1; found && i < n; i++)
+        {
+            uint32_t want = pos[0][a] + i;
+            while (at[i] < npos[i] && pos[i][at[i]] < want)
+                at[i]++;
+            found = at[i] < npos[i] && pos[i][at[i]] == want;
+        }
+        matches += found;
     }
-
-    free(tmp);
+    return matches;
 }
 
-static void free_doc(rankedDoc_t *dp)
+/* the number of positions a with a position of b, other than itself, within k */
+static int near_matches(const uint32_t *a, int na, const uint32_t *b, int nb, uint32_t k)
 {
-    if (dp->title)
-        free(dp->title);
-    if (dp->url)
-        free(dp->url);
-    if (dp->content)
-        free(dp->content);
-    if (dp)
-        free(dp);
+    int t = 0, matches = 0;
+    for (int x = 0; x < na; x++)
+    {
+        while (t < nb && b[t] + k < a[x])
+            t++;
+        for (int y = t; y < nb && b[y] <= a[x] + k; y++)
+        {
+            if (b[y] != a[x])
+            {
+                matches++;
+                break;
+            }
+        }
+    }
+    return matches;
 }
 
-static void free_queue(queue_t *qp)
+static postings_t *lookup_positional(const engine_t *engine, arena_t *scratch, char *token)
 {
-    rankedDoc_t *dp;
-    while ((dp = qget(qp)))
-        free_doc(dp);
-    qclose(qp);
+    /* the words of "w1 w2 ..." or of w1 near/k w2 */
+    char *copy = arena_strndup(scratch, token, strlen(token)), *save, *word;
+    int n = 0, k = 0;
+    if (!copy)
+        return NULL;
+    char **words = arena_alloc(scratch, strlen(copy) * sizeof(char *));
+    if (!words)
+        return NULL;
+    if (copy[0] == '"')
+    {
+        copy[strlen(copy) - 1] = '\0';
+        copy++;
+    }
+    for (word = strtok_r(copy, " ", &save); word; word = strtok_r(NULL, " ", &save))
+    {
+        if (!is_near(word, &k))
+            words[n++] = word;
+    }
+
+    /* the docs with every word; there are at least two */
+    postings_t *lists[n], *docs = NULL, *pp, *matched = NULL;
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        if (!(lists[i] = lookup_token(engine->set, NULL, words[i])))
+            break;
+        if (i == 0)
+            continue;
+        pp = postings_intersect(i == 1 ? lists[0] : docs, lists[i]);
+        postings_free(docs);
+        if (!(docs = pp))
+        {
+            i++;
+            break;
+        }
+    }
+
+    /* their positions, doc by doc */
+    uint32_t **pos[n];
+    int *npos[n];
+    bool ok = i == n && (matched = postings_new()) && postings_reserve(matched, docs->ndocs) == 0;
+    for (int w = 0; ok && w < n; w++)
+    {
+        ok = (pos[w] = arena_alloc(scratch, (docs->ndocs ? docs->ndocs : 1) * sizeof(uint32_t *))) &&
+             (npos[w] = arena_alloc(scratch, (docs->ndocs ? docs->ndocs : 1) * sizeof(int))) &&
+             indexset_positions(engine->set, words[w], docs, scratch, pos[w], npos[w]) == 0;
+    }
+    for (int j = 0; ok && j < docs->ndocs; j++)
+    {
+        uint32_t *dpos[n];
+        int dn[n], m;
+        for (int w = 0; w < n; w++)
+        {
+            dpos[w] = pos[w][j];
+            dn[w] = npos[w][j];
+        }
+        m = k > 0 ? near_matches(dpos[0], dn[0], dpos[1], dn[1], k) : phrase_matches(dpos, dn, n);
+        if (m > 0)
+        {
+            /* a scored match takes the scores of its words below */
+            matched->docs[matched->ndocs].id = docs->docs[j].id;
+            matched->docs[matched->ndocs++].word_count = engine->ranker ? 0 : m;
+        }
+    }
+    for (int w = 0; ok && engine->ranker && w < n; w++)
+    {
+        ok = (pp = ranker_score(engine->ranker, lists[w])) != NULL;
+        postings_t *summed = ok ? postings_intersect_sum(matched, pp) : NULL;
+        postings_free(pp);
+        postings_free(matched);
+        ok = (matched = summed) != NULL;
+    }
+    while (i-- > 0)
+    {
+        postings_free(lists[i]);
+    }
+    postings_free(docs);
+    if (!ok)
+    {
+        postings_free(matched);
+        return NULL;
+    }
+    return matched;
 }
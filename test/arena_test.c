@@ -0,0 +1,142 @@
+/*
+ * arena_test.c -- tests the arena allocator and the queue and hash
+ * tables opened on one
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: allocations must be aligned, distinct and survive until
+ * the arena is reset; an arena queue must reuse the nodes it frees and
+ * an arena hash table must leave its entries to the arena
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdalign.h>
+#include <arena.h>
+#include <queue.h>
+#include <hash.h>
+
+#define NUM_ALLOCS 10000
+#define BLOCK_SIZE 1024
+
+static void fail(const char *msg)
+{
+    printf("%s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+static bool int_searchfn(void *elementp, const void *keyp)
+{
+    return *(int *)elementp == *(const int *)keyp;
+}
+
+static bool key_searchfn(void *elementp, const void *keyp)
+{
+    char key[32];
+    sprintf(key, "key%d", *(int *)elementp);
+    return strcmp(key, (const char *)keyp) == 0;
+}
+
+int main(void)
+{
+    arena_t *ap = arena_open(BLOCK_SIZE);
+    int *ints[NUM_ALLOCS];
+    char key[32];
+
+    if (!ap)
+        fail("Failed to open arena");
+
+    /* small allocations are aligned and do not overlap */
+    for (int i = 0; i < NUM_ALLOCS; i++)
+    {
+        if (!(ints[i] = arena_alloc(ap, 1 + i % 13)))
+            fail("Failed to allocate from arena");
+        if ((uintptr_t)ints[i] % alignof(max_align_t) != 0)
+            fail("Allocation is not aligned");
+        *(char *)ints[i] = (char)i;
+    }
+    for (int i = 0; i < NUM_ALLOCS; i++)
+    {
+        if (*(char *)ints[i] != (char)i)
+            fail("Allocation was overwritten");
+    }
+
+    /* a request larger than a block gets a block of its own */
+    char *big = arena_alloc(ap, 4 * BLOCK_SIZE);
+    if (!big)
+        fail("Failed to allocate a large block");
+    memset(big, 'x', 4 * BLOCK_SIZE);
+
+    char *s = arena_strndup(ap, "hello world", 5);
+    if (!s || strcmp(s, "hello") != 0)
+        fail("arena_strndup copied the wrong string");
+    if (arena_used(ap) < NUM_ALLOCS + 4 * BLOCK_SIZE)
+        fail("arena_used is too small");
+
+    arena_reset(ap);
+    if (arena_used(ap) != 0)
+        fail("arena_used is not zero after reset");
+
+    /* an arena queue reuses the nodes freed by qget and qremove */
+    queue_t *qp = qopen_arena(ap);
+    if (!qp)
+        fail("Failed to open arena queue");
+    for (int i = 0; i < NUM_ALLOCS; i++)
+    {
+        int *ip = arena_alloc(ap, sizeof(int));
+        *ip = i;
+        if (qput(qp, ip) != 0)
+            fail("Failed to put into arena queue");
+    }
+    int last = NUM_ALLOCS - 1;
+    int *ip = qremove(qp, int_searchfn, &last);
+    if (!ip || *ip != last)
+        fail("qremove did not find the back of the queue");
+    if (qput(qp, ip) != 0)
+        fail("Failed to put after removing the back");
+    for (int i = 0; i < NUM_ALLOCS; i++)
+    {
+        if (!(ip = qget(qp)) || *ip != i)
+            fail("Arena queue returned elements out of order");
+    }
+    if (qget(qp))
+        fail("Arena queue should be empty");
+
+    size_t used = arena_used(ap);
+    for (int round = 0; round < 10; round++)
+    {
+        for (int i = 0; i < 100; i++)
+            qput(qp, &ints[0]);
+        while (qget(qp))
+            ;
+    }
+    if (arena_used(ap) != used)
+        fail("Arena queue did not reuse its nodes");
+    qclose(qp);
+
+    /* an arena hash table leaves its entries to the arena */
+    hashtable_t *htp = hopen_arena(8, ap);
+    if (!htp)
+        fail("Failed to open arena hash table");
+    for (int i = 0; i < NUM_ALLOCS; i++)
+    {
+        int *ep = arena_alloc(ap, sizeof(int));
+        *ep = i;
+        sprintf(key, "key%d", i);
+        if (hput(htp, ep, key, strlen(key)) != 0)
+            fail("Failed to put into arena hash table");
+    }
+    for (int i = 0; i < NUM_ALLOCS; i++)
+    {
+        sprintf(key, "key%d", i);
+        if (!(ip = hsearch(htp, key_searchfn, key, strlen(key))) || *ip != i)
+            fail("Arena hash table lost an entry");
+    }
+    hclose(htp);
+
+    arena_close(ap);
+    printf("Arena passed all tests.\n");
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,162 @@
+/*
+ * cqueue_test.c -- tests the concurrent queue module
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: producers and consumers share a small ring buffer that
+ * is then shut and drained; work stealing deques are taken oldest
+ * first, by their owner and by thieves; workers on them expand a tree
+ * of work items from one root and must all stop once it is done
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <cqueue.h>
+
+#define NUM_PRODUCERS 3
+#define NUM_CONSUMERS 3
+#define PER_PRODUCER 5000
+#define NUM_WORKERS 4
+#define TREE_DEPTH 12 /* the tree has 2^(TREE_DEPTH+1) - 1 items */
+
+static cqueue_t *cqp;
+static wsqueue_t *wsp;
+static long consumed_sum = 0, consumed = 0, expanded = 0;
+static pthread_mutex_t count_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *produce(void *arg)
+{
+    int base = (int)(intptr_t)arg * PER_PRODUCER;
+    for (int i = 0; i < PER_PRODUCER; i++)
+    {
+        int *ip = malloc(sizeof(int));
+        *ip = base + i;
+        if (cqput(cqp, ip) != 0)
+        {
+            printf("Put failed on an open queue\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return NULL;
+}
+
+static void *consume(void *arg)
+{
+    int *ip;
+    while ((ip = cqget(cqp)) != NULL)
+    {
+        pthread_mutex_lock(&count_mutex);
+        consumed++;
+        consumed_sum += *ip;
+        pthread_mutex_unlock(&count_mutex);
+        free(ip);
+    }
+    return NULL;
+}
+
+/* each item is its depth in the tree; items above the leaves add two children */
+static void *expand(void *arg)
+{
+    int worker = (int)(intptr_t)arg;
+    int *ip;
+    while ((ip = wsget(wsp, worker)) != NULL)
+    {
+        for (int i = 0; *ip < TREE_DEPTH && i < 2; i++)
+        {
+            int *child = malloc(sizeof(int));
+            *child = *ip + 1;
+            wsput(wsp, worker, child);
+        }
+        pthread_mutex_lock(&count_mutex);
+        expanded++;
+        pthread_mutex_unlock(&count_mutex);
+        free(ip);
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t producers[NUM_PRODUCERS], consumers[NUM_CONSUMERS], workers[NUM_WORKERS];
+
+    /* ring buffer */
+    cqp = cqopen(8);
+    for (int i = 0; i < NUM_CONSUMERS; i++)
+        pthread_create(&consumers[i], NULL, consume, NULL);
+    for (int i = 0; i < NUM_PRODUCERS; i++)
+        pthread_create(&producers[i], NULL, produce, (void *)(intptr_t)i);
+    for (int i = 0; i < NUM_PRODUCERS; i++)
+        pthread_join(producers[i], NULL);
+    cqshut(cqp);
+    for (int i = 0; i < NUM_CONSUMERS; i++)
+        pthread_join(consumers[i], NULL);
+
+    long total = NUM_PRODUCERS * PER_PRODUCER;
+    if (consumed != total || consumed_sum != total * (total - 1) / 2)
+    {
+        printf("Consumed %ld elements summing to %ld\n", consumed, consumed_sum);
+        exit(EXIT_FAILURE);
+    }
+    int dummy = 0;
+    if (cqput(cqp, &dummy) == 0 || cqget(cqp) != NULL)
+    {
+        printf("A shut queue still accepts or returns elements\n");
+        exit(EXIT_FAILURE);
+    }
+    cqclose(cqp);
+
+    cqp = cqopen(2);
+    if (cqtimedget(cqp, 50) != NULL)
+    {
+        printf("Timed get returned an element from an empty queue\n");
+        exit(EXIT_FAILURE);
+    }
+    int *ip = malloc(sizeof(int));
+    *ip = 7;
+    cqput(cqp, ip);
+    if (cqlength(cqp) != 1 || (ip = cqtimedget(cqp, 50)) == NULL || *ip != 7)
+    {
+        printf("Timed get missed an element\n");
+        exit(EXIT_FAILURE);
+    }
+    free(ip);
+    cqclose(cqp);
+
+    /* a thief takes the oldest elements, as the owner does */
+    int items[3] = {1, 2, 3};
+    wsp = wsopen(2);
+    for (int i = 0; i < 3; i++)
+        wsput(wsp, 0, &items[i]);
+    if (wsget(wsp, 1) != &items[0] || wsget(wsp, 0) != &items[1] || wsget(wsp, 1) != &items[2])
+    {
+        printf("Deques not taken oldest first\n");
+        exit(EXIT_FAILURE);
+    }
+    wsclose(wsp);
+
+    /* work stealing: all the work starts on worker 0 */
+    wsp = wsopen(NUM_WORKERS);
+    ip = malloc(sizeof(int));
+    *ip = 0;
+    wsput(wsp, 0, ip);
+    for (int i = 0; i < NUM_WORKERS; i++)
+        pthread_create(&workers[i], NULL, expand, (void *)(intptr_t)i);
+    for (int i = 0; i < NUM_WORKERS; i++)
+        pthread_join(workers[i], NULL);
+    if (expanded != (2L << TREE_DEPTH) - 1)
+    {
+        printf("Expanded %ld items, expected %ld\n", expanded, (2L << TREE_DEPTH) - 1);
+        exit(EXIT_FAILURE);
+    }
+    if (wsget(wsp, 1) != NULL)
+    {
+        printf("Finished deques returned an element\n");
+        exit(EXIT_FAILURE);
+    }
+    wsclose(wsp);
+
+    printf("Concurrent queues passed all tests.\n");
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,164 @@
+/*
+ * dict_test.c -- tests the front coded term dictionary
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: encodes a few blocks of sorted words sharing prefixes,
+ * one of them long, and checks that every word decodes and is found
+ * under its term id, that absent words are not found, and that prefix
+ * ranges hold exactly the words starting with the prefix, for words
+ * decoded on the stack and on the heap, and for prefixes longer than
+ * every word; an encoding cut short or with a longest word longer than
+ * its words is refused
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dict.h>
+
+#define NWORDS (3 * DICT_BLOCK + 5)
+
+static int word_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void fail(const char *msg)
+{
+    printf("%s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+/* checks the prefix range of prefix against every word */
+static void check_prefix(const dict_t *dp, char **words, int n, const char *prefix)
+{
+    int first = -1, count = dict_prefix(dp, prefix, &first), expected = 0, start = -1;
+    for (int i = 0; i < n; i++)
+    {
+        if (strncmp(words[i], prefix, strlen(prefix)) == 0)
+        {
+            if (start < 0)
+                start = i;
+            expected++;
+        }
+    }
+    if (count != expected || (count > 0 && first != start))
+    {
+        printf("Prefix %s: %d words from %d, expected %d from %d\n", prefix, count, first, expected, start);
+        fail("Wrong prefix range");
+    }
+}
+
+int main(void)
+{
+    char *words[NWORDS], long_word[300];
+    int first;
+    memset(long_word, 'q', sizeof(long_word) - 1);
+    long_word[sizeof(long_word) - 1] = '\0';
+    for (int i = 0; i < NWORDS - 1; i++)
+    {
+        words[i] = malloc(32);
+        sprintf(words[i], "%s%c%d", i % 3 ? "comput" : "compa", 'a' + i % 5, i);
+    }
+    words[NWORDS - 1] = long_word;
+    qsort(words, NWORDS, sizeof(char *), word_cmp);
+
+    size_t size = dict_encoded_size(words, NWORDS), plain = 0;
+    uint32_t *data = malloc(size + sizeof(uint32_t));
+    dict_t dict;
+    for (int i = 0; i < NWORDS; i++)
+        plain += strlen(words[i]) + 1;
+    if (!data)
+        fail("Out of memory");
+    dict_encode(words, NWORDS, (uint8_t *)data);
+    if (dict_open(&dict, data, size) != 0 || dict.nterms != NWORDS || dict.maxlen != (int)strlen(long_word))
+        fail("Failed to open the dictionary");
+    if (size >= plain)
+        fail("Front coding did not save space");
+
+    char buf[sizeof(long_word)];
+    for (int i = 0; i < NWORDS; i++)
+    {
+        if (dict_word(&dict, i, buf, sizeof(buf)) != (int)strlen(words[i]) || strcmp(buf, words[i]) != 0)
+            fail("Decoded word differs");
+        if (dict_find(&dict, words[i]) != i)
+            fail("Word not found under its term id");
+    }
+    if (dict_word(&dict, NWORDS, buf, sizeof(buf)) >= 0 || dict_word(&dict, 0, buf, 4) >= 0)
+        fail("Decoded a word out of range or too long");
+
+    const char *absent[] = {"", "aaa", "comp", "compa", "computb", "comput", "zzz", "qqq"};
+    for (int i = 0; i < (int)(sizeof(absent) / sizeof(absent[0])); i++)
+    {
+        if (dict_find(&dict, absent[i]) >= 0)
+            fail("Found a word never added");
+    }
+
+    const char *prefixes[] = {"", "c", "comp", "compa", "compac", "comput", "computb", "computa1", "q", "qq", "r", "a"};
+    for (int i = 0; i < (int)(sizeof(prefixes) / sizeof(prefixes[0])); i++)
+        check_prefix(&dict, words, NWORDS, prefixes[i]);
+
+    /* a prefix longer than any word matches none, however long it is */
+    size_t huge = 16 << 20;
+    char *long_prefix = malloc(huge + 1);
+    if (!long_prefix)
+        fail("Out of memory");
+    memset(long_prefix, 'q', huge);
+    long_prefix[huge] = '\0';
+    if (dict_prefix(&dict, long_prefix, &first) != 0 || dict_find(&dict, long_prefix) >= 0)
+        fail("Matched a prefix longer than every word");
+    long_prefix[strlen(long_word)] = '\0';
+    if (dict_prefix(&dict, long_prefix, &first) != 1 || first != NWORDS - 1)
+        fail("Wrong range of the longest word as a prefix");
+    free(long_prefix);
+
+    /* a cut short encoding is refused */
+    if (dict_open(&dict, data, size / 2) == 0)
+        fail("Opened a dictionary cut short");
+
+    /* so is a longest word longer than all the words, as it sizes buffers */
+    uint32_t maxlen = data[2];
+    data[2] = data[3] + 1;
+    if (dict_open(&dict, data, size) == 0)
+        fail("Opened a dictionary with a word longer than its words");
+    data[2] = UINT32_MAX;
+    if (dict_open(&dict, data, size) == 0)
+        fail("Opened a dictionary with a word too long");
+    data[2] = maxlen;
+
+    /* words short enough to be decoded on the stack; the long one sorts last */
+    size_t short_size = dict_encoded_size(words, NWORDS - 1);
+    uint32_t *short_data = malloc(short_size + sizeof(uint32_t));
+    if (!short_data)
+        fail("Out of memory");
+    dict_encode(words, NWORDS - 1, (uint8_t *)short_data);
+    if (dict_open(&dict, short_data, short_size) != 0 || dict.maxlen >= (int)strlen(long_word))
+        fail("Failed to open the dictionary of short words");
+    for (int i = 0; i < NWORDS - 1; i++)
+    {
+        if (dict_find(&dict, words[i]) != i)
+            fail("Short word not found under its term id");
+    }
+    if (dict_find(&dict, long_word) >= 0)
+        fail("Found a word never added");
+    for (int i = 0; i < (int)(sizeof(prefixes) / sizeof(prefixes[0])); i++)
+        check_prefix(&dict, words, NWORDS - 1, prefixes[i]);
+    free(short_data);
+
+    /* no words at all */
+    uint32_t empty[8];
+    dict_encode(words, 0, (uint8_t *)empty);
+    if (dict_open(&dict, empty, dict_encoded_size(words, 0)) != 0 || dict_find(&dict, "compa") >= 0 ||
+        dict_prefix(&dict, "", &first) != 0)
+        fail("Wrong empty dictionary");
+
+    for (int i = 0; i < NWORDS; i++)
+    {
+        if (words[i] != long_word)
+            free(words[i]);
+    }
+    free(data);
+    printf("Dictionary passed all tests.\n");
+    exit(EXIT_SUCCESS);
+}
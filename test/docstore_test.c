@@ -0,0 +1,123 @@
+/*
+ * docstore_test.c -- tests the doc store module
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: saves the metadata of a few pages, with and without a
+ * title or description, and checks that the mapped doc store returns
+ * the same url, title and snippet, and nothing for ids never added.
+ * A store of large ids only must hold no slots for the ids before them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <docstore.h>
+
+#define DOCS_FILE "docstore_test.docs"
+
+static void fail(const char *msg)
+{
+    printf("%s\n", msg);
+    remove(DOCS_FILE);
+    exit(EXIT_FAILURE);
+}
+
+static webpage_t *make_page(const char *url, const char *html)
+{
+    char *u = malloc(strlen(url) + 1), *h = malloc(strlen(html) + 1);
+    strcpy(u, url);
+    strcpy(h, html);
+    webpage_t *page = webpage_new(u, 0, h);
+    free(u);
+    return page;
+}
+
+/* true if s of length len is expected, a NUL-terminated string or NULL */
+static bool same(const char *s, int len, const char *expected)
+{
+    if (!s || !expected)
+        return s == expected;
+    return len == (int)strlen(expected) && strcmp(s, expected) == 0;
+}
+
+int main(void)
+{
+    char long_desc[300];
+    memset(long_desc, 'd', sizeof(long_desc) - 1);
+    long_desc[sizeof(long_desc) - 1] = '\0';
+    char long_html[400];
+    sprintf(long_html, "<meta name=\"description\" content=\"%s\">", long_desc);
+
+    webpage_t *pages[] = {
+        make_page("http://a.com/1", "<html><title>First</title><meta name=\"description\" content=\"about one\"></html>"),
+        make_page("http://a.com/2", "<html><body>no title here</body></html>"),
+        make_page("http://a.com/3", long_html),
+    };
+    int ids[] = {1, 4, 7};
+    const char *titles[] = {"First", NULL, NULL};
+    char snippet[SNIPPET_LEN + 1];
+    memcpy(snippet, long_desc, SNIPPET_LEN);
+    snippet[SNIPPET_LEN] = '\0';
+    const char *snippets[] = {"about one", NULL, snippet};
+
+    docstore_t *ds = docstore_new(1, 8);
+    if (!ds)
+        fail("Failed to create doc store");
+    for (int i = 0; i < 3; i++)
+    {
+        if (docstore_add(ds, ids[i], pages[i]) != 0)
+            fail("Failed to add a page");
+    }
+    if (docstore_add(ds, 1, pages[0]) == 0 || docstore_add(ds, 8, pages[0]) == 0 ||
+        docstore_add(ds, 0, pages[0]) == 0)
+        fail("Added a page twice or out of range");
+    if (docstore_save(ds, DOCS_FILE) != 0)
+        fail("Failed to save doc store");
+    docstore_free(ds);
+
+    docmap_t *map = docmap_open(DOCS_FILE);
+    docmeta_t meta;
+    int base, nids;
+    if (!map)
+        fail("Failed to map doc store");
+    docmap_ids(map, &base, &nids);
+    if (base != 1 || nids != 8)
+        fail("Wrong ids of the mapped doc store");
+    for (int i = 0; i < 3; i++)
+    {
+        if (!docmap_get(map, ids[i], &meta) ||
+            !same(meta.url, meta.url_len, webpage_getURL(pages[i])) ||
+            !same(meta.title, meta.title_len, titles[i]) ||
+            !same(meta.snippet, meta.snippet_len, snippets[i]))
+            fail("Mapped metadata does not match the page");
+    }
+    for (int id = -1; id < 10; id++)
+    {
+        if (id != 1 && id != 4 && id != 7 && docmap_get(map, id, &meta))
+            fail("Found metadata for an id never added");
+    }
+    docmap_close(map);
+
+    /* the newest pages of a delta, after a million others */
+    struct stat st;
+    if (!(ds = docstore_new(1000000, 1000002)) || docstore_add(ds, 1000001, pages[0]) != 0 ||
+        docstore_add(ds, 1, pages[0]) == 0 || docstore_save(ds, DOCS_FILE) != 0)
+        fail("Failed to save a doc store of large ids");
+    docstore_free(ds);
+    if (stat(DOCS_FILE, &st) != 0 || st.st_size > 1024 || !(map = docmap_open(DOCS_FILE)) ||
+        !docmap_get(map, 1000001, &meta) || !same(meta.url, meta.url_len, webpage_getURL(pages[0])) ||
+        docmap_get(map, 1000000, &meta) || docmap_get(map, 1, &meta))
+        fail("Wrong doc store of large ids");
+    docmap_close(map);
+
+    if (docmap_open("docstore_test.c") != NULL)
+        fail("Mapped a file that is not a doc store");
+
+    for (int i = 0; i < 3; i++)
+        webpage_delete(pages[i]);
+    remove(DOCS_FILE);
+    printf("Doc store passed all tests.\n");
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,194 @@
+/*
+ * extract_test.c -- tests the single scan of a page's html
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: extracts pages with spaced out, unquoted, relative and
+ * non-http links, a title and a description, and checks that the words,
+ * links, title and description are those found by the separate scans
+ * of webpage_getNextSpan, webpage_getNextURL and docmeta_extract, that
+ * the html is left as it was, and that a callback can stop the scan.
+ * A '<' that opens no tag must not hide the links and words after it,
+ * and links inside comments are found.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <webpage.h>
+#include <docstore.h>
+
+#define MAX_FOUND 256
+
+/* a '<' in the text must not hide the links and words after it */
+#define STRAY_PAGE                                                            \
+    "<p>x<y and <a href=\"after.html\">after</a>, 1 < 3 <a href=three.html>three</a>\n" \
+    "<!-- <a href=\"old.html\">old</a> --> if a<b, <b>bold</b></p>"
+
+/* what the callbacks found in a page */
+typedef struct found
+{
+    const char *words[MAX_FOUND];
+    int lens[MAX_FOUND];
+    int nwords;
+    char *links[MAX_FOUND];
+    int nlinks;
+    int stop_after; /* words taken before stopping the scan, or -1 */
+} found_t;
+
+static const char *pages[] = {
+    "<html><head><title>First page</title>\n"
+    "<meta name=\"description\" content=\"all about links\"></head><body>\n"
+    "<a href=\"one.html\">one</a> < a  href = \"sub/two.html\" >two</a>\n"
+    "<A HREF='http://example.com/x.html#frag'>x</A><area href=\"area.html\">\n"
+    "<a href=\"#top\">top</a><a href=\"mailto:me@example.com\">mail</a>\n"
+    "<a href=bare.html>bare</a><a name=n href=\"../up.html?x=1\">up</a>\n"
+    "<a\nhref=\"split\n name.html\">split</a><a data-href=\"data.html\">data</a>\n"
+    "</body></html>\n",
+    "<title>no end to it <body>words and <a href=\"https://thayer.github.io/engs50/\">home</a>",
+    "just some plain text without any tags",
+    "<p>cut short<a href=\"last.html\"",
+    STRAY_PAGE,
+};
+
+static void fail(const char *msg)
+{
+    printf("%s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+static webpage_t *make_page(const char *url, const char *html)
+{
+    char *u = malloc(strlen(url) + 1), *h = malloc(strlen(html) + 1);
+    strcpy(u, url);
+    strcpy(h, html);
+    webpage_t *page = webpage_new(u, 0, h);
+    free(u);
+    return page;
+}
+
+static int take_word(void *arg, const char *word, int len)
+{
+    found_t *fp = (found_t *)arg;
+    if (fp->nwords == fp->stop_after)
+        return 7;
+    if (fp->nwords == MAX_FOUND)
+        fail("Too many words");
+    fp->words[fp->nwords] = word;
+    fp->lens[fp->nwords++] = len;
+    return 0;
+}
+
+static int take_link(void *arg, char *url)
+{
+    found_t *fp = (found_t *)arg;
+    if (fp->nlinks == MAX_FOUND)
+        fail("Too many links");
+    fp->links[fp->nlinks++] = url;
+    return 0;
+}
+
+static void check_page(const char *html)
+{
+    webpage_t *page = make_page("http://thayer.github.io/engs50/dir/page.html", html);
+    found_t found = {.stop_after = -1};
+    webpage_parts_t parts = {.word = take_word, .link = take_link, .arg = &found};
+
+    if (webpage_extract(page, &parts) != 0)
+        fail("Failed to extract a page");
+    if (strcmp(webpage_getHTML(page), html) != 0)
+        fail("Extracting changed the html");
+
+    /* the words are the spans */
+    int pos = 0, len, n = 0;
+    const char *start;
+    while ((pos = webpage_getNextSpan(page, pos, &start, &len)) > 0)
+    {
+        if (n >= found.nwords || found.words[n] != start || found.lens[n] != len)
+            fail("Extracted words differ from the spans");
+        n++;
+    }
+    if (n != found.nwords)
+        fail("Extracted more words than there are spans");
+
+    /* the title and description are those of the doc store */
+    docmeta_t meta;
+    docmeta_extract(page, &meta);
+    if (meta.title != parts.title || meta.title_len != parts.title_len ||
+        meta.snippet != parts.description || meta.snippet_len != parts.description_len)
+        fail("Extracted title or description differs");
+
+    /* the links are those of webpage_getNextURL, which condenses the html */
+    webpage_t *copy = make_page(webpage_getURL(page), html);
+    char *url;
+    pos = n = 0;
+    while ((pos = webpage_getNextURL(copy, pos, &url)) > 0)
+    {
+        if (n >= found.nlinks || strcmp(found.links[n], url) != 0)
+        {
+            printf("Expected %s, extracted %s\n", url, n < found.nlinks ? found.links[n] : "nothing");
+            fail("Extracted links differ");
+        }
+        free(url);
+        n++;
+    }
+    if (n != found.nlinks)
+        fail("Extracted more links than webpage_getNextURL");
+    for (int i = 0; i < found.nlinks; i++)
+        free(found.links[i]);
+    webpage_delete(copy);
+    webpage_delete(page);
+}
+
+int main(void)
+{
+    for (int i = 0; i < (int)(sizeof(pages) / sizeof(pages[0])); i++)
+        check_page(pages[i]);
+
+    /* spot checks of the first page */
+    webpage_t *page = make_page("http://thayer.github.io/engs50/dir/page.html", pages[0]);
+    found_t found = {.stop_after = -1};
+    webpage_parts_t parts = {.link = take_link, .arg = &found};
+    if (webpage_extract(page, &parts) != 0 || found.nlinks != 8 ||
+        strcmp(found.links[0], "http://thayer.github.io/engs50/dir/one.html") != 0 ||
+        strcmp(found.links[2], "http://example.com/x.html") != 0 ||
+        !parts.title || strncmp(parts.title, "First page", parts.title_len) != 0 || parts.title_len != 10 ||
+        !parts.description || parts.description_len != 15)
+        fail("Wrong links, title or description of the first page");
+    for (int i = 0; i < found.nlinks; i++)
+        free(found.links[i]);
+
+    /* a callback stops the scan, and its value is returned */
+    found = (found_t){.stop_after = 3};
+    parts = (webpage_parts_t){.word = take_word, .arg = &found};
+    if (webpage_extract(page, &parts) != 7 || found.nwords != 3)
+        fail("A callback did not stop the scan");
+    webpage_delete(page);
+
+    /* links after a stray '<' and inside a comment; words after it */
+    page = make_page("http://thayer.github.io/engs50/dir/page.html", STRAY_PAGE);
+    found = (found_t){.stop_after = -1};
+    parts = (webpage_parts_t){.word = take_word, .link = take_link, .arg = &found};
+    if (webpage_extract(page, &parts) != 0 || found.nlinks != 3 ||
+        strcmp(found.links[0], "http://thayer.github.io/engs50/dir/after.html") != 0 ||
+        strcmp(found.links[1], "http://thayer.github.io/engs50/dir/three.html") != 0 ||
+        strcmp(found.links[2], "http://thayer.github.io/engs50/dir/old.html") != 0)
+        fail("Wrong links after a stray '<' or inside a comment");
+    for (int i = 0; i < found.nlinks; i++)
+        free(found.links[i]);
+    static const char *words[] = {"x", "y", "and", "after", "three", "old", "if", "a", "b", "bold"};
+    int nwords = (int)(sizeof(words) / sizeof(words[0]));
+    for (int i = 0; i < nwords && i < found.nwords; i++)
+    {
+        if ((int)strlen(words[i]) != found.lens[i] || strncmp(words[i], found.words[i], found.lens[i]) != 0)
+            fail("Wrong words after a stray '<'");
+    }
+    if (found.nwords != nwords)
+        fail("Wrong number of words after a stray '<'");
+    webpage_delete(page);
+
+    if (webpage_extract(NULL, &parts) >= 0)
+        fail("Extracted a missing page");
+    printf("Extraction passed all tests.\n");
+    exit(EXIT_SUCCESS);
+}
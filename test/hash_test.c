@@ -0,0 +1,98 @@
+/*
+ * hash_test.c -- tests the hash module
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: tests put, search, remove and apply on the open
+ * addressing hash table, including growth well past the initial size
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <hash.h>
+
+#define NUM_KEYS 50000
+
+static int sum = 0;
+
+static bool searchfn(void *ep, const void *key)
+{
+    return strcmp((char *)ep, (const char *)key) == 0;
+}
+
+static void sum_fn(void *ep)
+{
+    sum += atoi((char *)ep);
+}
+
+int main(void)
+{
+    hashtable_t *htp = hopen(10);
+    char key[16];
+
+    /* put enough keys to force several resizes */
+    for (int i = 0; i < NUM_KEYS; i++)
+    {
+        char *data = malloc(16);
+        sprintf(data, "%d", i);
+        if (hput(htp, data, data, strlen(data)) != 0)
+        {
+            printf("Failed to put key %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int i = 0; i < NUM_KEYS; i++)
+    {
+        sprintf(key, "%d", i);
+        char *data = hsearch(htp, searchfn, key, strlen(key));
+        if (data == NULL || strcmp(data, key) != 0)
+        {
+            printf("Failed to find key %s\n", key);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (hsearch(htp, searchfn, "missing", strlen("missing")) != NULL)
+    {
+        printf("Found a key that was never added\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* remove every odd key; even keys must survive the shifts */
+    for (int i = 1; i < NUM_KEYS; i += 2)
+    {
+        sprintf(key, "%d", i);
+        char *data = hremove(htp, searchfn, key, strlen(key));
+        if (data == NULL)
+        {
+            printf("Failed to remove key %s\n", key);
+            exit(EXIT_FAILURE);
+        }
+        free(data);
+    }
+    for (int i = 0; i < NUM_KEYS; i++)
+    {
+        sprintf(key, "%d", i);
+        bool found = hsearch(htp, searchfn, key, strlen(key)) != NULL;
+        if (found != (i % 2 == 0))
+        {
+            printf("Unexpected search result for key %s\n", key);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    long expected = 0;
+    for (int i = 0; i < NUM_KEYS; i += 2)
+        expected += i;
+    happly(htp, sum_fn);
+    if (sum != expected)
+    {
+        printf("happly visited the wrong entries: %d != %ld\n", sum, expected);
+        exit(EXIT_FAILURE);
+    }
+
+    hclose(htp);
+    printf("Hash table passed all tests.\n");
+    exit(EXIT_SUCCESS);
+}
@@ -5,12 +5,31 @@
  * Version: 1.0
  *
  * Description: tests the indexsave() and indexload() functions
- * of the indexio utils
+ * of the indexio utils, and the binary format read by indexmap_open()
+ * including its document lengths
  */
 
 #include <stdio.h>
 #include "indexio.h"
 
+static indexmap_t *map;
+static int mismatches = 0;
+
+/* compares an entry of a loaded index with the mapped index */
+static void compare_fn(void *ep)
+{
+    entry_t *entry = (entry_t *)ep;
+    postings_t pp;
+    postings_init(&pp);
+    if (!indexmap_lookup(map, entry->word, &pp) || pp.ndocs != entry->documents.ndocs ||
+        memcmp(pp.docs, entry->documents.docs, pp.ndocs * sizeof(document_t)) != 0)
+    {
+        printf("Mapped postings differ for word: %s\n", entry->word);
+        mismatches++;
+    }
+    postings_clear(&pp);
+}
+
 int main(void)
 {
     char *indexnm = "test_index";
@@ -33,6 +52,41 @@ int main(void)
         exit(EXIT_FAILURE);
     }
     printf("Saved index successfully to: %s\n", indexcp);
+
+    char *indexbin = "test_indexbin";
+    if (indexsave_binary(index, indexbin) != 0)
+    {
+        printf("Failed to save binary index to %s\n", indexbin);
+        exit(EXIT_FAILURE);
+    }
+    if (!(map = indexmap_open(indexbin)))
+    {
+        printf("Failed to map binary index %s\n", indexbin);
+        exit(EXIT_FAILURE);
+    }
+    happly(index, compare_fn);
+    doclens_t summed, mapped;
+    if (index_doclens(index, &summed) != 0 || indexmap_doclens(map, &mapped) != 0 ||
+        summed.nids != mapped.nids || summed.base != mapped.base || summed.ndocs != mapped.ndocs ||
+        summed.ndocs == 0 || summed.avglen != mapped.avglen ||
+        memcmp(summed.lens, mapped.lens, (summed.nids - summed.base) * sizeof(uint32_t)) != 0)
+    {
+        printf("Mapped document lengths differ\n");
+        mismatches++;
+    }
+    doclens_clear(&summed);
+    postings_t pp;
+    postings_init(&pp);
+    if (indexmap_lookup(map, "notaword", &pp))
+    {
+        printf("Found a word that is not in the index\n");
+        mismatches++;
+    }
+    postings_clear(&pp);
+    indexmap_close(map);
+    if (mismatches > 0)
+        exit(EXIT_FAILURE);
+    printf("Mapped index successfully from: %s\n", indexbin);
     free_entries(index);
     hclose(index);
 
@@ -41,7 +95,22 @@ int main(void)
     {
         printf("Index loaded successfully from: %s\n", indexcp);
     }
+    free_entries(index);
+    hclose(index);
 
+    /* a text index must not map, and a binary index must load */
+    if (indexmap_open(indexcp) != NULL)
+    {
+        printf("Mapped a text index\n");
+        exit(EXIT_FAILURE);
+    }
+    index = indexload(indexbin);
+    if (!index)
+    {
+        printf("Failed to load binary index %s\n", indexbin);
+        exit(EXIT_FAILURE);
+    }
+    printf("Index loaded successfully from: %s\n", indexbin);
     free_entries(index);
     hclose(index);
     exit(EXIT_SUCCESS);
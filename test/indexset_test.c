@@ -0,0 +1,195 @@
+/*
+ * indexset_test.c -- tests the indexset module
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: saves a small index whole, and again as a base and a
+ * delta of the later pages, and checks that the set reads the same
+ * posting lists, document lengths and document frequencies as the whole
+ * index, that a stale delta is skipped, and that merging the set writes
+ * the same file as saving the whole index. The delta stores lengths for
+ * its own ids only.
+ */
+#define _POSIX_C_SOURCE 200809L // access
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <indexset.h>
+#include <docstore.h>
+
+#define INDEX_FILE "indexset_index"
+#define DELTA_FILE "indexset_index.1"
+#define STALE_FILE "indexset_index.2"
+#define FULL_FILE "indexset_full"
+#define NWORDS 5
+#define NIDS 40
+#define SPLIT 25 /* the first id of the delta */
+
+static const char *words[NWORDS] = {"alpha", "beta", "gamma", "delta", "omega"};
+
+static void cleanup(void)
+{
+    remove(INDEX_FILE);
+    remove(DELTA_FILE);
+    remove(STALE_FILE);
+    remove(FULL_FILE);
+    remove(INDEX_FILE DOCSTORE_SUFFIX);
+}
+
+static void fail(const char *msg)
+{
+    printf("%s\n", msg);
+    cleanup();
+    exit(EXIT_FAILURE);
+}
+
+static bool searchfn(void *elementp, const void *searchkeyp)
+{
+    return strcmp(((entry_t *)elementp)->word, (const char *)searchkeyp) == 0;
+}
+
+/* an index of the ids from first to last - 1; word w is in every id
+ * divisible by w + 1, except omega, which only the later pages have
+ */
+static hashtable_t *make_index(int first, int last)
+{
+    hashtable_t *index = hopen(16);
+    for (int w = 0; index && w < NWORDS; w++)
+    {
+        for (int id = first; id < last; id++)
+        {
+            if (id % (w + 1) != 0 || (w == NWORDS - 1 && id < SPLIT))
+                continue;
+            entry_t *ep = hsearch(index, searchfn, words[w], strlen(words[w]));
+            if (!ep)
+            {
+                if (!(ep = new_entry((char *)words[w])) || hput(index, ep, ep->word, strlen(ep->word)) != 0)
+                    fail("Failed to build an index");
+            }
+            if (postings_add(&ep->documents, id, id % 7 + 1) != 0)
+                fail("Failed to build an index");
+        }
+    }
+    if (!index)
+        fail("Failed to build an index");
+    return index;
+}
+
+static void save_index(int first, int last, char *indexnm)
+{
+    hashtable_t *index = make_index(first, last);
+    if (indexsave_binary(index, indexnm) != 0)
+        fail("Failed to save an index");
+    free_entries(index);
+    hclose(index);
+}
+
+/* reads the whole of file name into a new buffer of *size bytes */
+static char *read_file(const char *name, long *size)
+{
+    FILE *file = fopen(name, "rb");
+    char *buf = NULL;
+    if (file && fseek(file, 0, SEEK_END) == 0 && (*size = ftell(file)) > 0 &&
+        fseek(file, 0, SEEK_SET) == 0 && (buf = malloc(*size)) &&
+        fread(buf, 1, *size, file) != (size_t)*size)
+    {
+        free(buf);
+        buf = NULL;
+    }
+    if (file)
+        fclose(file);
+    return buf;
+}
+
+/* checks the set against the whole index, word by word */
+static void compare(indexset_t *set, indexmap_t *full)
+{
+    postings_t expected, found;
+    pcursor_t cursors[INDEXSET_MAX];
+    int df;
+    postings_init(&expected);
+    postings_init(&found);
+    for (int w = 0; w < NWORDS; w++)
+    {
+        if (!indexmap_lookup(full, words[w], &expected) || !indexset_lookup(set, words[w], &found) ||
+            found.ndocs != expected.ndocs ||
+            memcmp(found.docs, expected.docs, found.ndocs * sizeof(document_t)) != 0)
+            fail("Set postings differ from the whole index");
+        int n = indexset_cursors(set, words[w], cursors, &df);
+        if (df != expected.ndocs || n != (w == NWORDS - 1 ? 1 : indexset_count(set)))
+            fail("Set cursors differ from the whole index");
+    }
+    if (indexset_lookup(set, "notaword", &found) || indexset_cursors(set, "notaword", cursors, &df) != 0 || df != 0)
+        fail("Found a word never indexed");
+    postings_clear(&expected);
+    postings_clear(&found);
+
+    doclens_t summed, mapped;
+    if (indexset_doclens(set, &summed) != 0 || indexmap_doclens(full, &mapped) != 0 ||
+        summed.nids != mapped.nids || summed.base != mapped.base || summed.ndocs != mapped.ndocs ||
+        summed.avglen != mapped.avglen ||
+        memcmp(summed.lens, mapped.lens, (summed.nids - summed.base) * sizeof(uint32_t)) != 0)
+        fail("Set document lengths differ from the whole index");
+    doclens_clear(&summed);
+}
+
+int main(void)
+{
+    save_index(0, NIDS, FULL_FILE);
+    save_index(0, SPLIT, INDEX_FILE);
+    indexmap_t *full = indexmap_open(FULL_FILE);
+    if (!full)
+        fail("Failed to map the whole index");
+
+    /* the base alone */
+    indexset_t *set = indexset_open(INDEX_FILE);
+    if (!set || indexset_count(set) != 1 || indexset_next(set) != 1 || indexset_nids(set) != SPLIT)
+        fail("Failed to open the base alone");
+    indexset_close(set);
+    uint64_t base_gen, gen;
+    if (indexset_generation(INDEX_FILE, &base_gen) != 0)
+        fail("Failed to get the generation of the base");
+
+    /* the base and a delta, then a delta already in them */
+    save_index(SPLIT, NIDS, DELTA_FILE);
+    save_index(0, SPLIT, STALE_FILE);
+    indexmap_t *delta = indexmap_open(DELTA_FILE);
+    doclens_t dl;
+    if (!delta || indexmap_doclens(delta, &dl) != 0 || dl.base != SPLIT || dl.nids != NIDS)
+        fail("The delta stores lengths for ids before its own");
+    indexmap_close(delta);
+    if (indexset_generation(INDEX_FILE, &gen) != 0 || gen == base_gen)
+        fail("Adding a delta did not change the generation");
+    if (!(set = indexset_open(INDEX_FILE)) || indexset_count(set) != 2 || indexset_next(set) != 3 ||
+        indexset_nids(set) != NIDS || strcmp(indexset_name(set, 1), DELTA_FILE) != 0)
+        fail("Failed to open the base and its delta");
+    compare(set, full);
+    indexset_close(set);
+
+    /* merging writes the whole index */
+    if (indexset_merge(INDEX_FILE) != 0)
+        fail("Failed to merge the set");
+    if (access(DELTA_FILE, F_OK) == 0 || access(STALE_FILE, F_OK) == 0)
+        fail("Merging left the deltas");
+    long merged_size = 0, full_size = 0;
+    char *merged = read_file(INDEX_FILE, &merged_size), *whole = read_file(FULL_FILE, &full_size);
+    if (!merged || !whole || merged_size != full_size || memcmp(merged, whole, full_size) != 0)
+        fail("The merged base differs from the whole index");
+    free(merged);
+    free(whole);
+    if (!(set = indexset_open(INDEX_FILE)) || indexset_count(set) != 1)
+        fail("Failed to open the merged base");
+    compare(set, full);
+    indexset_close(set);
+
+    if (indexset_open("indexset_test.c") != NULL)
+        fail("Opened a file that is not an index");
+
+    indexmap_close(full);
+    cleanup();
+    printf("Index set passed all tests.\n");
+    exit(EXIT_SUCCESS);
+}
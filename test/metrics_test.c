@@ -0,0 +1,148 @@
+/*
+ * metrics_test.c -- tests the counters, histograms and their dumps
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: counts from several threads at once and checks the
+ * totals and the shares of the threads, records latencies and checks
+ * the percentiles of the histogram, checks that a name keeps its kind,
+ * and that the dump is written on a signal and at exit
+ */
+#define _POSIX_C_SOURCE 200809L // kill, nanosleep
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <metrics.h>
+
+#define NTHREADS 4
+#define ADDS 100000
+
+static void fail(const char *msg)
+{
+    printf("%s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+static void *count(void *arg)
+{
+    metric_t *mp = metrics_counter("test.adds");
+    char name[16];
+
+    snprintf(name, sizeof(name), "adder %d", (int)(long)arg);
+    metrics_thread(name);
+    for (int i = 0; i < ADDS; i++)
+        metrics_add(mp, 1);
+    return NULL;
+}
+
+/* the dump of the metrics, as a string; freed by the caller */
+static char *dump(void)
+{
+    char *text = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&text, &size);
+
+    if (!out || metrics_dump(out) != 0)
+        fail("Failed to dump the metrics");
+    fclose(out);
+    return text;
+}
+
+/* the contents of a file, or NULL if it cannot be read */
+static char *slurp(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    char *text;
+    long len;
+
+    if (!file)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    len = ftell(file);
+    rewind(file);
+    if (!(text = calloc(len + 1, 1)) || fread(text, 1, len, file) != (size_t)len)
+        fail("Failed to read the export");
+    fclose(file);
+    return text;
+}
+
+int main(void)
+{
+    char path[64], *text;
+    pthread_t threads[NTHREADS];
+
+    metrics_thread("main");
+    for (long t = 0; t < NTHREADS; t++)
+    {
+        if (pthread_create(&threads[t], NULL, count, (void *)t) != 0)
+            fail("Failed to start a thread");
+    }
+    for (int t = 0; t < NTHREADS; t++)
+        pthread_join(threads[t], NULL);
+
+    /* 90 latencies of 100 us and 10 of 10 ms */
+    metric_t *hp = metrics_histogram("test.latency");
+    for (int i = 0; i < 100; i++)
+        metrics_record(hp, i < 90 ? 100e-6 : 10e-3);
+    if (metrics_histogram("test.adds") || metrics_counter("test.latency") ||
+        metrics_counter("test.adds") != metrics_counter("test.adds"))
+        fail("A name changed its kind or its metric");
+    metrics_add(NULL, 1);
+    metrics_record(NULL, 1);
+
+    text = dump();
+    char expect[128];
+    snprintf(expect, sizeof(expect), "\"test.adds\": {\"total\": %d,", NTHREADS * ADDS);
+    if (!strstr(text, expect) || !strstr(text, "\"main\", \"adder ") ||
+        !strstr(text, "\"threads\": [0, 100000, 100000, 100000, 100000]"))
+        fail("Wrong counts in the dump");
+    /* 100 us is in the bucket up to 128 us, 10 ms in the one up to 16.384 ms */
+    if (!strstr(text, "\"test.latency\": {\"count\": 100, \"mean_ms\": 1.090, \"p50_ms\": 0.128, "
+                      "\"p90_ms\": 0.128, \"p99_ms\": 10.000, \"max_ms\": 10.000, \"threads\": [100,"))
+    {
+        printf("%s", text);
+        fail("Wrong histogram in the dump");
+    }
+    free(text);
+
+    /* the export is tried in a child, which is still single threaded, so
+     * that this process leaves no file behind when it exits
+     */
+    snprintf(path, sizeof(path), "/tmp/metrics_test.%d.json", (int)getpid());
+    remove(path);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        if (metrics_export(path, SIGUSR1) != 0 || metrics_export(path, SIGUSR1) == 0)
+            fail("Failed to export the metrics only once");
+
+        /* a signal has the dump written to the file */
+        kill(getpid(), SIGUSR1);
+        for (int tries = 0; tries < 100 && !(text = slurp(path)); tries++)
+            nanosleep(&(struct timespec){0, 10000000}, NULL);
+        if (!text || !strstr(text, "\"test.latency\"") || strstr(text, "\"test.exit\""))
+            fail("The signal did not write the dump");
+        free(text);
+        metrics_add(metrics_counter("test.exit"), 7);
+        exit(EXIT_SUCCESS);
+    }
+
+    /* and so does exiting */
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        fail("The export failed");
+    if (!(text = slurp(path)) || !strstr(text, "\"test.exit\": {\"total\": 7,"))
+        fail("Exiting did not write the dump");
+    free(text);
+    remove(path);
+
+    printf("Metrics passed all tests.\n");
+    exit(EXIT_SUCCESS);
+}
@@ -5,13 +5,25 @@
  * Version: 1.0
  *
  * Description: tests the pagesave() and pageload() functions
- * of the pageio utils
+ * of the pageio utils, with and without syncing pages in batches, and
+ * a page whose url is longer than any fixed buffer
  */
 
 #include <stdio.h>
 #include "pageio.h"
 #include "webpage.h"
 
+#define LONG_URL_LEN 4000
+
+/* true if the two pages are the same */
+static bool same_page(webpage_t *a, webpage_t *b)
+{
+    return webpage_getDepth(a) == webpage_getDepth(b) &&
+           webpage_getHTMLlen(a) == webpage_getHTMLlen(b) &&
+           strcmp(webpage_getURL(a), webpage_getURL(b)) == 0 &&
+           strcmp(webpage_getHTML(a), webpage_getHTML(b)) == 0;
+}
+
 int main(void)
 {
     char *dirname = "./";
@@ -45,6 +57,54 @@ int main(void)
     if (strcmp(webpage_getHTML(page), webpage_getHTML(page_copy)) != 0)
         return 1;
 
+    /* pages synced in batches of two, the last one by pageio_flush */
+    pageio_sync(2);
+    for (int i = 3; i <= 5; i++)
+    {
+        if (pagesave(page, i, dirname) != 0)
+        {
+            printf("Failed to save synced page.\n");
+            return 1;
+        }
+    }
+    if (pageio_flush() != 0)
+    {
+        printf("Failed to sync pages.\n");
+        return 1;
+    }
+    pageio_sync(0);
+    for (int i = 3; i <= 5; i++)
+    {
+        webpage_t *synced = pageload(i, dirname);
+        if (!synced || !same_page(page, synced))
+        {
+            printf("Synced page %d does not match.\n", i);
+            return 1;
+        }
+        webpage_delete(synced);
+    }
+
+    char *url = malloc(LONG_URL_LEN + 1), *html = malloc(strlen("<html>long</html>") + 1);
+    memset(url, 'u', LONG_URL_LEN);
+    url[LONG_URL_LEN] = '\0';
+    strcpy(html, "<html>long</html>");
+    webpage_t *long_page = webpage_new(url, 2, html), *long_copy;
+    if (pagesave(long_page, 3, dirname) != 0 || !(long_copy = pageload(3, dirname)) ||
+        !same_page(long_page, long_copy))
+    {
+        printf("Failed to save and load a page with a long url.\n");
+        return 1;
+    }
+    for (int i = 3; i <= 5; i++)
+    {
+        char path[32];
+        sprintf(path, "%s%d", dirname, i);
+        remove(path);
+    }
+
+    free(url);
+    webpage_delete(long_page);
+    webpage_delete(long_copy);
     webpage_delete(page);
     webpage_delete(page_copy);
     printf("Saved and loaded page successfully.\n");
@@ -0,0 +1,187 @@
+/*
+ * pagestore_test.c -- tests the page store and packed segments
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: pages appended to small segments, by two writers in
+ * turn, must be listed in id order and load unchanged, with the later
+ * copy of a page winning; a segment cut short loses only its last,
+ * incomplete record; a record with an id too large to hold ends its
+ * segment; a directory of page files reads the same way
+ */
+#define _POSIX_C_SOURCE 200809L // truncate, pwrite
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <pageio.h>
+
+#define SEG_DIR "pagestore_test.seg"
+#define FILE_DIR "pagestore_test.files"
+#define NPAGES 12
+
+/* removes the directory dirnm and the files in it */
+static void remove_dir(const char *dirnm)
+{
+    DIR *dir = opendir(dirnm);
+    struct dirent *entry;
+    char path[512];
+    if (!dir)
+        return;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dirnm, entry->d_name);
+        remove(path);
+    }
+    closedir(dir);
+    rmdir(dirnm);
+}
+
+static void fail(const char *msg)
+{
+    printf("%s\n", msg);
+    remove_dir(SEG_DIR);
+    remove_dir(FILE_DIR);
+    exit(EXIT_FAILURE);
+}
+
+/* a page with the given id in its url and html */
+static webpage_t *make_page(int id, int copy)
+{
+    char url[64], *html = malloc(128);
+    sprintf(url, "http://a.com/%d", id);
+    sprintf(html, "<html>page %d copy %d %s</html>", id, copy, id % 2 ? "odd" : "even");
+    return webpage_new(url, id % 3, html);
+}
+
+/* true if page id loads from ps as made by make_page */
+static bool loads(pagestore_t *ps, int id, int copy)
+{
+    webpage_t *page = pagestore_load(ps, id), *expected = make_page(id, copy);
+    bool same = page && webpage_getDepth(page) == webpage_getDepth(expected) &&
+                strcmp(webpage_getURL(page), webpage_getURL(expected)) == 0 &&
+                strcmp(webpage_getHTML(page), webpage_getHTML(expected)) == 0;
+    webpage_delete(page);
+    webpage_delete(expected);
+    return same;
+}
+
+/* adds pages first to last, copy copy, to the segments of SEG_DIR */
+static void add_pages(int first, int last, int copy)
+{
+    segwriter_t *sw = segwriter_open(SEG_DIR, 200);
+    if (!sw)
+        fail("Failed to open segment writer");
+    for (int id = first; id <= last; id++)
+    {
+        webpage_t *page = make_page(id, copy);
+        if (segwriter_add(sw, page, id) != 0)
+            fail("Failed to add page");
+        webpage_delete(page);
+    }
+    if (segwriter_close(sw) != 0)
+        fail("Failed to close segment writer");
+}
+
+/* the size of the last segment of SEG_DIR, whose path is set */
+static long last_segment(char *path)
+{
+    DIR *dir = opendir(SEG_DIR);
+    struct dirent *entry;
+    struct stat st;
+    path[0] = '\0';
+    while ((entry = readdir(dir)) != NULL)
+    {
+        char candidate[512];
+        snprintf(candidate, sizeof(candidate), "%s/%s", SEG_DIR, entry->d_name);
+        if (entry->d_name[0] != '.' && strcmp(candidate, path) > 0)
+            strcpy(path, candidate);
+    }
+    closedir(dir);
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+int main(void)
+{
+    int count;
+    const int *ids;
+
+    remove_dir(SEG_DIR);
+    remove_dir(FILE_DIR);
+    if (mkdir(SEG_DIR, 0755) != 0 || mkdir(FILE_DIR, 0755) != 0)
+        fail("Failed to create directories");
+
+    /* a second writer appends new segments and replaces page 3 */
+    add_pages(1, NPAGES - 1, 0);
+    add_pages(NPAGES, NPAGES, 1);
+    add_pages(3, 3, 1);
+    pagestore_t *ps = pagestore_open(SEG_DIR);
+    if (!ps || !(ids = pagestore_ids(ps, &count)) || count != NPAGES)
+        fail("Wrong number of packed pages");
+    for (int id = -1; id <= NPAGES + 1; id++)
+        pagestore_prefetch(ps, id);
+    for (int i = 0; i < NPAGES; i++)
+    {
+        if (ids[i] != i + 1 || !loads(ps, ids[i], ids[i] == 3 || ids[i] == NPAGES))
+            fail("Packed page does not match");
+    }
+    if (pagestore_load(ps, 0) || pagestore_load(ps, NPAGES + 1) || pagestore_load(ps, -1))
+        fail("Loaded a page never added");
+    pagestore_close(ps);
+
+    /* a crash in the middle of the second record of a new segment */
+    char path[512];
+    add_pages(NPAGES + 1, NPAGES + 2, 0);
+    long size = last_segment(path);
+    if (size <= 0 || truncate(path, size / 2) != 0)
+        fail("Failed to cut a segment short");
+    if (!(ps = pagestore_open(SEG_DIR)) || !(ids = pagestore_ids(ps, &count)))
+        fail("Failed to open a segment cut short");
+    if (!loads(ps, NPAGES + 1, 0) || pagestore_load(ps, NPAGES + 2))
+        fail("Wrong pages in a segment cut short");
+    pagestore_close(ps);
+
+    /* an id too large for a segment is neither written nor read back */
+    segwriter_t *sw = segwriter_open(SEG_DIR, 200);
+    webpage_t *page = make_page(NPAGES + 3, 0);
+    if (!sw || segwriter_add(sw, page, INT_MAX) == 0 || segwriter_add(sw, page, NPAGES + 3) != 0 ||
+        segwriter_close(sw) != 0)
+        fail("Wrong ids added to a segment");
+    webpage_delete(page);
+    size = last_segment(path);
+    int fd = open(path, O_WRONLY), big = INT_MAX;
+    if (size <= 0 || fd < 0 || pwrite(fd, &big, sizeof(big), 2 * sizeof(uint32_t)) != sizeof(big) ||
+        ftruncate(fd, size - 1) != 0 || close(fd) != 0)
+        fail("Failed to corrupt a segment");
+    if (!(ps = pagestore_open(SEG_DIR)) || !(ids = pagestore_ids(ps, &count)))
+        fail("Failed to open a segment with a corrupt id");
+    if (!loads(ps, NPAGES + 1, 0) || pagestore_load(ps, NPAGES + 3) || ids[count - 1] != NPAGES + 1)
+        fail("Wrong pages in a segment with a corrupt id");
+    pagestore_close(ps);
+
+    /* one file per page */
+    page = make_page(5, 0);
+    if (pagesave(page, 5, FILE_DIR) != 0 || pagesave(page, 2, FILE_DIR) != 0)
+        fail("Failed to save page files");
+    webpage_delete(page);
+    if (!(ps = pagestore_open(FILE_DIR)) || !(ids = pagestore_ids(ps, &count)))
+        fail("Failed to open page files");
+    pagestore_prefetch(ps, 5);
+    pagestore_prefetch(ps, 3);
+    if (count != 2 || ids[0] != 2 || ids[1] != 5 || !loads(ps, 5, 0))
+        fail("Page files do not match");
+    pagestore_close(ps);
+
+    remove_dir(SEG_DIR);
+    remove_dir(FILE_DIR);
+    printf("Page store passed all tests.\n");
+    exit(EXIT_SUCCESS);
+}
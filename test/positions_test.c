@@ -0,0 +1,245 @@
+/*
+ * positions_test.c -- tests the positions module
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: saves the positions of a small index, whole and as a
+ * base and a delta, and checks that cursors decode every doc's positions
+ * or skip them, that the set finds the positions of chosen docs across
+ * its segments, that merging the set writes the same positions as the
+ * whole index, and that positions not matching their posting lists or
+ * their index are refused
+ */
+#define _POSIX_C_SOURCE 200809L // access
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <positions.h>
+#include <indexset.h>
+#include <docstore.h>
+
+#define INDEX_FILE "positions_index"
+#define DELTA_FILE "positions_index.1"
+#define FULL_FILE "positions_full"
+#define NWORDS 4
+#define NIDS 30
+#define SPLIT 18 /* the first id of the delta */
+
+static const char *words[NWORDS] = {"alpha", "beta", "delta", "gamma"}; /* sorted, as term ids */
+
+static void cleanup(void)
+{
+    remove(INDEX_FILE);
+    remove(DELTA_FILE);
+    remove(FULL_FILE);
+    remove(INDEX_FILE POSITIONS_SUFFIX);
+    remove(DELTA_FILE POSITIONS_SUFFIX);
+    remove(FULL_FILE POSITIONS_SUFFIX);
+    remove(INDEX_FILE DOCSTORE_SUFFIX);
+}
+
+static void fail(const char *msg)
+{
+    printf("%s\n", msg);
+    cleanup();
+    exit(EXIT_FAILURE);
+}
+
+static bool searchfn(void *elementp, const void *searchkeyp)
+{
+    return strcmp(((entry_t *)elementp)->word, (const char *)searchkeyp) == 0;
+}
+
+/* word w is in every id divisible by w + 1, id % 3 + 1 times */
+static bool has_word(int w, int id)
+{
+    return id % (w + 1) == 0;
+}
+
+static int count_of(int id)
+{
+    return id % 3 + 1;
+}
+
+/* the c-th position of word w in doc id, far apart for some docs */
+static uint32_t position_of(int w, int id, int c)
+{
+    return (id % 5 == 0 ? 1000 * (id + 1) : id) + w + 7 * c;
+}
+
+/* an index with positions of the ids from first to last - 1 */
+static hashtable_t *make_index(int first, int last)
+{
+    hashtable_t *index = hopen(16);
+    for (int w = 0; index && w < NWORDS; w++)
+    {
+        for (int id = first; id < last; id++)
+        {
+            if (!has_word(w, id))
+                continue;
+            entry_t *ep = hsearch(index, searchfn, words[w], strlen(words[w]));
+            if (!ep)
+            {
+                if (!(ep = new_entry((char *)words[w])) || hput(index, ep, ep->word, strlen(ep->word)) != 0)
+                    fail("Failed to build an index");
+            }
+            if (postings_add(&ep->documents, id, count_of(id)) != 0)
+                fail("Failed to build an index");
+            for (int c = 0; c < count_of(id); c++)
+            {
+                uint32_t pos = position_of(w, id, c);
+                if (positions_append(&ep->positions, &pos, 1) != 0)
+                    fail("Failed to build an index");
+            }
+        }
+    }
+    if (!index)
+        fail("Failed to build an index");
+    return index;
+}
+
+static void save_index(int first, int last, char *indexnm, char *posnm)
+{
+    hashtable_t *index = make_index(first, last);
+    if (indexsave_binary(index, indexnm) != 0 || indexsave_positions(index, posnm) != 0)
+        fail("Failed to save an index");
+    free_entries(index);
+    hclose(index);
+}
+
+/* reads the whole of file name into a new buffer of *size bytes */
+static char *read_file(const char *name, long *size)
+{
+    FILE *file = fopen(name, "rb");
+    char *buf = NULL;
+    if (file && fseek(file, 0, SEEK_END) == 0 && (*size = ftell(file)) > 0 &&
+        fseek(file, 0, SEEK_SET) == 0 && (buf = malloc(*size)) &&
+        fread(buf, 1, *size, file) != (size_t)*size)
+    {
+        free(buf);
+        buf = NULL;
+    }
+    if (file)
+        fclose(file);
+    return buf;
+}
+
+/* decodes the positions of every doc of the whole index, skipping odd ids */
+static void check_cursors(void)
+{
+    posmap_t *pm = posmap_open(FULL_FILE POSITIONS_SUFFIX, NWORDS);
+    poscursor_t pc;
+    uint32_t pos[8];
+    if (!pm)
+        fail("Failed to map the positions");
+    for (int w = 0; w < NWORDS; w++)
+    {
+        if (!posmap_cursor(pm, w, &pc))
+            fail("Failed to open a cursor");
+        for (int id = 0; id < NIDS; id++)
+        {
+            if (!has_word(w, id))
+                continue;
+            if (poscursor_next(&pc, count_of(id), id % 2 ? NULL : pos) != 0)
+                fail("Failed to decode positions");
+            for (int c = 0; id % 2 == 0 && c < count_of(id); c++)
+            {
+                if (pos[c] != position_of(w, id, c))
+                    fail("Decoded positions differ");
+            }
+        }
+        if (poscursor_next(&pc, 1, pos) == 0)
+            fail("Decoded positions past the end of a list");
+    }
+    if (posmap_cursor(pm, NWORDS, &pc) || posmap_cursor(pm, -1, &pc))
+        fail("Opened a cursor on a term out of range");
+    posmap_close(pm);
+    if (posmap_open(FULL_FILE POSITIONS_SUFFIX, NWORDS + 1) || posmap_open(FULL_FILE, NWORDS))
+        fail("Mapped positions of another index");
+}
+
+/* finds the positions of word w in every third doc having it */
+static void check_set(indexset_t *set, int w)
+{
+    postings_t docs;
+    uint32_t *pos[NIDS];
+    int npos[NIDS];
+    arena_t *ap = arena_open(0);
+    postings_init(&docs);
+    for (int id = 0; id < NIDS; id++)
+    {
+        if (has_word(w, id) && id % 3 == 1 && postings_add(&docs, id, count_of(id)) != 0)
+            fail("Failed to build a document list");
+    }
+    if (!ap || indexset_positions(set, words[w], &docs, ap, pos, npos) != 0)
+        fail("Failed to find positions in the set");
+    for (int j = 0; j < docs.ndocs; j++)
+    {
+        int id = docs.docs[j].id;
+        if (npos[j] != count_of(id))
+            fail("Found the wrong number of positions");
+        for (int c = 0; c < npos[j]; c++)
+        {
+            if (pos[j][c] != position_of(w, id, c))
+                fail("Found positions differ");
+        }
+    }
+    postings_clear(&docs);
+    arena_close(ap);
+}
+
+int main(void)
+{
+    save_index(0, NIDS, FULL_FILE, FULL_FILE POSITIONS_SUFFIX);
+    check_cursors();
+
+    /* positions that do not match their posting list are refused */
+    hashtable_t *index = make_index(0, NIDS);
+    entry_t *ep = hsearch(index, searchfn, words[0], strlen(words[0]));
+    ep->positions.n--;
+    if (indexsave_positions(index, INDEX_FILE POSITIONS_SUFFIX) == 0)
+        fail("Saved positions not matching their posting list");
+    free_entries(index);
+    hclose(index);
+
+    /* a base and delta with positions, then a set missing some */
+    save_index(0, SPLIT, INDEX_FILE, INDEX_FILE POSITIONS_SUFFIX);
+    save_index(SPLIT, NIDS, DELTA_FILE, DELTA_FILE POSITIONS_SUFFIX);
+    indexset_t *set = indexset_open(INDEX_FILE);
+    if (!set || indexset_count(set) != 2 || !indexset_positional(set))
+        fail("Failed to open the positional set");
+    for (int w = 0; w < NWORDS; w++)
+        check_set(set, w);
+    indexset_close(set);
+
+    rename(DELTA_FILE POSITIONS_SUFFIX, FULL_FILE ".tmp");
+    if (!(set = indexset_open(INDEX_FILE)) || indexset_positional(set))
+        fail("A set missing positions is positional");
+    indexset_close(set);
+    rename(FULL_FILE ".tmp", DELTA_FILE POSITIONS_SUFFIX);
+
+    /* merging writes the positions of the whole index */
+    if (indexset_merge(INDEX_FILE) != 0)
+        fail("Failed to merge the set");
+    if (access(DELTA_FILE POSITIONS_SUFFIX, F_OK) == 0)
+        fail("Merging left the positions of the delta");
+    long merged_size = 0, full_size = 0;
+    char *merged = read_file(INDEX_FILE POSITIONS_SUFFIX, &merged_size);
+    char *whole = read_file(FULL_FILE POSITIONS_SUFFIX, &full_size);
+    if (!merged || !whole || merged_size != full_size || memcmp(merged, whole, full_size) != 0)
+        fail("The merged positions differ from the whole index");
+    free(merged);
+    free(whole);
+    if (!(set = indexset_open(INDEX_FILE)) || !indexset_positional(set))
+        fail("Failed to open the merged set");
+    for (int w = 0; w < NWORDS; w++)
+        check_set(set, w);
+    indexset_close(set);
+
+    cleanup();
+    printf("Positions passed all tests.\n");
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,300 @@
+/*
+ * postings_test.c -- tests the postings module
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: tests that posting lists stay sorted by doc id and
+ * accumulate word counts, for in-order and out-of-order adds, and
+ * checks the intersection and union merges and top-k selection
+ * against brute force, the block encoding round trip and cursors over
+ * the encoding, of several blocks and of one, which has no skip table,
+ * and that both take no more than their bounds, gaps and counts and the
+ * skip table
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <postings.h>
+#include <varint.h>
+
+static int check_sorted(postings_t *pp)
+{
+    for (int i = 1; i < pp->ndocs; i++)
+    {
+        if (pp->docs[i - 1].id >= pp->docs[i].id)
+            return -1;
+    }
+    return 0;
+}
+
+/* compares the merges against a brute force scan over both lists */
+static int check_merges(postings_t *a, postings_t *b)
+{
+    postings_t *and = postings_intersect(a, b);
+    postings_t *or = postings_union(a, b);
+    postings_t *sum_and = postings_intersect_sum(a, b);
+    int nand = 0, nor = 0;
+
+    for (int id = 0; id <= 20000; id++)
+    {
+        document_t *da = postings_find(a, id), *db = postings_find(b, id);
+        document_t *dand = postings_find(and, id), *dor = postings_find(or, id);
+        if (da && db)
+        {
+            int min = da->word_count < db->word_count ? da->word_count : db->word_count;
+            document_t *dsum = postings_find(sum_and, id);
+            if (!dand || dand->word_count != min ||
+                !dsum || dsum->word_count != da->word_count + db->word_count)
+                return -1;
+            nand++;
+        }
+        if (da || db)
+        {
+            int sum = (da ? da->word_count : 0) + (db ? db->word_count : 0);
+            if (!dor || dor->word_count != sum)
+                return -1;
+            nor++;
+        }
+    }
+    if (and->ndocs != nand || or->ndocs != nor || sum_and->ndocs != nand ||
+        check_sorted(and) || check_sorted(or))
+        return -1;
+
+    postings_free(and);
+    postings_free(or);
+    postings_free(sum_and);
+    return 0;
+}
+
+static int rank_cmp(const void *a, const void *b)
+{
+    const document_t *da = a, *db = b;
+    if (da->word_count != db->word_count)
+        return da->word_count < db->word_count ? 1 : -1;
+    return da->id < db->id ? -1 : da->id > db->id;
+}
+
+/* checks postings_topk for several k against sorting a copy */
+static int check_topk(postings_t *pp)
+{
+    int ks[] = {1, 2, 10, 100, pp->ndocs, pp->ndocs + 5};
+    document_t *sorted = malloc((pp->ndocs + 1) * sizeof(document_t));
+    document_t *top = malloc((pp->ndocs + 5) * sizeof(document_t));
+
+    memcpy(sorted, pp->docs, pp->ndocs * sizeof(document_t));
+    qsort(sorted, pp->ndocs, sizeof(document_t), rank_cmp);
+    for (int i = 0; i < sizeof(ks) / sizeof(ks[0]); i++)
+    {
+        int want = ks[i] < pp->ndocs ? ks[i] : pp->ndocs;
+        if (postings_topk(pp, ks[i], top) != want ||
+            memcmp(top, sorted, want * sizeof(document_t)) != 0)
+        {
+            free(sorted);
+            free(top);
+            return -1;
+        }
+    }
+    free(sorted);
+    free(top);
+    return 0;
+}
+
+/* walks, seeks and bounds a cursor over the encoding of pp */
+static int check_cursor(postings_t *pp, const uint8_t *data, size_t size, const uint32_t *lens)
+{
+    pcursor_t cursor;
+    int last_id, max_count;
+    uint32_t min_len;
+
+    if (pcursor_open(&cursor, data, size, pp->ndocs) != 0)
+        return -1;
+    for (int i = 0; i < pp->ndocs; i++)
+    {
+        if (pcursor_id(&cursor) != pp->docs[i].id || pcursor_count(&cursor) != pp->docs[i].word_count)
+            return -1;
+        if (!pcursor_block(&cursor, pp->docs[i].id, &last_id, &max_count, &min_len) ||
+            last_id < pp->docs[i].id || max_count < pp->docs[i].word_count ||
+            min_len > lens[pp->docs[i].id] || max_count > cursor.max_count || min_len < cursor.min_len)
+            return -1;
+        pcursor_next(&cursor);
+    }
+    if (pcursor_id(&cursor) != PCURSOR_END)
+        return -1;
+
+    /* seeks land on the first document at or after the target */
+    pcursor_open(&cursor, data, size, pp->ndocs);
+    for (int id = 0; id <= 20001; id += 1 + rand() % 700)
+    {
+        pcursor_seek(&cursor, id);
+        document_t *dp = NULL;
+        for (int i = 0; i < pp->ndocs && !dp; i++)
+        {
+            if (pp->docs[i].id >= id)
+                dp = &pp->docs[i];
+        }
+        if (pcursor_id(&cursor) != (dp ? dp->id : PCURSOR_END))
+            return -1;
+    }
+    return 0;
+}
+
+/* encodes pp with the lengths lens, which may be NULL, and checks that
+ * it decodes back, that a truncated encoding does not, and the cursor
+ */
+static int check_encoding(postings_t *pp, const uint32_t *lens)
+{
+    size_t size = postings_encoded_size(pp, lens, 0, 20001);
+    uint8_t *buffer = malloc(size);
+    postings_t *decoded = postings_new();
+    int status = 0;
+
+    if (postings_encode(pp, lens, 0, 20001, buffer) != size ||
+        postings_decode(buffer, size, pp->ndocs, decoded) != 0 ||
+        decoded->ndocs != pp->ndocs ||
+        memcmp(decoded->docs, pp->docs, pp->ndocs * sizeof(document_t)) != 0)
+    {
+        printf("Encoded posting list did not round trip\n");
+        status = -1;
+    }
+    else if (postings_decode(buffer, size - 1, pp->ndocs, decoded) == 0)
+    {
+        printf("Decoded a truncated posting list\n");
+        status = -1;
+    }
+    else if (lens && check_cursor(pp, buffer, size, lens) != 0)
+    {
+        printf("Cursor disagrees with the encoded posting list\n");
+        status = -1;
+    }
+    free(buffer);
+    postings_free(decoded);
+    return status;
+}
+
+/* the size of the bounds of documents first to last - 1 of pp */
+static size_t bounds_size(postings_t *pp, int first, int last, const uint32_t *lens)
+{
+    uint32_t max_count = 0, min_len = UINT32_MAX;
+    for (int i = first; i < last; i++)
+    {
+        max_count = pp->docs[i].word_count > (int)max_count ? pp->docs[i].word_count : max_count;
+        min_len = lens[pp->docs[i].id] < min_len ? lens[pp->docs[i].id] : min_len;
+    }
+    return varint_size(max_count) + varint_size(min_len);
+}
+
+/* the size pp should take: the bounds of the list, then for several
+ * blocks an 8 byte skip entry and the bounds of each, and the documents
+ */
+static size_t compact_size(postings_t *pp, const uint32_t *lens)
+{
+    size_t size = bounds_size(pp, 0, pp->ndocs, lens), prev = 0;
+    for (int first = 0; pp->ndocs > POSTINGS_BLOCK && first < pp->ndocs; first += POSTINGS_BLOCK)
+    {
+        int last = first + POSTINGS_BLOCK < pp->ndocs ? first + POSTINGS_BLOCK : pp->ndocs;
+        size += 8 + bounds_size(pp, first, last, lens);
+    }
+    for (int i = 0; i < pp->ndocs; i++)
+    {
+        size += varint_size(pp->docs[i].id - prev) + varint_size(pp->docs[i].word_count);
+        prev = pp->docs[i].id;
+    }
+    return size;
+}
+
+int main(void)
+{
+    postings_t *pp = postings_new();
+
+    /* in-order adds take the append-or-increment path */
+    for (int id = 1; id <= 100; id++)
+    {
+        for (int n = 0; n < id % 3 + 1; n++)
+            postings_add(pp, id, 1);
+    }
+    if (pp->ndocs != 100 || check_sorted(pp) != 0)
+    {
+        printf("In-order adds produced %d docs\n", pp->ndocs);
+        exit(EXIT_FAILURE);
+    }
+
+    /* out-of-order adds are inserted or merged in place */
+    postings_add(pp, 50, 10);
+    postings_add(pp, 0, 1);
+    postings_add(pp, 1000, 2);
+    postings_add(pp, 500, 3);
+    if (pp->ndocs != 103 || check_sorted(pp) != 0)
+    {
+        printf("Out-of-order adds produced %d docs\n", pp->ndocs);
+        exit(EXIT_FAILURE);
+    }
+
+    document_t *dp = postings_find(pp, 50);
+    if (!dp || dp->word_count != 50 % 3 + 1 + 10)
+    {
+        printf("Wrong word count for doc 50\n");
+        exit(EXIT_FAILURE);
+    }
+    if (postings_find(pp, 101) != NULL)
+    {
+        printf("Found doc 101 which was never added\n");
+        exit(EXIT_FAILURE);
+    }
+
+    postings_free(pp);
+
+    /* a short list against a long one exercises the galloping search */
+    postings_t *a = postings_new(), *b = postings_new(), *empty = postings_new();
+    srand(7);
+    for (int id = 0; id <= 20000; id++)
+    {
+        if (rand() % 500 == 0)
+            postings_add(a, id, rand() % 5 + 1);
+        if (rand() % 3 == 0)
+            postings_add(b, id, rand() % 5 + 1);
+    }
+    if (check_merges(a, b) != 0 || check_merges(b, a) != 0 ||
+        check_merges(a, empty) != 0 || check_merges(b, b) != 0)
+    {
+        printf("Intersection or union disagrees with brute force\n");
+        exit(EXIT_FAILURE);
+    }
+    if (check_topk(a) != 0 || check_topk(b) != 0 || check_topk(empty) != 0)
+    {
+        printf("Top-k selection disagrees with sorting\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* encoding and decoding must round trip across block boundaries */
+    uint32_t *lens = malloc(20001 * sizeof(uint32_t));
+    for (int id = 0; id <= 20000; id++)
+        lens[id] = 10 + rand() % 100;
+    if (check_encoding(b, NULL) != 0 || check_encoding(b, lens) != 0 || check_encoding(a, lens) != 0)
+        exit(EXIT_FAILURE);
+
+    /* a list of one block has its bounds and documents, and no skip table */
+    if (a->ndocs > POSTINGS_BLOCK || b->ndocs <= POSTINGS_BLOCK ||
+        postings_encoded_size(a, lens, 0, 20001) != compact_size(a, lens) ||
+        postings_encoded_size(b, lens, 0, 20001) != compact_size(b, lens))
+    {
+        printf("A posting list is not encoded compactly\n");
+        exit(EXIT_FAILURE);
+    }
+    free(lens);
+
+    /* views borrow documents and must not free them */
+    postings_t *view = postings_view(b->docs, b->ndocs);
+    if (check_merges(a, view) != 0)
+    {
+        printf("Merges over a view disagree with brute force\n");
+        exit(EXIT_FAILURE);
+    }
+    postings_free(view);
+    postings_free(a);
+    postings_free(b);
+    postings_free(empty);
+
+    printf("Posting lists passed all tests.\n");
+    exit(EXIT_SUCCESS);
+}
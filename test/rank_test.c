@@ -0,0 +1,145 @@
+/*
+ * rank_test.c -- tests the rank module
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: scores a posting list over documents of known lengths
+ * and checks the BM25 scores against the formula, that a short page
+ * outranks a long one with as many occurrences, and that rarer terms
+ * weigh more. Block-max WAND over encoded lists must select the same
+ * documents as scoring every one of them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <rank.h>
+
+#define NIDS 6
+#define WAND_IDS 20000
+#define WAND_TERMS 5
+
+static void fail(const char *msg)
+{
+    printf("%s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+/* compares WAND with scoring the union of random lists, for several k */
+static int check_wand(rank_mode_t mode)
+{
+    static uint32_t lens[WAND_IDS];
+    postings_t *lists[WAND_TERMS];
+    uint8_t *data[WAND_TERMS];
+    size_t sizes[WAND_TERMS];
+    pcursor_t cursors[WAND_TERMS];
+    document_t expected[100], got[100];
+
+    for (int id = 0; id < WAND_IDS; id++)
+        lens[id] = 20 + rand() % 500;
+    doclens_t dl = {lens, WAND_IDS, WAND_IDS, 0, NULL};
+    for (int id = 0; id < WAND_IDS; id++)
+        dl.avglen += lens[id] / (double)WAND_IDS;
+    ranker_t *rp = ranker_open(mode, &dl);
+
+    /* terms from very common to rare */
+    postings_t *all = postings_new();
+    for (int t = 0; t < WAND_TERMS; t++)
+    {
+        lists[t] = postings_new();
+        for (int id = 0; id < WAND_IDS; id++)
+        {
+            if (rand() % (1 << (2 * t)) == 0)
+                postings_add(lists[t], id, 1 + rand() % (t + 3));
+        }
+        sizes[t] = postings_encoded_size(lists[t], lens, 0, WAND_IDS);
+        data[t] = malloc(sizes[t]);
+        postings_encode(lists[t], lens, 0, WAND_IDS, data[t]);
+
+        postings_t *scores = ranker_score(rp, lists[t]), *sum = postings_union(all, scores);
+        postings_free(scores);
+        postings_free(all);
+        all = sum;
+    }
+
+    int ks[] = {1, 10, 100};
+    for (int i = 0; i < 3; i++)
+    {
+        for (int t = 0; t < WAND_TERMS; t++)
+            pcursor_open(&cursors[t], data[t], sizes[t], lists[t]->ndocs);
+        int n = postings_topk(all, ks[i], expected);
+        if (ranker_topk_or(rp, cursors, NULL, WAND_TERMS, ks[i], got) != n ||
+            memcmp(got, expected, n * sizeof(document_t)) != 0)
+            return -1;
+    }
+
+    for (int t = 0; t < WAND_TERMS; t++)
+    {
+        postings_free(lists[t]);
+        free(data[t]);
+    }
+    postings_free(all);
+    ranker_close(rp);
+    return 0;
+}
+
+int main(void)
+{
+    /* ids 1 to 5 are indexed; id 0 is not */
+    uint32_t lens[NIDS] = {0, 10, 100, 10, 40, 40};
+    doclens_t dl = {lens, NIDS, 5, 40.0, NULL};
+    rank_mode_t mode;
+
+    if (rank_parse("bm25", &mode) != 0 || mode != RANK_BM25 ||
+        rank_parse("tfidf", &mode) != 0 || mode != RANK_TFIDF ||
+        rank_parse("count", &mode) != 0 || mode != RANK_COUNT ||
+        rank_parse("pagerank", &mode) == 0)
+        fail("Rank mode names are not parsed");
+
+    postings_t *common = postings_new(), *rare = postings_new();
+    postings_add(common, 1, 3);
+    postings_add(common, 2, 3);
+    postings_add(common, 3, 1);
+    postings_add(common, 4, 2);
+    postings_add(rare, 4, 2);
+
+    ranker_t *rp = ranker_open(RANK_BM25, &dl);
+    postings_t *scores = ranker_score(rp, common);
+    if (!scores || scores->ndocs != common->ndocs)
+        fail("BM25 scoring lost documents");
+    double idf = log(1 + (5 - 4 + 0.5) / (4 + 0.5));
+    for (int i = 0; i < scores->ndocs; i++)
+    {
+        double tf = common->docs[i].word_count;
+        double norm = BM25_K1 * (1 - BM25_B + BM25_B * lens[common->docs[i].id] / 40.0);
+        int expected = (int)lround(idf * tf * (BM25_K1 + 1) / (tf + norm) * RANK_SCALE);
+        if (scores->docs[i].id != common->docs[i].id || scores->docs[i].word_count != expected)
+            fail("BM25 score differs from the formula");
+    }
+    if (postings_find(scores, 1)->word_count <= postings_find(scores, 2)->word_count)
+        fail("A long page scored as high as a short one");
+
+    postings_t *rare_scores = ranker_score(rp, rare);
+    if (rare_scores->docs[0].word_count <= postings_find(scores, 4)->word_count)
+        fail("A rare term weighs no more than a common one");
+    postings_free(scores);
+    postings_free(rare_scores);
+    ranker_close(rp);
+
+    rp = ranker_open(RANK_TFIDF, &dl);
+    scores = ranker_score(rp, common);
+    if (postings_find(scores, 1)->word_count != postings_find(scores, 2)->word_count ||
+        postings_find(scores, 1)->word_count <= postings_find(scores, 3)->word_count)
+        fail("TF-IDF did not depend on the term frequency only");
+    postings_free(scores);
+    ranker_close(rp);
+
+    postings_free(common);
+    postings_free(rare);
+
+    if (check_wand(RANK_BM25) != 0 || check_wand(RANK_TFIDF) != 0)
+        fail("WAND selected other documents than exhaustive scoring");
+    printf("Ranking passed all tests.\n");
+    exit(EXIT_SUCCESS);
+}
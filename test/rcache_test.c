@@ -0,0 +1,98 @@
+/*
+ * rcache_test.c -- tests the query result cache
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: cached results must come back unchanged and be counted
+ * as hits, the least recently used results must be evicted first to
+ * stay under the cap, and a new index generation must drop everything
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <rcache.h>
+
+#define NDOCS 10
+#define CAPACITY 2000 /* bytes */
+
+static void fail(const char *msg)
+{
+    printf("%s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+/* true if key is cached on generation gen with the docs of put_docs */
+static bool cached(rcache_t *rc, arena_t *ap, uint64_t gen, const char *key, int ndocs)
+{
+    document_t *docs;
+    int n = rcache_get(rc, gen, key, ap, &docs);
+    if (n < 0)
+        return false;
+    if (n != ndocs)
+        fail("Cached results have the wrong length");
+    for (int i = 0; i < n; i++)
+    {
+        if (docs[i].id != i || docs[i].word_count != 100 - i)
+            fail("Cached results do not match");
+    }
+    return true;
+}
+
+int main(void)
+{
+    document_t docs[NDOCS];
+    for (int i = 0; i < NDOCS; i++)
+        docs[i] = (document_t){i, 100 - i};
+    arena_t *ap = arena_open(0);
+    rcache_stats_t stats;
+
+    rcache_t *rc = rcache_open(CAPACITY);
+    if (!rc || !ap)
+        fail("Failed to open cache");
+    if (cached(rc, ap, 1, "dog", NDOCS))
+        fail("Found a query never cached");
+    if (rcache_put(rc, 1, "dog", docs, NDOCS) != 0 || rcache_put(rc, 1, "cat", docs, 3) != 0 ||
+        rcache_put(rc, 1, "dog and cat", docs, 0) != 0)
+        fail("Failed to cache results");
+    if (rcache_put(rc, 1, "dog", docs, NDOCS) == 0)
+        fail("Cached a query twice");
+    if (!cached(rc, ap, 1, "cat", 3) || !cached(rc, ap, 1, "dog and cat", 0) || !cached(rc, ap, 1, "dog", NDOCS))
+        fail("Failed to find cached results");
+
+    /* fill the cache, keeping "dog" recently used: "cat" goes first */
+    char key[16];
+    int n = 0;
+    do
+    {
+        sprintf(key, "cow%d", n++);
+        if (rcache_put(rc, 1, key, docs, NDOCS) != 0 || !cached(rc, ap, 1, "dog", NDOCS))
+            fail("Failed to cache results");
+        rcache_getstats(rc, &stats);
+    } while (stats.evictions == 0);
+    if (cached(rc, ap, 1, "cat", 3) || !cached(rc, ap, 1, "dog", NDOCS) || !cached(rc, ap, 1, key, NDOCS))
+        fail("Evicted the wrong results");
+    uint64_t evictions = stats.evictions;
+    rcache_getstats(rc, &stats);
+    if (stats.hits != 3 + n + 2 || stats.misses != 2 || stats.entries != 3 + n - evictions || stats.used > CAPACITY)
+        fail("Wrong counters");
+
+    document_t big[CAPACITY / sizeof(document_t)];
+    memset(big, 0, sizeof(big));
+    if (rcache_put(rc, 1, "big", big, CAPACITY / sizeof(document_t)) == 0)
+        fail("Cached results larger than the cap");
+
+    /* a rewritten index invalidates everything */
+    if (cached(rc, ap, 2, "cat", 3))
+        fail("Found results of an old index generation");
+    rcache_getstats(rc, &stats);
+    if (stats.invalidations != 1 || stats.entries != 0 || stats.used != 0)
+        fail("Cache not invalidated");
+    if (rcache_put(rc, 2, "cat", docs, 3) != 0 || !cached(rc, ap, 2, "cat", 3))
+        fail("Failed to cache results after invalidation");
+
+    rcache_close(rc);
+    arena_close(ap);
+    printf("Result cache passed all tests.\n");
+    exit(EXIT_SUCCESS);
+}
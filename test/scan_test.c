@@ -0,0 +1,122 @@
+/*
+ * scan_test.c -- tests the scan module
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: checks every implementation the CPU supports against
+ * the scalar one from every start position of random html-like text,
+ * and checks that the tokens of a page do not depend on it
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <scan.h>
+#include <webpage.h>
+
+#define TEXT_LEN 4099
+
+static const char *impls[] = {"avx2", "sse2", "neon"};
+
+/* alphabet weighted towards letters, with tag marks, NULs and high bytes */
+static void fill(char *text, size_t len)
+{
+    static const char marks[] = "<<>> \n\t.,-_@[`{~\x80\xc1\xe1\xff";
+    for (size_t i = 0; i < len; i++)
+    {
+        int r = rand() % 64;
+        if (r < 40)
+            text[i] = (r % 2 ? 'a' : 'A') + rand() % 26;
+        else if (r < 63)
+            text[i] = marks[rand() % (sizeof(marks) - 1)];
+        else
+            text[i] = '\0';
+    }
+    text[len] = '\0';
+}
+
+/* the words of a page, joined by spaces */
+static char *words(webpage_t *page)
+{
+    size_t size = webpage_getHTMLlen(page) * 2 + 1, used = 0;
+    char *out = calloc(size, 1);
+    char *word;
+    int pos = 0;
+
+    while ((pos = webpage_getNextWord(page, pos, &word)) > 0)
+    {
+        used += sprintf(out + used, "%s ", word);
+        free(word);
+    }
+    return out;
+}
+
+int main(void)
+{
+    char *text = malloc(TEXT_LEN + 1);
+    size_t len;
+
+    srand(42);
+    printf("Using the %s scanner.\n", scan_impl());
+
+    for (int round = 0; round < 20; round++)
+    {
+        fill(text, TEXT_LEN);
+        len = TEXT_LEN - rand() % 64;
+        for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++)
+        {
+            if (!scan_use(impls[i]))
+                continue;
+            for (size_t pos = 0; pos <= len; pos++)
+            {
+                size_t w, e, t;
+                w = scan_to_word(text, pos, len);
+                e = scan_word_end(text, pos, len);
+                t = scan_tag_end(text, pos, len);
+                scan_use("scalar");
+                if (w != scan_to_word(text, pos, len) || e != scan_word_end(text, pos, len) ||
+                    t != scan_tag_end(text, pos, len))
+                {
+                    printf("%s scan differs from scalar at %zu\n", impls[i], pos);
+                    exit(EXIT_FAILURE);
+                }
+                scan_use(impls[i]);
+            }
+        }
+    }
+
+    /* the same page must give the same words with every scanner */
+    char *html = calloc(TEXT_LEN + 1, 1);
+    fill(html, TEXT_LEN);
+    for (size_t i = 0; i < TEXT_LEN; i++)
+        if (html[i] == '\0')
+            html[i] = ' ';
+    char *url = malloc(strlen("http://localhost/") + 1);
+    strcpy(url, "http://localhost/");
+    webpage_t *page = webpage_new(url, 0, html);
+    scan_use("scalar");
+    char *expected = words(page);
+    if (strlen(expected) == 0)
+    {
+        printf("Found no words\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++)
+    {
+        if (!scan_use(impls[i]))
+            continue;
+        char *got = words(page);
+        if (strcmp(got, expected) != 0)
+        {
+            printf("%s scan changes the words of a page\n", impls[i]);
+            exit(EXIT_FAILURE);
+        }
+        free(got);
+    }
+
+    free(expected);
+    webpage_delete(page);
+    free(text);
+    printf("Scan passed all tests.\n");
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,341 @@
+/*
+ * server_test.c -- tests the server mode of the querier
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: indexes a few pages with ../indexer/indexer and answers
+ * each query with ../querier/query reading stdin, then starts the
+ * querier on a unix socket and checks that every answer ends with a
+ * "." line and matches the one read from stdin: for queries pipelined
+ * on one connection, an empty line among them, and for several clients
+ * at once. SIGTERM must then stop the server and remove its socket.
+ * A page indexed into a delta while the server runs must show up in
+ * its answers, which are cached, once the index is checked again.
+ * Both programs must be built first.
+ */
+#define _POSIX_C_SOURCE 200809L // getline, mkdtemp, strdup, kill
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <webpage.h>
+#include <pageio.h>
+
+#define INDEXER "../indexer/indexer"
+#define QUERIER "../querier/query"
+#define NPAGES 6
+#define NCLIENTS 4
+#define ROUNDS 3
+#define CONNECT_TRIES 200 /* of 50 ms, while the querier loads its index */
+
+static char *pages[NPAGES] = {
+    "<html><title>Dartmouth</title><body>dartmouth college computer science</body></html>",
+    "<html><title>Science</title><body>computer science and science fiction</body></html>",
+    "<html><title>Art</title><body>art history at dartmouth, art studio</body></html>",
+    "<html><title>Hanover</title><body>hanover town green near dartmouth college</body></html>",
+    "<html><title>Computers</title><body>computer computer computing computers</body></html>",
+    "<html><title>Fiction</title><body>science fiction art and fiction writing</body></html>",
+};
+
+/* the answers are compared, so the queries cover hits, misses and errors */
+static char *queries[] = {
+    "dartmouth",
+    "computer science",
+    "science or art",
+    "Dartmouth AND college or fiction",
+    "comp*",
+    "",
+    "elephant",
+    "and science",
+};
+#define NQUERIES ((int)(sizeof(queries) / sizeof(queries[0])))
+
+static char dir[64], pagedir[96], indexnm[96], socket_path[96];
+static char *expected[NQUERIES];
+
+static void fail(const char *msg)
+{
+    printf("%s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+/* the output of a shell command, as a string; freed by the caller */
+static char *run(const char *command)
+{
+    FILE *pipe = popen(command, "r");
+    char *text = NULL, buffer[4096];
+    size_t len = 0, n;
+
+    if (!pipe)
+        fail("Failed to run a command");
+    while ((n = fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+    {
+        if (!(text = realloc(text, len + n + 1)))
+            fail("Out of memory");
+        memcpy(text + len, buffer, n);
+        len += n;
+    }
+    if (pclose(pipe) != 0)
+        fail(command);
+    if (!text && !(text = malloc(1)))
+        fail("Out of memory");
+    text[len] = '\0';
+    return text;
+}
+
+/* the answer of the querier reading stdin, without its prompts */
+static char *answer_stdin(const char *query, const char *options)
+{
+    char path[128], command[512];
+    FILE *file;
+
+    snprintf(path, sizeof(path), "%s/query", dir);
+    if (!(file = fopen(path, "w")) || fprintf(file, "%s\n", query) < 0 || fclose(file) != 0)
+        fail("Failed to write the query");
+    snprintf(command, sizeof(command), "%s %s %s %s < %s 2>/dev/null", QUERIER, pagedir, indexnm, options, path);
+    char *text = run(command);
+    size_t len = strlen(text);
+
+    /* "> " before the answer, and "> \n" at the end of the input */
+    if (len < 5 || strncmp(text, "> ", 2) != 0 || strcmp(text + len - 3, "> \n") != 0)
+        fail("Unexpected output from the querier on stdin");
+    text[len - 3] = '\0';
+    memmove(text, text + 2, len - 4);
+    return text;
+}
+
+/* connects to the server, waiting for it to listen */
+static int connect_server(void)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    for (int tries = 0; tries < CONNECT_TRIES; tries++)
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+            return fd;
+        close(fd);
+        nanosleep(&(struct timespec){0, 50000000}, NULL);
+    }
+    return -1;
+}
+
+/* reads one answer up to its "." line, which is left out
+ * returns: 0 if the answer matched expected; nonzero otherwise
+ */
+static int check_answer(FILE *in, const char *expected)
+{
+    char *line = NULL;
+    size_t size = 0, at = 0, len = strlen(expected);
+    ssize_t n;
+    int status = 1;
+
+    while ((n = getline(&line, &size, in)) > 0)
+    {
+        if (strcmp(line, ".\n") == 0)
+        {
+            status = at != len;
+            break;
+        }
+        if (at + n > len || strncmp(expected + at, line, n) != 0)
+            break;
+        at += n;
+    }
+    free(line);
+    return status;
+}
+
+/* sends every query ROUNDS times, starting from query *arg, all before
+ * reading any answer, then checks the answers in order
+ * returns: NULL if every answer matched; non NULL otherwise
+ */
+static void *run_client(void *arg)
+{
+    int first = (int)(long)arg, fd = connect_server(), out_fd = fd < 0 ? -1 : dup(fd);
+    FILE *in = fd < 0 ? NULL : fdopen(fd, "r"), *out = out_fd < 0 ? NULL : fdopen(out_fd, "w");
+    void *failed = NULL;
+
+    if (!in || !out)
+        fail("Failed to connect to the querier");
+    for (int q = 0; q < NQUERIES * ROUNDS; q++)
+        fprintf(out, "%s\n", queries[(first + q) % NQUERIES]);
+    if (fflush(out) != 0)
+        failed = (void *)1;
+    for (int q = 0; !failed && q < NQUERIES * ROUNDS; q++)
+    {
+        if (check_answer(in, expected[(first + q) % NQUERIES]) != 0)
+            failed = (void *)1;
+    }
+    fclose(out);
+    fclose(in);
+    return failed;
+}
+
+/* starts the querier on the socket with the options */
+static pid_t start_server(char *options)
+{
+    char *qargv[16] = {QUERIER, pagedir, indexnm, "-s", socket_path, "-t", "2"};
+    int qargc = 7;
+
+    for (char *opt = strtok(options, " "); opt && qargc < 15; opt = strtok(NULL, " "))
+        qargv[qargc++] = opt;
+    qargv[qargc] = NULL;
+
+    pid_t pid = fork();
+    if (pid < 0)
+        fail("Failed to fork");
+    if (pid == 0)
+    {
+        execv(QUERIER, qargv);
+        _exit(EXIT_FAILURE);
+    }
+    return pid;
+}
+
+/* stops the server, which must remove its socket */
+static void stop_server(pid_t pid)
+{
+    int status;
+
+    if (kill(pid, SIGTERM) != 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0)
+        fail("The server did not stop on SIGTERM");
+    if (access(socket_path, F_OK) == 0)
+        fail("The server left its socket behind");
+}
+
+/* saves the page id holding html */
+static void save_page(int id, char *html)
+{
+    char url[64];
+
+    snprintf(url, sizeof(url), "http://example.com/%d.html", id);
+    webpage_t *page = webpage_new(url, 0, strdup(html));
+    if (!page || pagesave(page, id, pagedir) != 0)
+        fail("Failed to save a page");
+    webpage_delete(page);
+}
+
+/* the answer of the server to one query, on a connection of its own */
+static char *answer_server(const char *query)
+{
+    int fd = connect_server(), out_fd = fd < 0 ? -1 : dup(fd);
+    FILE *in = fd < 0 ? NULL : fdopen(fd, "r"), *out = out_fd < 0 ? NULL : fdopen(out_fd, "w");
+    char *text = NULL, *line = NULL;
+    size_t size = 0, len = 0;
+    ssize_t n;
+
+    if (!in || !out || fprintf(out, "%s\n", query) < 0 || fflush(out) != 0)
+        fail("Failed to connect to the querier");
+    while ((n = getline(&line, &size, in)) > 0 && strcmp(line, ".\n") != 0)
+    {
+        if (!(text = realloc(text, len + n + 1)))
+            fail("Out of memory");
+        memcpy(text + len, line, n + 1);
+        len += n;
+    }
+    if (n <= 0)
+        fail("The server did not end its answer");
+    free(line);
+    fclose(out);
+    fclose(in);
+    return text ? text : strdup("");
+}
+
+/* runs the clients against a server started with the options */
+static void test_server(char *options)
+{
+    pthread_t threads[NCLIENTS];
+    void *failed;
+    pid_t pid = start_server(options);
+
+    /* one client alone, with its queries pipelined */
+    if (run_client((void *)0) != NULL)
+        fail("Wrong answers from the server to one client");
+
+    /* several at once, each starting from another query */
+    for (long c = 0; c < NCLIENTS; c++)
+    {
+        if (pthread_create(&threads[c], NULL, run_client, (void *)c) != 0)
+            fail("Failed to start a client");
+    }
+    for (int c = 0; c < NCLIENTS; c++)
+    {
+        pthread_join(threads[c], &failed);
+        if (failed)
+            fail("Wrong answers from the server to several clients");
+    }
+    stop_server(pid);
+}
+
+/* indexes a new page into a delta while a server with a cache runs */
+static void test_reload(void)
+{
+    char command[256], options[] = "-c 64";
+    pid_t pid = start_server(options);
+    char *text = answer_server("zebra");
+
+    if (strstr(text, "doc:"))
+        fail("Found a word of a page not indexed yet");
+    free(text);
+    save_page(NPAGES + 1, "<html><title>Zoo</title><body>zebra crossing</body></html>");
+    snprintf(command, sizeof(command), "%s -u %s %s > /dev/null", INDEXER, pagedir, indexnm);
+    free(run(command));
+
+    /* the index is checked at most once a second */
+    nanosleep(&(struct timespec){1, 200000000}, NULL);
+    text = answer_server("zebra");
+    snprintf(command, sizeof(command), "doc:%d ", NPAGES + 1);
+    if (!strstr(text, command))
+        fail("The server did not load the index again");
+    free(text);
+    stop_server(pid);
+}
+
+int main(void)
+{
+    char command[256], options[][32] = {"", "-r bm25 -k 2"};
+
+    if (access(INDEXER, X_OK) != 0 || access(QUERIER, X_OK) != 0)
+        fail("Build the indexer and the querier first");
+    snprintf(dir, sizeof(dir), "/tmp/server_test.XXXXXX");
+    if (!mkdtemp(dir))
+        fail("Failed to make a directory");
+    snprintf(pagedir, sizeof(pagedir), "%s/pages", dir);
+    snprintf(indexnm, sizeof(indexnm), "%s/index", dir);
+    snprintf(socket_path, sizeof(socket_path), "%s/sock", dir);
+    snprintf(command, sizeof(command), "mkdir %s", pagedir);
+    free(run(command));
+    for (int i = 0; i < NPAGES; i++)
+        save_page(i + 1, pages[i]);
+    snprintf(command, sizeof(command), "%s %s %s > /dev/null", INDEXER, pagedir, indexnm);
+    free(run(command));
+
+    for (int o = 0; o < (int)(sizeof(options) / sizeof(options[0])); o++)
+    {
+        for (int q = 0; q < NQUERIES; q++)
+            expected[q] = answer_stdin(queries[q], options[o]);
+        if (!strstr(expected[1], "doc:") || strstr(expected[6], "doc:"))
+            fail("Wrong answers from the querier on stdin");
+        test_server(options[o]);
+        for (int q = 0; q < NQUERIES; q++)
+            free(expected[q]);
+    }
+    test_reload();
+
+    snprintf(command, sizeof(command), "rm -r %s", dir);
+    free(run(command));
+    printf("Server passed all tests.\n");
+    exit(EXIT_SUCCESS);
+}
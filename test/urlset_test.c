@@ -0,0 +1,129 @@
+/*
+ * urlset_test.c -- tests the url set module
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: several threads insert overlapping ranges of urls at
+ * once; every url must be won by exactly one insert and be found
+ * afterwards, with the stripes growing well past their initial size.
+ * The set is then written and read back, and a damaged copy refused
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <urlset.h>
+
+#define NUM_THREADS 4
+#define NUM_URLS 20000 /* distinct urls */
+#define PER_THREAD 10000 /* urls inserted by each thread */
+
+static urlset_t *usp;
+static int wins[NUM_URLS];
+
+static void *insert_urls(void *arg)
+{
+    int first = (int)(intptr_t)arg * (NUM_URLS - PER_THREAD) / (NUM_THREADS - 1);
+    char url[64];
+
+    /* each thread's range overlaps its neighbours' */
+    for (int i = first; i < first + PER_THREAD; i++)
+    {
+        sprintf(url, "https://example.com/page%d.html", i);
+        if (urlset_insert(usp, url))
+            __atomic_fetch_add(&wins[i], 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t threads[NUM_THREADS];
+    char url[64];
+
+    usp = urlset_open(10);
+    for (int i = 0; i < NUM_THREADS; i++)
+    {
+        if (pthread_create(&threads[i], NULL, insert_urls, (void *)(intptr_t)i) != 0)
+        {
+            printf("Failed to create thread %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < NUM_THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    for (int i = 0; i < NUM_URLS; i++)
+    {
+        sprintf(url, "https://example.com/page%d.html", i);
+        if (wins[i] != 1)
+        {
+            printf("%s was won %d times\n", url, wins[i]);
+            exit(EXIT_FAILURE);
+        }
+        if (!urlset_contains(usp, url) || urlset_insert(usp, url))
+        {
+            printf("%s is missing from the set\n", url);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (urlset_contains(usp, "https://example.com/missing.html"))
+    {
+        printf("Found a url that was never added\n");
+        exit(EXIT_FAILURE);
+    }
+    if (urlset_count(usp) != NUM_URLS)
+    {
+        printf("Set holds %u urls, expected %d\n", urlset_count(usp), NUM_URLS);
+        exit(EXIT_FAILURE);
+    }
+
+    /* the saved set holds the same urls, and a truncated one is refused */
+    FILE *file = tmpfile();
+    urlset_t *loaded;
+    long size;
+    if (!file || urlset_write(usp, file) != 0 || (size = ftell(file)) <= 0 || fseek(file, 0, SEEK_SET) != 0 ||
+        !(loaded = urlset_read(file)) || urlset_count(loaded) != NUM_URLS)
+    {
+        printf("Failed to write and read back the set\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < NUM_URLS; i++)
+    {
+        sprintf(url, "https://example.com/page%d.html", i);
+        if (!urlset_contains(loaded, url))
+        {
+            printf("%s is missing from the loaded set\n", url);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (urlset_contains(loaded, "https://example.com/missing.html") ||
+        !urlset_insert(loaded, "https://example.com/missing.html"))
+    {
+        printf("The loaded set holds a url that was never added\n");
+        exit(EXIT_FAILURE);
+    }
+    urlset_close(loaded);
+
+    char *bytes = malloc(size);
+    if (!bytes || fseek(file, 0, SEEK_SET) != 0 || fread(bytes, 1, size, file) != (size_t)size)
+    {
+        printf("Failed to read the saved set\n");
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+    file = tmpfile();
+    if (!file || fwrite(bytes, 1, size - 3, file) != (size_t)(size - 3) || fseek(file, 0, SEEK_SET) != 0 ||
+        (loaded = urlset_read(file)))
+    {
+        printf("Read a truncated set\n");
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+    free(bytes);
+
+    urlset_close(usp);
+    printf("Url set passed all tests.\n");
+    exit(EXIT_SUCCESS);
+}
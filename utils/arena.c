@@ -0,0 +1,141 @@
+/*
+ * arena.c -- region allocator
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: implementation of arenas as a list of blocks, newest
+ * first. Only the newest block is allocated from; when it is full a new
+ * one is started, and the space left in the old one is not used again.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "arena.h"
+
+#define DEFAULT_BLOCK (64 * 1024)
+#define ALIGN (sizeof(max_align_t))
+
+typedef struct block
+{
+	struct block *next;
+	size_t size; /* bytes of data */
+	size_t used;
+	max_align_t data[]; /* aligned for any type */
+} block_t;
+
+struct arena
+{
+	block_t *blocks;
+	size_t block_size;
+	size_t used;
+};
+
+static block_t *new_block(size_t size)
+{
+	block_t *bp = malloc(sizeof(block_t) + size);
+
+	if (bp == NULL)
+		return NULL;
+	bp->next = NULL;
+	bp->size = size;
+	bp->used = 0;
+	return bp;
+}
+
+arena_t *arena_open(size_t block_size)
+{
+	arena_t *ap = malloc(sizeof(arena_t));
+
+	if (ap == NULL)
+		return NULL;
+	ap->block_size = block_size ? block_size : DEFAULT_BLOCK;
+	ap->used = 0;
+	if ((ap->blocks = new_block(ap->block_size)) == NULL)
+	{
+		free(ap);
+		return NULL;
+	}
+	return ap;
+}
+
+void arena_close(arena_t *ap)
+{
+	block_t *bp, *next;
+
+	if (ap == NULL)
+		return;
+	for (bp = ap->blocks; bp != NULL; bp = next)
+	{
+		next = bp->next;
+		free(bp);
+	}
+	free(ap);
+}
+
+void arena_reset(arena_t *ap)
+{
+	block_t *bp, *next;
+
+	if (ap == NULL)
+		return;
+	/* the oldest block is the last; keep it if it is a regular one */
+	for (bp = ap->blocks; bp != NULL && bp->next != NULL; bp = next)
+	{
+		next = bp->next;
+		free(bp);
+	}
+	if (bp != NULL && bp->size != ap->block_size)
+	{
+		free(bp);
+		bp = NULL;
+	}
+	if (bp != NULL)
+		bp->used = 0;
+	ap->blocks = bp;
+	ap->used = 0;
+}
+
+/* takes size bytes from the newest block at a multiple of align */
+static void *bump(arena_t *ap, size_t size, size_t align)
+{
+	block_t *bp = ap->blocks;
+	size_t start = bp ? (bp->used + align - 1) & ~(align - 1) : 0;
+	void *p;
+
+	if (bp == NULL || start > bp->size || bp->size - start < size)
+	{
+		if ((bp = new_block(size > ap->block_size ? size : ap->block_size)) == NULL)
+			return NULL;
+		bp->next = ap->blocks;
+		ap->blocks = bp;
+		start = 0;
+	}
+	p = (char *)bp->data + start;
+	bp->used = start + size;
+	ap->used += size;
+	return p;
+}
+
+void *arena_alloc(arena_t *ap, size_t size)
+{
+	if (ap == NULL)
+		return NULL;
+	return bump(ap, size, ALIGN);
+}
+
+char *arena_strndup(arena_t *ap, const char *s, size_t len)
+{
+	char *copy;
+
+	if (ap == NULL || s == NULL || (copy = bump(ap, len + 1, 1)) == NULL)
+		return NULL;
+	memcpy(copy, s, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+size_t arena_used(arena_t *ap)
+{
+	return ap ? ap->used : 0;
+}
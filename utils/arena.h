@@ -0,0 +1,50 @@
+#pragma once
+/*
+ * arena.h -- region allocator
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: an arena hands out memory from large blocks by bumping
+ * a pointer. Nothing is freed on its own; everything allocated from an
+ * arena is released at once by arena_reset or arena_close. This suits
+ * the many small, equally long-lived objects of a queue, an index or
+ * one query.
+ *
+ * The queue and hash modules can be opened on an arena (qopen_arena,
+ * hopen_arena); so can index entries (new_entry_in). An arena is not
+ * locked; use one per thread.
+ */
+#include <stddef.h>
+
+typedef struct arena arena_t; /* representation of an arena hidden */
+
+/* arena_open -- creates an arena that allocates in blocks of about
+ * block_size bytes, or a default size if block_size is 0
+ * returns: the arena, or NULL on failure
+ */
+arena_t *arena_open(size_t block_size);
+
+/* arena_close -- frees an arena and everything allocated from it */
+void arena_close(arena_t *ap);
+
+/* arena_reset -- frees everything allocated from an arena, keeping its
+ * first block for reuse
+ */
+void arena_reset(arena_t *ap);
+
+/* arena_alloc -- returns size bytes aligned for any type, or NULL if
+ * memory runs out; larger requests than the block size get a block of
+ * their own
+ */
+void *arena_alloc(arena_t *ap, size_t size);
+
+/* arena_strndup -- copies the first len characters of s into the arena,
+ * followed by a '\0'; returns the copy, or NULL on failure
+ */
+char *arena_strndup(arena_t *ap, const char *s, size_t len);
+
+/* arena_used -- returns the number of bytes allocated from an arena
+ * since it was opened or last reset
+ */
+size_t arena_used(arena_t *ap);
@@ -0,0 +1,320 @@
+/*
+ * cqueue.c -- concurrent work queues
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: implementation of the ring buffer and the work stealing
+ * deques. Each deque is itself a growable ring guarded by its own
+ * mutex; only sleeping and waking go through the shared one.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <cqueue.h>
+
+/**************** ring buffer ****************/
+
+struct cqueue
+{
+    void **ring;
+    uint32_t capacity;
+    uint32_t front; /* index of the front element */
+    uint32_t count;
+    bool shut;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+};
+
+cqueue_t *cqopen(uint32_t capacity)
+{
+    cqueue_t *cqp;
+
+    if (capacity == 0 || (cqp = calloc(1, sizeof(cqueue_t))) == NULL)
+        return NULL;
+    if ((cqp->ring = calloc(capacity, sizeof(void *))) == NULL)
+    {
+        free(cqp);
+        return NULL;
+    }
+    cqp->capacity = capacity;
+    pthread_mutex_init(&cqp->mutex, NULL);
+    pthread_cond_init(&cqp->not_empty, NULL);
+    pthread_cond_init(&cqp->not_full, NULL);
+    return cqp;
+}
+
+void cqclose(cqueue_t *cqp)
+{
+    if (cqp == NULL)
+        return;
+    for (uint32_t i = 0; i < cqp->count; i++)
+        free(cqp->ring[(cqp->front + i) % cqp->capacity]);
+    free(cqp->ring);
+    pthread_mutex_destroy(&cqp->mutex);
+    pthread_cond_destroy(&cqp->not_empty);
+    pthread_cond_destroy(&cqp->not_full);
+    free(cqp);
+}
+
+int32_t cqput(cqueue_t *cqp, void *elementp)
+{
+    if (cqp == NULL)
+        return 1;
+    pthread_mutex_lock(&cqp->mutex);
+    while (cqp->count == cqp->capacity && !cqp->shut)
+        pthread_cond_wait(&cqp->not_full, &cqp->mutex);
+    if (cqp->shut)
+    {
+        pthread_mutex_unlock(&cqp->mutex);
+        return 1;
+    }
+    cqp->ring[(cqp->front + cqp->count) % cqp->capacity] = elementp;
+    cqp->count++;
+    pthread_cond_signal(&cqp->not_empty);
+    pthread_mutex_unlock(&cqp->mutex);
+    return 0;
+}
+
+/* removes the front element; the caller holds the mutex */
+static void *take(cqueue_t *cqp)
+{
+    void *elementp;
+
+    if (cqp->count == 0)
+        return NULL;
+    elementp = cqp->ring[cqp->front];
+    cqp->front = (cqp->front + 1) % cqp->capacity;
+    cqp->count--;
+    pthread_cond_signal(&cqp->not_full);
+    return elementp;
+}
+
+void *cqget(cqueue_t *cqp)
+{
+    void *elementp;
+
+    if (cqp == NULL)
+        return NULL;
+    pthread_mutex_lock(&cqp->mutex);
+    while (cqp->count == 0 && !cqp->shut)
+        pthread_cond_wait(&cqp->not_empty, &cqp->mutex);
+    elementp = take(cqp);
+    pthread_mutex_unlock(&cqp->mutex);
+    return elementp;
+}
+
+void *cqtimedget(cqueue_t *cqp, long ms)
+{
+    struct timespec deadline;
+    void *elementp;
+
+    if (cqp == NULL)
+        return NULL;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&cqp->mutex);
+    while (cqp->count == 0 && !cqp->shut)
+    {
+        if (pthread_cond_timedwait(&cqp->not_empty, &cqp->mutex, &deadline) == ETIMEDOUT)
+            break;
+    }
+    elementp = take(cqp);
+    pthread_mutex_unlock(&cqp->mutex);
+    return elementp;
+}
+
+void cqshut(cqueue_t *cqp)
+{
+    if (cqp == NULL)
+        return;
+    pthread_mutex_lock(&cqp->mutex);
+    cqp->shut = true;
+    pthread_cond_broadcast(&cqp->not_empty);
+    pthread_cond_broadcast(&cqp->not_full);
+    pthread_mutex_unlock(&cqp->mutex);
+}
+
+uint32_t cqlength(cqueue_t *cqp)
+{
+    uint32_t count;
+
+    if (cqp == NULL)
+        return 0;
+    pthread_mutex_lock(&cqp->mutex);
+    count = cqp->count;
+    pthread_mutex_unlock(&cqp->mutex);
+    return count;
+}
+
+/**************** work stealing ****************/
+
+#define MIN_DEQUE 16
+
+typedef struct deque
+{
+    void **ring;
+    uint32_t capacity; /* zero until the first put */
+    uint32_t front;
+    uint32_t count;
+    pthread_mutex_t mutex;
+} deque_t;
+
+struct wsqueue
+{
+    deque_t *deques;
+    int nworkers;
+    pthread_mutex_t mutex; /* guards the fields below */
+    pthread_cond_t work;
+    long items;            /* elements in all deques */
+    int waiting;           /* workers asleep in wsget */
+    bool done;
+};
+
+static int32_t push_back(deque_t *dp, void *elementp)
+{
+    if (dp->count == dp->capacity)
+    {
+        uint32_t capacity = dp->capacity ? dp->capacity * 2 : MIN_DEQUE;
+        void **ring = malloc(capacity * sizeof(void *));
+
+        if (ring == NULL)
+            return 1;
+        for (uint32_t i = 0; i < dp->count; i++)
+            ring[i] = dp->ring[(dp->front + i) % dp->capacity];
+        free(dp->ring);
+        dp->ring = ring;
+        dp->capacity = capacity;
+        dp->front = 0;
+    }
+    dp->ring[(dp->front + dp->count) % dp->capacity] = elementp;
+    dp->count++;
+    return 0;
+}
+
+/* takes the oldest element of a deque */
+static void *pop(deque_t *dp)
+{
+    void *elementp = NULL;
+
+    pthread_mutex_lock(&dp->mutex);
+    if (dp->count > 0)
+    {
+        dp->count--;
+        elementp = dp->ring[dp->front];
+        dp->front = (dp->front + 1) % dp->capacity;
+    }
+    pthread_mutex_unlock(&dp->mutex);
+    return elementp;
+}
+
+wsqueue_t *wsopen(int nworkers)
+{
+    wsqueue_t *wsp;
+
+    if (nworkers < 1 || (wsp = calloc(1, sizeof(wsqueue_t))) == NULL)
+        return NULL;
+    if ((wsp->deques = calloc(nworkers, sizeof(deque_t))) == NULL)
+    {
+        free(wsp);
+        return NULL;
+    }
+    wsp->nworkers = nworkers;
+    for (int i = 0; i < nworkers; i++)
+        pthread_mutex_init(&wsp->deques[i].mutex, NULL);
+    pthread_mutex_init(&wsp->mutex, NULL);
+    pthread_cond_init(&wsp->work, NULL);
+    return wsp;
+}
+
+void wsclose(wsqueue_t *wsp)
+{
+    void *elementp;
+
+    if (wsp == NULL)
+        return;
+    for (int i = 0; i < wsp->nworkers; i++)
+    {
+        while ((elementp = pop(&wsp->deques[i])) != NULL)
+            free(elementp);
+        free(wsp->deques[i].ring);
+        pthread_mutex_destroy(&wsp->deques[i].mutex);
+    }
+    free(wsp->deques);
+    pthread_mutex_destroy(&wsp->mutex);
+    pthread_cond_destroy(&wsp->work);
+    free(wsp);
+}
+
+int32_t wsput(wsqueue_t *wsp, int worker, void *elementp)
+{
+    deque_t *dp;
+    int32_t status;
+
+    if (wsp == NULL || elementp == NULL || worker < 0 || worker >= wsp->nworkers)
+        return 1;
+    dp = &wsp->deques[worker];
+    pthread_mutex_lock(&dp->mutex);
+    status = push_back(dp, elementp);
+    pthread_mutex_unlock(&dp->mutex);
+    if (status == 0)
+    {
+        pthread_mutex_lock(&wsp->mutex);
+        wsp->items++;
+        if (wsp->waiting > 0)
+            pthread_cond_signal(&wsp->work);
+        pthread_mutex_unlock(&wsp->mutex);
+    }
+    return status;
+}
+
+void *wsget(wsqueue_t *wsp, int worker)
+{
+    void *elementp;
+
+    if (wsp == NULL || worker < 0 || worker >= wsp->nworkers)
+        return NULL;
+    for (;;)
+    {
+        /* own work first, then steal, starting with the next worker */
+        elementp = pop(&wsp->deques[worker]);
+        for (int i = 1; elementp == NULL && i < wsp->nworkers; i++)
+            elementp = pop(&wsp->deques[(worker + i) % wsp->nworkers]);
+
+        pthread_mutex_lock(&wsp->mutex);
+        if (elementp != NULL)
+        {
+            wsp->items--;
+            pthread_mutex_unlock(&wsp->mutex);
+            return elementp;
+        }
+        if (wsp->items == 0 && !wsp->done)
+        {
+            /* the last worker to run dry ends the work for everyone */
+            if (++wsp->waiting == wsp->nworkers)
+            {
+                wsp->done = true;
+                pthread_cond_broadcast(&wsp->work);
+            }
+            while (wsp->items == 0 && !wsp->done)
+                pthread_cond_wait(&wsp->work, &wsp->mutex);
+            wsp->waiting--;
+        }
+        if (wsp->done)
+        {
+            pthread_mutex_unlock(&wsp->mutex);
+            return NULL;
+        }
+        pthread_mutex_unlock(&wsp->mutex);
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+/*
+ * cqueue.h -- concurrent work queues
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: two queues for handing work between threads, each with
+ * its own synchronization.
+ *
+ * A cqueue_t is a bounded multi-producer, multi-consumer ring buffer.
+ * cqput waits while it is full and cqget waits while it is empty, so
+ * idle consumers sleep instead of polling. Once cqshut is called, no
+ * more elements are accepted and consumers get NULL after the queue has
+ * drained.
+ *
+ * A wsqueue_t gives each of a fixed number of workers its own deque.
+ * A worker takes its own elements oldest first and, when it runs out,
+ * steals the oldest elements of the others, the shallowest of a
+ * frontier. A frontier that each worker fills breadth first is
+ * therefore also consumed breadth first.
+ * wsget returns NULL for every worker once all deques are empty and
+ * every worker is waiting in wsget, which is the natural end of the
+ * work; workers may add elements at any time before that.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+/**************** ring buffer ****************/
+
+typedef struct cqueue cqueue_t; /* representation of the queue hidden */
+
+/* cqopen -- creates an empty queue holding at most capacity elements;
+ * returns NULL on failure
+ */
+cqueue_t *cqopen(uint32_t capacity);
+
+/* cqclose -- deallocates a queue, frees everything in it; no thread
+ * may be using the queue
+ */
+void cqclose(cqueue_t *cqp);
+
+/* cqput -- puts an element at the back of the queue, waiting while it
+ * is full; returns 0 for success; nonzero if the queue is shut
+ */
+int32_t cqput(cqueue_t *cqp, void *elementp);
+
+/* cqget -- removes and returns the front element, waiting while the
+ * queue is empty; returns NULL once the queue is shut and empty
+ */
+void *cqget(cqueue_t *cqp);
+
+/* cqtimedget -- like cqget, but waits at most ms milliseconds;
+ * returns NULL on timeout, or once the queue is shut and empty
+ */
+void *cqtimedget(cqueue_t *cqp, long ms);
+
+/* cqshut -- stops the queue accepting elements and wakes every waiting
+ * thread; consumers drain what is left
+ */
+void cqshut(cqueue_t *cqp);
+
+/* cqlength -- returns the number of elements in the queue */
+uint32_t cqlength(cqueue_t *cqp);
+
+/**************** work stealing ****************/
+
+typedef struct wsqueue wsqueue_t; /* representation of the queue hidden */
+
+/* wsopen -- creates empty deques for workers 0 .. nworkers-1;
+ * returns NULL on failure
+ */
+wsqueue_t *wsopen(int nworkers);
+
+/* wsclose -- deallocates the deques, frees everything in them */
+void wsclose(wsqueue_t *wsp);
+
+/* wsput -- adds an element to the back of a worker's deque; any thread
+ * may call it; returns 0 for success; nonzero otherwise
+ */
+int32_t wsput(wsqueue_t *wsp, int worker, void *elementp);
+
+/* wsget -- returns worker's next element: the front of its own deque,
+ * else the front of another's, waiting while there is none; returns
+ * NULL once all the work is done
+ */
+void *wsget(wsqueue_t *wsp, int worker);
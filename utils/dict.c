@@ -0,0 +1,244 @@
+/*
+ * dict.c -- front coded term dictionary
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: words compare as unsigned bytes, the order of strcmp,
+ * which is the order the index sorts them in. The words of a block are
+ * decoded one after the other into a buffer of the longest word's size,
+ * each overwriting the suffix of the one before it. The buffer is on
+ * the stack unless the longest word is too long for it, as lookups of
+ * a shared dictionary may run in several threads at once.
+ */
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dict.h"
+#include "varint.h"
+
+#define LOCAL_WORD 256 /* bytes of the stack buffer words are decoded into */
+
+/* encoding header */
+typedef struct dict_header
+{
+    uint32_t nterms;
+    uint32_t nblocks;
+    uint32_t maxlen;
+    uint32_t words_size;
+} dict_header_t;
+
+/* the length of the prefix shared by words a and b */
+static size_t shared_len(const char *a, const char *b)
+{
+    size_t n = 0;
+    while (a[n] && a[n] == b[n])
+        n++;
+    return n;
+}
+
+/* the number of blocks of n words */
+static int block_count(int n)
+{
+    return (n + DICT_BLOCK - 1) / DICT_BLOCK;
+}
+
+size_t dict_encoded_size(char **words, int n)
+{
+    size_t size = sizeof(dict_header_t) + (size_t)block_count(n) * sizeof(uint32_t);
+    for (int i = 0; i < n; i++)
+    {
+        size_t len = strlen(words[i]);
+        size_t shared = i % DICT_BLOCK ? shared_len(words[i - 1], words[i]) : 0;
+        size += varint_size(shared) + varint_size(len - shared) + len - shared;
+    }
+    return size;
+}
+
+void dict_encode(char **words, int n, uint8_t *out)
+{
+    dict_header_t header = {n, block_count(n), 0, 0};
+    uint32_t *blocks = (uint32_t *)(out + sizeof(header));
+    uint8_t *start = (uint8_t *)(blocks + header.nblocks), *p = start;
+    for (int i = 0; i < n; i++)
+    {
+        size_t len = strlen(words[i]);
+        size_t shared = 0;
+        if (i % DICT_BLOCK == 0)
+            blocks[i / DICT_BLOCK] = p - start;
+        else
+            shared = shared_len(words[i - 1], words[i]);
+        p = varint_put(p, shared);
+        p = varint_put(p, len - shared);
+        memcpy(p, words[i] + shared, len - shared);
+        p += len - shared;
+        if (len > header.maxlen)
+            header.maxlen = len;
+    }
+    header.words_size = p - start;
+    memcpy(out, &header, sizeof(header));
+}
+
+int32_t dict_open(dict_t *dp, const void *data, size_t size)
+{
+    dict_header_t header;
+    if (!dp || !data || size < sizeof(header) || (uintptr_t)data % sizeof(uint32_t) != 0)
+        return 1;
+    memcpy(&header, data, sizeof(header));
+    if (header.nterms > INT_MAX || header.nblocks != (uint32_t)block_count(header.nterms) ||
+        sizeof(header) + (uint64_t)header.nblocks * sizeof(uint32_t) + header.words_size > size)
+        return 1;
+    /* a word is made of the bytes of its block, so it is no longer than them */
+    if (header.maxlen > header.words_size || header.maxlen > INT_MAX - 1)
+        return 1;
+
+    dp->nterms = header.nterms;
+    dp->nblocks = header.nblocks;
+    dp->maxlen = header.maxlen;
+    dp->blocks = (const uint32_t *)((const uint8_t *)data + sizeof(header));
+    dp->words = (const uint8_t *)(dp->blocks + header.nblocks);
+    dp->words_size = header.words_size;
+    for (int b = 0; b < dp->nblocks; b++)
+    {
+        if (dp->blocks[b] >= dp->words_size)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * decodes the word at p, which follows the word of length *len in buf,
+ * into buf of size bytes
+ * returns: the position of the next word; NULL if the encoding is corrupt
+ */
+static const uint8_t *next_word(const dict_t *dp, const uint8_t *p, char *buf, size_t size, int *len)
+{
+    const uint8_t *end = dp->words + dp->words_size;
+    uint32_t shared, suffix;
+    if (!(p = varint_get(p, end, &shared)) || !(p = varint_get(p, end, &suffix)) ||
+        shared > (uint32_t)*len || (uint64_t)shared + suffix >= size || suffix > (size_t)(end - p))
+        return NULL;
+    memcpy(buf + shared, p, suffix);
+    *len = shared + suffix;
+    buf[*len] = '\0';
+    return p + suffix;
+}
+
+/* a buffer with room for the longest word of dp: local, of LOCAL_WORD
+ * bytes, if it fits, or else allocated; NULL if out of memory
+ */
+static char *word_buffer(const dict_t *dp, char *local)
+{
+    return dp->maxlen < LOCAL_WORD ? local : malloc((size_t)dp->maxlen + 1);
+}
+
+static void free_buffer(char *buf, const char *local)
+{
+    if (buf != local)
+        free(buf);
+}
+
+/* compares the word of length len with key of length keylen */
+static int compare(const char *word, size_t len, const char *key, size_t keylen)
+{
+    int cmp = memcmp(word, key, len < keylen ? len : keylen);
+    if (cmp != 0)
+        return cmp;
+    return len < keylen ? -1 : len > keylen;
+}
+
+/* the term id of the first word not below key, decoding the words into
+ * buf, from word_buffer; -1 if the encoding is corrupt
+ */
+static int lower_bound(const dict_t *dp, const char *key, size_t keylen, char *buf)
+{
+    size_t size = (size_t)dp->maxlen + 1;
+    int lo = 0, hi = dp->nblocks, len;
+
+    /* the first block whose first word is above key */
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        len = 0;
+        if (!next_word(dp, dp->words + dp->blocks[mid], buf, size, &len))
+            return -1;
+        if (compare(buf, len, key, keylen) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0)
+        return 0;
+
+    /* the block before it holds the word, or it is the first of the next */
+    int id = (lo - 1) * DICT_BLOCK, last = id + DICT_BLOCK;
+    const uint8_t *p = dp->words + dp->blocks[lo - 1];
+    for (len = 0; id < dp->nterms && id < last; id++)
+    {
+        if (!(p = next_word(dp, p, buf, size, &len)))
+            return -1;
+        if (compare(buf, len, key, keylen) >= 0)
+            return id;
+    }
+    return id;
+}
+
+int dict_find(const dict_t *dp, const char *word)
+{
+    char local[LOCAL_WORD], *buf = dp && word ? word_buffer(dp, local) : NULL;
+    if (!buf)
+        return -1;
+    int id = lower_bound(dp, word, strlen(word), buf);
+    if (id >= dp->nterms || (id >= 0 && (dict_word(dp, id, buf, (size_t)dp->maxlen + 1) < 0 || strcmp(buf, word) != 0)))
+        id = -1;
+    free_buffer(buf, local);
+    return id;
+}
+
+int dict_prefix(const dict_t *dp, const char *prefix, int *first)
+{
+    if (!dp || !prefix || !first)
+        return 0;
+    /* a prefix longer than every word starts none of them */
+    size_t len = strlen(prefix);
+    if (len > (size_t)dp->maxlen)
+        return 0;
+    char local[LOCAL_WORD], local_next[LOCAL_WORD];
+    char *buf = word_buffer(dp, local), *next = word_buffer(dp, local_next);
+    int lo = -1, hi = dp->nterms;
+    if (buf && next)
+        lo = lower_bound(dp, prefix, len, buf);
+
+    /* the words with the prefix end before its successor, if it has one */
+    if (lo >= 0)
+    {
+        memcpy(next, prefix, len + 1);
+        while (len > 0 && (uint8_t)next[len - 1] == UINT8_MAX)
+            len--;
+        if (len > 0)
+        {
+            next[len - 1]++;
+            hi = lower_bound(dp, next, len, buf);
+        }
+    }
+    free_buffer(buf, local);
+    free_buffer(next, local_next);
+    if (lo < 0 || hi < 0)
+        return 0;
+    *first = lo;
+    return hi - lo;
+}
+
+int dict_word(const dict_t *dp, int id, char *buf, size_t size)
+{
+    if (!dp || !buf || id < 0 || id >= dp->nterms)
+        return -1;
+    const uint8_t *p = dp->words + dp->blocks[id / DICT_BLOCK];
+    int len = 0;
+    for (int i = id - id % DICT_BLOCK; i <= id; i++)
+    {
+        if (!(p = next_word(dp, p, buf, size, &len)))
+            return -1;
+    }
+    return len;
+}
@@ -0,0 +1,83 @@
+#pragma once
+/*
+ * dict.h -- front coded term dictionary
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: a read only dictionary of sorted words, each known by
+ * its term id, its position in sorted order. Words are front coded in
+ * blocks of DICT_BLOCK: the first word of a block is stored whole and
+ * every other one as the length of the prefix it shares with the word
+ * before it and the rest of its bytes, so a dictionary takes a fraction
+ * of the space of its words as separate strings.
+ *
+ * A word is found by binary searching the first words of the blocks,
+ * then decoding the one block that may hold it. As the words are
+ * sorted, the words starting with a prefix have consecutive term ids.
+ *
+ * The encoding (host byte order) is laid out as:
+ *   <header>     number of words and blocks, longest word length
+ *   <blocks>     uint32_t offset of every block within the words
+ *   <words>      per word: varint shared length, varint suffix
+ *                length, suffix bytes
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#define DICT_BLOCK 16 /* words per front coded block */
+
+/* a dictionary, viewed in place over its encoding */
+typedef struct dict
+{
+    int nterms;
+    int nblocks;
+    int maxlen;             /* length of the longest word */
+    const uint32_t *blocks; /* offset of every block in words */
+    const uint8_t *words;
+    size_t words_size;
+} dict_t;
+
+/*
+ * dict_encoded_size -- the size in bytes of the encoding of the n
+ * sorted, distinct words
+ */
+size_t dict_encoded_size(char **words, int n);
+
+/*
+ * dict_encode -- encodes the n sorted, distinct words into out, which
+ * holds dict_encoded_size bytes, aligned for a uint32_t
+ */
+void dict_encode(char **words, int n, uint8_t *out);
+
+/*
+ * dict_open -- views the encoding of size bytes at data as dp; data
+ * must stay valid while dp is used
+ *
+ * returns: 0 for success; nonzero if it is not a valid encoding
+ */
+int32_t dict_open(dict_t *dp, const void *data, size_t size);
+
+/*
+ * dict_find -- the term id of word
+ *
+ * returns: the term id, or -1 if the word is not in the dictionary
+ */
+int dict_find(const dict_t *dp, const char *word);
+
+/*
+ * dict_prefix -- finds the words starting with prefix, which are the
+ * term ids from *first on
+ *
+ * returns: the number of such words
+ */
+int dict_prefix(const dict_t *dp, const char *prefix, int *first);
+
+/*
+ * dict_word -- decodes the word of term id into buf of size bytes,
+ * which needs room for maxlen + 1
+ *
+ * returns: the length of the word, or -1 if id is out of range, the
+ * word does not fit or the encoding is corrupt
+ */
+int dict_word(const dict_t *dp, int id, char *buf, size_t size);
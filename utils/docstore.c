@@ -0,0 +1,325 @@
+/* docstore.c --- per document metadata saved by the indexer
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: the doc store file (host byte order) is laid out as:
+ *   <header>     magic, version, number of slots and section offsets
+ *   <slots>      one doc_slot_t per id, from the base id to the largest
+ *                id, so that a delta of the newest pages stores no slots
+ *                for the ids before it
+ *   <strings>    NUL-terminated strings referenced by the slots
+ *
+ * An id that was never added has a slot whose url is NO_STRING.
+ */
+#define _POSIX_C_SOURCE 200809L // strndup
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include "docstore.h"
+
+#define DOCS_MAGIC "TSEDOCS"
+#define DOCS_MAGIC_LEN 8
+#define DOCS_VERSION 2
+#define NO_STRING UINT32_MAX /* offset of a missing string */
+
+/* doc store file header */
+typedef struct docs_header
+{
+    char magic[DOCS_MAGIC_LEN];
+    uint32_t version;
+    uint32_t nslots;
+    uint64_t slots_off;    /* offset of the doc_slot_t table */
+    uint64_t strings_off;  /* offset of the string heap */
+    uint64_t strings_size; /* size of the string heap in bytes */
+    uint64_t file_size;
+    uint32_t base_id;      /* id of the first slot */
+    uint32_t unused;
+} docs_header_t;
+
+/* doc store file slot: offsets into the string heap and lengths */
+typedef struct doc_slot
+{
+    uint32_t url_off;
+    uint32_t url_len;
+    uint32_t title_off;
+    uint32_t title_len;
+    uint32_t snippet_off;
+    uint32_t snippet_len;
+} doc_slot_t;
+
+/* metadata of one document in a doc store being built */
+typedef struct doc
+{
+    char *url;
+    char *title;
+    char *snippet;
+} doc_t;
+
+struct docstore
+{
+    int base;
+    int nids;
+    doc_t *docs; /* of ids base to nids - 1 */
+};
+
+struct docmap
+{
+    char *base;
+    size_t size;
+    const docs_header_t *header;
+    const doc_slot_t *slots;
+    const char *strings;
+};
+
+void docmeta_extract(webpage_t *page, docmeta_t *mp)
+{
+    webpage_parts_t parts = {0};
+
+    if (webpage_extract(page, &parts) != 0)
+        parts.title = parts.description = NULL;
+    docmeta_parts(page, &parts, mp);
+}
+
+void docmeta_parts(webpage_t *page, const webpage_parts_t *pp, docmeta_t *mp)
+{
+    mp->url = webpage_getURL(page);
+    mp->url_len = strlen(mp->url);
+    mp->title = pp->title;
+    mp->title_len = pp->title_len;
+    mp->snippet = pp->description;
+    mp->snippet_len = pp->description_len < SNIPPET_LEN ? pp->description_len : SNIPPET_LEN;
+}
+
+docstore_t *docstore_new(int base, int nids)
+{
+    docstore_t *ds;
+
+    if (base < 0 || nids < base || !(ds = malloc(sizeof(docstore_t))))
+        return NULL;
+    ds->base = base;
+    ds->nids = nids;
+    if (!(ds->docs = calloc(nids > base ? nids - base : 1, sizeof(doc_t))))
+    {
+        free(ds);
+        return NULL;
+    }
+    return ds;
+}
+
+int32_t docstore_add(docstore_t *ds, int id, webpage_t *page)
+{
+    docmeta_t meta;
+
+    if (!page)
+        return 1;
+    docmeta_extract(page, &meta);
+    return docstore_put(ds, id, &meta);
+}
+
+int32_t docstore_put(docstore_t *ds, int id, const docmeta_t *mp)
+{
+    if (!ds || !mp || !mp->url || id < ds->base || id >= ds->nids || ds->docs[id - ds->base].url)
+        return 1;
+
+    doc_t *dp = &ds->docs[id - ds->base];
+    dp->url = strndup(mp->url, mp->url_len);
+    dp->title = mp->title ? strndup(mp->title, mp->title_len) : NULL;
+    dp->snippet = mp->snippet ? strndup(mp->snippet, mp->snippet_len) : NULL;
+    if (!dp->url || (mp->title && !dp->title) || (mp->snippet && !dp->snippet))
+    {
+        free(dp->url);
+        free(dp->title);
+        free(dp->snippet);
+        dp->url = dp->title = dp->snippet = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+void docstore_free(docstore_t *ds)
+{
+    if (!ds)
+        return;
+    for (int i = 0; i < ds->nids - ds->base; i++)
+    {
+        free(ds->docs[i].url);
+        free(ds->docs[i].title);
+        free(ds->docs[i].snippet);
+    }
+    free(ds->docs);
+    free(ds);
+}
+
+/* places string s in the heap of offset *heap_size, filling off and len */
+static void place(const char *s, uint32_t *off, uint32_t *len, uint64_t *heap_size)
+{
+    if (!s)
+    {
+        *off = NO_STRING;
+        *len = 0;
+        return;
+    }
+    *off = *heap_size;
+    *len = strlen(s);
+    *heap_size += *len + 1;
+}
+
+static void write_string(const char *s, FILE *file)
+{
+    if (s)
+        fwrite(s, 1, strlen(s) + 1, file);
+}
+
+int32_t docstore_save(docstore_t *ds, char *docsnm)
+{
+    if (!ds || !docsnm)
+        return 1;
+
+    docs_header_t header;
+    int nslots = ds->nids - ds->base;
+    doc_slot_t *slots = calloc(nslots ? nslots : 1, sizeof(doc_slot_t));
+    if (!slots)
+        return 1;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DOCS_MAGIC, DOCS_MAGIC_LEN);
+    header.version = DOCS_VERSION;
+    header.nslots = nslots;
+    header.base_id = ds->base;
+    header.slots_off = sizeof(docs_header_t);
+    header.strings_off = header.slots_off + (uint64_t)nslots * sizeof(doc_slot_t);
+    for (int i = 0; i < nslots; i++)
+    {
+        doc_t *dp = &ds->docs[i];
+        place(dp->url, &slots[i].url_off, &slots[i].url_len, &header.strings_size);
+        place(dp->url ? dp->title : NULL, &slots[i].title_off, &slots[i].title_len, &header.strings_size);
+        place(dp->url ? dp->snippet : NULL, &slots[i].snippet_off, &slots[i].snippet_len, &header.strings_size);
+    }
+    header.file_size = header.strings_off + header.strings_size;
+    if (header.strings_size >= NO_STRING)
+    {
+        printf("Doc store too large: %s\n", docsnm);
+        free(slots);
+        return 1;
+    }
+
+    FILE *file = fopen(docsnm, "wb");
+    if (file == NULL)
+    {
+        printf("Failed to create file: %s\n", docsnm);
+        free(slots);
+        return 1;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(slots, sizeof(doc_slot_t), nslots, file);
+    for (int i = 0; i < nslots; i++)
+    {
+        if (!ds->docs[i].url)
+            continue;
+        write_string(ds->docs[i].url, file);
+        write_string(ds->docs[i].title, file);
+        write_string(ds->docs[i].snippet, file);
+    }
+    free(slots);
+
+    int error = ferror(file);
+    if (fclose(file) != 0 || error)
+    {
+        printf("Failed to write file: %s\n", docsnm);
+        return 1;
+    }
+    return 0;
+}
+
+/* true if a string of the slot lies within the string heap */
+static bool valid_string(const docmap_t *map, uint32_t off, uint32_t len)
+{
+    if (off == NO_STRING)
+        return true;
+    return (uint64_t)off + len < map->header->strings_size && map->strings[off + len] == '\0';
+}
+
+docmap_t *docmap_open(char *docsnm)
+{
+    int fd = open(docsnm, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(docs_header_t))
+    {
+        close(fd);
+        return NULL;
+    }
+    char *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    const docs_header_t *header = (const docs_header_t *)base;
+    uint64_t size = st.st_size;
+    if (memcmp(header->magic, DOCS_MAGIC, DOCS_MAGIC_LEN) != 0 ||
+        header->version != DOCS_VERSION ||
+        header->file_size != size ||
+        (uint64_t)header->base_id + header->nslots > INT_MAX ||
+        header->slots_off + (uint64_t)header->nslots * sizeof(doc_slot_t) > size ||
+        header->strings_off + header->strings_size > size)
+    {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+
+    docmap_t *map = malloc(sizeof(docmap_t));
+    if (!map)
+    {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+    map->base = base;
+    map->size = st.st_size;
+    map->header = header;
+    map->slots = (const doc_slot_t *)(base + header->slots_off);
+    map->strings = base + header->strings_off;
+    return map;
+}
+
+void docmap_ids(docmap_t *map, int *base, int *nids)
+{
+    *base = map ? (int)map->header->base_id : 0;
+    *nids = map ? *base + (int)map->header->nslots : 0;
+}
+
+void docmap_close(docmap_t *map)
+{
+    if (!map)
+        return;
+    munmap(map->base, map->size);
+    free(map);
+}
+
+bool docmap_get(docmap_t *map, int id, docmeta_t *mp)
+{
+    if (!map || !mp || id < (int)map->header->base_id || id - (int)map->header->base_id >= (int)map->header->nslots)
+        return false;
+
+    const doc_slot_t *sp = &map->slots[id - map->header->base_id];
+    if (sp->url_off == NO_STRING ||
+        !valid_string(map, sp->url_off, sp->url_len) ||
+        !valid_string(map, sp->title_off, sp->title_len) ||
+        !valid_string(map, sp->snippet_off, sp->snippet_len))
+        return false;
+
+    mp->url = map->strings + sp->url_off;
+    mp->url_len = sp->url_len;
+    mp->title = sp->title_off == NO_STRING ? NULL : map->strings + sp->title_off;
+    mp->title_len = sp->title_len;
+    mp->snippet = sp->snippet_off == NO_STRING ? NULL : map->strings + sp->snippet_off;
+    mp->snippet_len = sp->snippet_len;
+    return true;
+}
@@ -0,0 +1,115 @@
+#pragma once
+/*
+ * docstore.h --- per document metadata saved by the indexer
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: the url, title and description snippet of every indexed
+ * page are extracted once by the indexer and saved to a doc store file
+ * next to the index. The querier memory maps it with docmap_open and
+ * looks up a document's metadata by id in constant time, instead of
+ * loading and searching the page's html for every result.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "webpage.h"
+
+#define DOCSTORE_SUFFIX ".docs" /* appended to the index file name */
+#define SNIPPET_LEN 128         /* longest description snippet kept */
+
+/* metadata of one document
+ *
+ * @param url, url_len - the page url
+ * @param title, title_len - the page title, or NULL if it has none
+ * @param snippet, snippet_len - the start of the page description, or
+ * NULL if it has none
+ */
+typedef struct docmeta
+{
+    const char *url;
+    int url_len;
+    const char *title;
+    int title_len;
+    const char *snippet;
+    int snippet_len;
+} docmeta_t;
+
+/* doc store being built; representation hidden */
+typedef struct docstore docstore_t;
+
+/* memory mapped doc store; representation hidden */
+typedef struct docmap docmap_t;
+
+/*
+ * docmeta_extract -- points mp at the url, <title> and description
+ * <meta> of page. The strings are not NUL-terminated and are only valid
+ * while the page is.
+ */
+void docmeta_extract(webpage_t *page, docmeta_t *mp);
+
+/*
+ * docmeta_parts -- points mp at the url of page and the title and
+ * description that webpage_extract found in it into pp
+ */
+void docmeta_parts(webpage_t *page, const webpage_parts_t *pp, docmeta_t *mp);
+
+/*
+ * docstore_new -- creates an empty doc store for ids base to nids - 1,
+ * which holds no slots for the ids below base
+ *
+ * returns: non-NULL for success; NULL otherwise
+ */
+docstore_t *docstore_new(int base, int nids);
+
+/*
+ * docstore_add -- copies the metadata of page into the doc store under
+ * id. Threads may add different ids at the same time.
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t docstore_add(docstore_t *ds, int id, webpage_t *page);
+
+/*
+ * docstore_put -- copies the metadata *mp into the doc store under id,
+ * like docstore_add
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t docstore_put(docstore_t *ds, int id, const docmeta_t *mp);
+
+/*
+ * docstore_save -- saves the doc store to filename docsnm
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t docstore_save(docstore_t *ds, char *docsnm);
+
+/* docstore_free -- frees a doc store and the metadata in it */
+void docstore_free(docstore_t *ds);
+
+/*
+ * docmap_open -- memory maps the doc store file docsnm
+ *
+ * returns: non-NULL for success; NULL if the file cannot be mapped or
+ * is not a doc store of a supported version
+ */
+docmap_t *docmap_open(char *docsnm);
+
+/*
+ * docmap_ids -- sets *base and *nids so that the store has slots for the
+ * ids base to nids - 1; both are 0 if map is NULL
+ */
+void docmap_ids(docmap_t *map, int *base, int *nids);
+
+/* docmap_close -- unmaps the doc store */
+void docmap_close(docmap_t *map);
+
+/*
+ * docmap_get -- points mp at the metadata of document id, whose strings
+ * are NUL-terminated and valid until the map is closed
+ *
+ * returns: true if the document is in the store; false otherwise
+ */
+bool docmap_get(docmap_t *map, int id, docmeta_t *mp);
@@ -0,0 +1,597 @@
+/*
+ * fetch.c -- asynchronous page fetching
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: implementation of the fetcher on a curl multi handle.
+ * Only the thread in fetch_run touches curl; other threads append to
+ * the pending list under the fetcher's mutex and wake the multi handle.
+ *
+ * The fetching thread moves pending pages into a queue per host, and
+ * visits the hosts with queued pages in turn, starting the next page
+ * of every host that is ready. A host with a delay is ready once its
+ * last transfer has finished and the delay has passed since.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <pthread.h>
+#include <curl/curl.h>
+#include "fetch.h"
+#include "hash.h"
+#include "metrics.h"
+
+#define POLL_MS 1000    /* longest wait for network activity */
+#define RETRY_MS 1000   /* delay before retrying a failed transfer */
+#define HOSTS_SIZE 64   /* initial size of the host table */
+#define MAX_DELAY_MS 60000  /* longest Crawl-delay taken from robots.txt */
+#define HOST_TRANSFERS 4    /* most transfers at once from a host without a delay */
+
+#ifdef NOSLEEP
+#define DELAY_MS 0      /* default delay between transfers of a host */
+#else
+#define DELAY_MS 1000
+#endif
+
+enum { ROBOTS_WANTED, ROBOTS_FETCHING, ROBOTS_DONE };
+
+/* one page and the curl handle fetching it */
+typedef struct transfer
+{
+	CURL *curl;
+	webpage_t *page;
+	char *html;
+	size_t len;
+	size_t size;
+	int tries;
+	long retry_at; /* in ms, on the monotonic clock */
+	double started; /* of the current attempt, in seconds */
+	struct host *host;
+	bool robots; /* fetching the robots.txt of its host, not a page */
+	struct transfer *next;
+	char errbuf[CURL_ERROR_SIZE];
+} transfer_t;
+
+/* a host pages are fetched from */
+typedef struct host
+{
+	transfer_t *first;       /* its pages waiting to start, in order */
+	transfer_t *last;
+	long ready_at;           /* earliest start of its next transfer, in ms */
+	long delay;              /* ms from the end of a transfer to the next start */
+	int running;             /* its transfers in the multi handle */
+	int robots;              /* state of its robots.txt */
+	bool waiting;            /* in the fetcher's list of hosts with pages */
+	struct host *next;
+	char name[];             /* scheme://host[:port] of its urls */
+} host_t;
+
+struct fetcher
+{
+	CURLM *multi;
+	CURLSH *share;
+	fetch_fn done;
+	void *arg;
+	int max_transfers;
+	int running;             /* transfers in the multi handle */
+	transfer_t *retry;       /* failed transfers waiting to retry */
+	CURL **pool;             /* handles of finished transfers, for reuse */
+	int npool;
+	hashtable_t *hosts;      /* every host seen, by name */
+	host_t *waiting;         /* hosts with pages waiting, in turn */
+	host_t *waiting_last;
+	int queued;              /* pages waiting in the hosts */
+	long delay;              /* default delay of a host */
+	bool use_robots;         /* take Crawl-delay from robots.txt */
+	metric_t *latency;       /* of each attempt at a page */
+	metric_t *bytes;         /* of the pages fetched */
+	metric_t *pages;         /* fetched */
+	metric_t *retries;       /* attempts after the first */
+	metric_t *failures;      /* pages given up on */
+	pthread_mutex_t mutex;   /* guards the fields below */
+	transfer_t *pending;     /* added, not yet started; in order */
+	transfer_t *last;
+	bool stop;
+};
+
+static long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+static size_t write_fn(void *contents, size_t size, size_t nmemb, void *userp)
+{
+	transfer_t *tp = userp;
+	size_t realsize = size * nmemb;
+
+	if (tp->len + realsize + 1 > tp->size)
+	{
+		size_t want = tp->size ? tp->size : 16384;
+		char *html;
+
+		while (want < tp->len + realsize + 1)
+			want *= 2;
+		if ((html = realloc(tp->html, want)) == NULL)
+			return 0;
+		tp->html = html;
+		tp->size = want;
+	}
+	memcpy(tp->html + tp->len, contents, realsize);
+	tp->len += realsize;
+	tp->html[tp->len] = '\0';
+	return realsize;
+}
+
+/* frees a transfer; its handle goes back to the pool when there is room */
+static void put_transfer(fetcher_t *fp, transfer_t *tp)
+{
+	if (tp->curl && fp->npool < fp->max_transfers)
+		fp->pool[fp->npool++] = tp->curl;
+	else if (tp->curl)
+		curl_easy_cleanup(tp->curl);
+	free(tp->html);
+	free(tp);
+}
+
+static bool host_searchfn(void *elementp, const void *searchkeyp)
+{
+	return strcmp(((host_t *)elementp)->name, (const char *)searchkeyp) == 0;
+}
+
+/* finds or adds the host of url, which is everything before the path;
+ * returns NULL on failure
+ */
+static host_t *host_of(fetcher_t *fp, const char *url)
+{
+	const char *sep = strstr(url, "://");
+	size_t len = sep ? (size_t)(sep - url) + 3 : 0;
+	host_t *hp;
+
+	len += strcspn(url + len, "/?#");
+	if ((hp = malloc(sizeof(host_t) + len + 1)) == NULL)
+		return NULL;
+	memcpy(hp->name, url, len);
+	hp->name[len] = '\0';
+	host_t *found = hsearch(fp->hosts, host_searchfn, hp->name, len);
+	if (found)
+	{
+		free(hp);
+		return found;
+	}
+	hp->first = hp->last = NULL;
+	hp->ready_at = 0;
+	hp->delay = fp->delay;
+	hp->running = 0;
+	hp->robots = fp->use_robots ? ROBOTS_WANTED : ROBOTS_DONE;
+	hp->waiting = false;
+	hp->next = NULL;
+	if (hput(fp->hosts, hp, hp->name, len) != 0)
+	{
+		free(hp);
+		return NULL;
+	}
+	return hp;
+}
+
+/* adds a host to the back of the hosts with pages waiting */
+static void host_wait(fetcher_t *fp, host_t *hp)
+{
+	hp->waiting = true;
+	hp->next = NULL;
+	if (fp->waiting_last)
+		fp->waiting_last->next = hp;
+	else
+		fp->waiting = hp;
+	fp->waiting_last = hp;
+}
+
+/* queues a transfer at the front or back of its host's pages */
+static void host_put(fetcher_t *fp, transfer_t *tp, bool front)
+{
+	host_t *hp = tp->host;
+
+	if (front || hp->first == NULL)
+	{
+		tp->next = hp->first;
+		hp->first = tp;
+		if (hp->last == NULL)
+			hp->last = tp;
+	}
+	else
+	{
+		tp->next = NULL;
+		hp->last->next = tp;
+		hp->last = tp;
+	}
+	fp->queued++;
+	if (!hp->waiting)
+		host_wait(fp, hp);
+}
+
+/* the Crawl-delay in ms that robots.txt gives every agent or ours, the
+ * longest if several apply; -1 if it gives none
+ */
+static long robots_delay(char *txt)
+{
+	bool applies = false, agents = false;
+	long delay = -1;
+	char *line, *save = NULL;
+
+	for (line = strtok_r(txt, "\r\n", &save); line; line = strtok_r(NULL, "\r\n", &save))
+	{
+		char *value = strchr(line, ':');
+
+		line[strcspn(line, "#")] = '\0';
+		if (value == NULL || value > line + strlen(line))
+			continue;
+		*value++ = '\0';
+		value += strspn(value, " \t");
+		value[strcspn(value, " \t")] = '\0';
+		line += strspn(line, " \t");
+		line[strcspn(line, " \t")] = '\0';
+		if (strcasecmp(line, "user-agent") == 0)
+		{
+			/* a group starts with one or more user agents */
+			if (!agents)
+				applies = false;
+			agents = true;
+			/* a prefix of our name names us, but an empty one names no one */
+			if (strcmp(value, "*") == 0 ||
+				(value[0] != '\0' && strncasecmp(value, "libcurl-agent", strlen(value)) == 0))
+				applies = true;
+			continue;
+		}
+		agents = false;
+		if (applies && strcasecmp(line, "crawl-delay") == 0)
+		{
+			char *end;
+			double seconds = strtod(value, &end);
+
+			if (end != value && seconds >= 0 && seconds * 1000 > delay)
+				delay = seconds * 1000 < MAX_DELAY_MS ? (long)(seconds * 1000) : MAX_DELAY_MS;
+		}
+	}
+	return delay;
+}
+
+/* starts an attempt at the transfer's page; the options match those
+ * of webpage_fetch
+ */
+static int32_t start(fetcher_t *fp, transfer_t *tp)
+{
+	CURL *curl;
+
+	if (tp->curl == NULL)
+		tp->curl = fp->npool > 0 ? fp->pool[--fp->npool] : curl_easy_init();
+	if ((curl = tp->curl) == NULL)
+		return 1;
+	tp->len = 0;
+	if (tp->html)
+		tp->html[0] = '\0';
+	tp->errbuf[0] = '\0';
+	curl_easy_setopt(curl, CURLOPT_URL, webpage_getURL(tp->page));
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_fn);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)tp);
+	curl_easy_setopt(curl, CURLOPT_PRIVATE, (void *)tp);
+	curl_easy_setopt(curl, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+	curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, tp->errbuf);
+	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(curl, CURLOPT_SHARE, fp->share);
+	if (curl_multi_add_handle(fp->multi, curl) != CURLM_OK)
+		return 1;
+	tp->tries++;
+	tp->started = metrics_now();
+	fp->running++;
+	tp->host->running++;
+	return 0;
+}
+
+/* reports a page to the callback; on failure its html is the error */
+static void report(fetcher_t *fp, transfer_t *tp, bool ok)
+{
+	webpage_t *page = tp->page;
+	char *html;
+
+	if (ok)
+	{
+		metrics_add(fp->pages, 1);
+		metrics_add(fp->bytes, tp->len);
+		html = tp->html;
+		tp->html = NULL;
+		if (html == NULL)
+			html = calloc(1, sizeof(char));
+	}
+	else
+	{
+		metrics_add(fp->failures, 1);
+		if (tp->errbuf[0] == '\0')
+			strcpy(tp->errbuf, "fetch failed");
+		html = malloc(strlen(tp->errbuf) + 1);
+		if (html)
+			strcpy(html, tp->errbuf);
+	}
+	webpage_setHTML(page, html);
+	put_transfer(fp, tp);
+	fp->done(page, ok && html != NULL, fp->arg);
+}
+
+/* takes the host's delay from its robots.txt, if it gives a longer one */
+static void robots_done(fetcher_t *fp, transfer_t *tp, bool ok)
+{
+	host_t *hp = tp->host;
+	long delay = ok && tp->html ? robots_delay(tp->html) : -1;
+
+	if (delay > hp->delay)
+		hp->delay = delay;
+	hp->robots = ROBOTS_DONE;
+	webpage_delete(tp->page);
+	put_transfer(fp, tp);
+}
+
+static void finish(fetcher_t *fp, transfer_t *tp, CURLcode res)
+{
+	host_t *hp = tp->host;
+
+	curl_multi_remove_handle(fp->multi, tp->curl);
+	fp->running--;
+	hp->running--;
+	if (tp->robots)
+	{
+		robots_done(fp, tp, res == CURLE_OK);
+		hp->ready_at = now_ms() + hp->delay;
+		return;
+	}
+	hp->ready_at = now_ms() + hp->delay;
+	metrics_record(fp->latency, metrics_now() - tp->started);
+	if (res == CURLE_OK)
+	{
+		report(fp, tp, true);
+	}
+	else if (tp->tries < FETCH_TRIES)
+	{
+		metrics_add(fp->retries, 1);
+		tp->retry_at = now_ms() + RETRY_MS;
+		tp->next = fp->retry;
+		fp->retry = tp;
+	}
+	else
+	{
+		report(fp, tp, false);
+	}
+}
+
+/* starts the next transfer of a ready host: its robots.txt first if
+ * it is wanted, then its first page
+ */
+static void start_host(fetcher_t *fp, host_t *hp)
+{
+	transfer_t *tp;
+
+	if (hp->robots == ROBOTS_WANTED)
+	{
+		size_t len = strlen(hp->name);
+		char url[len + sizeof("/robots.txt")];
+
+		hp->robots = ROBOTS_FETCHING;
+		sprintf(url, "%s/robots.txt", hp->name);
+		if ((tp = calloc(1, sizeof(transfer_t))) == NULL ||
+		    (tp->page = webpage_new(url, 0, NULL)) == NULL)
+		{
+			free(tp);
+			hp->robots = ROBOTS_DONE;
+			return;
+		}
+		tp->host = hp;
+		tp->robots = true;
+		tp->tries = FETCH_TRIES; /* not retried */
+		if (start(fp, tp) != 0)
+			robots_done(fp, tp, false);
+		return;
+	}
+	tp = hp->first;
+	if ((hp->first = tp->next) == NULL)
+		hp->last = NULL;
+	fp->queued--;
+	if (start(fp, tp) != 0)
+		report(fp, tp, false);
+}
+
+/* moves due retries to the front of their hosts and pending pages to
+ * the back, then visits each host with pages once, starting what it
+ * is ready for while there is room; returns the time in ms until the
+ * next retry or host is due, at most POLL_MS
+ */
+static long start_transfers(fetcher_t *fp)
+{
+	transfer_t **tpp, *tp, *next;
+	host_t *hp;
+	long now = now_ms(), wait = POLL_MS;
+
+	for (tpp = &fp->retry; (tp = *tpp) != NULL;)
+	{
+		if (tp->retry_at <= now)
+		{
+			*tpp = tp->next;
+			host_put(fp, tp, true);
+			continue;
+		}
+		if (tp->retry_at - now < wait)
+			wait = tp->retry_at - now;
+		tpp = &tp->next;
+	}
+
+	pthread_mutex_lock(&fp->mutex);
+	tp = fp->pending;
+	fp->pending = fp->last = NULL;
+	pthread_mutex_unlock(&fp->mutex);
+	for (; tp != NULL; tp = next)
+	{
+		next = tp->next;
+		if ((tp->host = host_of(fp, webpage_getURL(tp->page))) == NULL)
+			report(fp, tp, false);
+		else
+			host_put(fp, tp, false);
+	}
+
+	/* a host without a delay may run a few transfers at once */
+	for (host_t *end = fp->waiting_last; (hp = fp->waiting) != NULL;)
+	{
+		fp->waiting = hp->next;
+		if (fp->waiting == NULL)
+			fp->waiting_last = NULL;
+		while (hp->first && fp->running < fp->max_transfers && hp->ready_at <= now &&
+		       hp->robots != ROBOTS_FETCHING && (hp->running == 0 || (hp->delay == 0 && hp->running < HOST_TRANSFERS)))
+			start_host(fp, hp);
+		hp->waiting = false;
+		if (hp->first)
+		{
+			if (hp->running == 0 && hp->ready_at > now && hp->ready_at - now < wait)
+				wait = hp->ready_at - now;
+			host_wait(fp, hp);
+		}
+		if (hp == end)
+			break;
+	}
+	return wait;
+}
+
+static bool finished(fetcher_t *fp)
+{
+	bool done;
+
+	pthread_mutex_lock(&fp->mutex);
+	done = fp->stop && fp->pending == NULL;
+	pthread_mutex_unlock(&fp->mutex);
+	return done && fp->running == 0 && fp->retry == NULL && fp->queued == 0;
+}
+
+fetcher_t *fetch_open(int max_transfers, fetch_fn done, void *arg)
+{
+	fetcher_t *fp;
+
+	if (max_transfers < 1 || done == NULL)
+		return NULL;
+	if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK)
+		return NULL;
+	if ((fp = calloc(1, sizeof(fetcher_t))) == NULL)
+		return NULL;
+	pthread_mutex_init(&fp->mutex, NULL);
+	fp->multi = curl_multi_init();
+	fp->share = curl_share_init();
+	fp->pool = calloc(max_transfers, sizeof(CURL *));
+	fp->hosts = hopen(HOSTS_SIZE);
+	if (fp->multi == NULL || fp->share == NULL || fp->pool == NULL || fp->hosts == NULL)
+	{
+		fetch_close(fp);
+		return NULL;
+	}
+	curl_share_setopt(fp->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(fp->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	fp->done = done;
+	fp->arg = arg;
+	fp->max_transfers = max_transfers;
+	fp->delay = DELAY_MS;
+	fp->latency = metrics_histogram("fetch.latency");
+	fp->bytes = metrics_counter("fetch.bytes");
+	fp->pages = metrics_counter("fetch.pages");
+	fp->retries = metrics_counter("fetch.retries");
+	fp->failures = metrics_counter("fetch.failures");
+	return fp;
+}
+
+void fetch_polite(fetcher_t *fp, long delay_ms, bool robots)
+{
+	if (fp == NULL)
+		return;
+	if (delay_ms >= 0)
+		fp->delay = delay_ms;
+	fp->use_robots = robots;
+}
+
+void fetch_close(fetcher_t *fp)
+{
+	if (fp == NULL)
+		return;
+	while (fp->npool > 0)
+		curl_easy_cleanup(fp->pool[--fp->npool]);
+	free(fp->pool);
+	hclose(fp->hosts);
+	if (fp->multi)
+		curl_multi_cleanup(fp->multi);
+	if (fp->share)
+		curl_share_cleanup(fp->share);
+	pthread_mutex_destroy(&fp->mutex);
+	free(fp);
+}
+
+int32_t fetch_add(fetcher_t *fp, webpage_t *page)
+{
+	transfer_t *tp;
+
+	if (fp == NULL || page == NULL || webpage_getHTML(page) != NULL)
+		return 1;
+	/* the handle is attached when the transfer starts */
+	if ((tp = calloc(1, sizeof(transfer_t))) == NULL)
+		return 1;
+	tp->page = page;
+	pthread_mutex_lock(&fp->mutex);
+	if (fp->last)
+		fp->last->next = tp;
+	else
+		fp->pending = tp;
+	fp->last = tp;
+	pthread_mutex_unlock(&fp->mutex);
+	curl_multi_wakeup(fp->multi);
+	return 0;
+}
+
+int32_t fetch_run(fetcher_t *fp)
+{
+	CURLMsg *msg;
+	int still, left;
+	long wait;
+	bool freed;
+
+	if (fp == NULL)
+		return 1;
+	while (!finished(fp))
+	{
+		wait = start_transfers(fp);
+		if (curl_multi_perform(fp->multi, &still) != CURLM_OK)
+			return 1;
+		freed = false;
+		while ((msg = curl_multi_info_read(fp->multi, &left)) != NULL)
+		{
+			if (msg->msg == CURLMSG_DONE)
+			{
+				freed = true;
+				CURLcode res = msg->data.result;
+				char *tp;
+
+				curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &tp);
+				finish(fp, (transfer_t *)tp, res);
+			}
+		}
+		/* finished transfers make room, so start more before waiting */
+		if (!freed && curl_multi_poll(fp->multi, NULL, 0, (int)wait, NULL) != CURLM_OK)
+			return 1;
+	}
+	return 0;
+}
+
+void fetch_stop(fetcher_t *fp)
+{
+	if (fp == NULL)
+		return;
+	pthread_mutex_lock(&fp->mutex);
+	fp->stop = true;
+	pthread_mutex_unlock(&fp->mutex);
+	curl_multi_wakeup(fp->multi);
+}
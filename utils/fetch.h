@@ -0,0 +1,75 @@
+#pragma once
+/*
+ * fetch.h -- asynchronous page fetching
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: a fetcher drives many transfers at once from a single
+ * thread with the libcurl multi interface. Pages may be added from any
+ * thread; each one is handed to a callback on the fetching thread when
+ * its transfer finishes. Connections, DNS lookups and TLS sessions are
+ * reused across transfers, and curl handles are pooled.
+ *
+ * A failed transfer is retried up to FETCH_TRIES times in all, one
+ * second apart, without holding up the other transfers.
+ *
+ * Fetching is polite per host (scheme, name and port of the url): a
+ * host with a delay has one transfer at a time, each starting at least
+ * the delay after the one before it finished, while the pages of other
+ * hosts go ahead. A host without a delay still has at most four
+ * transfers at once. The delay is one second by default, or none when
+ * built with -DNOSLEEP as for webpage_fetch.
+ *
+ * Each attempt at a page is timed in the fetch.latency histogram of
+ * metrics.h, and the pages, bytes, retries and failures are counted in
+ * fetch.pages, fetch.bytes, fetch.retries and fetch.failures, as they
+ * are by webpage_fetch.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <webpage.h>
+
+#define FETCH_TRIES 3 /* attempts per page */
+
+typedef struct fetcher fetcher_t; /* representation of a fetcher hidden */
+
+/* completion callback, called on the thread running fetch_run
+ * @page - the page, now owned by the callback
+ * @ok - true if its html was retrieved; otherwise its html holds the
+ *       curl error message, as with webpage_fetch
+ * @arg - the argument given to fetch_open
+ */
+typedef void (*fetch_fn)(webpage_t *page, bool ok, void *arg);
+
+/* fetch_open -- creates a fetcher running at most max_transfers at a
+ * time and reporting to done; returns NULL on failure
+ */
+fetcher_t *fetch_open(int max_transfers, fetch_fn done, void *arg);
+
+/* fetch_polite -- sets the delay in ms between transfers of a host,
+ * keeping the default if delay_ms is negative; with robots, a host's
+ * robots.txt is fetched before its pages and a longer Crawl-delay it
+ * gives for every agent or ours is used instead. Call before fetch_run.
+ */
+void fetch_polite(fetcher_t *fp, long delay_ms, bool robots);
+
+/* fetch_close -- destroys a fetcher that is no longer running */
+void fetch_close(fetcher_t *fp);
+
+/* fetch_add -- queues a page for fetching; may be called from any
+ * thread, including from the callback. The page must have no html.
+ * returns 0 for success; nonzero otherwise
+ */
+int32_t fetch_add(fetcher_t *fp, webpage_t *page);
+
+/* fetch_run -- runs transfers and callbacks until fetch_stop has been
+ * called and every page added has been reported
+ * returns 0 for success; nonzero otherwise
+ */
+int32_t fetch_run(fetcher_t *fp);
+
+/* fetch_stop -- asks fetch_run to return once it is idle; may be
+ * called from any thread
+ */
+void fetch_stop(fetcher_t *fp);
@@ -1,33 +1,53 @@
 /*
- * hash.c -- implements a generic hash table as an indexed set of queues.
+ * hash.c -- implements a generic hash table using open addressing
+ * with Robin Hood linear probing.
  *
  * Author: Nathaniel Mensah
- * Version: 1.0
+ * Version: 2.0
  *
- * Description: implementation of Hashtable ADT
+ * Description: implementation of Hashtable ADT. Entries live in a flat
+ * array of slots; each slot stores the full 32-bit hash of its key so
+ * that most mismatches are rejected without calling the search
+ * function. The table doubles whenever the load factor would exceed
+ * MAX_LOAD_NUM / MAX_LOAD_DEN, so the size given to hopen() is only an
+ * initial capacity hint.
  */
 #include <stdint.h>
 #include <stdlib.h>
 #include "hash.h"
-#include "queue.h"
 
 #define get16bits(d) (*((const uint16_t *)(d)))
 
+#define MIN_CAPACITY 8
+#define MAX_LOAD_NUM 4 /* grow when count exceeds 4/5 of capacity */
+#define MAX_LOAD_DEN 5
+
+/* slot -- an entry is NULL for an empty slot */
+typedef struct slot
+{
+	uint32_t hash;
+	void *entry;
+} slot_t;
+
 typedef struct table
 {
-	uint32_t tablesize;
-	queue_t **hash_table;
+	uint32_t capacity; /* always a power of two */
+	uint32_t mask;	   /* capacity - 1 */
+	uint32_t count;
+	slot_t *slots;
+	arena_t *arena;	   /* owner of the entries, or NULL */
 } table_t;
 
 /*
- * SuperFastHash() -- produces a number between 0 and the tablesize-1.
+ * SuperFastHash() -- produces a full 32-bit hash of the key; the
+ * table masks it down to a slot index.
  *
  * The following (rather complicated) code, has been taken from Paul
  * Hsieh's website under the terms of the BSD license. It's a hash
  * function used all over the place nowadays, including Google Sparse
  * Hash.
  */
-static uint32_t SuperFastHash(const char *data, int len, uint32_t tablesize)
+static uint32_t SuperFastHash(const char *data, int len)
 {
 	uint32_t hash = len, tmp;
 	int rem;
@@ -71,7 +91,92 @@ static uint32_t SuperFastHash(const char *data, int len, uint32_t tablesize)
 	hash += hash >> 17;
 	hash ^= hash << 25;
 	hash += hash >> 6;
-	return hash % tablesize;
+	return hash;
+}
+
+/* distance of the slot at idx from the home slot of its hash */
+static inline uint32_t probe_distance(const table_t *table, uint32_t idx, uint32_t hash)
+{
+	return (idx - (hash & table->mask)) & table->mask;
+}
+
+/*
+ * slot_insert -- Robin Hood insertion: an entry that is further from
+ * its home slot than the resident takes the slot, and the resident
+ * continues probing. Entries with equal hashes keep insertion order.
+ */
+static void slot_insert(table_t *table, uint32_t hash, void *ep)
+{
+	slot_t curr = {hash, ep}, tmp;
+	uint32_t idx = hash & table->mask;
+	uint32_t dist = 0, sdist;
+
+	for (;;)
+	{
+		slot_t *sp = &table->slots[idx];
+		if (sp->entry == NULL)
+		{
+			*sp = curr;
+			table->count++;
+			return;
+		}
+		sdist = probe_distance(table, idx, sp->hash);
+		if (sdist < dist)
+		{
+			tmp = *sp;
+			*sp = curr;
+			curr = tmp;
+			dist = sdist;
+		}
+		idx = (idx + 1) & table->mask;
+		dist++;
+	}
+}
+
+/* resize -- rehashes every entry into a table of newcap slots */
+static int32_t resize(table_t *table, uint32_t newcap)
+{
+	slot_t *old = table->slots;
+	uint32_t oldcap = table->capacity;
+
+	slot_t *slots = calloc(newcap, sizeof(slot_t));
+	if (slots == NULL)
+		return -1;
+
+	table->slots = slots;
+	table->capacity = newcap;
+	table->mask = newcap - 1;
+	table->count = 0;
+	for (uint32_t i = 0; i < oldcap; i++)
+	{
+		if (old[i].entry != NULL)
+			slot_insert(table, old[i].hash, old[i].entry);
+	}
+	free(old);
+	return 0;
+}
+
+/* find_slot -- index of the slot holding the entry, or -1 if absent */
+static int64_t find_slot(table_t *table,
+						 bool (*searchfn)(void *elementp, const void *searchkeyp),
+						 const char *key,
+						 uint32_t hash)
+{
+	uint32_t idx = hash & table->mask;
+	uint32_t dist = 0;
+
+	for (;;)
+	{
+		slot_t *sp = &table->slots[idx];
+		/* an empty slot, or a resident closer to home than we are,
+		 * means the key cannot be further along the probe sequence */
+		if (sp->entry == NULL || probe_distance(table, idx, sp->hash) < dist)
+			return -1;
+		if (sp->hash == hash && searchfn(sp->entry, key))
+			return idx;
+		idx = (idx + 1) & table->mask;
+		dist++;
+	}
 }
 
 /* hopen -- opens a hash table with initial size hsize */
@@ -83,31 +188,46 @@ hashtable_t *hopen(uint32_t hsize)
 	if (table == NULL)
 		return NULL;
 
-	table->tablesize = hsize;
-	table->hash_table = malloc(hsize * sizeof(queue_t *));
-
-	if (table->hash_table == NULL)
-		return NULL;
+	uint32_t capacity = MIN_CAPACITY;
+	while (capacity < hsize && capacity < (UINT32_C(1) << 31))
+		capacity <<= 1;
 
-	for (int i = 0; i < hsize; i++)
+	table->capacity = capacity;
+	table->mask = capacity - 1;
+	table->count = 0;
+	table->arena = NULL;
+	table->slots = calloc(capacity, sizeof(slot_t));
+	if (table->slots == NULL)
 	{
-		table->hash_table[i] = qopen();
+		free(table);
+		return NULL;
 	}
 	return (hashtable_t *)table;
 }
 
-/* hclose -- closes a hash table */
+/* hopen_arena -- opens a hash table whose entries belong to arena ap */
+hashtable_t *hopen_arena(uint32_t hsize, arena_t *ap)
+{
+	if (ap == NULL)
+		return NULL;
+	table_t *table = (table_t *)hopen(hsize);
+	if (table != NULL)
+		table->arena = ap;
+	return (hashtable_t *)table;
+}
+
+/* hclose -- closes a hash table, freeing every entry in it */
 void hclose(hashtable_t *htp)
 {
 	if (htp == NULL)
 		return;
 
 	table_t *table = (table_t *)htp;
-	for (int i = 0; i < table->tablesize; i++)
+	for (uint32_t i = 0; i < table->capacity && table->arena == NULL; i++)
 	{
-		qclose(table->hash_table[i]);
+		free(table->slots[i].entry);
 	}
-	free(table->hash_table);
+	free(table->slots);
 	free(table);
 }
 
@@ -119,9 +239,14 @@ int32_t hput(hashtable_t *htp, void *ep, const char *key, int keylen)
 	if (htp == NULL || ep == NULL)
 		return -1;
 	table_t *table = (table_t *)htp;
-	uint32_t hash = SuperFastHash(key, keylen, table->tablesize);
 
-	return qput(table->hash_table[hash], ep);
+	if ((uint64_t)(table->count + 1) * MAX_LOAD_DEN > (uint64_t)table->capacity * MAX_LOAD_NUM)
+	{
+		if (table->capacity >= (UINT32_C(1) << 31) || resize(table, table->capacity << 1) != 0)
+			return -1;
+	}
+	slot_insert(table, SuperFastHash(key, keylen), ep);
+	return 0;
 }
 
 /* happly -- applies a function to every entry in hash table */
@@ -130,9 +255,10 @@ void happly(hashtable_t *htp, void (*fn)(void *ep))
 	if (htp == NULL || fn == NULL)
 		return;
 	table_t *table = (table_t *)htp;
-	for (int i = 0; i < table->tablesize; i++)
+	for (uint32_t i = 0; i < table->capacity; i++)
 	{
-		qapply(table->hash_table[i], fn);
+		if (table->slots[i].entry != NULL)
+			fn(table->slots[i].entry);
 	}
 }
 
@@ -148,9 +274,9 @@ void *hsearch(hashtable_t *htp,
 	if (htp == NULL || searchfn == NULL)
 		return NULL;
 	table_t *table = (table_t *)htp;
-	uint32_t hash = SuperFastHash(key, keylen, table->tablesize);
+	int64_t idx = find_slot(table, searchfn, key, SuperFastHash(key, keylen));
 
-	return qsearch(table->hash_table[hash], searchfn, key);
+	return idx < 0 ? NULL : table->slots[idx].entry;
 }
 
 /* hremove -- removes and returns an entry under a designated key
@@ -165,7 +291,25 @@ void *hremove(hashtable_t *htp,
 	if (htp == NULL || searchfn == NULL)
 		return NULL;
 	table_t *table = (table_t *)htp;
-	uint32_t hash = SuperFastHash(key, keylen, table->tablesize);
+	int64_t found = find_slot(table, searchfn, key, SuperFastHash(key, keylen));
+	if (found < 0)
+		return NULL;
+
+	uint32_t idx = (uint32_t)found;
+	void *data = table->slots[idx].entry;
 
-	return qremove(table->hash_table[hash], searchfn, key);
+	/* backward-shift deletion: pull displaced successors one slot
+	 * closer to home so that no tombstones are needed */
+	uint32_t next = (idx + 1) & table->mask;
+	while (table->slots[next].entry != NULL &&
+		   probe_distance(table, next, table->slots[next].hash) > 0)
+	{
+		table->slots[idx] = table->slots[next];
+		idx = next;
+		next = (next + 1) & table->mask;
+	}
+	table->slots[idx].entry = NULL;
+	table->slots[idx].hash = 0;
+	table->count--;
+	return data;
 }
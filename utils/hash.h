@@ -3,16 +3,27 @@
  * hash.h -- A generic hash table implementation, allowing arbitrary
  * key structures.
  *
+ * The table is open addressed and grows automatically, so the size
+ * passed to hopen() is an initial capacity rather than a hard limit.
  */
 #include <stdint.h>
 #include <stdbool.h>
+#include "arena.h"
 
 typedef void hashtable_t;	/* representation of a hashtable hidden */
 
 /* hopen -- opens a hash table with initial size hsize */
 hashtable_t *hopen(uint32_t hsize);
 
-/* hclose -- closes a hash table */
+/* hopen_arena -- opens a hash table like hopen whose entries are
+ * allocated from arena ap; the slots themselves are still malloc'd
+ * so the table can grow
+ */
+hashtable_t *hopen_arena(uint32_t hsize, arena_t *ap);
+
+/* hclose -- closes a hash table, freeing every entry in it unless
+ * the table came from hopen_arena
+ */
 void hclose(hashtable_t *htp);
 
 /* hput -- puts an entry into a hash table under designated key 
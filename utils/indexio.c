@@ -2,23 +2,107 @@
  *
  * Author: Nathaniel Mensah
  * Created: Fri Feb 10 08:30:15 2023 (-0400)
- * Version: 1.0
+ * Version: 2.0
  *
  * Description: save and load an index to a named file indexnm. The
- * index file shall contain one line for each word in the index.
+ * index is saved either as text or in a binary format that can be
+ * memory mapped.
+ *
+ * The text file shall contain one line for each word in the index.
  * Each line has the format: <word> <docID1> <count1> <docID2> <count2> ....<docIDN> <countN>
  * <word> is a string of lowercase  letters, <docIDi> is a positive integer designating a document,
  * <counti> is a positive integer designating the number of occurrences of <word> in <docIDi>;
  * each entry should be placed on the line separated by a space.
  *
+ * The binary file (host byte order) is laid out as:
+ *   <header>     magic, version, number of words and section offsets
+ *   <terms>      a term_group_t for every TERM_GROUP words, then per
+ *                word, sorted by word, its number of documents and the
+ *                size of its posting list as varints. Posting lists are
+ *                stored in the same order, so a word's list starts where
+ *                its group's does plus the sizes of the words before it
+ *   <dict>       the words, front coded by dict.h; a word's term id
+ *                is its index in the terms
+ *   <doclens>    uint32_t length of every document id from the smallest
+ *                to the largest, for ranking
+ *   <postings>   posting lists in the block encoding of postings.h
+ *
+ * Both formats list the words in sorted order.
  */
+#define _POSIX_C_SOURCE 200809L // getline
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <limits.h>
 #include "indexio.h"
+#include "varint.h"
 
 #define hsize 1000 // hashtable size
 
+#define INDEX_MAGIC "TSEINDEX"
+#define INDEX_MAGIC_LEN 8
+#define INDEX_VERSION 8
+#define TERM_GROUP 16 /* words per term group */
+
+/* binary index header */
+typedef struct index_header
+{
+    char magic[INDEX_MAGIC_LEN];
+    uint32_t version;
+    uint32_t nterms;
+    uint64_t terms_off;    /* offset of the term groups */
+    uint64_t dict_off;     /* offset of the dictionary */
+    uint64_t dict_size;    /* size of the dictionary in bytes */
+    uint64_t postings_off; /* offset of the first posting list */
+    uint64_t file_size;
+    uint64_t doclens_off;  /* offset of the document lengths */
+    uint32_t nids;         /* one more than the largest document id */
+    uint32_t ndocs;        /* documents of nonzero length */
+    uint64_t total_len;    /* sum of the document lengths */
+    uint32_t base_id;      /* document lengths stored, for ids base_id to nids - 1 */
+    uint32_t unused;
+    uint64_t terms_size;   /* size of the term groups and records in bytes */
+} index_header_t;
+
+/* binary index term group: where the record and the posting list of
+ * its first word start
+ */
+typedef struct term_group
+{
+    uint64_t postings_off; /* offset of the posting list from the first one */
+    uint32_t record_off;   /* offset of the record from the end of the groups */
+    uint32_t unused;
+} term_group_t;
+
+/* memory mapped binary index */
+struct indexmap
+{
+    char *base;
+    size_t size;
+    const index_header_t *header;
+    const term_group_t *groups;
+    const uint8_t *records; /* of every word, after the groups */
+    const uint8_t *records_end;
+    dict_t dict;
+};
+
+/* the number of term groups of n words */
+static uint64_t group_count(uint64_t n)
+{
+    return (n + TERM_GROUP - 1) / TERM_GROUP;
+}
+
 static FILE *file;
 
+/* entries gathered from the index hashtable by collect_fn */
+static entry_t **collected;
+static int ncollected;
+
+/* document lengths summed by length_fn over ids first_id to nlengths - 1 */
+static uint32_t *lengths;
+static int first_id, nlengths;
+
 /* allocate entry */
 entry_t *new_entry(char *word)
 {
@@ -29,29 +113,39 @@ entry_t *new_entry(char *word)
     if (!entry)
         return NULL;
 
-    entry->documents = qopen();
-    if (entry->documents == NULL)
-        return NULL;
+    postings_init(&entry->documents);
+    positions_init(&entry->positions);
 
     entry->word = malloc(strlen(word) + 1);
     if (entry->word == NULL)
+    {
+        free(entry);
         return NULL;
+    }
 
     strcpy(entry->word, word);
 
     return entry;
 }
 
-/* allocate document */
-document_t *new_doc(int id, int word_count)
+/* allocate entry and its word from an arena */
+entry_t *new_entry_in(arena_t *ap, char *word)
 {
-    document_t *dp = (document_t *)malloc(sizeof(document_t));
-    if (!dp)
+    if (!ap || !word)
         return NULL;
 
-    dp->id = id;
-    dp->word_count = word_count;
-    return dp;
+    entry_t *entry = arena_alloc(ap, sizeof(entry_t));
+    if (!entry)
+        return NULL;
+
+    postings_init(&entry->documents);
+    positions_init(&entry->positions);
+
+    entry->word = arena_strndup(ap, word, strlen(word));
+    if (entry->word == NULL)
+        return NULL;
+
+    return entry;
 }
 
 /* frees all the entries in the index hashtable */
@@ -59,7 +153,8 @@ static void free_entry(void *ep)
 {
     entry_t *entryp = (entry_t *)ep;
     free(entryp->word);
-    qclose(entryp->documents);
+    postings_clear(&entryp->documents);
+    positions_clear(&entryp->positions);
 }
 
 void free_entries(hashtable_t *index)
@@ -67,19 +162,125 @@ void free_entries(hashtable_t *index)
     happly(index, free_entry);
 }
 
-/* appends doc id and word count in doc */
-static void doc_queue_write_fn(void *elementp)
+static void free_entry_postings(void *ep)
+{
+    postings_clear(&((entry_t *)ep)->documents);
+    positions_clear(&((entry_t *)ep)->positions);
+}
+
+/* frees only the posting lists of arena allocated entries */
+void free_postings(hashtable_t *index)
+{
+    happly(index, free_entry_postings);
+}
+
+static void count_fn(void *ep)
+{
+    ncollected++;
+}
+
+static void collect_fn(void *ep)
+{
+    collected[ncollected++] = (entry_t *)ep;
+}
+
+static int entry_cmp(const void *a, const void *b)
+{
+    const entry_t *ea = *(const entry_t **)a;
+    const entry_t *eb = *(const entry_t **)b;
+    return strcmp(ea->word, eb->word);
+}
+
+/* sorted_entries -- array of the entries in the index sorted by word;
+ * sets *count. The caller frees the array but not the entries.
+ */
+static entry_t **sorted_entries(hashtable_t *index, int *count)
+{
+    ncollected = 0;
+    happly(index, count_fn);
+    *count = ncollected;
+    collected = malloc((ncollected ? ncollected : 1) * sizeof(entry_t *));
+    if (!collected)
+        return NULL;
+    ncollected = 0;
+    happly(index, collect_fn);
+    qsort(collected, ncollected, sizeof(entry_t *), entry_cmp);
+    return collected;
+}
+
+/*
+ * index_sorted -- the entries of the index sorted by word
+ * returns: non-NULL for success; NULL otherwise
+ */
+entry_t **index_sorted(hashtable_t *index, int *count)
+{
+    if (!index || !count)
+        return NULL;
+    return sorted_entries(index, count);
+}
+
+static void max_id_fn(void *ep)
+{
+    postings_t *pp = &((entry_t *)ep)->documents;
+    if (pp->ndocs > 0 && pp->docs[pp->ndocs - 1].id >= nlengths)
+        nlengths = pp->docs[pp->ndocs - 1].id + 1;
+    if (pp->ndocs > 0 && pp->docs[0].id < first_id)
+        first_id = pp->docs[0].id;
+}
+
+static void length_fn(void *ep)
+{
+    postings_t *pp = &((entry_t *)ep)->documents;
+    for (int i = 0; i < pp->ndocs; i++)
+        lengths[pp->docs[i].id - first_id] += pp->docs[i].word_count;
+}
+
+/* fills in the document count and average length of dl from its lengths */
+static void doclens_stats(doclens_t *dl, uint64_t *total_len)
+{
+    uint64_t total = 0;
+    dl->ndocs = 0;
+    for (int i = 0; i < dl->nids - dl->base; i++)
+    {
+        total += dl->lens[i];
+        dl->ndocs += dl->lens[i] > 0;
+    }
+    dl->avglen = dl->ndocs > 0 ? (double)total / dl->ndocs : 0;
+    if (total_len)
+        *total_len = total;
+}
+
+/*
+ * index_doclens -- sums the word counts of every document in the index
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t index_doclens(hashtable_t *index, doclens_t *dl)
 {
-    document_t *dp = (document_t *)elementp;
-    fprintf(file, "%d %d ", dp->id, dp->word_count);
+    if (!index || !dl)
+        return 1;
+    first_id = INT_MAX;
+    nlengths = 0;
+    happly(index, max_id_fn);
+    if (first_id > nlengths)
+        first_id = nlengths;
+    if (!(lengths = calloc(nlengths > first_id ? nlengths - first_id : 1, sizeof(uint32_t))))
+        return 1;
+    happly(index, length_fn);
+    dl->buf = lengths;
+    dl->lens = lengths;
+    dl->nids = nlengths;
+    dl->base = first_id;
+    doclens_stats(dl, NULL);
+    return 0;
 }
 
-static void index_write_fn(void *elementp)
+/* doclens_clear -- frees lengths computed by index_doclens */
+void doclens_clear(doclens_t *dl)
 {
-    entry_t *ep = (entry_t *)elementp;
-    fprintf(file, "%s ", ep->word);
-    qapply(ep->documents, doc_queue_write_fn);
-    fprintf(file, "\n");
+    if (!dl)
+        return;
+    free(dl->buf);
+    memset(dl, 0, sizeof(doclens_t));
 }
 
 /*
@@ -89,28 +290,406 @@ static void index_write_fn(void *elementp)
  */
 int32_t indexsave(hashtable_t *index, char *indexnm)
 {
+    int count;
+    entry_t **entries = sorted_entries(index, &count);
+    if (!entries)
+        return 1;
 
     /* open file */
     file = fopen(indexnm, "w");
     if (file == NULL || access(indexnm, W_OK) != 0)
     {
         printf("Failed to create file: %s\n", indexnm);
+        free(entries);
         return 1;
     }
 
     /* write */
-    happly(index, index_write_fn);
+    for (int i = 0; i < count; i++)
+    {
+        entry_t *ep = entries[i];
+        fprintf(file, "%s ", ep->word);
+        for (int j = 0; j < ep->documents.ndocs; j++)
+        {
+            document_t *dp = &ep->documents.docs[j];
+            fprintf(file, "%d %d ", dp->id, dp->word_count);
+        }
+        fprintf(file, "\n");
+    }
 
-    fclose(file);
+    free(entries);
+    if (fclose(file) != 0)
+    {
+        printf("Failed to write file: %s\n", indexnm);
+        return 1;
+    }
     return 0;
 }
 
 /*
- * indexload -- loads the index from file indexnm
+ * indexsave_binary -- save the index to filename indexnm in the binary
+ * format read by indexmap_open
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t indexsave_binary(hashtable_t *index, char *indexnm)
+{
+    static const char padding[8];
+    int count;
+    entry_t **entries = sorted_entries(index, &count);
+    if (!entries)
+        return 1;
+
+    index_header_t header;
+    doclens_t dl;
+    uint64_t ngroups = group_count(count);
+    size_t groups_size = ngroups * sizeof(term_group_t);
+    uint32_t *sizes = malloc((count ? count : 1) * sizeof(uint32_t));
+    uint8_t *terms = malloc(groups_size + (size_t)count * 10 + 1);
+    char **words = malloc((count ? count : 1) * sizeof(char *));
+    if (!sizes || !terms || !words || index_doclens(index, &dl) != 0)
+    {
+        free(words);
+        free(terms);
+        free(sizes);
+        free(entries);
+        return 1;
+    }
+
+    /* the records of the words, and where each group of them starts */
+    term_group_t *groups = (term_group_t *)terms;
+    uint8_t *records = terms + groups_size, *p = records;
+    uint64_t off = 0;
+    size_t max_size = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (i % TERM_GROUP == 0)
+            groups[i / TERM_GROUP] = (term_group_t){off, (uint32_t)(p - records), 0};
+        sizes[i] = postings_encoded_size(&entries[i]->documents, dl.lens, dl.base, dl.nids);
+        p = varint_put(varint_put(p, entries[i]->documents.ndocs), sizes[i]);
+        off += sizes[i];
+        if (sizes[i] > max_size)
+            max_size = sizes[i];
+        words[i] = entries[i]->word;
+    }
+
+    /* lay out the sections */
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, INDEX_MAGIC_LEN);
+    header.version = INDEX_VERSION;
+    header.nterms = count;
+    header.terms_off = sizeof(index_header_t);
+    header.terms_size = p - terms;
+    header.dict_off = (header.terms_off + header.terms_size + 7) & ~(uint64_t)7;
+    header.dict_size = dict_encoded_size(words, count);
+    header.doclens_off = (header.dict_off + header.dict_size + 7) & ~(uint64_t)7;
+    header.nids = dl.nids;
+    header.base_id = dl.base;
+    doclens_stats(&dl, &header.total_len);
+    header.ndocs = dl.ndocs;
+    uint64_t doclens_size = (uint64_t)(dl.nids - dl.base) * sizeof(uint32_t);
+    header.postings_off = (header.doclens_off + doclens_size + 7) & ~(uint64_t)7;
+    header.file_size = header.postings_off + off;
+
+    uint8_t *buffer = malloc(max_size > header.dict_size ? max_size : header.dict_size);
+    if (!buffer)
+    {
+        doclens_clear(&dl);
+        free(words);
+        free(terms);
+        free(sizes);
+        free(entries);
+        return 1;
+    }
+
+    /* open file */
+    file = fopen(indexnm, "wb");
+    if (file == NULL || access(indexnm, W_OK) != 0)
+    {
+        printf("Failed to create file: %s\n", indexnm);
+        doclens_clear(&dl);
+        free(buffer);
+        free(words);
+        free(terms);
+        free(sizes);
+        free(entries);
+        return 1;
+    }
+
+    /* write */
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(terms, 1, header.terms_size, file);
+    fwrite(padding, 1, header.dict_off - header.terms_off - header.terms_size, file);
+    dict_encode(words, count, buffer);
+    fwrite(buffer, 1, header.dict_size, file);
+    fwrite(padding, 1, header.doclens_off - header.dict_off - header.dict_size, file);
+    fwrite(dl.lens, sizeof(uint32_t), dl.nids - dl.base, file);
+    fwrite(padding, 1, header.postings_off - header.doclens_off - doclens_size, file);
+    for (int i = 0; i < count; i++)
+    {
+        postings_encode(&entries[i]->documents, dl.lens, dl.base, dl.nids, buffer);
+        fwrite(buffer, 1, sizes[i], file);
+    }
+
+    doclens_clear(&dl);
+    free(buffer);
+    free(words);
+    free(terms);
+    free(sizes);
+    free(entries);
+    int error = ferror(file);
+    if (fclose(file) != 0 || error)
+    {
+        printf("Failed to write file: %s\n", indexnm);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * indexsave_positions -- save the positions of the words of the index
+ * to filename posnm
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t indexsave_positions(hashtable_t *index, char *posnm)
+{
+    int count;
+    entry_t **entries = sorted_entries(index, &count);
+    if (!entries)
+        return 1;
+    const postings_t **docs = malloc((count ? count : 1) * sizeof(postings_t *));
+    const positions_t **pos = malloc((count ? count : 1) * sizeof(positions_t *));
+    int32_t result = 1;
+    if (docs && pos)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            docs[i] = &entries[i]->documents;
+            pos[i] = &entries[i]->positions;
+        }
+        result = possave(posnm, count, docs, pos);
+    }
+    free(pos);
+    free(docs);
+    free(entries);
+    return result;
+}
+
+/*
+ * indexmap_open -- memory maps the binary index file indexnm
+ * returns: non-NULL for success; NULL if the file cannot be mapped or is
+ * not a binary index of a supported version
+ */
+indexmap_t *indexmap_open(char *indexnm)
+{
+    int fd = open(indexnm, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(index_header_t))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    char *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    /* check that the sections lie inside the file */
+    const index_header_t *header = (const index_header_t *)base;
+    uint64_t size = st.st_size;
+    if (memcmp(header->magic, INDEX_MAGIC, INDEX_MAGIC_LEN) != 0 ||
+        header->version != INDEX_VERSION ||
+        header->file_size != size ||
+        header->terms_off % 8 != 0 ||
+        group_count(header->nterms) * sizeof(term_group_t) > header->terms_size ||
+        header->terms_off + header->terms_size > size ||
+        header->dict_off + header->dict_size > size ||
+        header->doclens_off % 8 != 0 ||
+        header->base_id > header->nids || header->nids > INT_MAX ||
+        header->doclens_off + (uint64_t)(header->nids - header->base_id) * sizeof(uint32_t) > header->postings_off ||
+        header->postings_off > size || header->postings_off % 8 != 0)
+    {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+
+    indexmap_t *map = malloc(sizeof(indexmap_t));
+    if (!map)
+    {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+    map->base = base;
+    map->size = st.st_size;
+    map->header = header;
+    map->groups = (const term_group_t *)(base + header->terms_off);
+    map->records = (const uint8_t *)map->groups + group_count(header->nterms) * sizeof(term_group_t);
+    map->records_end = (const uint8_t *)base + header->terms_off + header->terms_size;
+    if (dict_open(&map->dict, base + header->dict_off, header->dict_size) != 0 ||
+        map->dict.nterms != (int)header->nterms)
+    {
+        indexmap_close(map);
+        return NULL;
+    }
+    return map;
+}
+
+/* indexmap_close -- unmaps the index */
+void indexmap_close(indexmap_t *map)
+{
+    if (!map)
+        return;
+    munmap(map->base, map->size);
+    free(map);
+}
+
+/*
+ * indexmap_doclens -- points dl at the document lengths of the index
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t indexmap_doclens(indexmap_t *map, doclens_t *dl)
+{
+    if (!map || !dl)
+        return 1;
+    dl->buf = NULL;
+    dl->lens = (const uint32_t *)(map->base + map->header->doclens_off);
+    dl->nids = map->header->nids;
+    dl->base = map->header->base_id;
+    dl->ndocs = map->header->ndocs;
+    dl->avglen = dl->ndocs > 0 ? (double)map->header->total_len / dl->ndocs : 0;
+    return 0;
+}
+
+/* indexmap_nterms -- the number of words in the index */
+int indexmap_nterms(indexmap_t *map)
+{
+    return map ? (int)map->header->nterms : 0;
+}
+
+/* indexmap_dict -- the words of the index, by term id */
+const dict_t *indexmap_dict(indexmap_t *map)
+{
+    return map ? &map->dict : NULL;
+}
+
+/*
+ * find_term -- reads the record of the i-th word, from the start of its
+ * group, and points *data at its posting list of *size bytes
+ * returns: 0 for success; nonzero if it lies outside the index
+ */
+static int32_t find_term(const indexmap_t *map, int i, const uint8_t **data, uint32_t *size, int *ndocs)
+{
+    if (i < 0 || i >= (int)map->header->nterms)
+        return -1;
+    const term_group_t *gp = &map->groups[i / TERM_GROUP];
+    const uint8_t *p = map->records + gp->record_off;
+    uint64_t off = gp->postings_off;
+    uint32_t n;
+    if (gp->record_off > (size_t)(map->records_end - map->records))
+        return -1;
+    for (int j = i - i % TERM_GROUP;; j++)
+    {
+        if (!(p = varint_get(p, map->records_end, &n)) || !(p = varint_get(p, map->records_end, size)))
+            return -1;
+        if (j == i)
+            break;
+        off += *size;
+    }
+    if (n > INT_MAX || off + *size > map->header->file_size - map->header->postings_off)
+        return -1;
+    *data = (const uint8_t *)map->base + map->header->postings_off + off;
+    *ndocs = (int)n;
+    return 0;
+}
+
+/*
+ * indexmap_get -- decodes the posting list of the i-th word into pp
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t indexmap_get(indexmap_t *map, int i, postings_t *pp)
+{
+    const uint8_t *data;
+    uint32_t size;
+    int ndocs;
+    if (!map || !pp || find_term(map, i, &data, &size, &ndocs) != 0)
+        return -1;
+    return postings_decode(data, size, ndocs, pp);
+}
+
+/*
+ * indexmap_lookup -- finds word and decodes its posting list into pp
+ * returns: true if the word is in the index; false otherwise
+ */
+bool indexmap_lookup(indexmap_t *map, const char *word, postings_t *pp)
+{
+    int i;
+    if (!map || !word || (i = dict_find(&map->dict, word)) < 0)
+        return false;
+    return indexmap_get(map, i, pp) == 0;
+}
+
+/*
+ * indexmap_cursor -- finds word and opens a cursor on its posting list
+ * returns: true if the word is in the index; false otherwise
+ */
+bool indexmap_cursor(indexmap_t *map, const char *word, pcursor_t *cp)
+{
+    int i;
+    if (!map || !word || !cp || (i = dict_find(&map->dict, word)) < 0)
+        return false;
+    const uint8_t *data;
+    uint32_t size;
+    int ndocs;
+    if (find_term(map, i, &data, &size, &ndocs) != 0)
+        return false;
+    return pcursor_open(cp, data, size, ndocs) == 0;
+}
+
+/* copies every word of a mapped index into a new hashtable */
+static hashtable_t *indexload_binary(indexmap_t *map)
+{
+    int nterms = indexmap_nterms(map);
+    hashtable_t *index = hopen(nterms > 0 ? nterms : hsize);
+    char *word = malloc((size_t)map->dict.maxlen + 1);
+    for (int i = 0; i < nterms; i++)
+    {
+        entry_t *ep = NULL;
+        if (!word || dict_word(&map->dict, i, word, (size_t)map->dict.maxlen + 1) < 0 || !(ep = new_entry(word)) ||
+            indexmap_get(map, i, &ep->documents) != 0)
+        {
+            if (ep)
+            {
+                free_entry(ep);
+                free(ep);
+            }
+            free(word);
+            free_entries(index);
+            hclose(index);
+            return NULL;
+        }
+        hput(index, ep, ep->word, strlen(ep->word));
+    }
+    free(word);
+    return index;
+}
+
+/*
+ * indexload -- loads the index from file indexnm, which may be in
+ * either the text or the binary format
  * returns: non-NULL for success; NULL otherwise
  */
 hashtable_t *indexload(char *indexnm)
 {
+    indexmap_t *map = indexmap_open(indexnm);
+    if (map)
+    {
+        hashtable_t *index = indexload_binary(map);
+        indexmap_close(map);
+        return index;
+    }
 
     /* open file */
     FILE *file = fopen(indexnm, "r");
@@ -120,32 +699,45 @@ hashtable_t *indexload(char *indexnm)
     }
 
     hashtable_t *index = hopen(hsize);
-    const int MAX_LINE_LEN = 1024;
-    char line_buffer[MAX_LINE_LEN];
-    char *token;
-    char *delim = " ";
-    int id, word_count;
+    char *line_buffer = NULL;
+    size_t line_size = 0;
+    char *token, *count;
+    char *delim = " \r\n";
 
-    while (fgets(line_buffer, MAX_LINE_LEN, file))
+    /* getline grows the buffer, so long posting lines are read whole */
+    while (getline(&line_buffer, &line_size, file) != -1)
     {
-        /* remove trailing white space */
-        int len = strcspn(line_buffer, "\r\n");
-        line_buffer[len] = '\0';
-
         token = strtok(line_buffer, delim);
+        if (!token)
+            continue;
         entry_t *ep = new_entry(token);
-        hput(index, ep, token, strlen(token));
+        hput(index, ep, ep->word, strlen(ep->word));
 
-        while ((token = strtok(NULL, delim)) != NULL)
+        while ((token = strtok(NULL, delim)) != NULL && (count = strtok(NULL, delim)) != NULL)
         {
-            id = atoi(token);
-            token = strtok(NULL, delim);
-            word_count = atoi(token);
-            document_t *dp = new_doc(id, word_count);
-            qput(ep->documents, dp);
+            postings_add(&ep->documents, atoi(token), atoi(count));
         }
     }
 
+    free(line_buffer);
     fclose(file);
     return index;
 }
+
+/*
+ * index_generation -- identifies the contents of the index file indexnm
+ * by its inode, size and modification time
+ * returns: 0 for success; nonzero if the file cannot be read
+ */
+int32_t index_generation(char *indexnm, uint64_t *gen)
+{
+    struct stat st;
+    if (!indexnm || !gen || stat(indexnm, &st) != 0)
+        return 1;
+    uint64_t g = (uint64_t)st.st_ino;
+    g = g * 1000003 ^ (uint64_t)st.st_size;
+    g = g * 1000003 ^ (uint64_t)st.st_mtim.tv_sec;
+    g = g * 1000003 ^ (uint64_t)st.st_mtim.tv_nsec;
+    *gen = g;
+    return 0;
+}
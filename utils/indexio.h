@@ -7,43 +7,69 @@
  * Version: 1.0
  *
  * Description: indexsave saves an index to a named file;
- * indexload cloads an index from the named file
+ * indexload cloads an index from the named file. indexsave_binary
+ * writes a binary index with compressed posting lists that
+ * indexmap_open maps into memory, so that a word's posting list can be
+ * decoded on demand without loading the whole index.
  */
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdbool.h>
 #include "hash.h"
-#include "queue.h"
+#include "postings.h"
+#include "dict.h"
+#include "positions.h"
 
 /* index entry struct
  *
  * @param word - the word to add to the index
- * @param documents - the queue of crawled docs containing the word
+ * @param documents - the crawled docs containing the word, sorted by id
+ * @param positions - the positions of the word in those docs, in order;
+ * empty unless the index is positional
  */
 typedef struct entry
 {
 	char *word;
-	queue_t *documents;
+	postings_t documents;
+	positions_t positions;
 } entry_t;
 
-/* document struct
+/* document lengths, in indexed words, used for ranking
  *
- * @param id - document id designated by crawler
- * @param word_count - the count of a specific word in the index in this doc
+ * @param lens - the length of every document id from base to nids - 1,
+ * id at lens[id - base], 0 for an id that is not in the index
+ * @param nids - one more than the largest id
+ * @param ndocs - the number of documents in the index
+ * @param avglen - the average length of those documents
+ * @param buf - the lengths if they were allocated, NULL if mapped
+ * @param base - the smallest id, so that a delta of the largest ids
+ * stores no lengths for the ids before it
  */
-typedef struct document
+typedef struct doclens
 {
-	int id;
-	int word_count;
-} document_t;
+    const uint32_t *lens;
+    int nids;
+    int ndocs;
+    double avglen;
+    uint32_t *buf;
+    int base;
+} doclens_t;
+
+/* memory mapped binary index; representation hidden */
+typedef struct indexmap indexmap_t;
 
 /* allocate index entry */
 entry_t *new_entry(char *word);
 
-/* allocate document */
-document_t *new_doc(int id, int word_count);
+/*
+ * new_entry_in -- allocate an index entry and a copy of its word from
+ * arena ap; only the posting list is malloc'd, so such entries are
+ * released with free_postings and the arena rather than free_entries
+ */
+entry_t *new_entry_in(arena_t *ap, char *word);
 
 /*
  * indexsave -- save the index to filename indexnm
@@ -53,7 +79,24 @@ document_t *new_doc(int id, int word_count);
 int32_t indexsave(hashtable_t *index, char *indexnm);
 
 /*
- * indexload -- loads the index from file indexnm
+ * indexsave_binary -- save the index to filename indexnm in the binary
+ * format read by indexmap_open
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t indexsave_binary(hashtable_t *index, char *indexnm);
+
+/*
+ * indexsave_positions -- save the positions of the words of the index
+ * to filename posnm, in the term order of indexsave_binary
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t indexsave_positions(hashtable_t *index, char *posnm);
+
+/*
+ * indexload -- loads the index from file indexnm, which may be in
+ * either the text or the binary format
  *
  * returns: non-NULL for success; NULL otherwise
  *
@@ -61,7 +104,92 @@ int32_t indexsave(hashtable_t *index, char *indexnm);
  */
 hashtable_t *indexload(char *indexnm);
 
+/*
+ * index_sorted -- the entries of the index sorted by word; sets *count.
+ * The caller frees the array but not the entries.
+ *
+ * returns: non-NULL for success; NULL otherwise
+ */
+entry_t **index_sorted(hashtable_t *index, int *count);
+
 /*
  * free_entries -- frees all entry structs in the index
  */
 void free_entries(hashtable_t *index);
+
+/*
+ * free_postings -- frees the posting lists of entries made by
+ * new_entry_in, leaving the entries themselves to their arena
+ */
+void free_postings(hashtable_t *index);
+
+/*
+ * index_doclens -- computes the document lengths of a loaded index, as
+ * the sum of the word counts of each document; the caller releases them
+ * with doclens_clear
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t index_doclens(hashtable_t *index, doclens_t *dl);
+
+/* doclens_clear -- frees document lengths computed by index_doclens */
+void doclens_clear(doclens_t *dl);
+
+/*
+ * index_generation -- sets gen to a number identifying the contents of
+ * the index file indexnm, which changes whenever the file is rewritten
+ *
+ * returns: 0 for success; nonzero if the file cannot be read
+ */
+int32_t index_generation(char *indexnm, uint64_t *gen);
+
+/*
+ * indexmap_open -- memory maps the binary index file indexnm
+ *
+ * returns: non-NULL for success; NULL if the file cannot be mapped or
+ * is not a binary index of a supported version
+ */
+indexmap_t *indexmap_open(char *indexnm);
+
+/* indexmap_close -- unmaps the index */
+void indexmap_close(indexmap_t *map);
+
+/*
+ * indexmap_doclens -- points dl at the document lengths stored in the
+ * index, which stay valid until it is unmapped
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t indexmap_doclens(indexmap_t *map, doclens_t *dl);
+
+/* indexmap_nterms -- the number of words in the index */
+int indexmap_nterms(indexmap_t *map);
+
+/*
+ * indexmap_dict -- the words of the index in sorted order; the term id
+ * of a word in the dictionary is its index in the map
+ */
+const dict_t *indexmap_dict(indexmap_t *map);
+
+/*
+ * indexmap_get -- decodes the posting list of term id i into pp,
+ * replacing its contents; pp must not be a view
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t indexmap_get(indexmap_t *map, int i, postings_t *pp);
+
+/*
+ * indexmap_lookup -- finds word and decodes its posting list into pp
+ *
+ * returns: true if the word is in the index; false otherwise
+ */
+bool indexmap_lookup(indexmap_t *map, const char *word, postings_t *pp);
+
+/*
+ * indexmap_cursor -- finds word and opens a cursor on its posting list,
+ * which is decoded in place as the cursor moves
+ *
+ * returns: true if the word is in the index; false otherwise
+ */
+bool indexmap_cursor(indexmap_t *map, const char *word, pcursor_t *cp);
@@ -0,0 +1,527 @@
+/*
+ * indexset.c -- an index made of a base and delta segments
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: the segments are found by name, <indexnm>.1 onwards,
+ * until one is missing. A merge loads every posting list into one
+ * hashtable, appending the lists of later segments, and saves it with
+ * indexsave_binary, so the merged base is the same file a full rebuild
+ * would write. The positions of a positional set are merged beside the
+ * posting lists and saved with indexsave_positions.
+ */
+#define _POSIX_C_SOURCE 200809L // strdup
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "indexset.h"
+#include "docstore.h"
+
+#define MERGE_SUFFIX ".merge" /* a merged base being written */
+
+struct indexset
+{
+    int nsegs;
+    indexmap_t *maps[INDEXSET_MAX];
+    char *names[INDEXSET_MAX];
+    posmap_t *posmaps[INDEXSET_MAX]; /* NULL for a segment without positions */
+    int nids;
+    int next; /* the first delta number not in use */
+};
+
+void indexset_segname(const char *indexnm, int i, char *buf, size_t size)
+{
+    if (i == 0)
+        snprintf(buf, size, "%s", indexnm);
+    else
+        snprintf(buf, size, "%s.%d", indexnm, i);
+}
+
+/* one more than the largest document id of map */
+static int map_nids(indexmap_t *map)
+{
+    doclens_t dl;
+    return indexmap_doclens(map, &dl) == 0 ? dl.nids : 0;
+}
+
+/* the positions of segment name of map, if it has them */
+static posmap_t *open_positions(const char *name, indexmap_t *map)
+{
+    char posnm[strlen(name) + strlen(POSITIONS_SUFFIX) + 1];
+    sprintf(posnm, "%s%s", name, POSITIONS_SUFFIX);
+    return posmap_open(posnm, indexmap_nterms(map));
+}
+
+indexset_t *indexset_open(char *indexnm)
+{
+    if (!indexnm)
+        return NULL;
+    indexset_t *set = calloc(1, sizeof(indexset_t));
+    if (!set)
+        return NULL;
+
+    size_t size = strlen(indexnm) + 16;
+    char name[size];
+    for (int i = 0; i < INDEXSET_MAX; i++)
+    {
+        indexset_segname(indexnm, i, name, size);
+        set->next = i + 1;
+        if (i > 0 && access(name, F_OK) != 0)
+        {
+            set->next = i;
+            break;
+        }
+        indexmap_t *map = indexmap_open(name);
+        if (!map && i == 0)
+        {
+            indexset_close(set);
+            return NULL;
+        }
+        /* a delta being written, or one already merged into the base */
+        int nids = map ? map_nids(map) : 0;
+        if (!map || nids <= set->nids)
+        {
+            indexmap_close(map);
+            continue;
+        }
+        if (!(set->names[set->nsegs] = strdup(name)))
+        {
+            indexmap_close(map);
+            indexset_close(set);
+            return NULL;
+        }
+        set->posmaps[set->nsegs] = open_positions(name, map);
+        set->maps[set->nsegs++] = map;
+        set->nids = nids;
+    }
+    return set;
+}
+
+void indexset_close(indexset_t *set)
+{
+    if (!set)
+        return;
+    for (int i = 0; i < set->nsegs; i++)
+    {
+        indexmap_close(set->maps[i]);
+        posmap_close(set->posmaps[i]);
+        free(set->names[i]);
+    }
+    free(set);
+}
+
+int indexset_count(indexset_t *set)
+{
+    return set ? set->nsegs : 0;
+}
+
+const char *indexset_name(indexset_t *set, int i)
+{
+    return set && i >= 0 && i < set->nsegs ? set->names[i] : NULL;
+}
+
+indexmap_t *indexset_map(indexset_t *set, int i)
+{
+    return set && i >= 0 && i < set->nsegs ? set->maps[i] : NULL;
+}
+
+int indexset_nids(indexset_t *set)
+{
+    return set ? set->nids : 0;
+}
+
+int indexset_next(indexset_t *set)
+{
+    return set ? set->next : 0;
+}
+
+int32_t indexset_doclens(indexset_t *set, doclens_t *dl)
+{
+    if (!set || !dl)
+        return 1;
+    if (set->nsegs == 1)
+        return indexmap_doclens(set->maps[0], dl);
+
+    doclens_t segs[INDEXSET_MAX];
+    int base = set->nids;
+    for (int i = 0; i < set->nsegs; i++)
+    {
+        if (indexmap_doclens(set->maps[i], &segs[i]) != 0)
+            return 1;
+        if (segs[i].base < base)
+            base = segs[i].base;
+    }
+    uint32_t *lens = calloc(set->nids > base ? set->nids - base : 1, sizeof(uint32_t));
+    if (!lens)
+        return 1;
+    for (int i = 0; i < set->nsegs; i++)
+    {
+        for (int id = segs[i].base; id < segs[i].nids; id++)
+            lens[id - base] += segs[i].lens[id - segs[i].base];
+    }
+
+    uint64_t total = 0;
+    dl->ndocs = 0;
+    for (int i = 0; i < set->nids - base; i++)
+    {
+        total += lens[i];
+        dl->ndocs += lens[i] > 0;
+    }
+    dl->buf = lens;
+    dl->lens = lens;
+    dl->nids = set->nids;
+    dl->base = base;
+    dl->avglen = dl->ndocs > 0 ? (double)total / dl->ndocs : 0;
+    return 0;
+}
+
+bool indexset_lookup(indexset_t *set, const char *word, postings_t *pp)
+{
+    if (!set || !pp)
+        return false;
+    if (set->nsegs == 1)
+        return indexmap_lookup(set->maps[0], word, pp);
+
+    postings_t seg;
+    bool found = false;
+    postings_init(&seg);
+    pp->ndocs = 0;
+    for (int i = 0; i < set->nsegs; i++)
+    {
+        if (indexmap_lookup(set->maps[i], word, &seg))
+        {
+            if (postings_append(pp, &seg) != 0)
+            {
+                found = false;
+                break;
+            }
+            found = true;
+        }
+    }
+    postings_clear(&seg);
+    return found;
+}
+
+int indexset_cursors(indexset_t *set, const char *word, pcursor_t *cps, int *df)
+{
+    int n = 0;
+    if (df)
+        *df = 0;
+    if (!set || !cps)
+        return 0;
+    for (int i = 0; i < set->nsegs; i++)
+    {
+        if (indexmap_cursor(set->maps[i], word, &cps[n]))
+        {
+            if (df)
+                *df += cps[n].ndocs;
+            n++;
+        }
+    }
+    return n;
+}
+
+bool indexset_positional(indexset_t *set)
+{
+    if (!set || set->nsegs == 0)
+        return false;
+    for (int i = 0; i < set->nsegs; i++)
+    {
+        if (!set->posmaps[i])
+            return false;
+    }
+    return true;
+}
+
+int32_t indexset_positions(indexset_t *set, const char *word, const postings_t *docs, arena_t *ap, uint32_t **pos,
+                           int *npos)
+{
+    if (!set || !word || !docs || !ap || !pos || !npos || !indexset_positional(set))
+        return 1;
+    for (int j = 0; j < docs->ndocs; j++)
+    {
+        pos[j] = NULL;
+        npos[j] = 0;
+    }
+
+    /* walk each segment's list beside the docs, skipping the others */
+    postings_t seg;
+    poscursor_t pc;
+    int32_t status = 0;
+    int j = 0;
+    postings_init(&seg);
+    for (int i = 0; status == 0 && i < set->nsegs && j < docs->ndocs; i++)
+    {
+        int t = dict_find(indexmap_dict(set->maps[i]), word);
+        if (t < 0)
+            continue;
+        if (indexmap_get(set->maps[i], t, &seg) != 0 || !posmap_cursor(set->posmaps[i], t, &pc))
+        {
+            status = 1;
+            break;
+        }
+        for (int k = 0; status == 0 && k < seg.ndocs && j < docs->ndocs; k++)
+        {
+            const document_t *dp = &seg.docs[k];
+            while (j < docs->ndocs && docs->docs[j].id < dp->id)
+                j++;
+            if (j < docs->ndocs && docs->docs[j].id == dp->id)
+            {
+                if (!(pos[j] = arena_alloc(ap, dp->word_count * sizeof(uint32_t))))
+                    status = 1;
+                else if (!(status = poscursor_next(&pc, dp->word_count, pos[j])))
+                    npos[j++] = dp->word_count;
+            }
+            else
+            {
+                status = poscursor_next(&pc, dp->word_count, NULL);
+            }
+        }
+    }
+    postings_clear(&seg);
+    return status;
+}
+
+static int word_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int indexset_expand(indexset_t *set, const char *prefix, arena_t *ap, char ***words)
+{
+    if (!set || !prefix || !ap || !words)
+        return -1;
+    int first[INDEXSET_MAX], count[INDEXSET_MAX], total = 0, n = 0;
+    for (int i = 0; i < set->nsegs; i++)
+    {
+        count[i] = dict_prefix(indexmap_dict(set->maps[i]), prefix, &first[i]);
+        total += count[i];
+    }
+    char **all = arena_alloc(ap, (total ? total : 1) * sizeof(char *));
+    if (!all)
+        return -1;
+    for (int i = 0; i < set->nsegs; i++)
+    {
+        const dict_t *dict = indexmap_dict(set->maps[i]);
+        char *word = count[i] > 0 ? malloc((size_t)dict->maxlen + 1) : NULL;
+        if (count[i] > 0 && !word)
+            return -1;
+        for (int t = first[i]; t < first[i] + count[i]; t++)
+        {
+            int len = dict_word(dict, t, word, (size_t)dict->maxlen + 1);
+            if (len < 0 || !(all[n++] = arena_strndup(ap, word, len)))
+            {
+                free(word);
+                return -1;
+            }
+        }
+        free(word);
+    }
+
+    /* each segment's words are sorted; a word in several is kept once */
+    if (set->nsegs > 1)
+    {
+        qsort(all, n, sizeof(char *), word_cmp);
+        int distinct = 0;
+        for (int i = 0; i < n; i++)
+        {
+            if (distinct == 0 || strcmp(all[distinct - 1], all[i]) != 0)
+                all[distinct++] = all[i];
+        }
+        n = distinct;
+    }
+    *words = all;
+    return n;
+}
+
+int32_t indexset_generation(char *indexnm, uint64_t *gen)
+{
+    if (!indexnm || !gen)
+        return 1;
+    size_t size = strlen(indexnm) + 16;
+    char name[size];
+    uint64_t g, combined = 0;
+    for (int i = 0; i < INDEXSET_MAX; i++)
+    {
+        indexset_segname(indexnm, i, name, size);
+        if (index_generation(name, &g) != 0)
+        {
+            if (i == 0)
+                return 1;
+            break;
+        }
+        combined = combined * 1000003 ^ g;
+    }
+    *gen = combined;
+    return 0;
+}
+
+static bool entry_searchfn(void *elementp, const void *searchkeyp)
+{
+    return strcmp(((entry_t *)elementp)->word, (const char *)searchkeyp) == 0;
+}
+
+/* appends the positions of term t, whose posting list is seg, to pp */
+static int32_t merge_positions(positions_t *pp, posmap_t *pm, int t, const postings_t *seg, uint32_t **buf,
+                               int *bufsize)
+{
+    poscursor_t pc;
+    int total = 0, n = 0;
+    for (int k = 0; k < seg->ndocs; k++)
+        total += seg->docs[k].word_count;
+    if (total > *bufsize)
+    {
+        uint32_t *grown = realloc(*buf, total * sizeof(uint32_t));
+        if (!grown)
+            return 1;
+        *buf = grown;
+        *bufsize = total;
+    }
+    if (!posmap_cursor(pm, t, &pc))
+        return 1;
+    for (int k = 0; k < seg->ndocs; k++)
+    {
+        if (poscursor_next(&pc, seg->docs[k].word_count, *buf + n) != 0)
+            return 1;
+        n += seg->docs[k].word_count;
+    }
+    return positions_append(pp, *buf, total);
+}
+
+/* appends the posting lists of every word of map, and their positions if
+ * pm is not NULL, to index
+ */
+static int32_t merge_map(hashtable_t *index, indexmap_t *map, posmap_t *pm)
+{
+    const dict_t *dict = indexmap_dict(map);
+    char *word = malloc((size_t)dict->maxlen + 1);
+    postings_t seg;
+    uint32_t *buf = NULL;
+    int bufsize = 0;
+    int32_t status = !word;
+    postings_init(&seg);
+    for (int t = 0; status == 0 && t < indexmap_nterms(map); t++)
+    {
+        int len = dict_word(dict, t, word, (size_t)dict->maxlen + 1);
+        entry_t *ep = len >= 0 ? hsearch(index, entry_searchfn, word, len) : NULL;
+        if (len >= 0 && !ep && (ep = new_entry(word)) && hput(index, ep, ep->word, len) != 0)
+        {
+            free(ep->word);
+            free(ep);
+            ep = NULL;
+        }
+        status = !ep || indexmap_get(map, t, &seg) != 0 || postings_append(&ep->documents, &seg) != 0 ||
+                 (pm && merge_positions(&ep->positions, pm, t, &seg, &buf, &bufsize) != 0);
+    }
+    free(word);
+    free(buf);
+    postings_clear(&seg);
+    return status;
+}
+
+/* the doc store of segment name, or NULL if it has none */
+static docmap_t *open_docs(const char *name)
+{
+    char docsnm[strlen(name) + strlen(DOCSTORE_SUFFIX) + 1];
+    sprintf(docsnm, "%s%s", name, DOCSTORE_SUFFIX);
+    return docmap_open(docsnm);
+}
+
+/* copies the documents of map, which may be NULL, into ds */
+static int32_t merge_docs(docstore_t *ds, docmap_t *map)
+{
+    docmeta_t meta;
+    int32_t status = 0;
+    int base, nids;
+    docmap_ids(map, &base, &nids);
+    for (int id = base; status == 0 && id < nids; id++)
+    {
+        if (docmap_get(map, id, &meta))
+            status = docstore_put(ds, id, &meta);
+    }
+    return status;
+}
+
+int32_t indexset_merge(char *indexnm)
+{
+    indexset_t *set = indexset_open(indexnm);
+    if (!set)
+        return 1;
+
+    /* the merged doc store starts at the smallest id of any segment's */
+    docmap_t *docs[INDEXSET_MAX];
+    int base = set->nids, first, nids;
+    for (int i = 0; i < set->nsegs; i++)
+    {
+        docmap_ids(docs[i] = open_docs(set->names[i]), &first, &nids);
+        if (docs[i] && first < base)
+            base = first;
+    }
+
+    hashtable_t *index = hopen(indexmap_nterms(set->maps[0]) + 1);
+    docstore_t *ds = docstore_new(base, set->nids);
+    int32_t status = !index || !ds;
+    bool positional = indexset_positional(set);
+    for (int i = 0; status == 0 && i < set->nsegs; i++)
+    {
+        status = merge_map(index, set->maps[i], positional ? set->posmaps[i] : NULL) ||
+                 merge_docs(ds, docs[i]);
+    }
+    for (int i = 0; i < set->nsegs; i++)
+        docmap_close(docs[i]);
+    int next = set->next;
+    indexset_close(set);
+
+    /* the doc store goes first: a newer one only has more documents */
+    size_t size = strlen(indexnm) + strlen(MERGE_SUFFIX) + strlen(DOCSTORE_SUFFIX) + strlen(POSITIONS_SUFFIX) + 1;
+    char mergenm[size], docsnm[size], mergedocsnm[size], posnm[size], mergeposnm[size];
+    snprintf(mergenm, size, "%s%s", indexnm, MERGE_SUFFIX);
+    snprintf(docsnm, size, "%s%s", indexnm, DOCSTORE_SUFFIX);
+    snprintf(mergedocsnm, size, "%s%s", mergenm, DOCSTORE_SUFFIX);
+    snprintf(posnm, size, "%s%s", indexnm, POSITIONS_SUFFIX);
+    snprintf(mergeposnm, size, "%s%s", mergenm, POSITIONS_SUFFIX);
+    if (status == 0)
+    {
+        status = indexsave_binary(index, mergenm) || docstore_save(ds, mergedocsnm) ||
+                 (positional && indexsave_positions(index, mergeposnm) != 0) ||
+                 rename(mergedocsnm, docsnm) != 0;
+    }
+    /* positions that no longer cover every segment are dropped */
+    if (status == 0)
+    {
+        status = positional ? rename(mergeposnm, posnm) != 0 : remove(posnm) != 0 && access(posnm, F_OK) == 0;
+        status = status || rename(mergenm, indexnm) != 0;
+    }
+    if (index)
+    {
+        free_entries(index);
+        hclose(index);
+    }
+    docstore_free(ds);
+    if (status != 0)
+    {
+        remove(mergenm);
+        remove(mergedocsnm);
+        remove(mergeposnm);
+        return 1;
+    }
+
+    /* every delta is in the base now */
+    size = strlen(indexnm) + strlen(DOCSTORE_SUFFIX) + strlen(POSITIONS_SUFFIX) + 16;
+    char name[size];
+    for (int i = next - 1; i > 0; i--)
+    {
+        indexset_segname(indexnm, i, name, size);
+        strcat(name, DOCSTORE_SUFFIX);
+        remove(name);
+        indexset_segname(indexnm, i, name, size);
+        strcat(name, POSITIONS_SUFFIX);
+        remove(name);
+        indexset_segname(indexnm, i, name, size);
+        remove(name);
+    }
+    return 0;
+}
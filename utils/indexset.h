@@ -0,0 +1,123 @@
+#pragma once
+/*
+ * indexset.h -- an index made of a base and delta segments
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: an incremental index is the binary index <indexnm>
+ * followed by delta segments <indexnm>.1, <indexnm>.2, ..., each a
+ * binary index of pages whose ids are all beyond those of the segments
+ * before it. The posting list of a word is therefore the concatenation
+ * of its lists in segment order, and stays sorted.
+ *
+ * indexset_merge compacts the segments into a new base. It renames the
+ * base into place before removing the deltas; a delta whose ids do not
+ * go beyond the segments before it is already part of them, and is
+ * skipped when the set is opened, so a merge cut short loses nothing.
+ *
+ * A positional index has the positions file of positions.h beside every
+ * segment; if any segment lacks one, the set has no positions.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "indexio.h"
+
+#define INDEXSET_MAX 64 /* segments of an index */
+
+typedef struct indexset indexset_t; /* representation hidden */
+
+/*
+ * indexset_segname -- writes the file name of segment i of index
+ * indexnm, indexnm itself for 0, to buf of size bytes
+ */
+void indexset_segname(const char *indexnm, int i, char *buf, size_t size);
+
+/*
+ * indexset_open -- memory maps the base index indexnm and its deltas
+ *
+ * returns: non-NULL for success; NULL if the base is not a binary index
+ */
+indexset_t *indexset_open(char *indexnm);
+
+/* indexset_close -- unmaps every segment */
+void indexset_close(indexset_t *set);
+
+/* indexset_count -- the number of segments used, the base included */
+int indexset_count(indexset_t *set);
+
+/* indexset_name -- the file name of the i-th segment used */
+const char *indexset_name(indexset_t *set, int i);
+
+/* indexset_map -- the i-th segment used */
+indexmap_t *indexset_map(indexset_t *set, int i);
+
+/* indexset_nids -- one more than the largest document id indexed */
+int indexset_nids(indexset_t *set);
+
+/* indexset_next -- the number of the next delta to save */
+int indexset_next(indexset_t *set);
+
+/*
+ * indexset_doclens -- sets dl to the document lengths of every segment;
+ * the caller releases them with doclens_clear
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t indexset_doclens(indexset_t *set, doclens_t *dl);
+
+/*
+ * indexset_lookup -- finds word and decodes its posting list, over all
+ * the segments, into pp
+ *
+ * returns: true if the word is in the index; false otherwise
+ */
+bool indexset_lookup(indexset_t *set, const char *word, postings_t *pp);
+
+/*
+ * indexset_cursors -- opens a cursor on the posting list of word in each
+ * segment that has it, into cps of indexset_count elements, and sets
+ * *df to the number of documents with the word
+ *
+ * returns: the number of cursors opened
+ */
+int indexset_cursors(indexset_t *set, const char *word, pcursor_t *cps, int *df);
+
+/* indexset_positional -- whether every segment has its word positions */
+bool indexset_positional(indexset_t *set);
+
+/*
+ * indexset_positions -- finds the positions of word in each document of
+ * docs, a sorted list of documents that have the word: sets pos[j] to
+ * the npos[j] positions of docs->docs[j], allocated from ap
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t indexset_positions(indexset_t *set, const char *word, const postings_t *docs, arena_t *ap, uint32_t **pos,
+                           int *npos);
+
+/*
+ * indexset_expand -- sets *words to the distinct words starting with
+ * prefix in any segment, sorted, allocated with their array from ap
+ *
+ * returns: the number of words, or -1 on failure
+ */
+int indexset_expand(indexset_t *set, const char *prefix, arena_t *ap, char ***words);
+
+/*
+ * indexset_generation -- sets gen to a number identifying the contents
+ * of index indexnm and its deltas, which changes whenever one is added
+ * or rewritten
+ *
+ * returns: 0 for success; nonzero if the base cannot be read
+ */
+int32_t indexset_generation(char *indexnm, uint64_t *gen);
+
+/*
+ * indexset_merge -- compacts index indexnm and its deltas, with their
+ * doc stores and positions, into a new base index
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t indexset_merge(char *indexnm);
@@ -11,27 +11,41 @@
 #include <queue.h>
 #include <hash.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <lhash.h>
 #include <pthread.h>
 
-pthread_mutex_t mutex_h = PTHREAD_MUTEX_INITIALIZER;
+/* each locked hashtable has its own mutex */
+typedef struct lhashtable
+{
+    hashtable_t *htp;
+    pthread_mutex_t mutex;
+} lhashtable_t;
 
 /* lhopen -- opens a hash table with initial size hsize */
-hashtable_t *lhopen(uint32_t lhsize)
+lhash_t *lhopen(uint32_t lhsize)
 {
-    pthread_mutex_lock(&mutex_h);
-    lhash_t *lhtp = (lhash_t *)hopen(lhsize);
-    pthread_mutex_unlock(&mutex_h);
-    return lhtp;
+    lhashtable_t *lhtp = malloc(sizeof(lhashtable_t));
+    if (lhtp == NULL)
+        return NULL;
+    if ((lhtp->htp = hopen(lhsize)) == NULL)
+    {
+        free(lhtp);
+        return NULL;
+    }
+    pthread_mutex_init(&lhtp->mutex, NULL);
+    return (lhash_t *)lhtp;
 }
 
 /* lhclose -- closes a hash table */
 void lhclose(lhash_t *lhtp)
 {
-    pthread_mutex_lock(&mutex_h);
-    hclose((hashtable_t *)lhtp);
-    pthread_mutex_unlock(&mutex_h);
-    pthread_mutex_destroy(&mutex_h); // Destroy the mutex
+    lhashtable_t *lp = (lhashtable_t *)lhtp;
+    if (lp == NULL)
+        return;
+    hclose(lp->htp);
+    pthread_mutex_destroy(&lp->mutex); // Destroy the mutex
+    free(lp);
 }
 
 /* lhput -- puts an entry into a hash table under designated key
@@ -39,18 +53,20 @@ void lhclose(lhash_t *lhtp)
  */
 int32_t lhput(lhash_t *lhtp, void *ep, const char *key, int keylen)
 {
-    pthread_mutex_lock(&mutex_h);
-    int32_t status = hput((hashtable_t *)lhtp, ep, key, keylen);
-    pthread_mutex_unlock(&mutex_h);
+    lhashtable_t *lp = (lhashtable_t *)lhtp;
+    pthread_mutex_lock(&lp->mutex);
+    int32_t status = hput(lp->htp, ep, key, keylen);
+    pthread_mutex_unlock(&lp->mutex);
     return status;
 }
 
 /* lhapply -- applies a function to every entry in hash table */
 void lhapply(lhash_t *lhtp, void (*fn)(void *ep))
 {
-    pthread_mutex_lock(&mutex_h);
-    happly((hashtable_t *)lhtp, fn);
-    pthread_mutex_unlock(&mutex_h);
+    lhashtable_t *lp = (lhashtable_t *)lhtp;
+    pthread_mutex_lock(&lp->mutex);
+    happly(lp->htp, fn);
+    pthread_mutex_unlock(&lp->mutex);
 }
 
 /* lhsearch -- searchs for an entry under a designated key using a
@@ -59,9 +75,10 @@ void lhapply(lhash_t *lhtp, void (*fn)(void *ep))
 void *lhsearch(lhash_t *lhtp, bool (*searchfn)(void *ep, const void *searchkeyp),
                const char *key, int keylen)
 {
-    pthread_mutex_lock(&mutex_h);
-    void *entry = hsearch((hashtable_t *)lhtp, searchfn, key, keylen);
-    pthread_mutex_unlock(&mutex_h);
+    lhashtable_t *lp = (lhashtable_t *)lhtp;
+    pthread_mutex_lock(&lp->mutex);
+    void *entry = hsearch(lp->htp, searchfn, key, keylen);
+    pthread_mutex_unlock(&lp->mutex);
     return entry;
 }
 
@@ -72,8 +89,9 @@ void *lhsearch(lhash_t *lhtp, bool (*searchfn)(void *ep, const void *searchkeyp)
 void *lhremove(lhash_t *lhtp, bool (*searchfn)(void *ep, const void *searchkeyp),
                const char *key, int keylen)
 {
-    pthread_mutex_lock(&mutex_h);
-    void *data = hremove((hashtable_t *)lhtp, searchfn, key, keylen);
-    pthread_mutex_unlock(&mutex_h);
+    lhashtable_t *lp = (lhashtable_t *)lhtp;
+    pthread_mutex_lock(&lp->mutex);
+    void *data = hremove(lp->htp, searchfn, key, keylen);
+    pthread_mutex_unlock(&lp->mutex);
     return data;
 }
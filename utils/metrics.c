@@ -0,0 +1,340 @@
+/*
+ * metrics.c -- counters, latency histograms and log levels
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: a thread takes the next slot the first time it updates
+ * a metric or names itself, and keeps it in thread local storage. The
+ * slots are relaxed atomics, so a dump may read them while they are
+ * updated, and the threads beyond METRICS_THREADS may share the last
+ * one. Metrics are created, and dumps written, under one lock.
+ *
+ * Bucket b of a histogram counts the latencies of less than 2^b
+ * microseconds not counted by bucket b - 1.
+ */
+#define _POSIX_C_SOURCE 200809L // clock_gettime, sigwait, strdup
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include "metrics.h"
+
+#define THREAD_NAME_LEN 32 /* longest name of a thread, with its NUL */
+
+int log_level = LOG_INFO;
+
+/* a thread's share of a histogram */
+typedef struct slot
+{
+    atomic_long count;
+    atomic_long sum_us;
+    atomic_long max_us;
+    atomic_long buckets[METRICS_BUCKETS];
+} slot_t;
+
+struct metric
+{
+    struct metric *next;  /* in the order created */
+    atomic_long *counts;  /* of a counter, one per thread */
+    slot_t *slots;        /* of a histogram, one per thread */
+    char name[];
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; /* guards the fields below */
+static metric_t *first, *last;
+static char thread_names[METRICS_THREADS][THREAD_NAME_LEN];
+static double started; /* when the first metric was created */
+
+static atomic_int nslots;            /* slots taken so far */
+static _Thread_local int slot = -1;  /* the calling thread's */
+
+static pthread_mutex_t export_lock = PTHREAD_MUTEX_INITIALIZER; /* held while a dump is written */
+static char *export_path;
+static sigset_t export_set;
+
+double metrics_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the slot of the calling thread, taking the next one the first time */
+static int my_slot(void)
+{
+    if (slot < 0)
+    {
+        int next = atomic_fetch_add(&nslots, 1);
+        slot = next < METRICS_THREADS ? next : METRICS_THREADS - 1;
+    }
+    return slot;
+}
+
+/* finds the metric name, or creates it; NULL if it is of the other kind */
+static metric_t *find_or_create(const char *name, bool histogram)
+{
+    metric_t *mp;
+
+    if (!name)
+        return NULL;
+    pthread_mutex_lock(&lock);
+    for (mp = first; mp && strcmp(mp->name, name) != 0; mp = mp->next)
+        ;
+    if (mp)
+    {
+        if ((mp->slots != NULL) != histogram)
+            mp = NULL;
+        pthread_mutex_unlock(&lock);
+        return mp;
+    }
+    if ((mp = calloc(1, sizeof(metric_t) + strlen(name) + 1)))
+    {
+        strcpy(mp->name, name);
+        if (histogram)
+            mp->slots = calloc(METRICS_THREADS, sizeof(slot_t));
+        else
+            mp->counts = calloc(METRICS_THREADS, sizeof(atomic_long));
+        if (!mp->slots && !mp->counts)
+        {
+            free(mp);
+            mp = NULL;
+        }
+    }
+    if (mp)
+    {
+        if (last)
+            last->next = mp;
+        else
+            first = mp;
+        last = mp;
+        if (started == 0)
+            started = metrics_now();
+    }
+    pthread_mutex_unlock(&lock);
+    return mp;
+}
+
+metric_t *metrics_counter(const char *name)
+{
+    return find_or_create(name, false);
+}
+
+metric_t *metrics_histogram(const char *name)
+{
+    return find_or_create(name, true);
+}
+
+void metrics_add(metric_t *mp, long n)
+{
+    if (!mp || !mp->counts)
+        return;
+    atomic_fetch_add_explicit(&mp->counts[my_slot()], n, memory_order_relaxed);
+}
+
+void metrics_record(metric_t *mp, double seconds)
+{
+    long us = seconds > 0 ? (long)(seconds * 1e6 + 0.5) : 0, max;
+    int b = 0;
+
+    if (!mp || !mp->slots)
+        return;
+    for (long v = us; v > 0 && b < METRICS_BUCKETS - 1; v >>= 1)
+        b++;
+    slot_t *sp = &mp->slots[my_slot()];
+    atomic_fetch_add_explicit(&sp->buckets[b], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&sp->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&sp->sum_us, us, memory_order_relaxed);
+    max = atomic_load_explicit(&sp->max_us, memory_order_relaxed);
+    while (us > max && !atomic_compare_exchange_weak_explicit(&sp->max_us, &max, us, memory_order_relaxed,
+                                                              memory_order_relaxed))
+        ;
+}
+
+void metrics_thread(const char *name)
+{
+    int s = my_slot();
+
+    pthread_mutex_lock(&lock);
+    if (name)
+        snprintf(thread_names[s], THREAD_NAME_LEN, "%s", name);
+    pthread_mutex_unlock(&lock);
+}
+
+/* writes s as a JSON string; names are plain, but quotes are escaped */
+static void put_string(FILE *out, const char *s)
+{
+    fputc('"', out);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', out);
+        if ((unsigned char)*s >= ' ')
+            fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+/* the upper bound in ms of the bucket holding fraction p of a histogram */
+static double percentile(const long *buckets, long count, long max_us, double p)
+{
+    long rank = (long)(p * count + 0.5), seen = 0;
+    int b;
+
+    if (rank < 1)
+        rank = 1;
+    for (b = 0; b < METRICS_BUCKETS - 1; b++)
+    {
+        if ((seen += buckets[b]) >= rank)
+            break;
+    }
+    long bound = b < METRICS_BUCKETS - 1 ? 1L << b : max_us;
+    return (bound < max_us ? bound : max_us) / 1e3;
+}
+
+static void dump_histogram(FILE *out, const metric_t *mp, int n)
+{
+    long buckets[METRICS_BUCKETS] = {0}, count = 0, sum = 0, max = 0;
+
+    for (int t = 0; t < n; t++)
+    {
+        const slot_t *sp = &mp->slots[t];
+        long m = atomic_load_explicit(&sp->max_us, memory_order_relaxed);
+        for (int b = 0; b < METRICS_BUCKETS; b++)
+            buckets[b] += atomic_load_explicit(&sp->buckets[b], memory_order_relaxed);
+        count += atomic_load_explicit(&sp->count, memory_order_relaxed);
+        sum += atomic_load_explicit(&sp->sum_us, memory_order_relaxed);
+        max = m > max ? m : max;
+    }
+    fprintf(out, "{\"count\": %ld, \"mean_ms\": %.3f, \"p50_ms\": %.3f, \"p90_ms\": %.3f, "
+                 "\"p99_ms\": %.3f, \"max_ms\": %.3f, \"threads\": [",
+            count, count ? sum / 1e3 / count : 0, percentile(buckets, count, max, 0.5),
+            percentile(buckets, count, max, 0.9), percentile(buckets, count, max, 0.99), max / 1e3);
+    for (int t = 0; t < n; t++)
+        fprintf(out, "%s%ld", t ? ", " : "", atomic_load_explicit(&mp->slots[t].count, memory_order_relaxed));
+    fputs("]}", out);
+}
+
+static void dump_counter(FILE *out, const metric_t *mp, int n, double uptime)
+{
+    long total = 0;
+
+    for (int t = 0; t < n; t++)
+        total += atomic_load_explicit(&mp->counts[t], memory_order_relaxed);
+    fprintf(out, "{\"total\": %ld, \"per_s\": %.1f, \"threads\": [", total, uptime > 0 ? total / uptime : 0);
+    for (int t = 0; t < n; t++)
+        fprintf(out, "%s%ld", t ? ", " : "", atomic_load_explicit(&mp->counts[t], memory_order_relaxed));
+    fputs("]}", out);
+}
+
+int32_t metrics_dump(FILE *out)
+{
+    int n = atomic_load(&nslots);
+    bool any;
+
+    if (!out)
+        return 1;
+    if (n > METRICS_THREADS)
+        n = METRICS_THREADS;
+    pthread_mutex_lock(&lock);
+    double uptime = started ? metrics_now() - started : 0;
+    fprintf(out, "{\n  \"uptime_s\": %.3f,\n  \"threads\": [", uptime);
+    for (int t = 0; t < n; t++)
+    {
+        char unnamed[THREAD_NAME_LEN];
+        snprintf(unnamed, sizeof(unnamed), "thread %d", t);
+        fputs(t ? ", " : "", out);
+        put_string(out, thread_names[t][0] ? thread_names[t] : unnamed);
+    }
+    fputs("],\n  \"counters\": {", out);
+    any = false;
+    for (metric_t *mp = first; mp; mp = mp->next)
+    {
+        if (!mp->counts)
+            continue;
+        fputs(any ? ",\n    " : "\n    ", out);
+        put_string(out, mp->name);
+        fputs(": ", out);
+        dump_counter(out, mp, n, uptime);
+        any = true;
+    }
+    fputs(any ? "\n  },\n  \"histograms\": {" : "},\n  \"histograms\": {", out);
+    any = false;
+    for (metric_t *mp = first; mp; mp = mp->next)
+    {
+        if (!mp->slots)
+            continue;
+        fputs(any ? ",\n    " : "\n    ", out);
+        put_string(out, mp->name);
+        fputs(": ", out);
+        dump_histogram(out, mp, n);
+        any = true;
+    }
+    fputs(any ? "\n  }\n}\n" : "}\n}\n", out);
+    pthread_mutex_unlock(&lock);
+    return fflush(out) != 0 || ferror(out);
+}
+
+/* dumps the metrics to the export file, through a temporary one */
+static int32_t write_export(void)
+{
+    int32_t status = 1;
+
+    pthread_mutex_lock(&export_lock);
+    char tmp[strlen(export_path) + 5];
+    sprintf(tmp, "%s.tmp", export_path);
+    FILE *file = fopen(tmp, "w");
+    if (file)
+    {
+        status = metrics_dump(file);
+        status = fclose(file) != 0 || status || rename(tmp, export_path) != 0;
+        if (status)
+            remove(tmp);
+    }
+    pthread_mutex_unlock(&export_lock);
+    return status;
+}
+
+static void export_at_exit(void)
+{
+    write_export();
+}
+
+/* waits for the export signal, dumping the metrics each time */
+static void *export_on_signal(void *arg)
+{
+    int sig;
+
+    (void)arg;
+    while (sigwait(&export_set, &sig) == 0)
+        write_export();
+    return NULL;
+}
+
+int32_t metrics_export(const char *path, int sig)
+{
+    pthread_t thread;
+
+    if (!path || export_path || !(export_path = strdup(path)))
+        return 1;
+    pthread_mutex_lock(&lock);
+    if (started == 0)
+        started = metrics_now();
+    pthread_mutex_unlock(&lock);
+    if (atexit(export_at_exit) != 0)
+        return 1;
+    if (sig == 0)
+        return 0;
+    sigemptyset(&export_set);
+    sigaddset(&export_set, sig);
+    if (pthread_sigmask(SIG_BLOCK, &export_set, NULL) != 0 ||
+        pthread_create(&thread, NULL, export_on_signal, NULL) != 0)
+        return 1;
+    pthread_detach(thread);
+    return 0;
+}
@@ -0,0 +1,85 @@
+#pragma once
+/*
+ * metrics.h -- counters, latency histograms and log levels
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: named counters and latency histograms that any thread
+ * may update without taking a lock. Every thread updates its own slot
+ * of a metric, and a dump adds the slots up, so the totals and the
+ * share of each thread are both reported. Metrics are found or created
+ * by name, and live until the program exits.
+ *
+ * A histogram counts latencies in buckets of powers of two of a
+ * microsecond, so its percentiles are upper bounds, within a factor of
+ * two of the true value.
+ *
+ * The metrics are dumped as JSON:
+ *   {"uptime_s": ..., "threads": [<name>, ...],
+ *    "counters": {<name>: {"total": ..., "per_s": ..., "threads": [...]}},
+ *    "histograms": {<name>: {"count": ..., "mean_ms": ..., "p50_ms": ...,
+ *                            "p90_ms": ..., "p99_ms": ..., "max_ms": ...,
+ *                            "threads": [...]}}}
+ * where "threads" holds the count of each thread, in the order of the
+ * top level list.
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+#define METRICS_THREADS 64 /* threads counted apart; later ones share the last slot */
+#define METRICS_BUCKETS 40 /* of a histogram, the last one open ended */
+
+/* levels of the progress messages of log_print */
+#define LOG_INFO 1  /* summaries; the default */
+#define LOG_DEBUG 2 /* a line per page or url */
+
+typedef struct metric metric_t; /* representation of a metric hidden */
+
+/* the highest level of message printed, LOG_INFO by default */
+extern int log_level;
+
+/* log_print -- printf, if level is at most log_level */
+#define log_print(level, ...)          \
+    do                                 \
+    {                                  \
+        if ((level) <= log_level)      \
+            printf(__VA_ARGS__);       \
+    } while (0)
+
+/* metrics_counter -- finds or creates the counter name
+ * returns: the counter, or NULL if out of memory
+ */
+metric_t *metrics_counter(const char *name);
+
+/* metrics_histogram -- finds or creates the latency histogram name
+ * returns: the histogram, or NULL if out of memory
+ */
+metric_t *metrics_histogram(const char *name);
+
+/* metrics_add -- adds n to a counter; a NULL metric is ignored */
+void metrics_add(metric_t *mp, long n);
+
+/* metrics_record -- counts a latency of a histogram, in seconds; a
+ * NULL metric is ignored
+ */
+void metrics_record(metric_t *mp, double seconds);
+
+/* metrics_now -- the time on the monotonic clock, in seconds */
+double metrics_now(void);
+
+/* metrics_thread -- names the calling thread in dumps */
+void metrics_thread(const char *name);
+
+/* metrics_dump -- writes every metric to out as JSON
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t metrics_dump(FILE *out);
+
+/* metrics_export -- dumps the metrics to the file path when the
+ * program exits and, unless sig is 0, whenever signal sig arrives. The
+ * file is replaced in one rename, so it is always complete. Call before
+ * starting any thread, which must leave sig blocked.
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t metrics_export(const char *path, int sig);
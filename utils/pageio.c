@@ -8,11 +8,216 @@
  * numbered name (e.g. 1,2,3 etc); pageload creates a new page by
  * loading a numbered file. For pagesave, the directory must exist and
  * be writable; for loadpage it must be readable.
+ *
+ * A page is saved with a single writev of its header and html, and
+ * loaded with a single read of the whole file, whose header is parsed
+ * in place; the html is then moved to the front of the same buffer.
+ *
+ * With pageio_sync the saved pages are kept open until a batch of them
+ * is complete, then synced together with their directory.
+ *
+ * A segment file (host byte order) is laid out as:
+ *   <records>    a seg_record_t, the url and the html of each page
+ *   <entries>    one seg_entry_t per record, the footer
+ *   <trailer>    offset and number of the entries, version and magic
+ *
+ * A segment without a valid trailer was not closed; its records are
+ * found by walking their length prefixes.
  */
+#define _POSIX_C_SOURCE 200809L // strdup, strndup
 
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include "pageio.h"
 #include "webpage.h"
 
+#define MAX_SYNC_BATCH 256 /* pages kept open waiting for a sync */
+
+#define SEG_MAGIC "TSESEG1"
+#define SEG_MAGIC_LEN 8
+#define SEG_VERSION 1
+#define SEG_RECORD_MAGIC 0x45474150u /* "PAGE" */
+#define SEG_NAME "pages-%06d.seg"
+#define SEG_MAX_ID (1 << 28) /* largest page id of a record; a larger one is corrupt */
+
+/* segment record header, followed by url_len bytes of url and the html */
+typedef struct seg_record
+{
+    uint32_t magic;
+    uint32_t size; /* bytes of url and html */
+    int32_t id;
+    int32_t depth;
+    uint32_t url_len;
+} seg_record_t;
+
+/* segment footer entry */
+typedef struct seg_entry
+{
+    int32_t id;
+    uint32_t unused;
+    uint64_t offset; /* of the record */
+} seg_entry_t;
+
+/* segment trailer, the last bytes of a closed segment */
+typedef struct seg_trailer
+{
+    uint64_t entries_off;
+    uint32_t count;
+    uint32_t version;
+    char magic[SEG_MAGIC_LEN];
+} seg_trailer_t;
+
+struct segwriter
+{
+    pthread_mutex_t lock;
+    char *dirnm;
+    long segment_size;
+    int next;             /* number of the next segment */
+    int fd;               /* the open segment, or -1 */
+    uint64_t size;        /* bytes written to it */
+    seg_entry_t *entries; /* its footer */
+    int nentries, capacity;
+    int unsynced; /* records written since the last sync */
+};
+
+/* where a page is in a packed store */
+typedef struct page_slot
+{
+    int32_t seg; /* -1 if there is no such page */
+    uint64_t offset;
+} page_slot_t;
+
+/* a mapped segment */
+typedef struct segment
+{
+    char *base;
+    size_t size;
+} segment_t;
+
+struct pagestore
+{
+    char *dirnm;
+    int *ids;
+    int count;
+    segment_t *segs; /* NULL for one file per page */
+    int nsegs;
+    page_slot_t *slots; /* indexed by page id */
+    int nslots;
+};
+
+/* the pages saved since the last sync */
+static struct
+{
+    pthread_mutex_t lock;
+    int every;       /* pages per sync, or 0 never to sync */
+    int nfds;
+    int fds[MAX_SYNC_BATCH];
+    char *dirnm;     /* the directory of the pages */
+} batch = {PTHREAD_MUTEX_INITIALIZER, 0, 0, {0}, NULL};
+
+/* writes all of the n buffers of iov to fd, resuming partial writes */
+static int32_t write_all(int fd, struct iovec *iov, int n)
+{
+    while (n > 0)
+    {
+        ssize_t done = writev(fd, iov, n);
+        if (done < 0)
+            return 1;
+        while (n > 0 && (size_t)done >= iov->iov_len)
+        {
+            done -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+    return 0;
+}
+
+/* syncs and closes the pages of the batch, then their directory; the
+ * caller holds the batch lock
+ */
+static int32_t sync_batch(void)
+{
+    int32_t status = 0;
+    for (int i = 0; i < batch.nfds; i++)
+    {
+        if (fsync(batch.fds[i]) != 0)
+            status = 1;
+        close(batch.fds[i]);
+    }
+    batch.nfds = 0;
+    if (batch.dirnm)
+    {
+        int dirfd = open(batch.dirnm, O_RDONLY);
+        if (dirfd < 0 || fsync(dirfd) != 0)
+            status = 1;
+        if (dirfd >= 0)
+            close(dirfd);
+        free(batch.dirnm);
+        batch.dirnm = NULL;
+    }
+    return status;
+}
+
+/* closes the file fd of a page saved in dirnm, syncing it as the policy
+ * says
+ */
+static int32_t finish_page(int fd, char *dirnm)
+{
+    int32_t status = 0;
+    pthread_mutex_lock(&batch.lock);
+    if (batch.every == 0)
+    {
+        pthread_mutex_unlock(&batch.lock);
+        return close(fd) != 0;
+    }
+    if (batch.dirnm && strcmp(batch.dirnm, dirnm) != 0)
+        status |= sync_batch();
+    if (!batch.dirnm && !(batch.dirnm = strdup(dirnm)))
+        status = 1;
+    batch.fds[batch.nfds++] = fd;
+    if (batch.nfds >= batch.every)
+        status |= sync_batch();
+    pthread_mutex_unlock(&batch.lock);
+    return status;
+}
+
+/* the number of pages per sync */
+static int sync_every(void)
+{
+    pthread_mutex_lock(&batch.lock);
+    int every = batch.every;
+    pthread_mutex_unlock(&batch.lock);
+    return every;
+}
+
+void pageio_sync(int every)
+{
+    pthread_mutex_lock(&batch.lock);
+    sync_batch();
+    batch.every = every < 0 ? 0 : every > MAX_SYNC_BATCH ? MAX_SYNC_BATCH : every;
+    pthread_mutex_unlock(&batch.lock);
+}
+
+int32_t pageio_flush(void)
+{
+    pthread_mutex_lock(&batch.lock);
+    int32_t status = sync_batch();
+    pthread_mutex_unlock(&batch.lock);
+    return status;
+}
+
 /*
  * pagesave -- save the page in filename id in directory dirnm
  *
@@ -38,20 +243,54 @@ int32_t pagesave(webpage_t *pagep, int id, char *dirnm)
 
     /* generate path */
     char path[1024];
-    sprintf(path, "%s/%d", dirnm, id);
+    snprintf(path, sizeof(path), "%s/%d", dirnm, id);
 
     /* open file */
-    FILE *file = fopen(path, "w");
-    if (file == NULL || access(path, W_OK) != 0)
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0)
     {
         printf("Failed to create file for url: %s\n", url);
         return 1;
     }
 
-    /* write into the file */
-    fprintf(file, "%s\n%d\n%d\n%s", url, depth, len, html_content);
+    /* write the header and html at once */
+    char numbers[32];
+    struct iovec iov[3];
+    iov[0].iov_base = url;
+    iov[0].iov_len = strlen(url);
+    iov[1].iov_base = numbers;
+    iov[1].iov_len = snprintf(numbers, sizeof(numbers), "\n%d\n%d\n", depth, len);
+    iov[2].iov_base = html_content;
+    iov[2].iov_len = html_content ? strlen(html_content) : 0;
+    if (write_all(fd, iov, 3) != 0)
+    {
+        printf("Failed to write file for url: %s\n", url);
+        close(fd);
+        return 1;
+    }
 
-    fclose(file);
+    return finish_page(fd, dirnm);
+}
+
+/* skips whitespace, like the "\n" of a scanf format */
+static char *skip_space(char *p)
+{
+    while (isspace((unsigned char)*p))
+        p++;
+    return p;
+}
+
+/* parses the integer at *pp, then skips the whitespace after it
+ * returns: 0 for success; nonzero if there is none
+ */
+static int32_t parse_int(char **pp, int *value)
+{
+    char *end;
+    long n = strtol(*pp, &end, 10);
+    if (end == *pp)
+        return 1;
+    *value = (int)n;
+    *pp = skip_space(end);
     return 0;
 }
 
@@ -67,58 +306,542 @@ webpage_t *pageload(int id, char *dirnm)
         return NULL;
 
     char path[1024];
-    sprintf(path, "%s/%d", dirnm, id);
+    snprintf(path, sizeof(path), "%s/%d", dirnm, id);
 
-    FILE *file = fopen(path, "r");
-    if (file == NULL || access(path, R_OK) != 0)
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
     {
         return NULL;
     }
 
-    /* scan url */
-    char url[1024];
-    if (fscanf(file, "%s\n", url) != 1)
+    /* read the whole file */
+    struct stat st;
+    char *buf = NULL;
+    size_t size = 0;
+    if (fstat(fd, &st) == 0 && (buf = malloc(st.st_size + 1)))
+    {
+        ssize_t got;
+        while (size < (size_t)st.st_size && (got = read(fd, buf + size, st.st_size - size)) > 0)
+        {
+            size += got;
+        }
+    }
+    close(fd);
+    if (!buf)
+    {
+        return NULL;
+    }
+    buf[size] = '\0';
+
+    /* parse url */
+    char *url = skip_space(buf), *p = url;
+    while (*p && !isspace((unsigned char)*p))
+    {
+        p++;
+    }
+    if (p == url)
     {
         printf("Failed to read URL from file id: %d\n", id);
-        fclose(file);
+        free(buf);
         return NULL;
     }
+    if (*p)
+    {
+        *p++ = '\0';
+        p = skip_space(p);
+    }
 
-    /* scan depth and html_length */
+    /* parse depth and html_length */
     int depth, html_length;
-    if (fscanf(file, "%d\n", &depth) != 1)
+    if (parse_int(&p, &depth) != 0)
     {
         printf("Failed to read depth from file id: %d\n", id);
-        fclose(file);
+        free(buf);
         return NULL;
     }
 
-    if (fscanf(file, "%d\n", &html_length) != 1)
+    if (parse_int(&p, &html_length) != 0)
     {
         printf("Failed to read character count from file id: %d\n", id);
-        fclose(file);
+        free(buf);
         return NULL;
     }
 
-    /* scan the html */
-    char *html = malloc((html_length + 1) * sizeof(char));
-    int idx = 0;
-    char c;
-    while ((c = fgetc(file)) != EOF && idx < html_length)
+    /* create webpage, copying the url before the html moves over it */
+    webpage_t *page = webpage_new(url, depth, NULL);
+    if (!page)
     {
-        html[idx++] = c;
+        printf("Failed to initialize webpage\n");
+        free(buf);
+        return NULL;
     }
+    size_t html_size = buf + size - p;
+    if (html_length < 0)
+        html_size = 0;
+    else if ((size_t)html_length < html_size)
+        html_size = html_length;
+    memmove(buf, p, html_size);
+    buf[html_size] = '\0';
+    webpage_setHTML(page, buf);
 
-    html[idx] = '\0';
-    fclose(file);
+    return page;
+}
 
-    /* create webpage */
-    webpage_t *page = webpage_new(url, depth, html);
-    if (!page)
+/* fsyncs directory dirnm, so the files created in it are durable */
+static int32_t sync_dir(char *dirnm)
+{
+    int dirfd = open(dirnm, O_RDONLY);
+    int32_t status = dirfd < 0 || fsync(dirfd) != 0;
+    if (dirfd >= 0)
+        close(dirfd);
+    return status;
+}
+
+/* the number of segment file name, or -1 if it names no segment */
+static int segment_number(const char *name)
+{
+    int n;
+    char extra;
+    if (sscanf(name, "pages-%d.seg%c", &n, &extra) != 1 || n < 0)
+        return -1;
+    return n;
+}
+
+segwriter_t *segwriter_open(char *dirnm, long segment_size)
+{
+    if (!dirnm || segment_size < 0)
+        return NULL;
+    DIR *dir = opendir(dirnm);
+    if (!dir)
+        return NULL;
+
+    segwriter_t *sw = calloc(1, sizeof(segwriter_t));
+    if (!sw || !(sw->dirnm = strdup(dirnm)) || pthread_mutex_init(&sw->lock, NULL) != 0)
     {
-        printf("Failed to initialize webpage\n");
+        if (sw)
+            free(sw->dirnm);
+        free(sw);
+        closedir(dir);
         return NULL;
     }
+    sw->segment_size = segment_size ? segment_size : SEGMENT_SIZE;
+    sw->fd = -1;
+
+    /* never append to an existing segment */
+    struct dirent *entry;
+    int n;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if ((n = segment_number(entry->d_name)) >= sw->next)
+            sw->next = n + 1;
+    }
+    closedir(dir);
+    return sw;
+}
+
+/* writes the footer of the open segment and closes it */
+static int32_t finish_segment(segwriter_t *sw)
+{
+    if (sw->fd < 0)
+        return 0;
+    seg_trailer_t trailer;
+    memset(&trailer, 0, sizeof(trailer));
+    trailer.entries_off = sw->size;
+    trailer.count = sw->nentries;
+    trailer.version = SEG_VERSION;
+    memcpy(trailer.magic, SEG_MAGIC, SEG_MAGIC_LEN);
 
+    struct iovec iov[2];
+    iov[0].iov_base = sw->entries;
+    iov[0].iov_len = sw->nentries * sizeof(seg_entry_t);
+    iov[1].iov_base = &trailer;
+    iov[1].iov_len = sizeof(trailer);
+    int32_t status = write_all(sw->fd, iov, 2);
+    if (sync_every() > 0 && fsync(sw->fd) != 0)
+        status = 1;
+    if (close(sw->fd) != 0)
+        status = 1;
+    sw->fd = -1;
+    sw->nentries = 0;
+    sw->unsynced = 0;
+    return status;
+}
+
+/* creates the next segment */
+static int32_t start_segment(segwriter_t *sw)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/" SEG_NAME, sw->dirnm, sw->next++);
+    if ((sw->fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0666)) < 0)
+    {
+        printf("Failed to create segment: %s\n", path);
+        return 1;
+    }
+    sw->size = 0;
+    if (sync_every() > 0)
+        return sync_dir(sw->dirnm);
+    return 0;
+}
+
+/* appends the record of page id, made of the three buffers of iov, to
+ * the open segment; the caller holds the writer lock
+ */
+static int32_t append_record(segwriter_t *sw, struct iovec *iov, int id)
+{
+    size_t size = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len;
+    if (sw->nentries == sw->capacity)
+    {
+        int capacity = sw->capacity ? 2 * sw->capacity : 64;
+        seg_entry_t *entries = realloc(sw->entries, capacity * sizeof(seg_entry_t));
+        if (!entries)
+            return 1;
+        sw->entries = entries;
+        sw->capacity = capacity;
+    }
+    if ((sw->fd < 0 && start_segment(sw) != 0) || write_all(sw->fd, iov, 3) != 0)
+        return 1;
+    sw->entries[sw->nentries++] = (seg_entry_t){id, 0, sw->size};
+    sw->size += size;
+
+    int32_t status = 0;
+    int every = sync_every();
+    if (every > 0 && ++sw->unsynced >= every)
+    {
+        status = fsync(sw->fd) != 0;
+        sw->unsynced = 0;
+    }
+    if (sw->size >= (uint64_t)sw->segment_size)
+        status |= finish_segment(sw);
+    return status;
+}
+
+int32_t segwriter_add(segwriter_t *sw, webpage_t *pagep, int id)
+{
+    if (!sw || !pagep || id < 0 || id > SEG_MAX_ID)
+        return 1;
+
+    char *url = webpage_getURL(pagep), *html = webpage_getHTML(pagep);
+    seg_record_t record;
+    record.magic = SEG_RECORD_MAGIC;
+    record.id = id;
+    record.depth = webpage_getDepth(pagep);
+    record.url_len = strlen(url);
+    size_t html_len = html ? strlen(html) : 0;
+    if (record.url_len + html_len >= UINT32_MAX)
+        return 1;
+    record.size = record.url_len + html_len;
+
+    struct iovec iov[3];
+    iov[0].iov_base = &record;
+    iov[0].iov_len = sizeof(record);
+    iov[1].iov_base = url;
+    iov[1].iov_len = record.url_len;
+    iov[2].iov_base = html;
+    iov[2].iov_len = html_len;
+
+    pthread_mutex_lock(&sw->lock);
+    int32_t status = append_record(sw, iov, id);
+    pthread_mutex_unlock(&sw->lock);
+    return status;
+}
+
+int32_t segwriter_flush(segwriter_t *sw)
+{
+    if (!sw)
+        return 1;
+    pthread_mutex_lock(&sw->lock);
+    int32_t status = sw->fd >= 0 && fsync(sw->fd) != 0;
+    if (status == 0)
+        sw->unsynced = 0;
+    pthread_mutex_unlock(&sw->lock);
+    return status;
+}
+
+int32_t segwriter_close(segwriter_t *sw)
+{
+    if (!sw)
+        return 1;
+    int32_t status = finish_segment(sw);
+    pthread_mutex_destroy(&sw->lock);
+    free(sw->entries);
+    free(sw->dirnm);
+    free(sw);
+    return status;
+}
+
+static int compare_ids(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* appends value to the array *ap of *np elements, doubling it as needed */
+static int32_t append_int(int **ap, int *np, int *capacity, int value)
+{
+    if (*np == *capacity)
+    {
+        int size = *capacity ? 2 * *capacity : 64;
+        int *a = realloc(*ap, size * sizeof(int));
+        if (!a)
+            return 1;
+        *ap = a;
+        *capacity = size;
+    }
+    (*ap)[(*np)++] = value;
+    return 0;
+}
+
+/* true if a complete record starts at offset off of segment sp */
+static bool valid_record(const segment_t *sp, uint64_t off, seg_record_t *rp)
+{
+    if (off + sizeof(seg_record_t) > sp->size)
+        return false;
+    memcpy(rp, sp->base + off, sizeof(seg_record_t));
+    return rp->magic == SEG_RECORD_MAGIC && rp->id >= 0 && rp->id <= SEG_MAX_ID && rp->url_len <= rp->size &&
+           off + sizeof(seg_record_t) + rp->size <= sp->size;
+}
+
+/* points the slot of page id at offset off of segment seg, doubling the
+ * slots as needed
+ */
+static int32_t place_page(pagestore_t *ps, int id, int seg, uint64_t off)
+{
+    if (id < 0 || id > SEG_MAX_ID)
+        return 1;
+    if (id >= ps->nslots)
+    {
+        size_t n = ps->nslots ? (size_t)ps->nslots : 64;
+        while (n <= (size_t)id)
+            n *= 2;
+        if (n > SIZE_MAX / sizeof(page_slot_t))
+            return 1;
+        page_slot_t *slots = realloc(ps->slots, n * sizeof(page_slot_t));
+        if (!slots)
+            return 1;
+        for (size_t i = ps->nslots; i < n; i++)
+            slots[i].seg = -1;
+        ps->slots = slots;
+        ps->nslots = (int)n;
+    }
+    ps->slots[id].seg = seg;
+    ps->slots[id].offset = off;
+    return 0;
+}
+
+/* finds the pages of segment seg, from its footer if it was closed;
+ * pages of later segments replace those of earlier ones
+ */
+static int32_t index_segment(pagestore_t *ps, int seg)
+{
+    const segment_t *sp = &ps->segs[seg];
+    seg_trailer_t trailer;
+    seg_record_t record;
+
+    if (sp->size >= sizeof(trailer))
+    {
+        memcpy(&trailer, sp->base + sp->size - sizeof(trailer), sizeof(trailer));
+        if (memcmp(trailer.magic, SEG_MAGIC, SEG_MAGIC_LEN) == 0 && trailer.version == SEG_VERSION &&
+            trailer.entries_off + (uint64_t)trailer.count * sizeof(seg_entry_t) + sizeof(trailer) == sp->size)
+        {
+            for (uint32_t i = 0; i < trailer.count; i++)
+            {
+                seg_entry_t entry;
+                memcpy(&entry, sp->base + trailer.entries_off + i * sizeof(entry), sizeof(entry));
+                if (!valid_record(sp, entry.offset, &record) || record.id != entry.id)
+                    return 1;
+                if (place_page(ps, entry.id, seg, entry.offset) != 0)
+                    return 1;
+            }
+            return 0;
+        }
+    }
+
+    /* not closed: walk the records */
+    uint64_t off = 0;
+    while (valid_record(sp, off, &record))
+    {
+        if (place_page(ps, record.id, seg, off) != 0)
+            return 1;
+        off += sizeof(record) + record.size;
+    }
+    return 0;
+}
+
+/* maps the segments numbered nums of the store's directory */
+static int32_t open_segments(pagestore_t *ps, int *nums, int n)
+{
+    qsort(nums, n, sizeof(int), compare_ids);
+    if (!(ps->segs = calloc(n, sizeof(segment_t))))
+        return 1;
+    for (int i = 0; i < n; i++)
+    {
+        char path[1024];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/" SEG_NAME, ps->dirnm, nums[i]);
+        int fd = open(path, O_RDONLY);
+        if (fd < 0 || fstat(fd, &st) != 0)
+        {
+            if (fd >= 0)
+                close(fd);
+            return 1;
+        }
+        segment_t *sp = &ps->segs[ps->nsegs++];
+        sp->size = st.st_size;
+        sp->base = NULL;
+        if (sp->size > 0 && (sp->base = mmap(NULL, sp->size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+        {
+            sp->base = NULL;
+            sp->size = 0;
+            close(fd);
+            return 1;
+        }
+        close(fd);
+        if (index_segment(ps, i) != 0)
+        {
+            printf("Corrupt segment: %s\n", path);
+            return 1;
+        }
+    }
+
+    /* the ids in order */
+    int capacity = 0;
+    for (int id = 0; id < ps->nslots; id++)
+    {
+        if (ps->slots[id].seg >= 0 && append_int(&ps->ids, &ps->count, &capacity, id) != 0)
+            return 1;
+    }
+    return 0;
+}
+
+pagestore_t *pagestore_open(char *dirnm)
+{
+    if (!dirnm)
+        return NULL;
+    DIR *dir = opendir(dirnm);
+    if (!dir)
+        return NULL;
+    pagestore_t *ps = calloc(1, sizeof(pagestore_t));
+    if (!ps || !(ps->dirnm = strdup(dirnm)))
+    {
+        free(ps);
+        closedir(dir);
+        return NULL;
+    }
+
+    /* numbered page files, or segments */
+    struct dirent *entry;
+    int *nums = NULL, nnums = 0, nums_capacity = 0, ids_capacity = 0, n;
+    int32_t status = 0;
+    while (status == 0 && (entry = readdir(dir)) != NULL)
+    {
+        if ((n = segment_number(entry->d_name)) >= 0)
+            status = append_int(&nums, &nnums, &nums_capacity, n);
+        else if (entry->d_name[0] != '.')
+            status = append_int(&ps->ids, &ps->count, &ids_capacity, atoi(entry->d_name));
+    }
+    closedir(dir);
+
+    if (status == 0 && nnums > 0)
+    {
+        free(ps->ids);
+        ps->ids = NULL;
+        ps->count = 0;
+        status = open_segments(ps, nums, nnums);
+    }
+    else if (status == 0)
+    {
+        qsort(ps->ids, ps->count, sizeof(int), compare_ids);
+    }
+    free(nums);
+    if (status != 0)
+    {
+        pagestore_close(ps);
+        return NULL;
+    }
+    return ps;
+}
+
+void pagestore_close(pagestore_t *ps)
+{
+    if (!ps)
+        return;
+    for (int i = 0; i < ps->nsegs; i++)
+    {
+        if (ps->segs[i].base)
+            munmap(ps->segs[i].base, ps->segs[i].size);
+    }
+    free(ps->segs);
+    free(ps->slots);
+    free(ps->ids);
+    free(ps->dirnm);
+    free(ps);
+}
+
+const int *pagestore_ids(pagestore_t *ps, int *count)
+{
+    if (!ps || !count)
+        return NULL;
+    *count = ps->count;
+    return ps->ids;
+}
+
+webpage_t *pagestore_load(pagestore_t *ps, int id)
+{
+    if (!ps)
+        return NULL;
+    if (!ps->segs)
+        return pageload(id, ps->dirnm);
+    if (id < 0 || id >= ps->nslots || ps->slots[id].seg < 0)
+        return NULL;
+
+    const segment_t *sp = &ps->segs[ps->slots[id].seg];
+    seg_record_t record;
+    uint64_t off = ps->slots[id].offset;
+    if (!valid_record(sp, off, &record))
+        return NULL;
+    const char *data = sp->base + off + sizeof(record);
+    size_t html_len = record.size - record.url_len;
+    char *url = strndup(data, record.url_len), *html = malloc(html_len + 1);
+    if (!url || !html)
+    {
+        free(url);
+        free(html);
+        return NULL;
+    }
+    memcpy(html, data + record.url_len, html_len);
+    html[html_len] = '\0';
+    webpage_t *page = webpage_new(url, record.depth, html);
+    free(url);
+    if (!page)
+        free(html);
     return page;
 }
+
+void pagestore_prefetch(pagestore_t *ps, int id)
+{
+    if (!ps)
+        return;
+    if (!ps->segs)
+    {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%d", ps->dirnm, id);
+        int fd = open(path, O_RDONLY);
+        if (fd >= 0)
+        {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+            close(fd);
+        }
+        return;
+    }
+    if (id < 0 || id >= ps->nslots || ps->slots[id].seg < 0)
+        return;
+
+    /* advice applies to whole pages of the mapping */
+    const segment_t *sp = &ps->segs[ps->slots[id].seg];
+    seg_record_t record;
+    uint64_t off = ps->slots[id].offset;
+    if (!valid_record(sp, off, &record))
+        return;
+    uint64_t start = off & ~(uint64_t)(sysconf(_SC_PAGESIZE) - 1);
+    posix_madvise(sp->base + start, off + sizeof(record) + record.size - start, POSIX_MADV_WILLNEED);
+}
@@ -10,6 +10,9 @@
  * numbered name (e.g. 1,2,3 etc); pageload creates a new page by
  * loading a numbered file. For pagesave, the directory must exist and
  * be writable; for loadpage it must be readable.
+ *
+ * Saved pages are left to the system to write out unless pageio_sync
+ * asks for them to be synced in batches.
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -38,3 +41,100 @@ int32_t pagesave(webpage_t *pagep, int id, char *dirnm);
  * returns: non-NULL for success; NULL otherwise
  */
 webpage_t *pageload(int id, char *dirnm);
+
+/*
+ * pageio_sync -- syncs every page saved from now on when every is 1,
+ * or batches of every pages at once, with their directory, when it is
+ * larger (at most 256); 0, the default, never syncs. A batch holds the
+ * pages of one directory; saving to another syncs it early.
+ */
+void pageio_sync(int every);
+
+/*
+ * pageio_flush -- syncs the pages saved since the last batch
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t pageio_flush(void);
+
+/**************** packed segments ****************/
+
+/*
+ * Instead of one file per page, a page directory may hold segment files,
+ * pages-<n>.seg, written by a segwriter_t. Each appends length-prefixed
+ * page records and ends with a footer mapping its page ids to their
+ * offsets. A segment is never changed once closed, and one cut short
+ * by a crash is read up to its last complete record.
+ *
+ * A pagestore_t reads either layout: it lists the page ids of the
+ * directory and loads a page by id, from a memory mapped segment in
+ * constant time.
+ */
+#define SEGMENT_SIZE (64L << 20) /* default size at which a segment is closed */
+
+typedef struct segwriter segwriter_t; /* representation hidden */
+typedef struct pagestore pagestore_t; /* representation hidden */
+
+/*
+ * segwriter_open -- appends pages to new segments in directory dirnm,
+ * after those already there, starting a new segment once one reaches
+ * segment_size bytes, or SEGMENT_SIZE if it is 0
+ *
+ * returns: non-NULL for success; NULL otherwise
+ */
+segwriter_t *segwriter_open(char *dirnm, long segment_size);
+
+/*
+ * segwriter_add -- appends the page under id, which must be at most
+ * 2^28; threads may add pages at the same time. Pages are synced as set
+ * by pageio_sync.
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t segwriter_add(segwriter_t *sw, webpage_t *pagep, int id);
+
+/*
+ * segwriter_flush -- syncs the pages added so far to the open segment
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t segwriter_flush(segwriter_t *sw);
+
+/*
+ * segwriter_close -- writes the footer of the last segment and frees
+ * the writer
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t segwriter_close(segwriter_t *sw);
+
+/*
+ * pagestore_open -- opens the pages of directory dirnm, packed in
+ * segments or one per file
+ *
+ * returns: non-NULL for success; NULL otherwise
+ */
+pagestore_t *pagestore_open(char *dirnm);
+
+/* pagestore_close -- closes a page store */
+void pagestore_close(pagestore_t *ps);
+
+/*
+ * pagestore_ids -- the ids of the pages in the store, in increasing
+ * order, valid until it is closed; sets *count to their number
+ */
+const int *pagestore_ids(pagestore_t *ps, int *count);
+
+/*
+ * pagestore_load -- loads page id into a new webpage; threads may load
+ * pages at the same time
+ *
+ * returns: non-NULL for success; NULL otherwise
+ */
+webpage_t *pagestore_load(pagestore_t *ps, int id);
+
+/*
+ * pagestore_prefetch -- asks the kernel to start reading page id from
+ * disk, so that a later pagestore_load of it does not wait on the read
+ */
+void pagestore_prefetch(pagestore_t *ps, int id);
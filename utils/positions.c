@@ -0,0 +1,270 @@
+/*
+ * positions.c -- word positions for phrase and proximity queries
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: the positions file (host byte order) is laid out as:
+ *   <header>     magic, version, number of terms and section offsets
+ *   <offsets>    uint64_t offset of the list of every term within the
+ *                data, and one past the last, nterms + 1 in all
+ *   <data>       per term, per doc of its posting list, word_count
+ *                varints: the first position, then the gaps between
+ *                successive positions
+ */
+#define _POSIX_C_SOURCE 200809L // mmap
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "positions.h"
+#include "varint.h"
+
+#define POSITIONS_MAGIC "TSEPOSNS"
+#define POSITIONS_MAGIC_LEN 8
+#define POSITIONS_VERSION 1
+#define MIN_CAPACITY 16
+
+/* positions file header */
+typedef struct positions_header
+{
+    char magic[POSITIONS_MAGIC_LEN];
+    uint32_t version;
+    uint32_t nterms;
+    uint64_t offsets_off; /* offset of the offsets table */
+    uint64_t data_off;    /* offset of the first list */
+    uint64_t file_size;
+} positions_header_t;
+
+/* memory mapped positions file */
+struct posmap
+{
+    char *base;
+    size_t size;
+    int nterms;
+    const uint64_t *offsets;
+    const uint8_t *data;
+    uint64_t data_size;
+};
+
+void positions_init(positions_t *pp)
+{
+    if (!pp)
+        return;
+    pp->pos = NULL;
+    pp->n = 0;
+    pp->capacity = 0;
+}
+
+void positions_clear(positions_t *pp)
+{
+    if (!pp)
+        return;
+    free(pp->pos);
+    positions_init(pp);
+}
+
+int32_t positions_append(positions_t *pp, const uint32_t *pos, int n)
+{
+    if (!pp || !pos || n < 0)
+        return 1;
+    if (pp->n + n > pp->capacity)
+    {
+        int capacity = pp->capacity ? pp->capacity : MIN_CAPACITY;
+        while (capacity < pp->n + n)
+            capacity *= 2;
+        uint32_t *grown = realloc(pp->pos, capacity * sizeof(uint32_t));
+        if (!grown)
+            return 1;
+        pp->pos = grown;
+        pp->capacity = capacity;
+    }
+    memcpy(pp->pos + pp->n, pos, n * sizeof(uint32_t));
+    pp->n += n;
+    return 0;
+}
+
+/*
+ * encoded_size -- the size of the encoded positions of one term; 0 if
+ * they do not match the word counts of its posting list
+ */
+static uint64_t encoded_size(const postings_t *docs, const positions_t *pp)
+{
+    uint64_t size = 0;
+    int k = 0;
+    for (int i = 0; i < docs->ndocs; i++)
+    {
+        uint32_t prev = 0;
+        for (int c = 0; c < docs->docs[i].word_count; c++, k++)
+        {
+            if (k >= pp->n || (c > 0 && pp->pos[k] <= prev))
+                return 0;
+            size += varint_size(pp->pos[k] - prev);
+            prev = pp->pos[k];
+        }
+    }
+    return k == pp->n ? size : 0;
+}
+
+static uint8_t *encode(const postings_t *docs, const positions_t *pp, uint8_t *out)
+{
+    int k = 0;
+    for (int i = 0; i < docs->ndocs; i++)
+    {
+        uint32_t prev = 0;
+        for (int c = 0; c < docs->docs[i].word_count; c++, k++)
+        {
+            out = varint_put(out, pp->pos[k] - prev);
+            prev = pp->pos[k];
+        }
+    }
+    return out;
+}
+
+int32_t possave(char *posnm, int nterms, const postings_t *const *docs, const positions_t *const *pos)
+{
+    if (!posnm || nterms < 0 || (nterms > 0 && (!docs || !pos)))
+        return 1;
+
+    positions_header_t header;
+    uint64_t *offsets = malloc((nterms + 1) * sizeof(uint64_t));
+    uint64_t max_size = 0;
+    if (!offsets)
+        return 1;
+    offsets[0] = 0;
+    for (int t = 0; t < nterms; t++)
+    {
+        uint64_t size = encoded_size(docs[t], pos[t]);
+        if (size == 0 && docs[t]->ndocs > 0)
+        {
+            printf("Positions do not match the posting list of term %d\n", t);
+            free(offsets);
+            return 1;
+        }
+        offsets[t + 1] = offsets[t] + size;
+        if (size > max_size)
+            max_size = size;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, POSITIONS_MAGIC, POSITIONS_MAGIC_LEN);
+    header.version = POSITIONS_VERSION;
+    header.nterms = nterms;
+    header.offsets_off = sizeof(header);
+    header.data_off = header.offsets_off + (uint64_t)(nterms + 1) * sizeof(uint64_t);
+    header.file_size = header.data_off + offsets[nterms];
+
+    uint8_t *buffer = malloc(max_size ? max_size : 1);
+    FILE *file = buffer ? fopen(posnm, "wb") : NULL;
+    if (!file)
+    {
+        printf("Failed to create file: %s\n", posnm);
+        free(buffer);
+        free(offsets);
+        return 1;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(offsets, sizeof(uint64_t), nterms + 1, file);
+    for (int t = 0; t < nterms; t++)
+    {
+        encode(docs[t], pos[t], buffer);
+        fwrite(buffer, 1, offsets[t + 1] - offsets[t], file);
+    }
+    free(buffer);
+    free(offsets);
+    int error = ferror(file);
+    if (fclose(file) != 0 || error)
+    {
+        printf("Failed to write file: %s\n", posnm);
+        return 1;
+    }
+    return 0;
+}
+
+posmap_t *posmap_open(char *posnm, int nterms)
+{
+    if (!posnm)
+        return NULL;
+    int fd = open(posnm, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(positions_header_t))
+    {
+        close(fd);
+        return NULL;
+    }
+    char *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    /* check that the sections lie inside the file and the offsets ascend */
+    const positions_header_t *header = (const positions_header_t *)base;
+    uint64_t size = st.st_size;
+    const uint64_t *offsets = (const uint64_t *)(base + sizeof(positions_header_t));
+    bool valid = memcmp(header->magic, POSITIONS_MAGIC, POSITIONS_MAGIC_LEN) == 0 &&
+                 header->version == POSITIONS_VERSION && header->nterms == (uint32_t)nterms &&
+                 header->file_size == size && header->offsets_off == sizeof(positions_header_t) &&
+                 header->data_off == header->offsets_off + (uint64_t)(nterms + 1) * sizeof(uint64_t) &&
+                 header->data_off <= size && offsets[0] == 0;
+    for (int t = 0; valid && t < nterms; t++)
+        valid = offsets[t] <= offsets[t + 1];
+    if (!valid || header->data_off + offsets[nterms] != size)
+    {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+
+    posmap_t *pm = malloc(sizeof(posmap_t));
+    if (!pm)
+    {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+    pm->base = base;
+    pm->size = st.st_size;
+    pm->nterms = nterms;
+    pm->offsets = offsets;
+    pm->data = (const uint8_t *)base + header->data_off;
+    pm->data_size = offsets[nterms];
+    return pm;
+}
+
+void posmap_close(posmap_t *pm)
+{
+    if (!pm)
+        return;
+    munmap(pm->base, pm->size);
+    free(pm);
+}
+
+bool posmap_cursor(posmap_t *pm, int term, poscursor_t *cp)
+{
+    if (!pm || !cp || term < 0 || term >= pm->nterms)
+        return false;
+    cp->p = pm->data + pm->offsets[term];
+    cp->end = pm->data + pm->offsets[term + 1];
+    return true;
+}
+
+int32_t poscursor_next(poscursor_t *cp, int count, uint32_t *out)
+{
+    if (!cp || !cp->p || count < 0)
+        return 1;
+    uint32_t pos = 0, gap;
+    for (int c = 0; c < count; c++)
+    {
+        if (!(cp->p = varint_get(cp->p, cp->end, &gap)))
+            return 1;
+        pos += gap;
+        if (out)
+            out[c] = pos;
+    }
+    return 0;
+}
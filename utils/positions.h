@@ -0,0 +1,95 @@
+#pragma once
+/*
+ * positions.h -- word positions for phrase and proximity queries
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: the position of a word in a page is the number of
+ * indexed words before it. The positions of a word are kept doc after
+ * doc, in the order of its posting list, so the word counts of the
+ * posting list tell how many belong to each doc.
+ *
+ * A positional index saves them next to a binary index, in the file
+ * <indexnm>.pos, one encoded list per term id of the index. Within a
+ * doc each position is stored as the gap from the one before it, as a
+ * variable-byte integer. A list is read in place with a cursor, doc by
+ * doc in posting list order, decoding the positions of the docs asked
+ * for and skipping the others.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "postings.h"
+
+#define POSITIONS_SUFFIX ".pos" /* appended to the index file name */
+
+/* growable list of positions
+ *
+ * @param pos - the positions, ascending within each doc
+ * @param n - number of positions in the list
+ * @param capacity - number of positions allocated
+ */
+typedef struct positions
+{
+    uint32_t *pos;
+    int n;
+    int capacity;
+} positions_t;
+
+/* mapped positions file; representation hidden */
+typedef struct posmap posmap_t;
+
+/* cursor over the encoded positions of one term; private to the module */
+typedef struct poscursor
+{
+    const uint8_t *p;
+    const uint8_t *end;
+} poscursor_t;
+
+/* positions_init -- initializes an empty, embedded list */
+void positions_init(positions_t *pp);
+
+/* positions_clear -- frees the positions of an embedded list */
+void positions_clear(positions_t *pp);
+
+/*
+ * positions_append -- adds the n positions pos to the end of the list
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t positions_append(positions_t *pp, const uint32_t *pos, int n);
+
+/*
+ * possave -- saves the positions of nterms terms, whose posting lists
+ * are docs, to filename posnm
+ *
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t possave(char *posnm, int nterms, const postings_t *const *docs, const positions_t *const *pos);
+
+/*
+ * posmap_open -- memory maps the positions file posnm of an index of
+ * nterms terms
+ *
+ * returns: non-NULL for success; NULL if the file cannot be mapped or
+ * does not belong to such an index
+ */
+posmap_t *posmap_open(char *posnm, int nterms);
+
+/* posmap_close -- unmaps the positions */
+void posmap_close(posmap_t *pm);
+
+/*
+ * posmap_cursor -- opens a cursor on the positions of term id term
+ *
+ * returns: true for success; false if the term is out of range
+ */
+bool posmap_cursor(posmap_t *pm, int term, poscursor_t *cp);
+
+/*
+ * poscursor_next -- decodes the count positions of the next doc into
+ * out, or skips them if out is NULL
+ *
+ * returns: 0 for success; nonzero if the list is corrupt or runs out
+ */
+int32_t poscursor_next(poscursor_t *cp, int count, uint32_t *out);
@@ -0,0 +1,652 @@
+/*
+ * postings.c -- posting lists for the index
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: implementation of contiguous posting lists sorted by
+ * document id, and of their block encoding
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "postings.h"
+#include "varint.h"
+
+#define MIN_CAPACITY 4
+
+/* skip table entry of an encoded posting list of several blocks;
+ * offsets are relative to the end of the skip table. Each of those
+ * blocks starts with the largest word count and the shortest document
+ * length in it, which bound the scores of its documents.
+ */
+typedef struct pskip
+{
+	uint32_t last_id;
+	uint32_t offset;
+} pskip_t;
+
+void postings_init(postings_t *pp)
+{
+	if (pp == NULL)
+		return;
+	pp->docs = NULL;
+	pp->ndocs = 0;
+	pp->capacity = 0;
+}
+
+void postings_clear(postings_t *pp)
+{
+	if (pp == NULL)
+		return;
+	if (pp->capacity > 0)
+		free(pp->docs);
+	postings_init(pp);
+}
+
+postings_t *postings_new(void)
+{
+	postings_t *pp = malloc(sizeof(postings_t));
+	if (pp == NULL)
+		return NULL;
+	postings_init(pp);
+	return pp;
+}
+
+postings_t *postings_view(document_t *docs, int ndocs)
+{
+	postings_t *pp = postings_new();
+	if (pp == NULL)
+		return NULL;
+	pp->docs = docs;
+	pp->ndocs = ndocs;
+	return pp;
+}
+
+void postings_free(postings_t *pp)
+{
+	if (pp == NULL)
+		return;
+	postings_clear(pp);
+	free(pp);
+}
+
+int32_t postings_reserve(postings_t *pp, int n)
+{
+	if (pp == NULL || n < 0 || (pp->capacity == 0 && pp->docs != NULL))
+		return -1;
+	if (n <= pp->capacity)
+		return 0;
+
+	int capacity = pp->capacity ? pp->capacity : MIN_CAPACITY;
+	while (capacity < n)
+		capacity *= 2;
+
+	document_t *docs = realloc(pp->docs, capacity * sizeof(document_t));
+	if (docs == NULL)
+		return -1;
+	pp->docs = docs;
+	pp->capacity = capacity;
+	return 0;
+}
+
+/* lower_bound -- index of the first document in docs[lo..hi) with an
+ * id >= id, or hi if there is none
+ */
+static int lower_bound(const document_t *docs, int lo, int hi, int id)
+{
+	while (lo < hi)
+	{
+		int mid = lo + (hi - lo) / 2;
+		if (docs[mid].id < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* gallop -- as lower_bound over docs[lo..n), probing lo, lo+1, lo+3,
+ * lo+7, ... before binary searching the last bracket, so nearby targets
+ * are found in O(log distance)
+ */
+static int gallop(const document_t *docs, int lo, int n, int id)
+{
+	int hi = lo, step = 1;
+	while (hi < n && docs[hi].id < id)
+	{
+		lo = hi + 1;
+		hi += step;
+		step <<= 1;
+	}
+	if (hi > n)
+		hi = n;
+	return lower_bound(docs, lo, hi, id);
+}
+
+int32_t postings_add(postings_t *pp, int id, int word_count)
+{
+	if (pp == NULL)
+		return -1;
+
+	/* fast path: documents arrive in ascending id order */
+	if (pp->ndocs > 0 && pp->docs[pp->ndocs - 1].id == id)
+	{
+		pp->docs[pp->ndocs - 1].word_count += word_count;
+		return 0;
+	}
+
+	int pos = pp->ndocs;
+	if (pp->ndocs > 0 && pp->docs[pp->ndocs - 1].id > id)
+	{
+		pos = lower_bound(pp->docs, 0, pp->ndocs, id);
+		if (pp->docs[pos].id == id)
+		{
+			pp->docs[pos].word_count += word_count;
+			return 0;
+		}
+	}
+
+	if (postings_reserve(pp, pp->ndocs + 1) != 0)
+		return -1;
+	if (pos < pp->ndocs)
+		memmove(&pp->docs[pos + 1], &pp->docs[pos], (pp->ndocs - pos) * sizeof(document_t));
+	pp->docs[pos].id = id;
+	pp->docs[pos].word_count = word_count;
+	pp->ndocs++;
+	return 0;
+}
+
+int32_t postings_append(postings_t *pp, const postings_t *src)
+{
+	if (pp == NULL || src == NULL)
+		return -1;
+	if (src->ndocs == 0)
+		return 0;
+
+	if (pp->ndocs == 0 || pp->docs[pp->ndocs - 1].id < src->docs[0].id)
+	{
+		if (postings_reserve(pp, pp->ndocs + src->ndocs) != 0)
+			return -1;
+		memcpy(&pp->docs[pp->ndocs], src->docs, src->ndocs * sizeof(document_t));
+		pp->ndocs += src->ndocs;
+		return 0;
+	}
+
+	for (int i = 0; i < src->ndocs; i++)
+	{
+		if (postings_add(pp, src->docs[i].id, src->docs[i].word_count) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+document_t *postings_find(const postings_t *pp, int id)
+{
+	if (pp == NULL || pp->ndocs == 0)
+		return NULL;
+	int pos = lower_bound(pp->docs, 0, pp->ndocs, id);
+	if (pos < pp->ndocs && pp->docs[pos].id == id)
+		return &pp->docs[pos];
+	return NULL;
+}
+
+/* intersects a and b, keeping the smaller word count or the sum */
+static postings_t *intersect(const postings_t *a, const postings_t *b, bool sum)
+{
+	if (a == NULL || b == NULL)
+		return NULL;
+	if (a->ndocs > b->ndocs)
+	{
+		const postings_t *tmp = a;
+		a = b;
+		b = tmp;
+	}
+
+	postings_t *pp = postings_new();
+	if (pp == NULL || postings_reserve(pp, a->ndocs) != 0)
+	{
+		postings_free(pp);
+		return NULL;
+	}
+
+	int j = 0;
+	for (int i = 0; i < a->ndocs && j < b->ndocs; i++)
+	{
+		int id = a->docs[i].id;
+		j = gallop(b->docs, j, b->ndocs, id);
+		if (j < b->ndocs && b->docs[j].id == id)
+		{
+			int wa = a->docs[i].word_count, wb = b->docs[j].word_count;
+			pp->docs[pp->ndocs].id = id;
+			pp->docs[pp->ndocs].word_count = sum ? wa + wb : wa < wb ? wa : wb;
+			pp->ndocs++;
+			j++;
+		}
+	}
+	return pp;
+}
+
+postings_t *postings_intersect(const postings_t *a, const postings_t *b)
+{
+	return intersect(a, b, false);
+}
+
+postings_t *postings_intersect_sum(const postings_t *a, const postings_t *b)
+{
+	return intersect(a, b, true);
+}
+
+postings_t *postings_union(const postings_t *a, const postings_t *b)
+{
+	if (a == NULL || b == NULL)
+		return NULL;
+
+	postings_t *pp = postings_new();
+	if (pp == NULL || postings_reserve(pp, a->ndocs + b->ndocs) != 0)
+	{
+		postings_free(pp);
+		return NULL;
+	}
+
+	int i = 0, j = 0;
+	document_t *out = pp->docs;
+	while (i < a->ndocs && j < b->ndocs)
+	{
+		if (a->docs[i].id < b->docs[j].id)
+			*out++ = a->docs[i++];
+		else if (a->docs[i].id > b->docs[j].id)
+			*out++ = b->docs[j++];
+		else
+		{
+			out->id = a->docs[i].id;
+			out->word_count = a->docs[i++].word_count + b->docs[j++].word_count;
+			out++;
+		}
+	}
+	while (i < a->ndocs)
+		*out++ = a->docs[i++];
+	while (j < b->ndocs)
+		*out++ = b->docs[j++];
+	pp->ndocs = out - pp->docs;
+	return pp;
+}
+
+/* true if document a ranks below document b: it has fewer words, or
+ * as many words and a later id
+ */
+static bool ranks_below(const document_t *a, const document_t *b)
+{
+	return a->word_count < b->word_count || (a->word_count == b->word_count && a->id > b->id);
+}
+
+/* restores the min-heap of n documents below position i */
+static void sift_down(document_t *heap, int n, int i)
+{
+	document_t d = heap[i];
+	int child;
+
+	while ((child = 2 * i + 1) < n)
+	{
+		if (child + 1 < n && ranks_below(&heap[child + 1], &heap[child]))
+			child++;
+		if (!ranks_below(&heap[child], &d))
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = d;
+}
+
+int postings_heap_push(document_t *heap, int n, int k, document_t d)
+{
+	if (n < k)
+	{
+		/* sift the new document up from the bottom */
+		int i = n++;
+		while (i > 0 && ranks_below(&d, &heap[(i - 1) / 2]))
+		{
+			heap[i] = heap[(i - 1) / 2];
+			i = (i - 1) / 2;
+		}
+		heap[i] = d;
+	}
+	else if (k > 0 && ranks_below(&heap[0], &d))
+	{
+		heap[0] = d;
+		sift_down(heap, n, 0);
+	}
+	return n;
+}
+
+void postings_heap_sort(document_t *heap, int n)
+{
+	/* move the lowest ranked to the back until the heap is sorted */
+	for (int last = n - 1; last > 0; last--)
+	{
+		document_t d = heap[0];
+		heap[0] = heap[last];
+		heap[last] = d;
+		sift_down(heap, last, 0);
+	}
+}
+
+int postings_topk(const postings_t *pp, int k, document_t *out)
+{
+	if (pp == NULL || out == NULL || k <= 0)
+		return 0;
+
+	/* out holds a min-heap of the best n documents seen so far */
+	int n = 0;
+	for (int i = 0; i < pp->ndocs; i++)
+		n = postings_heap_push(out, n, k, pp->docs[i]);
+	postings_heap_sort(out, n);
+	return n;
+}
+
+static int nblocks(int ndocs)
+{
+	return (ndocs + POSTINGS_BLOCK - 1) / POSTINGS_BLOCK;
+}
+
+/* the size of the skip table of a list of ndocs documents */
+static size_t skips_size(int ndocs)
+{
+	return nblocks(ndocs) > 1 ? nblocks(ndocs) * sizeof(pskip_t) : 0;
+}
+
+/* the bounds of documents first to last - 1 of pp */
+static void bounds(const postings_t *pp, int first, int last, const uint32_t *lens, int base, int nids,
+		   uint32_t *max_count, uint32_t *min_len)
+{
+	*max_count = 0;
+	*min_len = UINT32_MAX;
+	for (int i = first; i < last; i++)
+	{
+		int id = pp->docs[i].id;
+		uint32_t len = lens && id >= base && id < nids ? lens[id - base] : 0;
+		if ((uint32_t)pp->docs[i].word_count > *max_count)
+			*max_count = pp->docs[i].word_count;
+		if (len < *min_len)
+			*min_len = len;
+	}
+}
+
+size_t postings_encoded_size(const postings_t *pp, const uint32_t *lens, int base, int nids)
+{
+	if (pp == NULL)
+		return 0;
+	uint32_t max_count, min_len;
+	bounds(pp, 0, pp->ndocs, lens, base, nids, &max_count, &min_len);
+	size_t size = varint_size(max_count) + varint_size(min_len) + skips_size(pp->ndocs);
+	uint32_t prev = 0;
+	for (int first = 0; nblocks(pp->ndocs) > 1 && first < pp->ndocs; first += POSTINGS_BLOCK)
+	{
+		int last = first + POSTINGS_BLOCK < pp->ndocs ? first + POSTINGS_BLOCK : pp->ndocs;
+		bounds(pp, first, last, lens, base, nids, &max_count, &min_len);
+		size += varint_size(max_count) + varint_size(min_len);
+	}
+	for (int i = 0; i < pp->ndocs; i++)
+	{
+		size += varint_size((uint32_t)pp->docs[i].id - prev);
+		size += varint_size((uint32_t)pp->docs[i].word_count);
+		prev = pp->docs[i].id;
+	}
+	return size;
+}
+
+size_t postings_encode(const postings_t *pp, const uint32_t *lens, int base, int nids, uint8_t *out)
+{
+	if (pp == NULL || out == NULL)
+		return 0;
+	int n = nblocks(pp->ndocs);
+	uint32_t max_count, min_len;
+	bounds(pp, 0, pp->ndocs, lens, base, nids, &max_count, &min_len);
+	uint8_t *skips = varint_put(varint_put(out, max_count), min_len);
+	uint8_t *blocks = skips + skips_size(pp->ndocs);
+	uint8_t *p = blocks;
+	uint32_t prev = 0;
+
+	for (int b = 0; b < n; b++)
+	{
+		int first = b * POSTINGS_BLOCK;
+		int last = first + POSTINGS_BLOCK < pp->ndocs ? first + POSTINGS_BLOCK : pp->ndocs;
+		if (n > 1)
+		{
+			pskip_t skip = {(uint32_t)pp->docs[last - 1].id, (uint32_t)(p - blocks)};
+			memcpy(skips + b * sizeof(pskip_t), &skip, sizeof(pskip_t));
+			bounds(pp, first, last, lens, base, nids, &max_count, &min_len);
+			p = varint_put(varint_put(p, max_count), min_len);
+		}
+
+		for (int i = first; i < last; i++)
+		{
+			p = varint_put(p, (uint32_t)pp->docs[i].id - prev);
+			prev = pp->docs[i].id;
+		}
+		for (int i = first; i < last; i++)
+			p = varint_put(p, (uint32_t)pp->docs[i].word_count);
+	}
+	return p - out;
+}
+
+int32_t postings_decode(const uint8_t *data, size_t size, int ndocs, postings_t *pp)
+{
+	if (pp == NULL || ndocs < 0 || (pp->capacity == 0 && pp->docs != NULL))
+		return -1;
+	pp->ndocs = 0;
+	if (ndocs == 0)
+		return 0;
+
+	/* past the bounds and the skip table, the blocks are contiguous, so
+	 * decode them as one stream
+	 */
+	const uint8_t *p = data, *end = data + size;
+	uint32_t prev = 0, v;
+	if (data == NULL || !(p = varint_get(p, end, &v)) || !(p = varint_get(p, end, &v)) ||
+	    (size_t)(end - p) < skips_size(ndocs) || postings_reserve(pp, ndocs) != 0)
+		return -1;
+	p += skips_size(ndocs);
+	for (int first = 0; first < ndocs; first += POSTINGS_BLOCK)
+	{
+		int last = first + POSTINGS_BLOCK < ndocs ? first + POSTINGS_BLOCK : ndocs;
+		if (ndocs > POSTINGS_BLOCK && (!(p = varint_get(p, end, &v)) || !(p = varint_get(p, end, &v))))
+			return -1;
+		for (int i = first; i < last; i++)
+		{
+			if (!(p = varint_get(p, end, &v)))
+				return -1;
+			prev += v;
+			pp->docs[i].id = (int)prev;
+		}
+		for (int i = first; i < last; i++)
+		{
+			if (!(p = varint_get(p, end, &v)))
+				return -1;
+			pp->docs[i].word_count = (int)v;
+		}
+	}
+	pp->ndocs = ndocs;
+	return 0;
+}
+
+/* reads the skip table entry of block b; a list of one block has no
+ * table, and its last id is that of the block, which stays decoded
+ * until the cursor ends
+ */
+static void get_skip(const pcursor_t *cp, int b, pskip_t *skip)
+{
+	if (cp->nblocks > 1)
+	{
+		memcpy(skip, cp->data + b * sizeof(pskip_t), sizeof(pskip_t));
+		return;
+	}
+	skip->last_id = cp->n > 0 ? (uint32_t)cp->docs[cp->n - 1].id : 0;
+	skip->offset = 0;
+}
+
+/* reads the bounds at the start of the block of skip into max_count
+ * and min_len; a list of one block has the bounds of the list, as does
+ * a block whose bounds cannot be read, as they bound it too
+ * returns: the start of the documents of the block, or NULL if its
+ * bounds cannot be read
+ */
+static const uint8_t *get_bounds(const pcursor_t *cp, const pskip_t *skip, int *max_count, uint32_t *min_len)
+{
+	const uint8_t *p = cp->data + skips_size(cp->ndocs) + skip->offset;
+	uint32_t count, len;
+
+	*max_count = cp->max_count;
+	*min_len = cp->min_len;
+	if (cp->nblocks == 1)
+		return p;
+	if (p > cp->end || !(p = varint_get(p, cp->end, &count)) || !(p = varint_get(p, cp->end, &len)) ||
+	    count > INT_MAX)
+		return NULL;
+	*max_count = (int)count;
+	*min_len = len;
+	return p;
+}
+
+/* moves the cursor past its last document */
+static int32_t cursor_end(pcursor_t *cp)
+{
+	cp->block = cp->nblocks;
+	cp->pos = cp->n = 0;
+	return 0;
+}
+
+/* decodes block b into the cursor and moves to its first document */
+static int32_t decode_block(pcursor_t *cp, int b)
+{
+	pskip_t skip, other;
+	const uint8_t *blocks = cp->data + skips_size(cp->ndocs);
+	int max_count;
+	uint32_t min_len;
+
+	if (b >= cp->nblocks)
+		return cursor_end(cp);
+	get_skip(cp, b, &skip);
+	const uint8_t *p = get_bounds(cp, &skip, &max_count, &min_len), *end = cp->end;
+	if (b + 1 < cp->nblocks)
+	{
+		get_skip(cp, b + 1, &other);
+		end = blocks + other.offset;
+	}
+	/* ids are gaps from the last id of the previous block */
+	uint32_t prev = 0, v;
+	if (b > 0)
+	{
+		get_skip(cp, b - 1, &other);
+		prev = other.last_id;
+	}
+	if (!p || p > end || end > cp->end)
+	{
+		cursor_end(cp);
+		return -1;
+	}
+
+	int n = cp->ndocs - b * POSTINGS_BLOCK < POSTINGS_BLOCK ? cp->ndocs - b * POSTINGS_BLOCK : POSTINGS_BLOCK;
+	for (int i = 0; i < n; i++)
+	{
+		if (!(p = varint_get(p, end, &v)))
+		{
+			cursor_end(cp);
+			return -1;
+		}
+		prev += v;
+		cp->docs[i].id = (int)prev;
+	}
+	for (int i = 0; i < n; i++)
+	{
+		if (!(p = varint_get(p, end, &v)))
+		{
+			cursor_end(cp);
+			return -1;
+		}
+		cp->docs[i].word_count = (int)v;
+	}
+	cp->block = b;
+	cp->pos = 0;
+	cp->n = n;
+	return 0;
+}
+
+int32_t pcursor_open(pcursor_t *cp, const uint8_t *data, size_t size, int ndocs)
+{
+	const uint8_t *p = data, *end = data + size;
+	uint32_t max_count;
+
+	if (cp == NULL || ndocs < 0)
+		return -1;
+	cp->ndocs = ndocs;
+	cp->nblocks = nblocks(ndocs);
+	cp->n = 0;
+	cp->end = end;
+	if (data == NULL || !(p = varint_get(p, end, &max_count)) || !(p = varint_get(p, end, &cp->min_len)) ||
+	    max_count > INT_MAX || (size_t)(end - p) < skips_size(ndocs))
+	{
+		cp->nblocks = 0;
+		cursor_end(cp);
+		return -1;
+	}
+	cp->max_count = (int)max_count;
+	cp->data = p;
+	return decode_block(cp, 0);
+}
+
+int pcursor_id(const pcursor_t *cp)
+{
+	return cp->block < cp->nblocks ? cp->docs[cp->pos].id : PCURSOR_END;
+}
+
+int pcursor_count(const pcursor_t *cp)
+{
+	return cp->docs[cp->pos].word_count;
+}
+
+int32_t pcursor_next(pcursor_t *cp)
+{
+	if (cp->block >= cp->nblocks)
+		return 0;
+	if (++cp->pos < cp->n)
+		return 0;
+	return decode_block(cp, cp->block + 1);
+}
+
+int32_t pcursor_seek(pcursor_t *cp, int id)
+{
+	pskip_t skip;
+	int b = cp->block;
+
+	if (b >= cp->nblocks || cp->docs[cp->pos].id >= id)
+		return 0;
+	/* skip whole blocks that end before id without decoding them */
+	get_skip(cp, b, &skip);
+	while ((int)skip.last_id < id)
+	{
+		if (++b >= cp->nblocks)
+			return cursor_end(cp);
+		get_skip(cp, b, &skip);
+	}
+	if (b != cp->block && decode_block(cp, b) != 0)
+		return -1;
+	cp->pos = lower_bound(cp->docs, cp->pos, cp->n, id);
+	return 0;
+}
+
+bool pcursor_block(const pcursor_t *cp, int id, int *last_id, int *max_count, uint32_t *min_len)
+{
+	pskip_t skip;
+
+	for (int b = cp->block; b < cp->nblocks; b++)
+	{
+		get_skip(cp, b, &skip);
+		if ((int)skip.last_id >= id)
+		{
+			*last_id = skip.last_id;
+			get_bounds(cp, &skip, max_count, min_len);
+			return true;
+		}
+	}
+	return false;
+}
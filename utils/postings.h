@@ -0,0 +1,209 @@
+#pragma once
+/*
+ * postings.h -- posting lists for the index
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: a posting list is a contiguous, growable array of
+ * documents kept in ascending id order. Documents are normally added
+ * in ascending id order, so adding to the last document or appending
+ * a new one is the fast path; out-of-order ids are inserted in place.
+ *
+ * A posting list with capacity 0 and non-NULL docs is a borrowed view
+ * of documents owned elsewhere (e.g. an index entry); such lists are
+ * read-only and their documents are never freed by this module.
+ *
+ * For storage, a posting list is encoded in blocks of POSTINGS_BLOCK
+ * documents. The encoding starts with the largest word count and the
+ * shortest document length of the whole list. A list of several blocks
+ * then has a skip table holding the last id and byte offset of every
+ * block, and each of its blocks starts with its own largest word count
+ * and shortest document length; a list of one block, most of them, has
+ * neither. Each block holds the id gaps followed by the word counts.
+ * All but the skip table are variable-byte integers.
+ *
+ * A cursor walks an encoded posting list in place, decoding one block
+ * at a time. It can skip blocks by their last id and read the bounds of
+ * a block without decoding it, which is what block-max WAND needs.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+
+#define POSTINGS_BLOCK 128 /* documents per encoded block */
+#define PCURSOR_END INT_MAX /* id of a cursor past its last document */
+
+/* document struct
+ *
+ * @param id - document id designated by crawler
+ * @param word_count - the count of a specific word in the index in this doc
+ */
+typedef struct document
+{
+	int id;
+	int word_count;
+} document_t;
+
+/* posting list struct
+ *
+ * @param docs - documents sorted by ascending id
+ * @param ndocs - number of documents in the list
+ * @param capacity - number of documents allocated
+ */
+typedef struct postings
+{
+	document_t *docs;
+	int ndocs;
+	int capacity;
+} postings_t;
+
+/* cursor over an encoded posting list
+ *
+ * @param ndocs - number of documents in the list
+ * @param max_count, min_len - bounds over all of its blocks
+ * @param block, pos - the current document is docs[pos] of this block
+ *
+ * the remaining fields are private to the postings module
+ */
+typedef struct pcursor
+{
+	int ndocs;
+	int max_count;
+	uint32_t min_len;
+	int block;
+	int pos;
+	int n;
+	int nblocks;
+	const uint8_t *data;
+	const uint8_t *end;
+	document_t docs[POSTINGS_BLOCK];
+} pcursor_t;
+
+/* postings_init -- initializes an empty, embedded posting list */
+void postings_init(postings_t *pp);
+
+/* postings_clear -- frees the documents of an embedded posting list */
+void postings_clear(postings_t *pp);
+
+/* postings_new -- allocates an empty posting list; NULL on failure */
+postings_t *postings_new(void);
+
+/* postings_view -- allocates a borrowed view of ndocs sorted documents
+ * returns NULL on failure
+ */
+postings_t *postings_view(document_t *docs, int ndocs);
+
+/* postings_free -- frees a posting list allocated with postings_new
+ * or postings_view
+ */
+void postings_free(postings_t *pp);
+
+/* postings_reserve -- makes room for at least n documents
+ * returns 0 for success; nonzero otherwise
+ */
+int32_t postings_reserve(postings_t *pp, int n);
+
+/* postings_add -- adds word_count occurrences in document id, either
+ * incrementing the existing document or inserting a new one in order
+ * returns 0 for success; nonzero otherwise
+ */
+int32_t postings_add(postings_t *pp, int id, int word_count);
+
+/* postings_append -- adds every document of src to pp; when src starts
+ * after the last document of pp the documents are copied in one step
+ * returns 0 for success; nonzero otherwise
+ */
+int32_t postings_append(postings_t *pp, const postings_t *src);
+
+/* postings_find -- binary searches for document id
+ * returns a pointer to the document or NULL if not present
+ */
+document_t *postings_find(const postings_t *pp, int id);
+
+/* postings_intersect -- documents present in both a and b, with the
+ * smaller of the two word counts; the shorter list is walked while the
+ * longer one is searched by galloping
+ * returns a new posting list, or NULL on failure
+ */
+postings_t *postings_intersect(const postings_t *a, const postings_t *b);
+
+/* postings_intersect_sum -- like postings_intersect, but with the word
+ * counts of the two lists summed, as when they hold scores
+ */
+postings_t *postings_intersect_sum(const postings_t *a, const postings_t *b);
+
+/* postings_union -- documents present in a or b, with the word counts
+ * of documents in both summed; computed by a linear merge
+ * returns a new posting list, or NULL on failure
+ */
+postings_t *postings_union(const postings_t *a, const postings_t *b);
+
+/* postings_heap_push -- offers d to heap, a min-heap of the n best
+ * ranked of at most k documents, using the order of postings_topk
+ * returns: the new number of documents in the heap
+ */
+int postings_heap_push(document_t *heap, int n, int k, document_t d);
+
+/* postings_heap_sort -- sorts a heap of n documents made by
+ * postings_heap_push into rank order
+ */
+void postings_heap_sort(document_t *heap, int n);
+
+/* postings_topk -- selects the k documents with the most words, ties
+ * going to the lower id, into out in rank order; out must hold k
+ * documents. Takes O(n log k) time for a list of n documents.
+ * returns: the number of documents selected
+ */
+int postings_topk(const postings_t *pp, int k, document_t *out);
+
+/* postings_encoded_size -- number of bytes postings_encode will write
+ * with the same lens, base and nids
+ */
+size_t postings_encoded_size(const postings_t *pp, const uint32_t *lens, int base, int nids);
+
+/* postings_encode -- encodes the posting list into out, which must hold
+ * postings_encoded_size bytes. lens holds the length of documents base
+ * to nids - 1, id at lens[id - base], for the bounds; it may be NULL.
+ * returns the number of bytes written
+ */
+size_t postings_encode(const postings_t *pp, const uint32_t *lens, int base, int nids, uint8_t *out);
+
+/* postings_decode -- decodes ndocs documents from the size bytes at data
+ * into pp, replacing its contents; pp must not be a view
+ * returns 0 for success; nonzero if the encoding is malformed
+ */
+int32_t postings_decode(const uint8_t *data, size_t size, int ndocs, postings_t *pp);
+
+/* pcursor_open -- opens a cursor on the first of the ndocs documents
+ * encoded in the size bytes at data, which must outlive it
+ * returns 0 for success; nonzero if the encoding is malformed
+ */
+int32_t pcursor_open(pcursor_t *cp, const uint8_t *data, size_t size, int ndocs);
+
+/* pcursor_id -- the id of the current document, or PCURSOR_END */
+int pcursor_id(const pcursor_t *cp);
+
+/* pcursor_count -- the word count of the current document */
+int pcursor_count(const pcursor_t *cp);
+
+/* pcursor_next -- moves to the next document
+ * returns 0 for success; nonzero if the encoding is malformed, which
+ * also ends the cursor
+ */
+int32_t pcursor_next(pcursor_t *cp);
+
+/* pcursor_seek -- moves forward to the first document with an id of at
+ * least id, skipping the blocks before it undecoded
+ * returns 0 for success; nonzero if the encoding is malformed, which
+ * also ends the cursor
+ */
+int32_t pcursor_seek(pcursor_t *cp, int id);
+
+/* pcursor_block -- gets the last id and the bounds of the block that
+ * holds the first document from the current one with an id of at least
+ * id, without moving the cursor
+ * returns: false if there is no such document
+ */
+bool pcursor_block(const pcursor_t *cp, int id, int *last_id, int *max_count, uint32_t *min_len);
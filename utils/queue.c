@@ -24,8 +24,35 @@ typedef struct queueWrapper
 {
     qelement_t *front;
     qelement_t *back;
+    arena_t *arena;    /* source of nodes, or NULL to use malloc */
+    qelement_t *spare; /* arena nodes no longer in use */
 } queueWrapper_t;
 
+/* allocates a node, reusing a spare one on an arena queue */
+static qelement_t *new_node(queueWrapper_t *q)
+{
+    qelement_t *qep;
+    if (q->arena == NULL)
+        return (qelement_t *)malloc(sizeof(qelement_t));
+    if ((qep = q->spare) != NULL)
+    {
+        q->spare = qep->next;
+        return qep;
+    }
+    return (qelement_t *)arena_alloc(q->arena, sizeof(qelement_t));
+}
+
+static void free_node(queueWrapper_t *q, qelement_t *qep)
+{
+    if (q->arena == NULL)
+    {
+        free(qep);
+        return;
+    }
+    qep->next = q->spare;
+    q->spare = qep;
+}
+
 /* initialize empty queue */
 queue_t *qopen(void)
 {
@@ -34,15 +61,34 @@ queue_t *qopen(void)
         return NULL;
     qp->front = NULL;
     qp->back = NULL;
+    qp->arena = NULL;
+    qp->spare = NULL;
     return (queue_t *)qp;
 }
 
-/* deallocate a queue, frees everything in it */
+/* initialize empty queue whose nodes come from an arena */
+queue_t *qopen_arena(arena_t *ap)
+{
+    queueWrapper_t *qp;
+    if (ap == NULL || (qp = (queueWrapper_t *)arena_alloc(ap, sizeof(queueWrapper_t))) == NULL)
+        return NULL;
+    qp->front = NULL;
+    qp->back = NULL;
+    qp->arena = ap;
+    qp->spare = NULL;
+    return (queue_t *)qp;
+}
+
+/* deallocate a queue, frees everything in it; an arena queue is left
+ * for its arena to free
+ */
 void qclose(queue_t *qp)
 {
     if (qp == NULL)
         return;
     queueWrapper_t *q = (queueWrapper_t *)qp;
+    if (q->arena != NULL)
+        return;
     qelement_t *curr = q->front;
     qelement_t *next;
     while (curr != NULL)
@@ -63,7 +109,7 @@ void qclose(queue_t *qp)
 int32_t qput(queue_t *qp, void *elementp)
 {
     queueWrapper_t *q = (queueWrapper_t *)qp;
-    qelement_t *qep = (qelement_t *)malloc(sizeof(qelement_t));
+    qelement_t *qep = new_node(q);
     if (qep == NULL)
     {
         return -1;
@@ -102,7 +148,7 @@ void *qget(queue_t *qp)
     {
         q->back = NULL;
     }
-    free(qep);
+    free_node(q, qep);
     return data;
 }
 
@@ -177,8 +223,12 @@ void *qremove(queue_t *qp, bool (*searchfn)(void *element, const void *keyp), co
             {
                 prev->next = curr->next;
             }
+            if (q->back == curr)
+            {
+                q->back = prev;
+            }
             data = curr->element;
-            free(curr);
+            free_node(q, curr);
             break;
         }
     }
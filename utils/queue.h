@@ -4,6 +4,7 @@
  */
 #include <stdint.h>
 #include <stdbool.h>
+#include "arena.h"
 
 /* the queue representation is hidden from users of the module */
 typedef void queue_t;		
@@ -11,7 +12,15 @@ typedef void queue_t;
 /* create an empty queue */
 queue_t* qopen(void);        
 
-/* deallocate a queue, frees everything in it */
+/* create an empty queue whose nodes are allocated from arena ap and
+ * reused as elements are removed; only queues on the same arena may
+ * be concatenated with it
+ */
+queue_t* qopen_arena(arena_t *ap);
+
+/* deallocate a queue, frees everything in it. A queue from qopen_arena
+ * and its elements are left for the arena to free.
+ */
 void qclose(queue_t *qp);   
 
 /* put element at the end of the queue
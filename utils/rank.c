@@ -0,0 +1,258 @@
+/*
+ * rank.c -- relevance scoring of posting lists
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: implementation of BM25 and TF-IDF scoring over the
+ * posting list of a term, and of block-max WAND over several.
+ *
+ * WAND keeps the terms' cursors sorted by their current document. The
+ * pivot is the first document at which the score bounds of the terms
+ * so far could beat the k-th best score; every document before it is
+ * skipped. If the bounds of the blocks holding the pivot fall short
+ * too, every cursor up to the pivot jumps past the first of those
+ * blocks to end. Otherwise the pivot is scored once all the cursors
+ * before it have caught up. Scores are sums of the same rounded term
+ * scores as ranker_score, so the result equals scoring every document.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "rank.h"
+
+struct ranker
+{
+	rank_mode_t mode;
+	const doclens_t *dl;
+	double avglen;
+	float *norms; /* BM25 length normalization of every document id */
+};
+
+/* a query term being evaluated by WAND */
+typedef struct term
+{
+	pcursor_t *cp;
+	double idf;
+	int bound; /* the highest score the term can give a document */
+} term_t;
+
+int32_t rank_parse(const char *name, rank_mode_t *mode)
+{
+	if (name == NULL || mode == NULL)
+		return 1;
+	if (strcmp(name, "count") == 0)
+		*mode = RANK_COUNT;
+	else if (strcmp(name, "tfidf") == 0)
+		*mode = RANK_TFIDF;
+	else if (strcmp(name, "bm25") == 0)
+		*mode = RANK_BM25;
+	else
+		return 1;
+	return 0;
+}
+
+/* BM25 length normalization of a document of len words */
+static float length_norm(const ranker_t *rp, uint32_t len)
+{
+	return BM25_K1 * (1 - BM25_B + BM25_B * len / rp->avglen);
+}
+
+/* scaled weight of a term found in df documents */
+static double term_idf(const ranker_t *rp, int df)
+{
+	int ndocs = rp->dl->ndocs > df ? rp->dl->ndocs : df;
+	if (rp->mode == RANK_BM25)
+		return log(1 + (ndocs - df + 0.5) / (df + 0.5)) * RANK_SCALE;
+	return log(1 + (double)ndocs / (df ? df : 1)) * RANK_SCALE;
+}
+
+/* scaled score of a term of weight idf occurring tf times in a document
+ * of length normalization norm; never decreases with tf and never
+ * increases with norm, so it also bounds the scores of a block
+ */
+static int term_score(const ranker_t *rp, double idf, int tf, float norm)
+{
+	if (tf <= 0)
+		return 0;
+	if (rp->mode == RANK_BM25)
+		return (int)lround(idf * tf * (BM25_K1 + 1) / (tf + norm));
+	return (int)lround(idf * (1 + log(tf)));
+}
+
+/* length normalization of document id */
+static float doc_norm(const ranker_t *rp, int id)
+{
+	const doclens_t *dl = rp->dl;
+	return rp->norms && id >= dl->base && id < dl->nids ? rp->norms[id - dl->base] : BM25_K1;
+}
+
+ranker_t *ranker_open(rank_mode_t mode, const doclens_t *dl)
+{
+	if (dl == NULL)
+		return NULL;
+	ranker_t *rp = malloc(sizeof(ranker_t));
+	if (rp == NULL)
+		return NULL;
+	rp->mode = mode;
+	rp->dl = dl;
+	rp->avglen = dl->avglen > 0 ? dl->avglen : 1;
+	rp->norms = NULL;
+
+	if (mode == RANK_BM25)
+	{
+		int n = dl->nids - dl->base;
+		if ((rp->norms = malloc((n > 0 ? n : 1) * sizeof(float))) == NULL)
+		{
+			free(rp);
+			return NULL;
+		}
+		for (int i = 0; i < n; i++)
+			rp->norms[i] = length_norm(rp, dl->lens[i]);
+	}
+	return rp;
+}
+
+void ranker_close(ranker_t *rp)
+{
+	if (rp == NULL)
+		return;
+	free(rp->norms);
+	free(rp);
+}
+
+postings_t *ranker_score(ranker_t *rp, const postings_t *pp)
+{
+	if (rp == NULL || pp == NULL)
+		return NULL;
+	postings_t *out = postings_new();
+	if (out == NULL || postings_reserve(out, pp->ndocs) != 0)
+	{
+		postings_free(out);
+		return NULL;
+	}
+
+	const document_t *in = pp->docs;
+	document_t *docs = out->docs;
+	int n = pp->ndocs;
+
+	if (rp->mode == RANK_COUNT)
+	{
+		memcpy(docs, in, n * sizeof(document_t));
+	}
+	else
+	{
+		double idf = term_idf(rp, n);
+		for (int i = 0; i < n; i++)
+		{
+			docs[i].id = in[i].id;
+			docs[i].word_count = term_score(rp, idf, in[i].word_count, doc_norm(rp, in[i].id));
+		}
+	}
+	out->ndocs = n;
+	return out;
+}
+
+/* sorts the terms by the current document of their cursors */
+static void sort_terms(term_t **order, int n)
+{
+	for (int i = 1; i < n; i++)
+	{
+		term_t *tp = order[i];
+		int id = pcursor_id(tp->cp), j = i;
+		for (; j > 0 && pcursor_id(order[j - 1]->cp) > id; j--)
+			order[j] = order[j - 1];
+		order[j] = tp;
+	}
+}
+
+int ranker_topk_or(ranker_t *rp, pcursor_t *cursors, const int *dfs, int n, int k, document_t *out)
+{
+	if (rp == NULL || rp->mode == RANK_COUNT || cursors == NULL || n <= 0 || k <= 0 || out == NULL)
+		return 0;
+
+	term_t terms[n], *order[n];
+	int nterms = 0, size = 0;
+	for (int i = 0; i < n; i++)
+	{
+		if (pcursor_id(&cursors[i]) == PCURSOR_END)
+			continue;
+		terms[nterms].cp = &cursors[i];
+		terms[nterms].idf = term_idf(rp, dfs ? dfs[i] : cursors[i].ndocs);
+		terms[nterms].bound = term_score(rp, terms[nterms].idf, cursors[i].max_count,
+						 length_norm(rp, cursors[i].min_len));
+		order[nterms] = &terms[nterms];
+		nterms++;
+	}
+
+	while (nterms > 0)
+	{
+		sort_terms(order, nterms);
+		/* a document has to beat the k-th best score, or any score at first */
+		long threshold = size < k ? -1 : out[0].word_count;
+
+		/* the pivot is where the bounds of the terms so far beat it */
+		long bound = 0;
+		int p;
+		for (p = 0; p < nterms; p++)
+		{
+			if ((bound += order[p]->bound) > threshold)
+				break;
+		}
+		if (p == nterms)
+			break;
+		int pivot = pcursor_id(order[p]->cp);
+		while (p + 1 < nterms && pcursor_id(order[p + 1]->cp) == pivot)
+			p++;
+
+		/* bound the pivot by the blocks holding it */
+		int next = p + 1 < nterms ? pcursor_id(order[p + 1]->cp) : PCURSOR_END;
+		int last_id, max_count;
+		uint32_t min_len;
+		bound = 0;
+		for (int i = 0; i <= p; i++)
+		{
+			if (!pcursor_block(order[i]->cp, pivot, &last_id, &max_count, &min_len))
+				continue;
+			bound += term_score(rp, order[i]->idf, max_count, length_norm(rp, min_len));
+			if (last_id < next - 1)
+				next = last_id + 1;
+		}
+
+		if (bound <= threshold)
+		{
+			/* nothing before next can beat the threshold */
+			for (int i = 0; i <= p; i++)
+				pcursor_seek(order[i]->cp, next);
+		}
+		else if (pcursor_id(order[0]->cp) == pivot)
+		{
+			long score = 0;
+			for (int i = 0; i <= p; i++)
+			{
+				score += term_score(rp, order[i]->idf, pcursor_count(order[i]->cp), doc_norm(rp, pivot));
+				pcursor_next(order[i]->cp);
+			}
+			if (score > threshold)
+				size = postings_heap_push(out, size, k, (document_t){pivot, (int)score});
+		}
+		else
+		{
+			/* catch up on the pivot */
+			for (int i = 0; i < p && pcursor_id(order[i]->cp) < pivot; i++)
+				pcursor_seek(order[i]->cp, pivot);
+		}
+
+		/* drop the terms whose cursors have ended */
+		int live = 0;
+		for (int i = 0; i < nterms; i++)
+		{
+			if (pcursor_id(order[i]->cp) != PCURSOR_END)
+				order[live++] = order[i];
+		}
+		nterms = live;
+	}
+
+	postings_heap_sort(out, size);
+	return size;
+}
@@ -0,0 +1,69 @@
+#pragma once
+/*
+ * rank.h -- relevance scoring of posting lists
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: a ranker turns the posting list of one query term into
+ * a posting list of scores. Scores are kept in document_t.word_count as
+ * fixed point numbers, RANK_SCALE to 1, so the posting list operations
+ * and top-k selection work on them unchanged; the scores of the terms
+ * of a query are added up with postings_union and postings_intersect_sum.
+ *
+ * BM25 normalizes the term frequency by the document length relative
+ * to the average; TF-IDF simply dampens it logarithmically. Both weight
+ * a term by how rare it is in the index.
+ *
+ * ranker_topk_or finds the best documents of an OR of terms straight
+ * from their encoded posting lists with block-max WAND, skipping the
+ * documents and blocks whose score bounds cannot reach the top k.
+ */
+#include <stdbool.h>
+#include "postings.h"
+#include "indexio.h"
+
+#define RANK_SCALE 1000 /* fixed point units per score point */
+#define BM25_K1 1.2	/* term frequency saturation */
+#define BM25_B 0.75	/* document length normalization */
+
+/* ranking functions */
+typedef enum rank_mode
+{
+	RANK_COUNT, /* raw word counts: minimum for AND, sum for OR */
+	RANK_TFIDF,
+	RANK_BM25,
+} rank_mode_t;
+
+typedef struct ranker ranker_t; /* representation of a ranker hidden */
+
+/* rank_parse -- the mode named name ("count", "tfidf" or "bm25")
+ * returns: 0 for success; nonzero if the name is unknown
+ */
+int32_t rank_parse(const char *name, rank_mode_t *mode);
+
+/* ranker_open -- creates a ranker for the documents of dl, caching the
+ * length normalization of every document; dl must outlive the ranker
+ * returns: the ranker, or NULL on failure
+ */
+ranker_t *ranker_open(rank_mode_t mode, const doclens_t *dl);
+
+/* ranker_close -- frees a ranker */
+void ranker_close(ranker_t *rp);
+
+/* ranker_score -- scores the documents of pp, the posting list of one
+ * term, in a single pass
+ * returns: a new posting list of scaled scores, or NULL on failure
+ */
+postings_t *ranker_score(ranker_t *rp, const postings_t *pp);
+
+/* ranker_topk_or -- selects the k documents with the highest sum of
+ * scores over the n term cursors into out, in the rank order of
+ * postings_topk; the mode must not be RANK_COUNT and out must hold k
+ * documents. dfs, if not NULL, gives the number of documents of the
+ * term of each cursor, for a term split over cursors on disjoint
+ * documents; otherwise it is the length of the cursor. The cursors are
+ * used up.
+ * returns: the number of documents selected
+ */
+int ranker_topk_or(ranker_t *rp, pcursor_t *cursors, const int *dfs, int n, int k, document_t *out);
@@ -0,0 +1,199 @@
+/*
+ * rcache.c -- cache of query results
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: the results are kept in a hash table on their key and in
+ * a list from the most to the least recently used. Each result is one
+ * allocation holding its documents followed by its key, and costs that
+ * much of the memory cap.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "rcache.h"
+#include "hash.h"
+
+#define RCACHE_SLOTS 64 /* initial size of the hash table */
+
+/* the cached results of one query */
+typedef struct result
+{
+    struct result *prev, *next; /* neighbours in recency order */
+    char *key;                  /* points past the documents */
+    size_t cost;
+    int ndocs;
+    document_t docs[];
+} result_t;
+
+struct rcache
+{
+    pthread_mutex_t lock;
+    hashtable_t *table;
+    result_t *head, *tail; /* most and least recently used */
+    size_t capacity;
+    uint64_t generation;
+    rcache_stats_t stats;
+};
+
+static bool key_searchfn(void *elementp, const void *key)
+{
+    return strcmp(((result_t *)elementp)->key, (const char *)key) == 0;
+}
+
+static void unlink_result(rcache_t *rc, result_t *rp)
+{
+    if (rp->prev)
+        rp->prev->next = rp->next;
+    else
+        rc->head = rp->next;
+    if (rp->next)
+        rp->next->prev = rp->prev;
+    else
+        rc->tail = rp->prev;
+}
+
+static void push_front(rcache_t *rc, result_t *rp)
+{
+    rp->prev = NULL;
+    rp->next = rc->head;
+    if (rc->head)
+        rc->head->prev = rp;
+    else
+        rc->tail = rp;
+    rc->head = rp;
+}
+
+/* drops every result if they come from another generation of the index */
+static int32_t check_generation(rcache_t *rc, uint64_t gen)
+{
+    if (gen == rc->generation)
+        return 0;
+    rc->generation = gen;
+    if (!rc->head)
+        return 0;
+
+    hashtable_t *table = hopen(RCACHE_SLOTS);
+    if (!table)
+        return 1;
+    hclose(rc->table); /* frees the results */
+    rc->table = table;
+    rc->head = rc->tail = NULL;
+    rc->stats.entries = 0;
+    rc->stats.used = 0;
+    rc->stats.invalidations++;
+    return 0;
+}
+
+rcache_t *rcache_open(size_t capacity)
+{
+    rcache_t *rc = calloc(1, sizeof(rcache_t));
+    if (!rc)
+        return NULL;
+    if (!(rc->table = hopen(RCACHE_SLOTS)) || pthread_mutex_init(&rc->lock, NULL) != 0)
+    {
+        if (rc->table)
+            hclose(rc->table);
+        free(rc);
+        return NULL;
+    }
+    rc->capacity = capacity;
+    return rc;
+}
+
+void rcache_close(rcache_t *rc)
+{
+    if (!rc)
+        return;
+    hclose(rc->table);
+    pthread_mutex_destroy(&rc->lock);
+    free(rc);
+}
+
+int rcache_get(rcache_t *rc, uint64_t gen, const char *key, arena_t *ap, document_t **docs)
+{
+    if (!rc || !key || !ap || !docs)
+        return -1;
+
+    int ndocs = -1;
+    pthread_mutex_lock(&rc->lock);
+    result_t *rp = check_generation(rc, gen) == 0 ? hsearch(rc->table, key_searchfn, key, strlen(key)) : NULL;
+    if (rp)
+    {
+        *docs = NULL;
+        if (rp->ndocs == 0 || (*docs = arena_alloc(ap, rp->ndocs * sizeof(document_t))))
+        {
+            if (rp->ndocs)
+                memcpy(*docs, rp->docs, rp->ndocs * sizeof(document_t));
+            ndocs = rp->ndocs;
+            unlink_result(rc, rp);
+            push_front(rc, rp);
+        }
+    }
+    if (ndocs < 0)
+        rc->stats.misses++;
+    else
+        rc->stats.hits++;
+    pthread_mutex_unlock(&rc->lock);
+    return ndocs;
+}
+
+int32_t rcache_put(rcache_t *rc, uint64_t gen, const char *key, const document_t *docs, int ndocs)
+{
+    if (!rc || !key || ndocs < 0 || (ndocs && !docs))
+        return 1;
+
+    size_t keylen = strlen(key);
+    size_t cost = sizeof(result_t) + ndocs * sizeof(document_t) + keylen + 1;
+    if (cost > rc->capacity)
+        return 1;
+    result_t *rp = malloc(cost);
+    if (!rp)
+        return 1;
+    rp->key = (char *)(rp->docs + ndocs);
+    memcpy(rp->key, key, keylen + 1);
+    rp->cost = cost;
+    rp->ndocs = ndocs;
+    if (ndocs)
+        memcpy(rp->docs, docs, ndocs * sizeof(document_t));
+
+    pthread_mutex_lock(&rc->lock);
+    /* another thread may have cached the same query meanwhile */
+    if (check_generation(rc, gen) != 0 || hsearch(rc->table, key_searchfn, key, keylen))
+    {
+        pthread_mutex_unlock(&rc->lock);
+        free(rp);
+        return 1;
+    }
+    while (rc->tail && rc->stats.used + cost > rc->capacity)
+    {
+        result_t *old = rc->tail;
+        unlink_result(rc, old);
+        hremove(rc->table, key_searchfn, old->key, strlen(old->key));
+        rc->stats.used -= old->cost;
+        rc->stats.entries--;
+        rc->stats.evictions++;
+        free(old);
+    }
+    if (hput(rc->table, rp, rp->key, keylen) != 0)
+    {
+        pthread_mutex_unlock(&rc->lock);
+        free(rp);
+        return 1;
+    }
+    push_front(rc, rp);
+    rc->stats.used += cost;
+    rc->stats.entries++;
+    pthread_mutex_unlock(&rc->lock);
+    return 0;
+}
+
+void rcache_getstats(rcache_t *rc, rcache_stats_t *sp)
+{
+    if (!rc || !sp)
+        return;
+    pthread_mutex_lock(&rc->lock);
+    *sp = rc->stats;
+    pthread_mutex_unlock(&rc->lock);
+}
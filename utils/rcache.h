@@ -0,0 +1,58 @@
+#pragma once
+/*
+ * rcache.h -- cache of query results
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: maps the canonical form of a query to the ranked
+ * documents it selected, so a repeated query skips its evaluation. The
+ * least recently used results are evicted once the cache holds more
+ * than its memory cap.
+ *
+ * Every lookup and insertion names the generation of the index the
+ * results come from; when it differs from the cache's, the whole cache
+ * is invalidated first. The cache is locked, so the threads of a server
+ * can share it.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include "postings.h"
+#include "arena.h"
+
+typedef struct rcache rcache_t; /* representation of the cache hidden */
+
+/* counters of a cache */
+typedef struct rcache_stats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;     /* results dropped to stay under the cap */
+    uint64_t invalidations; /* times the index generation changed */
+    uint32_t entries;       /* results cached */
+    size_t used;            /* bytes used by the cached results */
+} rcache_stats_t;
+
+/* rcache_open -- creates an empty cache using at most capacity bytes
+ * returns: the cache, or NULL on failure
+ */
+rcache_t *rcache_open(size_t capacity);
+
+/* rcache_close -- frees a cache and the results in it */
+void rcache_close(rcache_t *rc);
+
+/* rcache_get -- looks up the results of query key on index generation
+ * gen, copying its documents into memory from arena ap
+ * returns: the number of documents with *docs set to them, or -1 if the
+ * query is not cached
+ */
+int rcache_get(rcache_t *rc, uint64_t gen, const char *key, arena_t *ap, document_t **docs);
+
+/* rcache_put -- caches the ndocs documents selected by query key on
+ * index generation gen, evicting older results as needed
+ * returns: 0 for success; nonzero if the results were not cached
+ */
+int32_t rcache_put(rcache_t *rc, uint64_t gen, const char *key, const document_t *docs, int ndocs);
+
+/* rcache_getstats -- copies the counters of the cache into sp */
+void rcache_getstats(rcache_t *rc, rcache_stats_t *sp);
@@ -0,0 +1,305 @@
+/*
+ * scan.c -- character class scanning over page html
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: scalar and SIMD implementations of the scans, and the
+ * runtime selection between them. Each SIMD scan builds a bit mask of
+ * the bytes that stop it, one block at a time, and finishes the last
+ * partial block with the scalar loop, so no load ever reaches past len.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <string.h>
+#include <pthread.h>
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SCAN_NEON
+#endif
+
+typedef struct scanner
+{
+	const char *name;
+	size_t (*to_word)(const char *s, size_t pos, size_t len);
+	size_t (*word_end)(const char *s, size_t pos, size_t len);
+	size_t (*tag_end)(const char *s, size_t pos, size_t len);
+} scanner_t;
+
+static inline bool is_alpha(unsigned char c)
+{
+	return (unsigned char)((c | 0x20) - 'a') < 26;
+}
+
+/**************** scalar ****************/
+
+static size_t scalar_to_word(const char *s, size_t pos, size_t len)
+{
+	while (pos < len && s[pos] != '\0' && s[pos] != '<' && !is_alpha(s[pos]))
+		pos++;
+	return pos;
+}
+
+static size_t scalar_word_end(const char *s, size_t pos, size_t len)
+{
+	while (pos < len && is_alpha(s[pos]))
+		pos++;
+	return pos;
+}
+
+static size_t scalar_tag_end(const char *s, size_t pos, size_t len)
+{
+	while (pos < len && s[pos] != '\0' && s[pos] != '>')
+		pos++;
+	return pos;
+}
+
+/**************** x86 ****************/
+#ifdef SCAN_X86
+
+/* ASCII letters: (c | 0x20) - 'a' < 26 unsigned, done as a signed
+ * compare after flipping the sign bit
+ */
+static inline __m128i sse2_alpha(__m128i v)
+{
+	__m128i t = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	return _mm_cmplt_epi8(_mm_xor_si128(t, _mm_set1_epi8((char)0x80)),
+						  _mm_set1_epi8((char)(0x80 + 26)));
+}
+
+static size_t sse2_to_word(const char *s, size_t pos, size_t len)
+{
+	for (; pos + 16 <= len; pos += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + pos));
+		__m128i stop = _mm_or_si128(sse2_alpha(v),
+									_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('<')),
+												 _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+		unsigned mask = _mm_movemask_epi8(stop);
+		if (mask)
+			return pos + __builtin_ctz(mask);
+	}
+	return scalar_to_word(s, pos, len);
+}
+
+static size_t sse2_word_end(const char *s, size_t pos, size_t len)
+{
+	for (; pos + 16 <= len; pos += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + pos));
+		unsigned mask = _mm_movemask_epi8(sse2_alpha(v)) ^ 0xFFFF;
+		if (mask)
+			return pos + __builtin_ctz(mask);
+	}
+	return scalar_word_end(s, pos, len);
+}
+
+static size_t sse2_tag_end(const char *s, size_t pos, size_t len)
+{
+	for (; pos + 16 <= len; pos += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + pos));
+		__m128i stop = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('>')),
+									_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+		unsigned mask = _mm_movemask_epi8(stop);
+		if (mask)
+			return pos + __builtin_ctz(mask);
+	}
+	return scalar_tag_end(s, pos, len);
+}
+
+__attribute__((target("avx2"))) static inline __m256i avx2_alpha(__m256i v)
+{
+	__m256i t = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+	return _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(0x80 + 26)),
+							 _mm256_xor_si256(t, _mm256_set1_epi8((char)0x80)));
+}
+
+__attribute__((target("avx2"))) static size_t avx2_to_word(const char *s, size_t pos, size_t len)
+{
+	for (; pos + 32 <= len; pos += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + pos));
+		__m256i stop = _mm256_or_si256(avx2_alpha(v),
+									   _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('<')),
+													   _mm256_cmpeq_epi8(v, _mm256_setzero_si256())));
+		unsigned mask = _mm256_movemask_epi8(stop);
+		if (mask)
+			return pos + __builtin_ctz(mask);
+	}
+	return sse2_to_word(s, pos, len);
+}
+
+__attribute__((target("avx2"))) static size_t avx2_word_end(const char *s, size_t pos, size_t len)
+{
+	for (; pos + 32 <= len; pos += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + pos));
+		unsigned mask = ~(unsigned)_mm256_movemask_epi8(avx2_alpha(v));
+		if (mask)
+			return pos + __builtin_ctz(mask);
+	}
+	return sse2_word_end(s, pos, len);
+}
+
+__attribute__((target("avx2"))) static size_t avx2_tag_end(const char *s, size_t pos, size_t len)
+{
+	for (; pos + 32 <= len; pos += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + pos));
+		__m256i stop = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('>')),
+									   _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+		unsigned mask = _mm256_movemask_epi8(stop);
+		if (mask)
+			return pos + __builtin_ctz(mask);
+	}
+	return sse2_tag_end(s, pos, len);
+}
+
+#endif /* SCAN_X86 */
+
+/**************** ARM ****************/
+#ifdef SCAN_NEON
+
+static inline uint8x16_t neon_alpha(uint8x16_t v)
+{
+	uint8x16_t t = vsubq_u8(vorrq_u8(v, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+	return vcltq_u8(t, vdupq_n_u8(26));
+}
+
+/* first set byte of a comparison result, or 16 if there is none;
+ * narrowing by 4 bits leaves one nibble per byte
+ */
+static inline unsigned neon_first(uint8x16_t m)
+{
+	uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+	return bits ? __builtin_ctzll(bits) >> 2 : 16;
+}
+
+static size_t neon_to_word(const char *s, size_t pos, size_t len)
+{
+	for (; pos + 16 <= len; pos += 16)
+	{
+		uint8x16_t v = vld1q_u8((const uint8_t *)(s + pos));
+		uint8x16_t stop = vorrq_u8(neon_alpha(v),
+								   vorrq_u8(vceqq_u8(v, vdupq_n_u8('<')), vceqq_u8(v, vdupq_n_u8(0))));
+		unsigned i = neon_first(stop);
+		if (i < 16)
+			return pos + i;
+	}
+	return scalar_to_word(s, pos, len);
+}
+
+static size_t neon_word_end(const char *s, size_t pos, size_t len)
+{
+	for (; pos + 16 <= len; pos += 16)
+	{
+		uint8x16_t v = vld1q_u8((const uint8_t *)(s + pos));
+		unsigned i = neon_first(vmvnq_u8(neon_alpha(v)));
+		if (i < 16)
+			return pos + i;
+	}
+	return scalar_word_end(s, pos, len);
+}
+
+static size_t neon_tag_end(const char *s, size_t pos, size_t len)
+{
+	for (; pos + 16 <= len; pos += 16)
+	{
+		uint8x16_t v = vld1q_u8((const uint8_t *)(s + pos));
+		uint8x16_t stop = vorrq_u8(vceqq_u8(v, vdupq_n_u8('>')), vceqq_u8(v, vdupq_n_u8(0)));
+		unsigned i = neon_first(stop);
+		if (i < 16)
+			return pos + i;
+	}
+	return scalar_tag_end(s, pos, len);
+}
+
+#endif /* SCAN_NEON */
+
+/**************** selection ****************/
+
+static const scanner_t scanners[] = {
+#ifdef SCAN_X86
+	{"avx2", avx2_to_word, avx2_word_end, avx2_tag_end},
+	{"sse2", sse2_to_word, sse2_word_end, sse2_tag_end},
+#endif
+#ifdef SCAN_NEON
+	{"neon", neon_to_word, neon_word_end, neon_tag_end},
+#endif
+	{"scalar", scalar_to_word, scalar_word_end, scalar_tag_end},
+};
+
+static const scanner_t *current = NULL;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+static bool supported(const scanner_t *sp)
+{
+#ifdef SCAN_X86
+	if (strcmp(sp->name, "avx2") == 0)
+		return __builtin_cpu_supports("avx2");
+	if (strcmp(sp->name, "sse2") == 0)
+		return __builtin_cpu_supports("sse2");
+#endif
+	(void)sp;
+	return true;
+}
+
+/* scanners are listed fastest first */
+static void select_scanner(void)
+{
+	size_t i;
+
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+#endif
+	for (i = 0; !supported(&scanners[i]); i++)
+		;
+	current = &scanners[i];
+}
+
+static inline const scanner_t *scanner(void)
+{
+	pthread_once(&once, select_scanner);
+	return current;
+}
+
+size_t scan_to_word(const char *s, size_t pos, size_t len)
+{
+	return scanner()->to_word(s, pos, len);
+}
+
+size_t scan_word_end(const char *s, size_t pos, size_t len)
+{
+	return scanner()->word_end(s, pos, len);
+}
+
+size_t scan_tag_end(const char *s, size_t pos, size_t len)
+{
+	return scanner()->tag_end(s, pos, len);
+}
+
+const char *scan_impl(void)
+{
+	return scanner()->name;
+}
+
+bool scan_use(const char *impl)
+{
+	size_t i;
+
+	scanner();
+	for (i = 0; i < sizeof(scanners) / sizeof(scanners[0]); i++)
+	{
+		if (impl != NULL && strcmp(scanners[i].name, impl) == 0 && supported(&scanners[i]))
+		{
+			current = &scanners[i];
+			return true;
+		}
+	}
+	return false;
+}
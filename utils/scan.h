@@ -0,0 +1,42 @@
+#pragma once
+/*
+ * scan.h -- character class scanning over page html
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: the tokenizer spends its time looking for the next
+ * word, the end of a word and the end of a tag. These scans classify
+ * many bytes at a time with SIMD instructions (AVX2 or SSE2 on x86-64,
+ * NEON on ARM) and fall back to a byte loop elsewhere. The fastest
+ * implementation the CPU supports is picked the first time a scan runs.
+ *
+ * Alphabetic means an ASCII letter, as isalpha(3) in the C locale.
+ * Every scan returns the index of the first byte in s[pos..len) that
+ * stops it, or len if there is none; a NUL byte always stops a scan.
+ * The caller guarantees that s[0..len) is readable.
+ */
+#include <stddef.h>
+#include <stdbool.h>
+
+/* scan_to_word -- finds the first alphabetic character, '<' or NUL */
+size_t scan_to_word(const char *s, size_t pos, size_t len);
+
+/* scan_word_end -- finds the first character that is not alphabetic */
+size_t scan_word_end(const char *s, size_t pos, size_t len);
+
+/* scan_tag_end -- finds the first '>' or NUL */
+size_t scan_tag_end(const char *s, size_t pos, size_t len);
+
+/* scan_impl -- returns the name of the implementation in use:
+ * "avx2", "sse2", "neon" or "scalar"
+ */
+const char *scan_impl(void);
+
+/* scan_use -- switches to the named implementation
+ *
+ * returns: true for success; false if it is unknown or not supported
+ * by this CPU, in which case the current one stays in use
+ * Meant for tests and benchmarks; call it before any thread scans.
+ */
+bool scan_use(const char *impl);
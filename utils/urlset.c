@@ -0,0 +1,279 @@
+/* urlset.c --- concurrent set of urls
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: implementation of the striped url set. Each stripe is a
+ * linear probing table of fingerprints, the 64-bit hashes of the urls,
+ * with 0 marking an empty slot. The high half of a fingerprint picks
+ * the stripe and the low bits the slot.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <urlset.h>
+
+#define MIN_SLOTS 16
+#define URLSET_MAGIC "TSEURLS1"
+#define URLSET_MAGIC_LEN 8
+#define READ_BATCH 4096 /* fingerprints read at a time */
+
+typedef struct stripe
+{
+    pthread_mutex_t mutex;
+    uint64_t *slots; /* fingerprints; 0 if the slot is empty */
+    uint32_t cap;    /* a power of two */
+    uint32_t count;
+} stripe_t;
+
+/* header of a saved set; the fingerprints follow */
+typedef struct urlset_header
+{
+    char magic[URLSET_MAGIC_LEN];
+    uint64_t count;
+} urlset_header_t;
+
+struct urlset
+{
+    stripe_t stripes[URLSET_STRIPES];
+};
+
+/* 64-bit FNV-1a, finished with a mixer so the low bits are well spread */
+static uint64_t hash_url(const char *url)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (; *url; url++)
+    {
+        h ^= (unsigned char)*url;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/* the fingerprint of url, never 0 */
+static uint64_t fingerprint(const char *url)
+{
+    uint64_t h = hash_url(url);
+    return h ? h : 1;
+}
+
+static inline stripe_t *stripe_of(urlset_t *usp, uint64_t fp)
+{
+    return &usp->stripes[(fp >> 32) % URLSET_STRIPES];
+}
+
+/* returns the slot holding fp, or the empty slot where it belongs */
+static uint64_t *find(stripe_t *sp, uint64_t fp)
+{
+    uint32_t i = fp & (sp->cap - 1);
+    while (sp->slots[i] != 0 && sp->slots[i] != fp)
+        i = (i + 1) & (sp->cap - 1);
+    return &sp->slots[i];
+}
+
+/* doubles a stripe; returns 0 for success; nonzero otherwise */
+static int32_t grow(stripe_t *sp)
+{
+    uint64_t *old = sp->slots;
+    uint32_t oldcap = sp->cap;
+    uint64_t *slots = calloc((size_t)oldcap * 2, sizeof(uint64_t));
+
+    if (slots == NULL)
+        return 1;
+    sp->slots = slots;
+    sp->cap = oldcap * 2;
+    for (uint32_t i = 0; i < oldcap; i++)
+    {
+        if (old[i] != 0)
+            *find(sp, old[i]) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+urlset_t *urlset_open(uint32_t hsize)
+{
+    urlset_t *usp = malloc(sizeof(urlset_t));
+    uint32_t cap = MIN_SLOTS;
+
+    if (usp == NULL)
+        return NULL;
+    /* room for hsize urls at half load, spread over the stripes */
+    while (cap < hsize / URLSET_STRIPES * 2)
+        cap *= 2;
+    for (int i = 0; i < URLSET_STRIPES; i++)
+    {
+        stripe_t *sp = &usp->stripes[i];
+        pthread_mutex_init(&sp->mutex, NULL);
+        sp->cap = cap;
+        sp->count = 0;
+        if ((sp->slots = calloc(cap, sizeof(uint64_t))) == NULL)
+        {
+            for (int j = 0; j <= i; j++)
+            {
+                free(usp->stripes[j].slots);
+                pthread_mutex_destroy(&usp->stripes[j].mutex);
+            }
+            free(usp);
+            return NULL;
+        }
+    }
+    return usp;
+}
+
+void urlset_close(urlset_t *usp)
+{
+    if (usp == NULL)
+        return;
+    for (int i = 0; i < URLSET_STRIPES; i++)
+    {
+        stripe_t *sp = &usp->stripes[i];
+        free(sp->slots);
+        pthread_mutex_destroy(&sp->mutex);
+    }
+    free(usp);
+}
+
+/* adds fingerprint fp; true if it was not in the set */
+static bool insert(urlset_t *usp, uint64_t fp)
+{
+    stripe_t *sp = stripe_of(usp, fp);
+    uint64_t *slot;
+    bool won = false;
+
+    pthread_mutex_lock(&sp->mutex);
+    /* keep the load at most 1/2 so probes stay short */
+    if ((sp->count + 1) * 2 <= sp->cap || grow(sp) == 0)
+    {
+        slot = find(sp, fp);
+        if (*slot == 0)
+        {
+            *slot = fp;
+            sp->count++;
+            won = true;
+        }
+    }
+    pthread_mutex_unlock(&sp->mutex);
+    return won;
+}
+
+bool urlset_insert(urlset_t *usp, const char *url)
+{
+    if (usp == NULL || url == NULL)
+        return false;
+    return insert(usp, fingerprint(url));
+}
+
+bool urlset_contains(urlset_t *usp, const char *url)
+{
+    uint64_t fp;
+    stripe_t *sp;
+    bool found;
+
+    if (usp == NULL || url == NULL)
+        return false;
+    fp = fingerprint(url);
+    sp = stripe_of(usp, fp);
+    pthread_mutex_lock(&sp->mutex);
+    found = *find(sp, fp) != 0;
+    pthread_mutex_unlock(&sp->mutex);
+    return found;
+}
+
+uint32_t urlset_count(urlset_t *usp)
+{
+    uint32_t count = 0;
+
+    if (usp == NULL)
+        return 0;
+    for (int i = 0; i < URLSET_STRIPES; i++)
+    {
+        pthread_mutex_lock(&usp->stripes[i].mutex);
+        count += usp->stripes[i].count;
+        pthread_mutex_unlock(&usp->stripes[i].mutex);
+    }
+    return count;
+}
+
+static int compare_fps(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+int32_t urlset_write(urlset_t *usp, FILE *file)
+{
+    uint64_t *fps = NULL;
+    size_t n = 0, capacity = 0;
+
+    if (usp == NULL || file == NULL)
+        return 1;
+    /* one stripe at a time, so inserts into the others go on */
+    for (int i = 0; i < URLSET_STRIPES; i++)
+    {
+        stripe_t *sp = &usp->stripes[i];
+        pthread_mutex_lock(&sp->mutex);
+        if (n + sp->count > capacity)
+        {
+            size_t grown = capacity ? capacity : MIN_SLOTS;
+            while (grown < n + sp->count)
+                grown *= 2;
+            uint64_t *p = realloc(fps, grown * sizeof(uint64_t));
+            if (p == NULL)
+            {
+                pthread_mutex_unlock(&sp->mutex);
+                free(fps);
+                return 1;
+            }
+            fps = p;
+            capacity = grown;
+        }
+        for (uint32_t j = 0; j < sp->cap; j++)
+        {
+            if (sp->slots[j] != 0)
+                fps[n++] = sp->slots[j];
+        }
+        pthread_mutex_unlock(&sp->mutex);
+    }
+    qsort(fps, n, sizeof(uint64_t), compare_fps);
+
+    urlset_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, URLSET_MAGIC, URLSET_MAGIC_LEN);
+    header.count = n;
+    int32_t status = fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(fps, sizeof(uint64_t), n, file) != n;
+    free(fps);
+    return status;
+}
+
+urlset_t *urlset_read(FILE *file)
+{
+    urlset_header_t header;
+    uint64_t batch[READ_BATCH], prev = 0;
+
+    if (file == NULL || fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, URLSET_MAGIC, URLSET_MAGIC_LEN) != 0 || header.count > UINT32_MAX)
+        return NULL;
+    urlset_t *usp = urlset_open(header.count);
+    for (uint64_t left = header.count; usp && left > 0;)
+    {
+        size_t n = left < READ_BATCH ? left : READ_BATCH;
+        bool valid = fread(batch, sizeof(uint64_t), n, file) == n;
+        /* increasing, so each is new */
+        for (size_t i = 0; valid && i < n; i++)
+        {
+            valid = batch[i] > prev && insert(usp, batch[i]);
+            prev = batch[i];
+        }
+        if (!valid)
+        {
+            urlset_close(usp);
+            return NULL;
+        }
+        left -= n;
+    }
+    return usp;
+}
@@ -0,0 +1,59 @@
+#pragma once
+/* urlset.h --- concurrent set of urls
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: a set of strings, such as the urls a crawler has seen,
+ * shared by many threads. The set is split into URLSET_STRIPES
+ * stripes by hash, each an open addressing table with its own lock,
+ * so threads adding different urls rarely wait for each other.
+ *
+ * Strings are not kept: a url is known by its 64-bit fingerprint, so
+ * a set takes 16 bytes or less per url whatever their length. Two urls
+ * share a fingerprint with a chance of about n / 2^64 per insert into
+ * a set of n, in which case the second is taken as seen.
+ *
+ * A set is saved as its fingerprints in increasing order, after a
+ * header holding their number.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define URLSET_STRIPES 64 /* independently locked parts of a set */
+
+typedef struct urlset urlset_t; /* representation of a url set hidden */
+
+/* urlset_open -- opens a set sized for about hsize urls; it grows as
+ * needed; returns NULL on failure
+ */
+urlset_t *urlset_open(uint32_t hsize);
+
+/* urlset_close -- closes a set */
+void urlset_close(urlset_t *usp);
+
+/* urlset_insert -- adds url to the set unless it is already there, as
+ * a single atomic step; exactly one of several threads inserting the
+ * same url wins
+ * returns: true if url was added by this call; false if it was already
+ * in the set or memory ran out
+ */
+bool urlset_insert(urlset_t *usp, const char *url);
+
+/* urlset_contains -- returns true if url is in the set */
+bool urlset_contains(urlset_t *usp, const char *url);
+
+/* urlset_count -- returns the number of urls in the set */
+uint32_t urlset_count(urlset_t *usp);
+
+/* urlset_write -- writes the fingerprints of the set to file; threads
+ * may insert at the same time, and their urls may or may not be saved
+ * returns: 0 for success; nonzero otherwise
+ */
+int32_t urlset_write(urlset_t *usp, FILE *file);
+
+/* urlset_read -- reads a set written by urlset_write from file
+ * returns: the set, or NULL if file holds no valid set or memory ran out
+ */
+urlset_t *urlset_read(FILE *file);
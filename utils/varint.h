@@ -0,0 +1,57 @@
+#pragma once
+/*
+ * varint.h -- variable length unsigned integers
+ *
+ * Author: Nathaniel Mensah
+ * Version: 1.0
+ *
+ * Description: a uint32_t is stored in 1 to 5 bytes of 7 bits each,
+ * least significant first, every byte but the last with its high bit
+ * set. The posting lists, the term dictionary and the word positions
+ * all encode their numbers this way.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+/* varint_size -- the number of bytes taking v */
+static inline size_t varint_size(uint32_t v)
+{
+	size_t n = 1;
+	while (v >= 0x80)
+	{
+		v >>= 7;
+		n++;
+	}
+	return n;
+}
+
+/* varint_put -- writes v at p; returns the position after it */
+static inline uint8_t *varint_put(uint8_t *p, uint32_t v)
+{
+	while (v >= 0x80)
+	{
+		*p++ = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = (uint8_t)v;
+	return p;
+}
+
+/* varint_get -- reads a varint from p into v; returns the position after
+ * it, or NULL if it runs past end or is longer than 5 bytes
+ */
+static inline const uint8_t *varint_get(const uint8_t *p, const uint8_t *end, uint32_t *v)
+{
+	uint32_t x = 0;
+	for (int shift = 0; p < end && shift < 35; shift += 7)
+	{
+		uint8_t b = *p++;
+		x |= (uint32_t)(b & 0x7f) << shift;
+		if (!(b & 0x80))
+		{
+			*v = x;
+			return p;
+		}
+	}
+	return NULL;
+}
@@ -19,6 +19,8 @@
 #include <unistd.h>
 #include <curl/curl.h>
 #include <webpage.h>
+#include <scan.h>
+#include <metrics.h>
 
 /* Private Section */
 
@@ -78,6 +80,16 @@ webpage_t *webpage_new(char *url, const int depth, char *html) {
 }
 
 
+void webpage_setHTML(webpage_t *page, char *html) {
+  if (page == NULL) {
+    return;
+  }
+  if (page->html) free(page->html);
+  page->html = html;
+  page->html_len = html ? strlen(html) : 0;
+}
+
+
 void webpage_delete(void *data)
 {
   webpage_t *page = data;
@@ -88,69 +100,167 @@ void webpage_delete(void *data)
   }
 }
 
-/**************** webpage_getNextWord ****************/
+/**************** tag_end ****************/
 /*
- * webpage_getNextWord - returns the next word from doc[pos] into word
- * See "webpage.h" for full documentation.
+ * tag_end - finds the '>' closing the tag that doc[pos], a '<', opens
+ *
+ * A '<' opens a tag only if the first character after it, past any
+ * whitespace, is a letter, '/', '!' or '?', and no other '<' comes
+ * before its '>'. Otherwise it is text, as in "x<y" or "a < 3", and must
+ * not hide the tags after it. Whatever a comment holds is scanned as
+ * html, so the links in "<!-- <a href=...> -->" are found as before.
+ * Returns the position of the '>', of a NUL or len, for a tag left
+ * open at the end of the html; or pos if the '<' is text.
+ */
+static size_t tag_end(const char *doc, size_t pos, size_t len) {
+  size_t i, end;
+
+  for (i = pos + 1; i < len && isspace((unsigned char)doc[i]); i++)
+    ;
+  if (i >= len || !(isalpha((unsigned char)doc[i]) || doc[i] == '/' || doc[i] == '!' || doc[i] == '?')) {
+    return pos;
+  }
+  end = scan_tag_end(doc, i, len);
+  if (memchr(&doc[i], '<', end - i) != NULL) {
+    return pos;
+  }
+  return end;
+}
+
+/**************** next_word ****************/
+/*
+ * next_word - finds the word at or after doc[pos], bounded by len
  * Code is courtesy of Ray Jenkins and/or Charles Palmer, 
  *   cleaned by David Kotz in April 2016, 2017.
  *
  * Pseudocode:
  *     1. skip any leading non-alphabetic characters
- *     2. if we find a tag, i.e., <...tag...>, skip that tag
+ *     2. if we find a tag, i.e., <...tag...>, skip that tag;
+ *        a '<' that opens no tag (see tag_end) is skipped alone
  *     3. save beginning of the word
  *     4. find the end, i.e., first non-alphabetic character
- *     5. create a new word buffer
- *     6. copy the word into the new buffer
- *     7. return first position past end of word
- * 
+ *     5. return beginning of word and, in *wend, first position past it
+ *
+ * The scans come from "scan.h", which looks at many bytes at a time.
+ * Returns -1 when there are no more words.
  */
-int webpage_getNextWord(webpage_t *page, int pos, char **word) {
+static int next_word(const char *doc, size_t pos, size_t len, size_t *wend) {
+  size_t end;                              // end of tag
+
+  for (;;) {
+    // consume any non-alphabetic characters up to a word or tag
+    pos = scan_to_word(doc, pos, len);
+    if (pos >= len || doc[pos] == '\0') { // ran out of html
+      return -1;
+    }
+    if (doc[pos] != '<') {
+      break;
+    }
+    // we found a tag, i.e., <...tag...>, skip it
+    end = tag_end(doc, pos, len);         // find the close
+    if (end == pos) {                     // a '<' in the text
+      pos++;
+      continue;
+    }
+    if (end >= len || doc[end] == '\0' || doc[end + 1] == '\0') { // ran out of html
+      return -1;
+    }
+    pos = end + 1;	      // skip over the <...tag...>
+  }
+
+  // pos is at the first character of a word; consume it.
+  // at this point, doc[*wend] is the first character *after* the word.
+  *wend = scan_word_end(doc, pos, len);
+  return pos;
+}
+
+/**************** webpage_getNextSpan ****************/
+/*
+ * webpage_getNextSpan - finds the next word at or after doc[pos]
+ * See "webpage.h" for full documentation.
+ */
+int webpage_getNextSpan(const webpage_t *page, int pos, const char **start, int *len) {
+  size_t wend;                             // end of word
+  int beg;                                 // beginning of word
+
   // make sure we have something to search, and a place for the result
-  if (page == NULL || page->html == NULL || word == NULL) {
+  if (page == NULL || page->html == NULL || start == NULL || len == NULL || pos < 0) {
     return -1;
   }
 
-  const char *doc = page->html;		   // the html document
-  const char *beg;                         // beginning of word
-  const char *end;                         // end of word
-
-  // consume any non-alphabetic characters
-  while (doc[pos] != '\0' && !isalpha(doc[pos])) {
-    // if we find a tag, i.e., <...tag...>, skip it
-    if (doc[pos] == '<') {
-      end = strchr(&doc[pos], '>');    // find the close
-			/* ST: end is a pointer -- cant compare to a char */
-      if(*end == '\0' || *(++end) == '\0') { // ran out of html
-				return -1;
-      }
-      pos = end - doc;	      // skip over the <...tag...>
-    } else {
-      pos++;		      // just move forward
-    }
+  if ((beg = next_word(page->html, pos, page->html_len, &wend)) < 0) {
+    return -1;
   }
+  *start = &(page->html[beg]);
+  *len = wend - beg;
+  return wend;
+}
 
-  // ran out of html
-  if (doc[pos] == '\0') {
-    *word = NULL;
+/**************** webpage_getNextTerm ****************/
+/*
+ * webpage_getNextTerm - returns the next word of at least minlen
+ * characters, lowercased, in a reusable buffer.
+ * See "webpage.h" for full documentation.
+ *
+ * Words that are too short are skipped before anything is copied.
+ */
+int webpage_getNextTerm(const webpage_t *page, int pos, int minlen,
+                        char **term, size_t *termsize, int *len) {
+  if (page == NULL || page->html == NULL || term == NULL || termsize == NULL || len == NULL || pos < 0) {
     return -1;
   }
 
-  // pos is at the first character of a word
-  beg = &(doc[pos]);
+  const char *doc = page->html;
+  size_t wend, n, i;
+  int beg;
+
+  do {
+    if ((beg = next_word(doc, pos, page->html_len, &wend)) < 0) {
+      return -1;
+    }
+    pos = wend;
+    n = wend - beg;
+  } while (n < (size_t)minlen);
+
+  // make room for the word and its '\0'
+  if (n >= *termsize) {
+    size_t size = *termsize ? *termsize : 64;
+    while (size <= n) {
+      size *= 2;
+    }
+    char *buf = realloc(*term, size);
+    if (buf == NULL) {
+      return -1;
+    }
+    *term = buf;
+    *termsize = size;
+  }
 
-  // consume word
-  while (doc[pos] != '\0' && isalpha(doc[pos])) {
-    pos++;
+  // copy the word, lowercased; it is all ASCII letters
+  for (i = 0; i < n; i++) {
+    (*term)[i] = doc[beg + i] | 0x20;
   }
-  // at this point, doc[pos] is the first character *after* the word.
+  (*term)[n] = '\0';
+  *len = n;
+  return pos;
+}
 
-  // pos refers to the last character of the word
-  end = &(doc[pos-1]);
+/**************** webpage_getNextWord ****************/
+/*
+ * webpage_getNextWord - returns the next word from doc[pos] into word
+ * See "webpage.h" for full documentation.
+ */
+int webpage_getNextWord(webpage_t *page, int pos, char **word) {
+  const char *beg;                         // beginning of word
+  int wordlen;                             // length of word
 
-  // 'beg' points to first character of the word
-  // 'end' points to last character of the word
-  int wordlen = end - beg + 1;
+  if (word == NULL) {
+    return -1;
+  }
+  *word = NULL;
+  if ((pos = webpage_getNextSpan(page, pos, &beg, &wordlen)) < 0) {
+    return -1;
+  }
 
   // allocate space for length of new word + '\0'
   *word = calloc(wordlen + 1, sizeof(char));
@@ -291,6 +401,159 @@ int webpage_getNextURL(webpage_t *page, int pos, char **result) {
   return end - html;
 }
 
+/**************** tag_link ****************/
+/*
+ * tag_link - finds the url of a link tag, doc[pos] to doc[pos + taglen - 1]
+ *
+ * The tag is condensed into *buf, which is grown as needed, and parsed
+ * exactly as webpage_getNextURL parses a tag in html without whitespace.
+ * Returns 1 with a malloc'd url in *url, 0 if the tag has no link, or
+ * -1 if out of memory.
+ */
+static int tag_link(const webpage_t *page, const char *tag, size_t taglen,
+                    char **buf, size_t *bufsize, char **url) {
+  size_t i, n = 0;
+  char *href, *end, *hash, *ptr;
+
+  // a link tag starts with "<a" or "<A"; nothing else needs condensing
+  for (i = 1; i < taglen && isspace((unsigned char)tag[i]); i++)
+    ;
+  if (i >= taglen || (tag[i] != 'a' && tag[i] != 'A')) {
+    return 0;
+  }
+  if (taglen >= *bufsize) {
+    size_t size = *bufsize ? *bufsize : 256;
+    while (size <= taglen) {
+      size *= 2;
+    }
+    char *grown = realloc(*buf, size);
+    if (grown == NULL) {
+      return -1;
+    }
+    *buf = grown;
+    *bufsize = size;
+  }
+  for (i = 0; i < taglen; i++) {
+    if (!isspace((unsigned char)tag[i])) {
+      (*buf)[n++] = tag[i];
+    }
+  }
+  (*buf)[n] = '\0';
+
+  if ((href = strcasestr(*buf, "href=")) == NULL) {
+    return 0;
+  }
+  href += 5;
+  if (*href == '\'' || *href == '"') {    // href="url" or href='url'
+    char delim = *(href++);
+    end = strchr(href, delim);
+  } else {                                // href=url>
+    end = strchr(href, '>');
+  }
+  // exclude any #fragment
+  hash = strchr(href, '#');
+  if (hash && (!end || hash < end)) {
+    end = hash;
+  }
+  if (end == NULL || *href == '#') {     // no end, or internal reference
+    return 0;
+  }
+
+  // the url is absolute if ':' precedes any '/', '?' or '#'
+  for (ptr = href; ptr < end && !strchr(":/?#", *ptr); ptr++)
+    ;
+  if (ptr < end && *ptr == ':') {
+    if (strncasecmp(href, "http", 4)) {  // absolute, but not http(s)
+      return 0;
+    }
+    *url = calloc(end - href + 1, sizeof(char));
+    if (*url == NULL) {
+      return -1;
+    }
+    strncpy(*url, href, end - href);
+  } else if ((*url = FixupRelativeURL(page->url, href, end - href)) == NULL) {
+    return -1;
+  }
+  return 1;
+}
+
+/**************** webpage_extract ****************/
+/*
+ * webpage_extract - scans the html once for words, links, the title
+ * and the description.
+ * See "webpage.h" for full documentation.
+ *
+ * Words and tags are found as by next_word; each tag is looked at once
+ * as it is skipped. A '<' that opens no tag is text, so links after a
+ * stray '<' are found, as are those inside comments.
+ */
+int webpage_extract(const webpage_t *page, webpage_parts_t *parts) {
+  if (page == NULL || page->html == NULL || parts == NULL) {
+    return -1;
+  }
+
+  const char *doc = page->html, *start, *close;
+  size_t len = page->html_len, pos = 0, end, taglen, bufsize = 0;
+  bool title_seen = false, description_seen = false;
+  char *buf = NULL, *url;
+  int status = 0;
+
+  parts->title = parts->description = NULL;
+  parts->title_len = parts->description_len = 0;
+  for (;;) {
+    pos = scan_to_word(doc, pos, len);
+    if (pos >= len || doc[pos] == '\0') {         // ran out of html
+      break;
+    }
+    if (doc[pos] != '<') {                        // a word
+      end = scan_word_end(doc, pos, len);
+      if (parts->word && (status = parts->word(parts->arg, &doc[pos], end - pos)) != 0) {
+        break;
+      }
+      pos = end;
+      continue;
+    }
+
+    // a tag, up to and including its '>'
+    if ((end = tag_end(doc, pos, len)) == pos) {  // a '<' in the text
+      pos++;
+      continue;
+    }
+    taglen = (end < len && doc[end] == '>' ? end + 1 : (end < len ? end : len)) - pos;
+    start = &doc[pos];
+    if (!title_seen && taglen == 7 && strncmp(start, "<title>", 7) == 0) {
+      title_seen = true;
+      if ((close = strstr(start + 7, "</title>"))) {
+        parts->title = start + 7;
+        parts->title_len = close - parts->title;
+      }
+    }
+    if (!description_seen && strncmp(start, "<meta name=\"description\"", 24) == 0) {
+      description_seen = true;
+      if ((start = strstr(start, "content=\""))) {
+        start += strlen("content=\"");
+        if ((close = strchr(start, '\"'))) {
+          parts->description = start;
+          parts->description_len = close - start;
+        }
+      }
+    }
+    if (parts->link) {
+      int found = tag_link(page, &doc[pos], taglen, &buf, &bufsize, &url);
+      if (found < 0 || (found > 0 && (status = parts->link(parts->arg, url)) != 0)) {
+        status = found < 0 ? -1 : status;
+        break;
+      }
+    }
+    if (end >= len || doc[end] == '\0' || doc[end + 1] == '\0') { // ran out of html
+      break;
+    }
+    pos = end + 1;                                // skip over the <...tag...>
+  }
+  free(buf);
+  return status;
+}
+
 /******************** NormalizeURL *******************************/
 /* Normalize the url according to RFC 3986 chapter 3
  *
@@ -959,9 +1222,14 @@ bool webpage_fetch(webpage_t *page) {
   // save error messages
   curl_easy_setopt(curl_handle, CURLOPT_ERRORBUFFER, &errbuf);
 
-  // get the page; repeat MAX_TRY times
+  // get the page; repeat MAX_TRY times, timing each attempt as the fetcher does
   do {
+    double start = metrics_now();
     res = curl_easy_perform(curl_handle);
+    metrics_record(metrics_histogram("fetch.latency"), metrics_now() - start);
+    if (res != CURLE_OK && tries + 1 < MAX_TRY) {
+      metrics_add(metrics_counter("fetch.retries"), 1);
+    }
 #ifndef NOSLEEP // CS50 students: please don't turn off the sleep!
     sleep(1);   // sleep one second between fetches, to lighten load on server
 #endif
@@ -976,11 +1244,15 @@ bool webpage_fetch(webpage_t *page) {
     strcpy(page->html, errbuf);
 
     status = false;                          // signal failure
+    metrics_add(metrics_counter("fetch.failures"), 1);
+  }
+  else {
+    metrics_add(metrics_counter("fetch.pages"), 1);
+    metrics_add(metrics_counter("fetch.bytes"), page->html_len);
   }
 
-  // cleanup curl stuff
+  // cleanup curl stuff; the global state is kept for later fetches
   curl_easy_cleanup(curl_handle);
-  curl_global_cleanup();
 
   return status;
 }
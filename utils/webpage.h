@@ -59,6 +59,9 @@ void webpage_delete(void *data);
  *     2. page->url contains the url to curl
  *     3. page->html is NULL at call time
  *
+ * Each attempt is timed in the fetch.latency histogram of metrics.h,
+ * and the page counted in fetch.pages and fetch.bytes, or fetch.failures.
+ *
  * Usage example:
  * webpage_t* page = webpage_new("http://www.example.com", 0, NULL);
  * if(webpage_fetch(page)) {
@@ -73,6 +76,15 @@ void webpage_delete(void *data);
  */
 bool webpage_fetch(webpage_t *page);
 
+/**************** webpage_setHTML ***************************************/
+/* replace the html of a page, e.g. with html fetched elsewhere
+ * @page: the webpage struct
+ * @html: a malloc'd, null-terminated string, or NULL
+ *
+ * The page takes ownership of html; any previous html is freed.
+ */
+void webpage_setHTML(webpage_t *page, char *html);
+
 
 /**************** webpage_getNextWord ***********************************/
 /* return the next word from html[pos] into word
@@ -80,7 +92,9 @@ bool webpage_fetch(webpage_t *page);
  * Assumptions:
  *     1. webpage has html
  *     2. don't care about opening/closing tags: ignore anything between <...>
- *     3. if the html is malformed, we don't care: match '<' with next '>'
+ *     3. if the html is malformed, we don't care: match '<' with next '>',
+ *        unless no tag name follows the '<' or another '<' comes first,
+ *        when the '<' is text
  *
  * Memory contract:
  *     1. inbound, webpage points to an existing struct, with existing html;
@@ -90,6 +104,40 @@ bool webpage_fetch(webpage_t *page);
 
 int webpage_getNextWord(webpage_t *page, int pos, char **word);
 
+/**************** webpage_getNextSpan ***********************************/
+/* find the next word at or after html[pos] without copying it
+ *
+ * Words and tags are found exactly as by webpage_getNextWord.
+ * On success, *start points at the first character of the word inside
+ * the page's html, *len is its length, and the position just past the
+ * word is returned; returns < 0 when there are no more words.
+ * Nothing is allocated; *start is valid while the page's html is.
+ */
+int webpage_getNextSpan(const webpage_t *page, int pos, const char **start, int *len);
+
+/**************** webpage_getNextTerm ***********************************/
+/* return the next word at or after html[pos] that is at least minlen
+ * characters long, lowercased, into a reusable buffer
+ *
+ * *term and *termsize describe a buffer owned by the caller, in the
+ * manner of getline(3): both may start as NULL and 0, and the buffer is
+ * grown with realloc only when a word does not fit. On success *term is
+ * NUL-terminated, *len is its length, and the position just past the
+ * word is returned; returns < 0 when there are no more words.
+ * The caller must eventually free(*term).
+ *
+ * Usage example:
+ * char *term = NULL;
+ * size_t termsize = 0;
+ * int pos = 0, len;
+ * while ((pos = webpage_getNextTerm(page, pos, 3, &term, &termsize, &len)) > 0) {
+ *     printf("Found term: %s\n", term);
+ * }
+ * free(term);
+ */
+int webpage_getNextTerm(const webpage_t *page, int pos, int minlen,
+                        char **term, size_t *termsize, int *len);
+
 /****************** webpage_getNextURL ***********************************/
 /* return the next url from html[pos] into result
  * @page: pointer to the webpage info
@@ -119,6 +167,47 @@ int webpage_getNextWord(webpage_t *page, int pos, char **word);
 
 int webpage_getNextURL(webpage_t *page, int pos, char **result);
 
+/****************** webpage_extract **************************************/
+/* scan the html of a page once for its words, links, title and description
+ * @page: the page, with html and url
+ * @parts: the callbacks to call, and where the title and description go
+ *
+ * Words are found exactly as by webpage_getNextSpan and handed to
+ * parts->word, if set, as a span of the html. Every tag is looked at as
+ * it is skipped: the urls of links are found as by webpage_getNextURL
+ * and handed to parts->link, if set, which takes ownership of the
+ * malloc'd url; links inside comments are found too. The first <title>
+ * tag and the first <meta name="description" ...> tag set parts->title
+ * and parts->description, which point into the html and are not
+ * NUL-terminated; both are NULL if the page has none.
+ *
+ * Unlike webpage_getNextURL, the html is not changed. A callback returns
+ * 0 to go on; anything else stops the scan and is returned.
+ * Returns 0 once the whole page is scanned; -1 on bad arguments or if
+ * out of memory.
+ *
+ * Usage example: (retrieve all urls in a page)
+ * static int print_link(void *arg, char *url) {
+ *     printf("Found url: %s\n", url);
+ *     free(url);
+ *     return 0;
+ * }
+ * ...
+ * webpage_parts_t parts = { .link = print_link };
+ * webpage_extract(page, &parts);
+ */
+typedef struct webpage_parts {
+  int (*word)(void *arg, const char *word, int len);
+  int (*link)(void *arg, char *url);
+  void *arg;                               // passed to the callbacks
+  const char *title;                       // set by webpage_extract
+  int title_len;
+  const char *description;
+  int description_len;
+} webpage_parts_t;
+
+int webpage_extract(const webpage_t *page, webpage_parts_t *parts);
+
 /***********************************************************************
  * NormalizeURL - attempts to normalize the url
  * @url: absolute url to normalize